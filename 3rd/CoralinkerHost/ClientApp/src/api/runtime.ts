@@ -194,6 +194,8 @@ export interface VmStatsSample {
   memCapacity: number
   memPeakUsed: number
   memLoadPercent: number
+  gcMicros: number
+  gcFreeCycles: number
 }
 
 /**
@@ -101,6 +101,8 @@ export interface PortStats {
   rxFrames: number
   txBytes: number
   rxBytes: number
+  /** DIVER IO 缓冲已满而丢弃的接收帧数 */
+  rxDropped?: number
 }
 
 /**
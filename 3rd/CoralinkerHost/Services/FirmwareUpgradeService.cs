@@ -56,6 +56,21 @@ public sealed class FirmwareUpgradeService
         FirmwareMetadata? McuInfo = null,
         FirmwareMetadata? UpgInfo = null);
 
+    /// <summary>
+    /// One node of a batch upgrade
+    /// </summary>
+    public record UpgradeTarget(string McuUri, string NodeId);
+
+    /// <summary>
+    /// Batch upgrade result of one node
+    /// </summary>
+    public record NodeUpgradeResult(string NodeId, UpgradeResult Result);
+
+    /// <summary>
+    /// Max nodes flashed at the same time by UpgradeManyAsync
+    /// </summary>
+    public const int MaxParallelUpgrades = 8;
+
     public FirmwareUpgradeService(
         TerminalBroadcaster broadcaster,
         ILogger<FirmwareUpgradeService> logger)
@@ -187,7 +202,8 @@ public sealed class FirmwareUpgradeService
             return new UpgradeResult(false, errMsg);
         }
 
-        _logger.LogInformation("Bootloader connected successfully, baudrate: {Baud}", mbl.Baudrate);
+        mbl.GetCapabilities(out var caps);
+        _logger.LogInformation("Bootloader connected successfully, baudrate: {Baud}, {Caps}", mbl.Baudrate, caps);
 
         // Read MCU firmware info
         await BroadcastProgressAsync(nodeId, 20, UpgradeStage.ReadingMcuInfo, "Reading MCU info...", ct);
@@ -237,8 +253,9 @@ public sealed class FirmwareUpgradeService
             return new UpgradeResult(false, errMsg);
         }
 
-        // Write firmware
+        // Write firmware (fast path with whole-image CRC verify when the bootloader supports it)
         await BroadcastProgressAsync(nodeId, 30, UpgradeStage.Writing, "Starting firmware write...", ct);
+        var writeStarted = DateTime.UtcNow;
         mblErr = mbl.WriteFirmware(upg, 1000);
         if (mblErr != MCUBootloaderError.OK)
         {
@@ -246,6 +263,8 @@ public sealed class FirmwareUpgradeService
             await BroadcastProgressAsync(nodeId, 0, UpgradeStage.Error, errMsg, ct);
             return new UpgradeResult(false, errMsg);
         }
+        _logger.LogInformation("Firmware written on {Port}: {Size} bytes in {Elapsed:F1}s",
+            portName, upg.FirmwareSize, (DateTime.UtcNow - writeStarted).TotalSeconds);
 
         // Exit Bootloader
         await BroadcastProgressAsync(nodeId, 95, UpgradeStage.Verifying, "Restarting MCU...", ct);
@@ -261,6 +280,48 @@ public sealed class FirmwareUpgradeService
         return new UpgradeResult(true, McuInfo: mcuMetadata, UpgInfo: upgMetadata);
     }
 
+    /// <summary>
+    /// Upgrade several nodes with the same UPG file. Nodes on different serial
+    /// ports are flashed in parallel (each on its own thread, the MBL calls are
+    /// blocking); nodes that resolve to the same port run one after another.
+    /// </summary>
+    public async Task<IReadOnlyList<NodeUpgradeResult>> UpgradeManyAsync(
+        IReadOnlyList<UpgradeTarget> targets,
+        byte[] upgData,
+        CancellationToken ct = default)
+    {
+        var results = new NodeUpgradeResult[targets.Count];
+        using var slots = new SemaphoreSlim(MaxParallelUpgrades);
+
+        // Unresolvable URIs get their own group; UpgradeAsync reports the error
+        var groups = targets
+            .Select((target, index) => (target, index))
+            .GroupBy(t => ParseMcuUri(t.target.McuUri).portName ?? $"?{t.index}",
+                StringComparer.OrdinalIgnoreCase);
+
+        var started = DateTime.UtcNow;
+        await Task.WhenAll(groups.Select(group => Task.Run(async () =>
+        {
+            foreach (var (target, index) in group)
+            {
+                await slots.WaitAsync(ct);
+                try
+                {
+                    var result = await UpgradeAsync(target.McuUri, upgData, target.NodeId, ct);
+                    results[index] = new NodeUpgradeResult(target.NodeId, result);
+                }
+                finally
+                {
+                    slots.Release();
+                }
+            }
+        }, ct)));
+
+        _logger.LogInformation("Batch upgrade of {Count} nodes finished in {Elapsed:F1}s, {Ok} succeeded",
+            targets.Count, (DateTime.UtcNow - started).TotalSeconds, results.Count(r => r.Result.Success));
+        return results;
+    }
+
     /// <summary>
     /// Parse MCU URI to get serial port name and baudrate
     /// </summary>
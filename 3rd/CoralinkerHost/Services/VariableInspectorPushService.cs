@@ -145,7 +145,8 @@ public sealed class VariableInspectorPushService : BackgroundService
                         txFrames = p.TxFrames,
                         rxFrames = p.RxFrames,
                         txBytes = p.TxBytes,
-                        rxBytes = p.RxBytes
+                        rxBytes = p.RxBytes,
+                        rxDropped = p.RxDropped
                     }).ToArray()
                 }
             };
@@ -1143,7 +1143,9 @@ public static class ApiRoutes
                 loadPercent = s.LoadPercent,
                 memCapacity = s.MemCapacity,
                 memPeakUsed = s.MemPeakUsed,
-                memLoadPercent = s.MemLoadPercent
+                memLoadPercent = s.MemLoadPercent,
+                gcMicros = s.GcMicros,
+                gcFreeCycles = s.GcFreeCycles
             };
 
             return JsonHelper.Json(new
@@ -1228,6 +1230,46 @@ public static class ApiRoutes
             return JsonHelper.Json(new { ok = true, mcuInfo = result.McuInfo, upgInfo = result.UpgInfo });
         });
 
+        // 多节点并行升级：mcuUri / nodeId 成对重复出现，不同串口上的节点同时烧录
+        app.MapPost("/api/upgrade/start-batch", async (FirmwareUpgradeService upgradeService, HttpRequest req, CancellationToken ct) =>
+        {
+            if (!req.HasFormContentType)
+                return Results.BadRequest(new { ok = false, error = "Expected multipart/form-data" });
+
+            var form = await req.ReadFormAsync(ct);
+            var file = form.Files.FirstOrDefault();
+            var mcuUris = form["mcuUri"];
+            var nodeIds = form["nodeId"];
+
+            if (file == null)
+                return Results.BadRequest(new { ok = false, error = "No file uploaded" });
+            if (mcuUris.Count == 0 || mcuUris.Any(string.IsNullOrWhiteSpace))
+                return Results.BadRequest(new { ok = false, error = "Missing mcuUri" });
+
+            var targets = mcuUris
+                .Select((uri, i) => new FirmwareUpgradeService.UpgradeTarget(
+                    uri!, i < nodeIds.Count && !string.IsNullOrEmpty(nodeIds[i]) ? nodeIds[i]! : Guid.NewGuid().ToString()))
+                .ToList();
+
+            await using var stream = file.OpenReadStream();
+            using var ms = new MemoryStream();
+            await stream.CopyToAsync(ms, ct);
+
+            var results = await upgradeService.UpgradeManyAsync(targets, ms.ToArray(), ct);
+            return JsonHelper.Json(new
+            {
+                ok = results.All(r => r.Result.Success),
+                results = results.Select(r => new
+                {
+                    nodeId = r.NodeId,
+                    ok = r.Result.Success,
+                    error = r.Result.Error,
+                    mcuInfo = r.Result.McuInfo,
+                    upgInfo = r.Result.UpgInfo
+                })
+            });
+        });
+
         // ============================================
         // 设备发现 API
         // ============================================
@@ -93,6 +93,12 @@ namespace CartActivator
         /// <summary>读事件（底层接口）。返回 null 表示无数据。</summary>
         public static byte[] ReadEvent(int port, int event_id) => default;
 
+        /// <summary>
+        /// 读该事件自上一周期以来收到的全部帧（按到达顺序）。返回 null 表示无数据。
+        /// 每帧为 [到达时间 µs 4 字节][长度 2 字节][数据]。ReadEvent 只返回最新一帧。
+        /// </summary>
+        public static byte[] ReadEvents(int port, int event_id) => default;
+
         /// <summary>写事件（底层接口）。</summary>
         public static void WriteEvent(byte[] payload, int port, int event_id) { }
 
@@ -121,6 +127,21 @@ namespace CartActivator
         /// <summary>写数字输出。固定传入 4 字节（32 位），bit0~bit31 对应 DO0~DO31，实际路数由硬件决定。</summary>
         public static void WriteSnapshot(byte[] payload) { }
 
+        /// <summary>读数字输入 DI{bit}，不拷贝整个快照。</summary>
+        public static bool ReadDigital(int bit) => default;
+
+        /// <summary>读模拟量通道（整数）。快照没有布局描述时按 4 字节一个 Int32 通道。</summary>
+        public static int ReadAnalog(int channel) => default;
+
+        /// <summary>读模拟量通道（浮点）。</summary>
+        public static float ReadAnalogFloat(int channel) => default;
+
+        /// <summary>从第 offset 字节起改写数字输出，其余位保持上次的值。本周期结束时统一输出一次。</summary>
+        public static void WriteSnapshot(byte[] payload, int offset) { }
+
+        /// <summary>只改写数字输出 DO{bit}，其余位保持上次的值。本周期结束时统一输出一次。</summary>
+        public static void WriteDigital(int bit, bool value) { }
+
         /// <summary>MCU 上电后经过的微秒数。</summary>
         public static int GetMicrosFromStart() => default;
 
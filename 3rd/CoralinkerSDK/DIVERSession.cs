@@ -1,3 +1,4 @@
+using System.Buffers.Binary;
 using System.Collections.Concurrent;
 using System.Text.Json;
 using System.Text.Json.Nodes;
@@ -63,7 +64,8 @@ public record PortStatsSnapshot(
     uint TxFrames,
     uint RxFrames,
     uint TxBytes,
-    uint RxBytes
+    uint RxBytes,
+    uint RxDropped = 0 // 因 DIVER IO 缓冲已满丢弃的接收帧
 );
 
 /// <summary>节点完整信息</summary>
@@ -241,6 +243,10 @@ internal class NodeEntry : IDisposable
     public MCUState? State { get; set; }
     public RuntimeStats? Stats { get; set; }
     public bool HasFatalError { get; set; }
+    /// <summary>MCU 已切换到增量 LowerIO 上报（'K' 关键帧 / 'D' 增量帧）</summary>
+    public bool LowerIoDelta { get; set; }
+    /// <summary>上次成功下发的各 UpperIO/Mutual 字段编码（按 CartFields 下标），null = 下次发全量</summary>
+    public Dictionary<int, byte[]>? UpperIoSent { get; set; }
     
     /// <summary>最后一次运行的统计数据（Stop后保留，用于显示TX/RX计数）</summary>
     public RuntimeStats? LastStats { get; set; }
@@ -313,7 +319,9 @@ public sealed record VmStatsSample(
     double LoadPercent,
     uint MemCapacity,
     uint MemPeakUsed,
-    double MemLoadPercent
+    double MemLoadPercent,
+    double GcMicros,
+    uint GcFreeCycles
 );
 
 /// <summary>VM 运行遥测滚动历史（线程安全的环形缓冲，用于绘制 CPU 负载曲线）</summary>
@@ -352,7 +360,9 @@ public sealed class VmStatsHistory
                 stats.LoadPercent,
                 stats.MemCapacity,
                 stats.MemPeakUsed,
-                stats.MemLoadPercent
+                stats.MemLoadPercent,
+                stats.GcMicros,
+                stats.GcFreeCycles
             );
             _samples.Add(sample);
             if (_samples.Count > _maxSamples)
@@ -1378,6 +1388,16 @@ public sealed class DIVERSession : IDisposable
             // 注册 WireTap 端口回调
             RegisterWireTapCallbacks(entry, handle);
 
+            // 协商增量 LowerIO（每次 Start 前都要协商，MCU 在 Start 后清除协商结果）；
+            // 旧固件/仿真节点不支持时按全量格式解析，超时等错误时格式未知，不能启动
+            if (!handle.SetLowerIoDelta(out var lowerIoDelta))
+            {
+                handle.Dispose();
+                return $"SetLowerIoMode failed: {handle.LastError}";
+            }
+            entry.LowerIoDelta = lowerIoDelta;
+            entry.UpperIoSent = null;
+
             // Start
             if (!handle.Start())
             {
@@ -2139,7 +2159,8 @@ public sealed class DIVERSession : IDisposable
                     _upperIOPending[kv.Key] = 0;
 
                     var upper = SerializeUpperIO(entry);
-                    handle.SendUpperIO(upper, 20);
+                    if (upper != null && !handle.SendUpperIO(upper, 20))
+                        entry.UpperIoSent = null; // 下发失败（或 MCU 无法合并稀疏包）：下次重发全量
                 }
                 catch (ObjectDisposedException)
                 {
@@ -2153,7 +2174,7 @@ public sealed class DIVERSession : IDisposable
         }
     }
 
-    private void HandleLowerIO(string uuid, byte[] data)
+    private void HandleLowerIO(string uuid, ReadOnlySpan<byte> data)
     {
         if (!_nodes.TryGetValue(uuid, out var entry))
             return;
@@ -2161,7 +2182,7 @@ public sealed class DIVERSession : IDisposable
         try
         {
             // 反序列化 LowerIO 数据到变量存储
-            DeserializeLowerIO(uuid, data, entry.CartFields);
+            DeserializeLowerIO(uuid, data, entry.CartFields, entry.LowerIoDelta);
 
             // 标记需要发送 UpperIO
             _upperIOPending[uuid] = 1;
@@ -2508,48 +2529,122 @@ public sealed class DIVERSession : IDisposable
 
     #region 序列化/反序列化
 
-    private byte[] SerializeUpperIO(NodeEntry entry)
+    /// <summary>
+    /// 生成下发给节点的 UpperIO。
+    /// 旧固件：每次都是全量 {每个 UpperIO/Mutual 字段}。
+    /// 协商了增量 LowerIO 的固件同样接受稀疏 UpperIO ['S'][count 2B]{[字段下标 2B][值]}：
+    /// 首包或下发失败后发全量，之后只发与上次成功下发相比变化的字段，没有变化时返回 null（不发）。
+    /// </summary>
+    private byte[]? SerializeUpperIO(NodeEntry entry)
     {
         using var ms = new MemoryStream();
         using var bw = new BinaryWriter(ms);
 
-        foreach (var field in entry.CartFields)
+        var sparse = entry.LowerIoDelta && entry.UpperIoSent != null;
+        var sent = entry.UpperIoSent ?? new Dictionary<int, byte[]>();
+        var count = 0;
+        if (sparse)
+        {
+            bw.Write((byte)'S');
+            bw.Write((ushort)0); // 条目数，最后回填
+        }
+
+        for (var i = 0; i < entry.CartFields.Length; i++)
         {
+            var field = entry.CartFields[i];
             if (!field.IsUpperIO && !field.IsMutual)
                 continue;
 
-            bw.Write(field.TypeId);
             var val = _variables.TryGetValue(field.Name, out var v)
                 ? v
                 : HostRuntime.GetDefaultValue(field.TypeId);
-            WriteTypedValue(bw, field.TypeId, val);
+            var token = SerializeUpperField(field.TypeId, val);
+            if (sparse)
+            {
+                if (sent.TryGetValue(i, out var prev) && prev.AsSpan().SequenceEqual(token))
+                    continue;
+                bw.Write((ushort)i);
+                count++;
+            }
+            bw.Write(token);
+            sent[i] = token;
         }
 
+        if (entry.LowerIoDelta)
+            entry.UpperIoSent = sent;
+        if (!sparse)
+            return ms.ToArray();
+        if (count == 0)
+            return null;
+
+        var data = ms.ToArray();
+        BitConverter.TryWriteBytes(data.AsSpan(1, 2), (ushort)count);
+        return data;
+    }
+
+    private static byte[] SerializeUpperField(byte typeid, object? val)
+    {
+        using var ms = new MemoryStream();
+        using var bw = new BinaryWriter(ms);
+        bw.Write(typeid);
+        WriteTypedValue(bw, typeid, val);
         return ms.ToArray();
     }
 
-    private void DeserializeLowerIO(string uuid, byte[] data, CartFieldInfo[] fields)
+    /// <summary>
+    /// 应用一帧 LowerIO 到变量存储。
+    /// 全量帧：[iteration 4B]{每个非 UpperIO 字段}；
+    /// 增量模式：'K' 关键帧同全量，'D' 增量帧在 iteration 后带位图（第 i 位 = 第 i 个非 UpperIO 字段），
+    /// 只含置位字段，未置位字段保留上次的值（格式见 MCURuntime/mcu_runtime.h）。
+    /// </summary>
+    private void DeserializeLowerIO(string uuid, ReadOnlySpan<byte> data, CartFieldInfo[] fields, bool delta = false)
     {
-        using var ms = new MemoryStream(data);
-        using var br = new BinaryReader(ms);
+        // data 直接指向 C 层接收缓冲，只在回调期间有效：按偏移就地解析，不拷贝
+        var pos = 0;
+
+        byte kind = 0;
+        if (delta)
+        {
+            if (data.Length < 5)
+                return;
+            kind = data[pos++];
+            if (kind != (byte)'K' && kind != (byte)'D')
+                throw new InvalidDataException($"unknown LowerIO frame kind 0x{kind:X2}");
+        }
 
         // LowerIO 以 iteration (int32) 开头
-        if (ms.Length >= 4)
+        if (data.Length - pos >= 4)
         {
-            var iteration = br.ReadInt32();
+            var iteration = BinaryPrimitives.ReadInt32LittleEndian(data.Slice(pos));
+            pos += 4;
             // 存储 iteration 到 HostRuntime
             HostRuntime.SetCartVariable(uuid, "__iteration", iteration);
         }
 
+        ReadOnlySpan<byte> bitmap = default;
+        if (kind == (byte)'D')
+        {
+            var bitmapSize = (fields.Count(f => !f.IsUpperIO) + 7) / 8;
+            if (data.Length - pos < bitmapSize)
+                return;
+            bitmap = data.Slice(pos, bitmapSize);
+            pos += bitmapSize;
+        }
+
+        var lowerIndex = 0;
         foreach (var field in fields)
         {
             if (field.IsUpperIO)
                 continue;
-            if (ms.Position >= data.Length)
+            var present = kind != (byte)'D' || (bitmap[lowerIndex / 8] & (1 << (lowerIndex % 8))) != 0;
+            lowerIndex++;
+            if (!present)
+                continue;
+            if (pos >= data.Length)
                 break;
 
-            var typeid = br.ReadByte();
-            var value = ReadTypedValue(br, typeid);
+            var typeid = data[pos++];
+            var value = ReadTypedValue(data, ref pos, typeid);
             if (value != null)
             {
                 _variables[field.Name] = value;
@@ -2557,23 +2652,51 @@ public sealed class DIVERSession : IDisposable
         }
     }
 
-    private static object? ReadTypedValue(BinaryReader br, int typeid)
+    private static object? ReadTypedValue(ReadOnlySpan<byte> data, ref int pos, int typeid)
     {
+        var size = typeid switch
+        {
+            0 or 1 or 2 => 1,
+            3 or 4 or 5 => 2,
+            6 or 7 or 8 => 4,
+            // 引用类字段：跳过负载以保持后续字段对齐（变量存储只记录基本类型）
+            11 => 5 + GetArrayPayloadSize(data.Slice(pos)),
+            12 => 2 + BinaryPrimitives.ReadUInt16LittleEndian(data.Slice(pos)),
+            16 => 4,
+            _ => 0,
+        };
+        var v = data.Slice(pos, size);
+        pos += size;
         return typeid switch
         {
-            0 => br.ReadBoolean(),
-            1 => br.ReadByte(),
-            2 => br.ReadSByte(),
-            3 => br.ReadChar(),
-            4 => br.ReadInt16(),
-            5 => br.ReadUInt16(),
-            6 => br.ReadInt32(),
-            7 => br.ReadUInt32(),
-            8 => br.ReadSingle(),
+            0 => v[0] != 0,
+            1 => v[0],
+            2 => (sbyte)v[0],
+            3 => (char)BinaryPrimitives.ReadUInt16LittleEndian(v),
+            4 => BinaryPrimitives.ReadInt16LittleEndian(v),
+            5 => BinaryPrimitives.ReadUInt16LittleEndian(v),
+            6 => BinaryPrimitives.ReadInt32LittleEndian(v),
+            7 => BinaryPrimitives.ReadUInt32LittleEndian(v),
+            8 => BinaryPrimitives.ReadSingleLittleEndian(v),
             _ => null,
         };
     }
 
+    // 数组负载：[elemTid 1B][len 4B][元素...]，返回元素部分的字节数
+    private static int GetArrayPayloadSize(ReadOnlySpan<byte> data)
+    {
+        var elemTid = data[0];
+        var len = BinaryPrimitives.ReadInt32LittleEndian(data.Slice(1));
+        var elemSize = elemTid switch
+        {
+            0 or 1 or 2 => 1,
+            3 or 4 or 5 => 2,
+            6 or 7 or 8 => 4,
+            _ => throw new InvalidDataException($"LowerIO array element type {elemTid} not supported"),
+        };
+        return len * elemSize;
+    }
+
     private static void WriteTypedValue(BinaryWriter bw, int typeid, object? val)
     {
         val ??= HostRuntime.GetDefaultValue(typeid);
@@ -2725,7 +2848,14 @@ public sealed class DIVERSession : IDisposable
                 validPorts
                     .Select(
                         (p, i) =>
-                            new PortStatsSnapshot(i, p.TxFrames, p.RxFrames, p.TxBytes, p.RxBytes)
+                            new PortStatsSnapshot(
+                                i,
+                                p.TxFrames,
+                                p.RxFrames,
+                                p.TxBytes,
+                                p.RxBytes,
+                                statsSource.Value.RxDropped is { } dropped && i < dropped.Length ? dropped[i] : 0
+                            )
                     )
                     .ToArray()
             );
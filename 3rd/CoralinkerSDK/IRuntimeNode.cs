@@ -18,7 +18,7 @@ public interface IRuntimeNode : IDisposable
     PortConfig[] PortConfigs { get; set; }
     CartFieldInfo[] CartFields { get; set; }
 
-    event Action<byte[]>? OnLowerIOReceived;
+    event MCUSerialBridge.LowerIOSpanHandler? OnLowerIOReceived;
     event Action<string, uint>? OnConsoleOutput;
     event Action<VmStats>? OnVmStats;
     event Action<ErrorPayload>? OnFatalError;
@@ -32,6 +32,7 @@ public interface IRuntimeNode : IDisposable
     bool Stop();
     bool SendUpperIO(byte[] data, uint timeoutMs = 20);
     bool SetWireTap(byte portIndex, WireTapFlags flags, uint timeoutMs = 200);
+    bool SetLowerIoDelta(out bool enabled, ushort keyframeInterval = 0, uint timeoutMs = 200);
     bool RegisterSerialPortCallback(byte portIndex, Action<byte, byte, byte[], uint> callback);
     bool RegisterCANPortCallback(byte portIndex, Action<byte, byte, CANMessage, uint> callback);
     void RefreshState();
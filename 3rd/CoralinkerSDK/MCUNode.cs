@@ -10,11 +10,14 @@ public class MCUNode : IRuntimeNode
     private const uint DefaultBaudRate = 2000000;
     private const uint DefaultTimeout = 500;
     private const uint ProgramTimeout = 10000;
+    // 支持闪存保存区的固件在 Program 应答之后由主循环擦写扇区（约 1~2s，期间不处理命令）
+    private const uint ProgramPersistTimeout = 3000;
 
     public static readonly int ResetWaitTime = 1000;
 
     private MCUSerialBridge? _bridge;
     private bool _disposed;
+    private long _programPersistUntil; // Environment.TickCount64，之前发出的命令按擦写时间放宽超时
     private readonly object _bridgeCallLock = new();
     private bool _isDisposingBridge;
     private int _activeBridgeCalls;
@@ -82,8 +85,8 @@ public class MCUNode : IRuntimeNode
     /// <summary>Cart 字段元数据（从 MetaJson 解析）</summary>
     public CartFieldInfo[] CartFields { get; set; } = Array.Empty<CartFieldInfo>();
 
-    /// <summary>LowerIO 数据接收事件（由 DIVERSession 订阅）</summary>
-    internal event Action<byte[]>? OnLowerIOReceived;
+    /// <summary>LowerIO 数据接收事件（由 DIVERSession 订阅）；data 只在事件处理期间有效</summary>
+    internal event MCUSerialBridge.LowerIOSpanHandler? OnLowerIOReceived;
 
     /// <summary>控制台输出事件 (message, mcuTimestampMs)</summary>
     internal event Action<string, uint>? OnConsoleOutput;
@@ -252,7 +255,7 @@ public class MCUNode : IRuntimeNode
             }
 
             // Register callbacks
-            _bridge.RegisterMemoryLowerIOCallback(data => OnLowerIOReceived?.Invoke(data));
+            _bridge.RegisterMemoryLowerIOSpanCallback(data => OnLowerIOReceived?.Invoke(data));
             _bridge.RegisterConsoleWriteLineCallback(
                 (msg, mcuTs) => OnConsoleOutput?.Invoke(msg, mcuTs)
             );
@@ -402,12 +405,16 @@ public class MCUNode : IRuntimeNode
                 return false;
             }
 
+            // MCU 上已是同一镜像时桥内部会跳过下载，耗时只有一次查询往返
+            var sw = System.Diagnostics.Stopwatch.StartNew();
             var err = bridge!.Program(ProgramBytes, ProgramTimeout);
             if (err != MCUSerialBridgeError.OK)
             {
                 LastError = $"Program failed: {err.ToDescription()}";
                 return false;
             }
+            Console.WriteLine($"[MCUNode] Programmed {ProgramBytes.Length} bytes in {sw.ElapsedMilliseconds} ms");
+            _programPersistUntil = Environment.TickCount64 + ProgramPersistTimeout;
         }
         finally
         {
@@ -419,6 +426,15 @@ public class MCUNode : IRuntimeNode
         return true;
     }
 
+    /// <summary>
+    /// Program 之后的几秒里 MCU 可能正在写闪存保存区，命令超时至少放宽到写完
+    /// </summary>
+    private uint AfterProgramTimeout(uint timeoutMs)
+    {
+        long remaining = _programPersistUntil - Environment.TickCount64;
+        return remaining > timeoutMs ? (uint)remaining : timeoutMs;
+    }
+
     /// <summary>
     /// 启动 MCU 执行
     /// </summary>
@@ -432,7 +448,7 @@ public class MCUNode : IRuntimeNode
 
         try
         {
-            var err = bridge!.Start(DefaultTimeout);
+            var err = bridge!.Start(AfterProgramTimeout(DefaultTimeout));
             if (err != MCUSerialBridgeError.OK)
             {
                 LastError = $"Start failed: {err.ToDescription()}";
@@ -529,7 +545,7 @@ public class MCUNode : IRuntimeNode
         {
             // 转换为底层类型
             var clrFlags = (MCUSerialBridgeCLR.WireTapFlags)(int)flags;
-            var err = bridge!.SetWireTap(portIndex, clrFlags, timeoutMs);
+            var err = bridge!.SetWireTap(portIndex, clrFlags, AfterProgramTimeout(timeoutMs));
             if (err != MCUSerialBridgeError.OK)
             {
                 LastError = $"SetWireTap failed: {err.ToDescription()}";
@@ -545,6 +561,49 @@ public class MCUNode : IRuntimeNode
         return true;
     }
 
+    /// <summary>
+    /// 请求 MCU 以增量格式上报 LowerIO（位图 + 变化字段，周期关键帧），须在每次 Start 之前调用。
+    /// 只有旧固件明确返回 Proto_UnknownCommand 时才按全量格式继续（enabled = false）；
+    /// 超时等其它错误时 MCU 的格式未知，返回 false
+    /// </summary>
+    /// <param name="enabled">MCU 是否已切换到增量格式</param>
+    /// <param name="keyframeInterval">关键帧间隔（迭代数），0 = 固件默认</param>
+    /// <param name="timeoutMs">超时时间（毫秒）</param>
+    /// <returns>是否协商成功</returns>
+    public bool SetLowerIoDelta(out bool enabled, ushort keyframeInterval = 0, uint timeoutMs = 200)
+    {
+        enabled = false;
+        if (!TryEnterBridgeCall(out var bridge))
+        {
+            LastError = IsDisposing ? "Bridge is disposing" : "Not connected";
+            return false;
+        }
+
+        try
+        {
+            var err = bridge!.SetLowerIoMode(LowerIoMode.Delta, keyframeInterval, AfterProgramTimeout(timeoutMs));
+            if (err == MCUSerialBridgeError.Proto_UnknownCommand)
+            {
+                // 旧固件：一直是全量格式
+                LastError = null;
+                return true;
+            }
+            if (err != MCUSerialBridgeError.OK)
+            {
+                LastError = $"SetLowerIoMode failed: {err.ToDescription()}";
+                return false;
+            }
+        }
+        finally
+        {
+            ExitBridgeCall();
+        }
+
+        enabled = true;
+        LastError = null;
+        return true;
+    }
+
     /// <summary>
     /// 注册串口数据回调（用于 WireTap 或 Bridge 模式）
     /// </summary>
@@ -636,7 +695,7 @@ public class MCUNode : IRuntimeNode
 
         try
         {
-            var err = bridge!.GetState(out var state, DefaultTimeout);
+            var err = bridge!.GetState(out var state, AfterProgramTimeout(DefaultTimeout));
             if (err == MCUSerialBridgeError.OK)
             {
                 State = state;
@@ -737,7 +796,7 @@ public class MCUNode : IRuntimeNode
         Disconnect();
     }
 
-    event Action<byte[]>? IRuntimeNode.OnLowerIOReceived
+    event MCUSerialBridge.LowerIOSpanHandler? IRuntimeNode.OnLowerIOReceived
     {
         add => OnLowerIOReceived += value;
         remove => OnLowerIOReceived -= value;
@@ -53,7 +53,7 @@ internal sealed class SimulatedMcuNode : IRuntimeNode
     public PortConfig[] PortConfigs { get; set; } = Array.Empty<PortConfig>();
     public CartFieldInfo[] CartFields { get; set; } = Array.Empty<CartFieldInfo>();
 
-    public event Action<byte[]>? OnLowerIOReceived;
+    public event MCUSerialBridge.LowerIOSpanHandler? OnLowerIOReceived;
     public event Action<string, uint>? OnConsoleOutput;
     public event Action<VmStats>? OnVmStats;
     public event Action<ErrorPayload>? OnFatalError;
@@ -290,6 +290,13 @@ internal sealed class SimulatedMcuNode : IRuntimeNode
         return response?.Ok ?? true;
     }
 
+    // 仿真节点始终上报全量 LowerIO
+    public bool SetLowerIoDelta(out bool enabled, ushort keyframeInterval = 0, uint timeoutMs = 200)
+    {
+        enabled = false;
+        return true;
+    }
+
     public bool RegisterSerialPortCallback(byte portIndex, Action<byte, byte, byte[], uint> callback)
     {
         _serialCallbacks[portIndex] = callback;
@@ -518,6 +525,8 @@ internal sealed class SimulatedMcuNode : IRuntimeNode
                     MemPeakUsed = root.TryGetProperty("memPeakUsed", out var mp) ? mp.GetUInt32() : 0,
                     HeapObjs = root.TryGetProperty("heapObjs", out var ho) ? (ushort)ho.GetUInt32() : (ushort)0,
                     Reserved = 0,
+                    GcCycles = root.TryGetProperty("gcCycles", out var gc) ? gc.GetUInt32() : 0,
+                    GcFreeCycles = root.TryGetProperty("gcFreeCycles", out var gf) ? gf.GetUInt32() : 0,
                 });
                 break;
             case "snapshot":
@@ -690,7 +699,8 @@ internal sealed class SimulatedMcuNode : IRuntimeNode
             DigitalOutputs = 0,
             PortCount = 4,
             Reserved = new byte[3],
-            Ports = Enumerable.Range(0, 16).Select(_ => new PortStats()).ToArray()
+            Ports = Enumerable.Range(0, 16).Select(_ => new PortStats()).ToArray(),
+            RxDropped = new uint[16]
         };
     }
 
@@ -38,6 +38,58 @@ internal static class McuRuntimeNative
     [DllImport("sim_node_runtime", EntryPoint = "sim_step", CallingConvention = CallingConvention.Cdecl)]
     public static extern int Step(uint timestampMs);
 
+    [DllImport("sim_node_runtime", EntryPoint = "sim_bench", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int Bench(uint steps);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_get_dispatch_mode", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int GetDispatchMode();
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_bench_mark", CallingConvention = CallingConvention.Cdecl)]
+    public static extern long BenchMark(int shape, int objects, int rounds);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_get_gc_free_cycles", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int GetGcFreeCycles();
+
+    // Extra nodes in this process, each with its own VM context. The other calls act
+    // on the node selected on the calling thread (IntPtr.Zero: the default node).
+    [DllImport("sim_node_runtime", EntryPoint = "sim_create", CallingConvention = CallingConvention.Cdecl)]
+    public static extern IntPtr Create();
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_select", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void Select(IntPtr node);
+
     [DllImport("sim_node_runtime", EntryPoint = "sim_destroy", CallingConvention = CallingConvention.Cdecl)]
-    public static extern void Destroy();
+    public static extern void Destroy(IntPtr node);
+
+    // Fleet runner (native/sim_fleet.c): steps many nodes per tick on a worker pool.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct FleetNodeStats
+    {
+        public uint Steps;
+        public uint LastNanos;
+        public uint MaxNanos;
+        public uint Reserved;
+        public ulong TotalNanos;
+    }
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_fleet_create", CallingConvention = CallingConvention.Cdecl)]
+    public static extern IntPtr FleetCreate(int threads, int pinCores);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_fleet_add", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int FleetAdd(IntPtr fleet, IntPtr node);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_fleet_set_upper", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int FleetSetUpper(IntPtr fleet, int index, byte[] data, int length);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_fleet_route", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int FleetRoute(IntPtr fleet, int from, int lowerField, int to, int upperField);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_fleet_run", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int FleetRun(IntPtr fleet, uint ticks, uint tickMs);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_fleet_get_stats", CallingConvention = CallingConvention.Cdecl)]
+    public static extern int FleetGetStats(IntPtr fleet, int index, out FleetNodeStats stats);
+
+    [DllImport("sim_node_runtime", EntryPoint = "sim_fleet_destroy", CallingConvention = CallingConvention.Cdecl)]
+    public static extern void FleetDestroy(IntPtr fleet);
 }
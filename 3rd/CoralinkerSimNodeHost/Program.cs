@@ -73,6 +73,15 @@ internal static class Program
             case "upper":
                 PutUpper(id, payload);
                 break;
+            case "bench":
+                RunBench(id, payload);
+                break;
+            case "benchMark":
+                RunBenchMark(id, payload);
+                break;
+            case "fleet":
+                RunFleet(id, payload);
+                break;
             case "wiretap":
                 WriteResponse(id, true);
                 break;
@@ -133,6 +142,217 @@ internal static class Program
         WriteResponse(id, result == 0, result == 0 ? null : "Failed to put upper IO data.");
     }
 
+    private static void RunBench(string id, JsonElement payload)
+    {
+        var steps = payload.ValueKind == JsonValueKind.Object && payload.TryGetProperty("steps", out var stepsElement)
+            ? Math.Max(1, stepsElement.GetInt32())
+            : 1000;
+
+        StopLoop();
+        int instructions;
+        int dispatchMode;
+        long elapsedTicks;
+        try
+        {
+            dispatchMode = McuRuntimeNative.GetDispatchMode();
+            var startTicks = System.Diagnostics.Stopwatch.GetTimestamp();
+            instructions = McuRuntimeNative.Bench((uint)steps);
+            elapsedTicks = System.Diagnostics.Stopwatch.GetTimestamp() - startTicks;
+        }
+        catch (Exception ex) when (ex is DllNotFoundException or EntryPointNotFoundException or BadImageFormatException)
+        {
+            WriteResponse(id, false, $"Cannot load mcu_runtime native library: {ex.Message}");
+            return;
+        }
+
+        var totalMicros = elapsedTicks * 1_000_000.0 / System.Diagnostics.Stopwatch.Frequency;
+        WriteEvent("bench", new
+        {
+            dispatch = dispatchMode == 1 ? "threaded" : "switch",
+            steps,
+            instructions,
+            totalMicros,
+            microsPerStep = totalMicros / steps,
+            nanosPerInstruction = instructions > 0 ? totalMicros * 1000.0 / instructions : 0.0
+        });
+        WriteResponse(id, true);
+    }
+
+    // GC mark-phase benchmark: marks deep / wide / tree graphs of `objects` nodes
+    // built on top of the loaded program's heap, `rounds` times each.
+    private static void RunBenchMark(string id, JsonElement payload)
+    {
+        var isObject = payload.ValueKind == JsonValueKind.Object;
+        var objects = isObject && payload.TryGetProperty("objects", out var objectsElement)
+            ? Math.Max(1, objectsElement.GetInt32())
+            : 1000;
+        var rounds = isObject && payload.TryGetProperty("rounds", out var roundsElement)
+            ? Math.Max(1, roundsElement.GetInt32())
+            : 100;
+
+        StopLoop();
+        var shapes = new[] { "deep", "wide", "tree" };
+        var results = new List<object>();
+        try
+        {
+            for (var shape = 0; shape < shapes.Length; shape++)
+            {
+                var nanos = McuRuntimeNative.BenchMark(shape, objects, rounds);
+                if (nanos < 0)
+                {
+                    WriteResponse(id, false, $"Cannot build a {objects}-object graph in the VM memory.");
+                    return;
+                }
+                results.Add(new
+                {
+                    shape = shapes[shape],
+                    objects,
+                    rounds,
+                    nanosPerRound = (double)nanos / rounds,
+                    nanosPerObject = (double)nanos / rounds / objects
+                });
+            }
+        }
+        catch (Exception ex) when (ex is DllNotFoundException or EntryPointNotFoundException or BadImageFormatException)
+        {
+            WriteResponse(id, false, $"Cannot load mcu_runtime native library: {ex.Message}");
+            return;
+        }
+
+        WriteEvent("benchMark", new { results });
+        WriteResponse(id, true);
+    }
+
+    // Whole-vehicle regression run: loads every node into its own VM context in
+    // this process, wires LowerIO fields to UpperIO fields through the native bus
+    // and steps all nodes `ticks` times on a worker pool, without real-time pacing.
+    // payload: { nodes: [{ program, memorySize?, upper? }], routes: [{ from, lowerField, to, upperField }],
+    //            ticks?, tickMs?, threads? (0: one per core), pinCores? }
+    private static void RunFleet(string id, JsonElement payload)
+    {
+        if (payload.ValueKind != JsonValueKind.Object || !payload.TryGetProperty("nodes", out var nodesElement))
+        {
+            WriteResponse(id, false, "fleet needs a nodes array.");
+            return;
+        }
+        var ticks = payload.TryGetProperty("ticks", out var ticksElement) ? Math.Max(1, ticksElement.GetInt32()) : 1000;
+        var tickMs = payload.TryGetProperty("tickMs", out var tickElement) ? Math.Max(1, tickElement.GetInt32()) : _scanIntervalMs;
+        var threads = payload.TryGetProperty("threads", out var threadsElement) ? threadsElement.GetInt32() : 0;
+        if (threads <= 0)
+        {
+            threads = Environment.ProcessorCount;
+        }
+        var pinCores = !payload.TryGetProperty("pinCores", out var pinElement) || pinElement.GetBoolean();
+
+        var nodes = new List<IntPtr>();
+        var fleet = IntPtr.Zero;
+        try
+        {
+            fleet = McuRuntimeNative.FleetCreate(threads, pinCores ? 1 : 0);
+            if (fleet == IntPtr.Zero)
+            {
+                WriteResponse(id, false, "Cannot start the fleet worker pool.");
+                return;
+            }
+
+            foreach (var nodeElement in nodesElement.EnumerateArray())
+            {
+                var program = Convert.FromBase64String(nodeElement.GetProperty("program").GetString() ?? "");
+                var memorySize = nodeElement.TryGetProperty("memorySize", out var memoryElement)
+                    ? memoryElement.GetInt32()
+                    : Math.Max(1024 * 1024, program.Length + 256 * 1024);
+                var node = McuRuntimeNative.Create();
+                if (node == IntPtr.Zero)
+                {
+                    WriteResponse(id, false, "Cannot create a simulated node.");
+                    return;
+                }
+                nodes.Add(node);
+                McuRuntimeNative.Select(node);
+                McuRuntimeNative.SetCallbacks(null!, ConsoleCallback, null!, null!, null!, FatalCallback);
+                if (McuRuntimeNative.LoadProgram(program, program.Length, memorySize) < 0)
+                {
+                    WriteResponse(id, false, $"mcu_runtime rejected the program of fleet node {nodes.Count - 1}.");
+                    return;
+                }
+                var index = McuRuntimeNative.FleetAdd(fleet, node);
+                if (nodeElement.TryGetProperty("upper", out var upperElement))
+                {
+                    var upper = Convert.FromBase64String(upperElement.GetString() ?? "");
+                    if (McuRuntimeNative.FleetSetUpper(fleet, index, upper, upper.Length) != 0)
+                    {
+                        WriteResponse(id, false, $"Malformed upper image for fleet node {index}.");
+                        return;
+                    }
+                }
+            }
+            McuRuntimeNative.Select(IntPtr.Zero);
+
+            if (payload.TryGetProperty("routes", out var routesElement))
+            {
+                foreach (var route in routesElement.EnumerateArray())
+                {
+                    if (McuRuntimeNative.FleetRoute(fleet,
+                            route.GetProperty("from").GetInt32(), route.GetProperty("lowerField").GetInt32(),
+                            route.GetProperty("to").GetInt32(), route.GetProperty("upperField").GetInt32()) != 0)
+                    {
+                        WriteResponse(id, false, "Invalid fleet route.");
+                        return;
+                    }
+                }
+            }
+
+            var startTicks = System.Diagnostics.Stopwatch.GetTimestamp();
+            McuRuntimeNative.FleetRun(fleet, (uint)ticks, (uint)tickMs);
+            var elapsedTicks = System.Diagnostics.Stopwatch.GetTimestamp() - startTicks;
+            var wallMicros = elapsedTicks * 1_000_000.0 / System.Diagnostics.Stopwatch.Frequency;
+
+            var results = new List<object>();
+            for (var index = 0; index < nodes.Count; index++)
+            {
+                McuRuntimeNative.FleetGetStats(fleet, index, out var stats);
+                results.Add(new
+                {
+                    index,
+                    steps = stats.Steps,
+                    lastMicros = stats.LastNanos / 1000.0,
+                    maxMicros = stats.MaxNanos / 1000.0,
+                    avgMicros = stats.Steps > 0 ? stats.TotalNanos / 1000.0 / stats.Steps : 0.0
+                });
+            }
+
+            WriteEvent("fleet", new
+            {
+                ticks,
+                tickMs,
+                threads,
+                wallMicros,
+                realtimeFactor = wallMicros > 0 ? ticks * tickMs * 1000.0 / wallMicros : 0.0,
+                nodes = results
+            });
+            WriteResponse(id, true);
+        }
+        catch (Exception ex) when (ex is DllNotFoundException or EntryPointNotFoundException or BadImageFormatException)
+        {
+            WriteResponse(id, false, $"Cannot load mcu_runtime native library: {ex.Message}");
+        }
+        finally
+        {
+            if (fleet != IntPtr.Zero)
+            {
+                McuRuntimeNative.FleetDestroy(fleet);
+            }
+            foreach (var node in nodes)
+            {
+                McuRuntimeNative.Destroy(node);
+            }
+            if (nodes.Count > 0)
+            {
+                McuRuntimeNative.Select(IntPtr.Zero);
+            }
+        }
+    }
+
     private static void StartLoop()
     {
         if (_runTask is { IsCompleted: false })
@@ -176,6 +396,7 @@ internal static class Program
                         memCapacity = (uint)(_memorySize > 0 ? _memorySize : 0),
                         memPeakUsed = 0u,
                         heapObjs = 0u,
+                        gcFreeCycles = (uint)McuRuntimeNative.GetGcFreeCycles(),
                         mcuTimestampMs = timestampMs
                     });
                     iteration++;
@@ -332,7 +553,7 @@ internal static class Program
     {
         try
         {
-            McuRuntimeNative.Destroy();
+            McuRuntimeNative.Destroy(IntPtr.Zero);
         }
         catch
         {
@@ -2,6 +2,9 @@ param(
     [ValidateSet("all", "windows", "linux-x64", "linux-arm64")]
     [string]$Target = "all",
     [string]$Configuration = "Release",
+    # Interpreter dispatch engine; "switch" builds the portable fallback for A/B benchmarks (see "bench" command).
+    [ValidateSet("threaded", "switch")]
+    [string]$Dispatch = "threaded",
     [string]$ZigPath = ""
 )
 
@@ -13,6 +16,8 @@ $mcuRuntimeDir = Join-Path $repoRoot "MCURuntime"
 $runtimeDir = Join-Path $scriptDir "build\runtimes"
 $runtimeSource = Join-Path $mcuRuntimeDir "mcu_runtime.c"
 $shimSource = Join-Path $scriptDir "native\sim_node_runtime.c"
+$fleetSource = Join-Path $scriptDir "native\sim_fleet.c"
+$dispatchDefine = if ($Dispatch -eq "switch") { "DIVER_THREADED_DISPATCH=0" } else { "DIVER_THREADED_DISPATCH=1" }
 
 function Resolve-Tool {
     param(
@@ -67,7 +72,7 @@ function Build-WindowsNative {
 
     $vcvars = Resolve-VsDevCmd
     $debugFlag = if ($Configuration -eq "Debug") { "/MDd /Od" } else { "/MD /O2" }
-    $cmd = "call `"$vcvars`" && cl /W0 /LD $debugFlag /DSIM_NODE_HOST /I`"$mcuRuntimeDir`" /Zi /EHsc `"$runtimeSource`" `"$shimSource`" /Fe:`"$outputFile`" /link /DEBUG"
+    $cmd = "call `"$vcvars`" && cl /W0 /LD $debugFlag /DSIM_NODE_HOST /I`"$mcuRuntimeDir`" /Zi /EHsc `"$runtimeSource`" `"$shimSource`" `"$fleetSource`" /Fe:`"$outputFile`" /link /DEBUG"
 
     Write-Host "Building win-x64 sim_node_runtime with MSVC..."
     & cmd /c $cmd
@@ -99,11 +104,14 @@ function Build-LinuxNative {
         "-fPIC",
         "-std=gnu11",
         "-DSIM_NODE_HOST",
+        "-D$dispatchDefine",
         "-O2",
         "-I", $mcuRuntimeDir,
         $runtimeSource,
         $shimSource,
+        $fleetSource,
         "-lm",
+        "-lpthread",
         "-o", $outputFile
     )
 
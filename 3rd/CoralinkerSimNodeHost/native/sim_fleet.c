@@ -0,0 +1,502 @@
+// Fleet runner: steps many simulated nodes (each its own VM context, see
+// sim_create) per simulated tick on a fixed worker pool, as fast as the host
+// allows, and carries LowerIO of one node into the UpperIO of others.
+//
+// - Node i always runs on worker i % threads, and workers can be pinned one per
+//   core, so a node's VM memory stays in the same core's caches.
+// - Bus: a node's LowerIO from tick t is delivered at tick t+1. Every node keeps
+//   two LowerIO buffers and only writes the current one while others read the
+//   previous one, so results do not depend on thread scheduling.
+// - A node receives UpperIO only once it has a baseline image
+//   (sim_fleet_set_upper). Routed fields replace the matching baseline fields.
+//
+// Node callbacks still fire, from the worker threads.
+#ifdef _WIN32
+#include <windows.h>
+#else
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_node_runtime.h"
+
+struct sim_fleet_route
+{
+    int upper_field; // field index in the destination's UpperIO
+    int src;         // source node index
+    int lower_field; // field index in the source's LowerIO
+};
+
+struct sim_fleet_node_stats
+{
+    unsigned int steps;
+    unsigned int last_ns;
+    unsigned int max_ns;
+    unsigned int reserved;
+    unsigned long long total_ns;
+};
+
+struct sim_fleet_io
+{
+    uchar* data;
+    int len, cap;
+    int* fields; // offset of each field in data
+    int n_fields, fields_cap;
+};
+
+struct sim_fleet_node
+{
+    struct sim_node* node;
+    struct sim_fleet_io lower[2]; // indexed by tick parity
+    struct sim_fleet_io upper;    // baseline UpperIO image
+    uchar* upper_img;             // baseline with routed fields applied
+    int upper_img_cap;
+    struct sim_fleet_route* routes;
+    int n_routes;
+    int routed_out; // another node reads this node's LowerIO
+    struct sim_fleet_node_stats stats;
+};
+
+struct sim_fleet;
+
+struct sim_fleet_worker
+{
+    struct sim_fleet* fleet;
+    int index;
+    int core; // -1: not pinned
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+};
+
+struct sim_fleet
+{
+    struct sim_fleet_node* nodes;
+    int n_nodes, nodes_cap;
+    struct sim_fleet_worker* workers;
+    int n_workers;
+    unsigned int tick_ms;
+    int parity;
+
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE start_cv, done_cv;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t start_cv, done_cv;
+#endif
+    unsigned int generation; // bumped once per tick
+    int pending;             // workers still stepping this tick
+    int quit;
+};
+
+#ifdef _WIN32
+#define FLEET_LOCK(f) EnterCriticalSection(&(f)->lock)
+#define FLEET_UNLOCK(f) LeaveCriticalSection(&(f)->lock)
+#define FLEET_WAIT(f, cv) SleepConditionVariableCS(&(f)->cv, &(f)->lock, INFINITE)
+#define FLEET_SIGNAL(f, cv) WakeConditionVariable(&(f)->cv)
+#define FLEET_BROADCAST(f, cv) WakeAllConditionVariable(&(f)->cv)
+#else
+#define FLEET_LOCK(f) pthread_mutex_lock(&(f)->lock)
+#define FLEET_UNLOCK(f) pthread_mutex_unlock(&(f)->lock)
+#define FLEET_WAIT(f, cv) pthread_cond_wait(&(f)->cv, &(f)->lock)
+#define FLEET_SIGNAL(f, cv) pthread_cond_signal(&(f)->cv)
+#define FLEET_BROADCAST(f, cv) pthread_cond_broadcast(&(f)->cv)
+#endif
+
+static int fleet_cpu_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Grows ptr to hold `need` elements; returns the (possibly moved) block, or 0
+// with ptr and *cap untouched if realloc fails, so callers assign on success only.
+static void* fleet_grow(void* ptr, int* cap, int need, int elem_size)
+{
+    if (need <= *cap)
+        return ptr;
+    int new_cap = *cap > 0 ? *cap : 4;
+    while (new_cap < need)
+        new_cap *= 2;
+    void* grown = realloc(ptr, (size_t)new_cap * elem_size);
+    if (grown != 0)
+        *cap = new_cap;
+    return grown;
+}
+
+// Size of one serialized cart IO field (type token + payload), the format of
+// vm_get_lower_memory / vm_put_upper_memory. 0: malformed or truncated.
+static int fleet_field_size(const uchar* p, const uchar* end)
+{
+    if (p >= end)
+        return 0;
+    int sz;
+    switch (*p)
+    {
+    case 0: case 1: case 2: sz = 1 + 1; break;  // Boolean, Byte, SByte
+    case 3: case 4: case 5: sz = 1 + 2; break;  // Char, Int16, UInt16
+    case 6: case 7: case 8: sz = 1 + 4; break;  // Int32, UInt32, Single
+    case 16: sz = 1 + 4; break;                 // ReferenceID (null)
+    case 12:                                    // String: len 2B|bytes
+        if (end - p < 3)
+            return 0;
+        sz = 1 + 2 + *(unsigned short*)(p + 1);
+        break;
+    case 11:                                    // Array: elem_tid 1B|len 4B|payload
+    {
+        if (end - p < 6)
+            return 0;
+        uchar elem = p[1];
+        int len = *(int*)(p + 2);
+        int esz = elem <= 2 ? 1 : (elem <= 5 ? 2 : 4);
+        if (len < 0 || elem > 8)
+            return 0;
+        sz = 1 + 1 + 4 + esz * len;
+        break;
+    }
+    default:
+        return 0;
+    }
+    return sz <= end - p ? sz : 0;
+}
+
+// Copies `len` bytes of serialized fields (after `skip` header bytes) into io
+// and indexes the field offsets. Returns 0, or -1 if the buffer is malformed.
+static int fleet_io_set(struct sim_fleet_io* io, const uchar* buf, int len, int skip)
+{
+    uchar* data = (uchar*)fleet_grow(io->data, &io->cap, len, 1);
+    if (data == 0 && len > 0)
+        return -1;
+    io->data = data;
+    memcpy(io->data, buf, len);
+    io->len = len;
+    io->n_fields = 0;
+    const uchar* end = io->data + len;
+    for (int off = skip; off < len;)
+    {
+        int sz = fleet_field_size(io->data + off, end);
+        if (sz == 0)
+            return -1;
+        int* fields = (int*)fleet_grow(io->fields, &io->fields_cap, io->n_fields + 1, sizeof(int));
+        if (fields == 0)
+            return -1;
+        io->fields = fields;
+        io->fields[io->n_fields++] = off;
+        off += sz;
+    }
+    return 0;
+}
+
+static void fleet_io_free(struct sim_fleet_io* io)
+{
+    free(io->data);
+    free(io->fields);
+    memset(io, 0, sizeof(*io));
+}
+
+static int fleet_io_field_len(const struct sim_fleet_io* io, int k)
+{
+    return (k + 1 < io->n_fields ? io->fields[k + 1] : io->len) - io->fields[k];
+}
+
+// Baseline UpperIO with this tick's routed fields, from the previous tick's LowerIO.
+static int fleet_build_upper(struct sim_fleet* f, struct sim_fleet_node* n)
+{
+    const struct sim_fleet_io* base = &n->upper;
+    int prev = f->parity ^ 1;
+    int total = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        uchar* out = n->upper_img;
+        for (int k = 0; k < base->n_fields; ++k)
+        {
+            const uchar* src = base->data + base->fields[k];
+            int len = fleet_io_field_len(base, k);
+            for (int r = 0; r < n->n_routes; ++r)
+            {
+                const struct sim_fleet_route* route = &n->routes[r];
+                const struct sim_fleet_io* lower = &f->nodes[route->src].lower[prev];
+                if (route->upper_field != k || route->lower_field >= lower->n_fields)
+                    continue;
+                src = lower->data + lower->fields[route->lower_field];
+                len = fleet_io_field_len(lower, route->lower_field);
+            }
+            if (pass == 0)
+                total += len;
+            else
+            {
+                memcpy(out, src, len);
+                out += len;
+            }
+        }
+        if (pass == 0)
+        {
+            uchar* img = (uchar*)fleet_grow(n->upper_img, &n->upper_img_cap, total, 1);
+            if (img == 0)
+                return -1;
+            n->upper_img = img;
+        }
+    }
+    return total;
+}
+
+static void fleet_step_node(struct sim_fleet* f, struct sim_fleet_node* n)
+{
+    sim_select(n->node);
+    unsigned int t0 = get_cyclic_cycles();
+
+    if (n->upper.len > 0)
+    {
+        int len = fleet_build_upper(f, n);
+        if (len > 0)
+            sim_put_upper(n->upper_img, len);
+    }
+    sim_step(f->tick_ms);
+    if (n->routed_out)
+    {
+        // skip the leading 4-byte iteration counter.
+        fleet_io_set(&n->lower[f->parity], vm_get_lower_memory(), vm_get_lower_memory_size(), 4);
+    }
+
+    unsigned int dt = get_cyclic_cycles() - t0;
+    n->stats.steps++;
+    n->stats.last_ns = dt;
+    if (dt > n->stats.max_ns)
+        n->stats.max_ns = dt;
+    n->stats.total_ns += dt;
+}
+
+static void fleet_pin(struct sim_fleet_worker* w)
+{
+    if (w->core < 0)
+        return;
+#ifdef _WIN32
+    if (w->core < (int)(sizeof(DWORD_PTR) * 8))
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << w->core);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+static void fleet_worker_loop(struct sim_fleet_worker* w)
+{
+    struct sim_fleet* f = w->fleet;
+    unsigned int seen = 0;
+    fleet_pin(w);
+    for (;;)
+    {
+        FLEET_LOCK(f);
+        while (f->generation == seen && !f->quit)
+            FLEET_WAIT(f, start_cv);
+        seen = f->generation;
+        int quit = f->quit;
+        FLEET_UNLOCK(f);
+        if (quit)
+            break;
+
+        for (int i = w->index; i < f->n_nodes; i += f->n_workers)
+            fleet_step_node(f, &f->nodes[i]);
+
+        FLEET_LOCK(f);
+        if (--f->pending == 0)
+            FLEET_SIGNAL(f, done_cv);
+        FLEET_UNLOCK(f);
+    }
+    sim_select(0);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI fleet_worker_main(LPVOID arg)
+{
+    fleet_worker_loop((struct sim_fleet_worker*)arg);
+    return 0;
+}
+#else
+static void* fleet_worker_main(void* arg)
+{
+    fleet_worker_loop((struct sim_fleet_worker*)arg);
+    return 0;
+}
+#endif
+
+// Starts a pool of `threads` workers (<=0: one per CPU); pin_cores != 0 binds
+// worker k to core k % cpus. Returns 0 on failure.
+SIM_EXPORT struct sim_fleet* sim_fleet_create(int threads, int pin_cores)
+{
+    int cpus = fleet_cpu_count();
+    if (threads <= 0)
+        threads = cpus;
+
+    struct sim_fleet* f = (struct sim_fleet*)calloc(1, sizeof(struct sim_fleet));
+    if (f == 0)
+        return 0;
+    f->workers = (struct sim_fleet_worker*)calloc(threads, sizeof(struct sim_fleet_worker));
+    if (f->workers == 0)
+    {
+        free(f);
+        return 0;
+    }
+#ifdef _WIN32
+    InitializeCriticalSection(&f->lock);
+    InitializeConditionVariable(&f->start_cv);
+    InitializeConditionVariable(&f->done_cv);
+#else
+    pthread_mutex_init(&f->lock, 0);
+    pthread_cond_init(&f->start_cv, 0);
+    pthread_cond_init(&f->done_cv, 0);
+#endif
+
+    for (int k = 0; k < threads; ++k)
+    {
+        struct sim_fleet_worker* w = &f->workers[k];
+        w->fleet = f;
+        w->index = k;
+        w->core = pin_cores ? k % cpus : -1;
+#ifdef _WIN32
+        w->thread = CreateThread(0, 0, fleet_worker_main, w, 0, 0);
+        if (w->thread == 0)
+            break;
+#else
+        if (pthread_create(&w->thread, 0, fleet_worker_main, w) != 0)
+            break;
+#endif
+        f->n_workers++;
+    }
+    if (f->n_workers == 0)
+    {
+        free(f->workers);
+        free(f);
+        return 0;
+    }
+    return f;
+}
+
+// Adds a loaded node (0: the default node); returns its fleet index, -1 on failure.
+// The fleet does not own the node: sim_destroy it after sim_fleet_destroy.
+SIM_EXPORT int sim_fleet_add(struct sim_fleet* f, struct sim_node* node)
+{
+    if (f == 0)
+        return -1;
+    struct sim_fleet_node* nodes = (struct sim_fleet_node*)fleet_grow(f->nodes, &f->nodes_cap, f->n_nodes + 1, sizeof(struct sim_fleet_node));
+    if (nodes == 0)
+        return -1;
+    f->nodes = nodes;
+    memset(&nodes[f->n_nodes], 0, sizeof(struct sim_fleet_node));
+    nodes[f->n_nodes].node = node;
+    return f->n_nodes++;
+}
+
+// Baseline UpperIO image for a node (the vm_put_upper_memory format); from now
+// on the node gets it, with routed fields replaced, before every step.
+SIM_EXPORT int sim_fleet_set_upper(struct sim_fleet* f, int index, uchar* buf, int len)
+{
+    if (f == 0 || index < 0 || index >= f->n_nodes || buf == 0 || len < 0)
+        return -1;
+    return fleet_io_set(&f->nodes[index].upper, buf, len, 0);
+}
+
+// Bus route: field `lower_field` of node `from`'s LowerIO (0-based, in the order
+// vm_get_lower_memory writes them) feeds field `upper_field` of node `to`'s UpperIO.
+SIM_EXPORT int sim_fleet_route(struct sim_fleet* f, int from, int lower_field, int to, int upper_field)
+{
+    if (f == 0 || from < 0 || from >= f->n_nodes || to < 0 || to >= f->n_nodes || lower_field < 0 || upper_field < 0)
+        return -1;
+    struct sim_fleet_node* dst = &f->nodes[to];
+    struct sim_fleet_route* routes = (struct sim_fleet_route*)realloc(dst->routes, (dst->n_routes + 1) * sizeof(struct sim_fleet_route));
+    if (routes == 0)
+        return -1;
+    dst->routes = routes;
+    routes[dst->n_routes++] = (struct sim_fleet_route){ upper_field, from, lower_field };
+    f->nodes[from].routed_out = 1;
+    return 0;
+}
+
+// One simulated tick: every node steps once at timestamp_ms, in parallel.
+SIM_EXPORT int sim_fleet_step(struct sim_fleet* f, unsigned int timestamp_ms)
+{
+    if (f == 0)
+        return -1;
+    f->tick_ms = timestamp_ms;
+    FLEET_LOCK(f);
+    f->pending = f->n_workers;
+    f->generation++;
+    FLEET_BROADCAST(f, start_cv);
+    while (f->pending > 0)
+        FLEET_WAIT(f, done_cv);
+    FLEET_UNLOCK(f);
+    f->parity ^= 1;
+    return 0;
+}
+
+// `ticks` ticks back to back (no real-time pacing), tick_ms of simulated time apart.
+SIM_EXPORT int sim_fleet_run(struct sim_fleet* f, unsigned int ticks, unsigned int tick_ms)
+{
+    if (f == 0)
+        return -1;
+    for (unsigned int i = 0; i < ticks; ++i)
+        sim_fleet_step(f, f->tick_ms + tick_ms);
+    return 0;
+}
+
+// Per-node cycle times in host nanoseconds (see struct sim_fleet_node_stats).
+SIM_EXPORT int sim_fleet_get_stats(struct sim_fleet* f, int index, struct sim_fleet_node_stats* out)
+{
+    if (f == 0 || index < 0 || index >= f->n_nodes || out == 0)
+        return -1;
+    *out = f->nodes[index].stats;
+    return 0;
+}
+
+SIM_EXPORT void sim_fleet_destroy(struct sim_fleet* f)
+{
+    if (f == 0)
+        return;
+    FLEET_LOCK(f);
+    f->quit = 1;
+    FLEET_BROADCAST(f, start_cv);
+    FLEET_UNLOCK(f);
+    for (int k = 0; k < f->n_workers; ++k)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(f->workers[k].thread, INFINITE);
+        CloseHandle(f->workers[k].thread);
+#else
+        pthread_join(f->workers[k].thread, 0);
+#endif
+    }
+#ifdef _WIN32
+    DeleteCriticalSection(&f->lock);
+#else
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->start_cv);
+    pthread_cond_destroy(&f->done_cv);
+#endif
+    for (int i = 0; i < f->n_nodes; ++i)
+    {
+        struct sim_fleet_node* n = &f->nodes[i];
+        fleet_io_free(&n->lower[0]);
+        fleet_io_free(&n->lower[1]);
+        fleet_io_free(&n->upper);
+        free(n->upper_img);
+        free(n->routes);
+    }
+    free(f->nodes);
+    free(f->workers);
+    free(f);
+}
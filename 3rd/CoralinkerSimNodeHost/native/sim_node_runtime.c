@@ -2,33 +2,53 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
-#define inline
-#include "mcu_runtime.h"
-#undef inline
+#include "sim_node_runtime.h"
 
-#ifdef _WIN32
-#define SIM_EXPORT __declspec(dllexport)
+// One simulated node: a VM context plus its host-side state. The sim_* exports
+// act on the calling thread's current node (sim_select), which starts out as the
+// built-in default node, so a single-node host never has to create one.
+struct sim_node
+{
+    struct vm_context* vm; // 0: the runtime's default context
+    SimBytesCb lower_cb;
+    SimTextCb console_cb;
+    SimBytesCb snapshot_cb;
+    SimPortBytesCb stream_cb;
+    SimPortBytesCb event_cb;
+    SimFatalCb fatal_cb;
+    uchar* vm_memory;
+    int vm_memory_size;
+    unsigned int tick_ms;
+    uchar snapshot_input[256];
+    int snapshot_input_size;
+};
+
+#if defined(_MSC_VER)
+#define SIM_TLS __declspec(thread)
 #else
-#define SIM_EXPORT __attribute__((visibility("default")))
+#define SIM_TLS __thread
 #endif
 
-typedef void(*SimBytesCb)(unsigned char* data, int length, unsigned int timestamp_ms);
-typedef void(*SimTextCb)(unsigned char* message, unsigned int timestamp_ms);
-typedef void(*SimPortBytesCb)(unsigned char port_index, unsigned char direction, unsigned char* data, int length, unsigned int timestamp_ms);
-typedef void(*SimFatalCb)(int il_offset, unsigned char* message, int line_no, unsigned int timestamp_ms);
-
-static SimBytesCb sim_lower_cb = 0;
-static SimTextCb sim_console_cb = 0;
-static SimBytesCb sim_snapshot_cb = 0;
-static SimPortBytesCb sim_stream_cb = 0;
-static SimPortBytesCb sim_event_cb = 0;
-static SimFatalCb sim_fatal_cb = 0;
-static uchar* sim_vm_memory = 0;
-static int sim_vm_memory_size = 0;
-static unsigned int sim_tick_ms = 0;
-static uchar sim_snapshot_input[256] = { 0 };
-static int sim_snapshot_input_size = 4;
+static struct sim_node sim_default_node = { .snapshot_input_size = 4 };
+static SIM_TLS struct sim_node* sim_cur = &sim_default_node;
+
+#define sim_lower_cb (sim_cur->lower_cb)
+#define sim_console_cb (sim_cur->console_cb)
+#define sim_snapshot_cb (sim_cur->snapshot_cb)
+#define sim_stream_cb (sim_cur->stream_cb)
+#define sim_event_cb (sim_cur->event_cb)
+#define sim_fatal_cb (sim_cur->fatal_cb)
+#define sim_vm_memory (sim_cur->vm_memory)
+#define sim_vm_memory_size (sim_cur->vm_memory_size)
+#define sim_tick_ms (sim_cur->tick_ms)
+#define sim_snapshot_input (sim_cur->snapshot_input)
+#define sim_snapshot_input_size (sim_cur->snapshot_input_size)
 
 void write_snapshot(uchar* buffer, int size)
 {
@@ -82,6 +102,23 @@ int get_cyclic_millis() { return (int)sim_tick_ms; }
 int get_cyclic_micros() { return (int)(sim_tick_ms * 1000); }
 int get_cyclic_seconds() { return (int)(sim_tick_ms / 1000); }
 
+// Host monotonic clock in nanoseconds (the simulated clock above does not advance
+// inside a step), so GC telemetry reports real cost at 1 tick = 1 ns.
+unsigned int get_cyclic_cycles()
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    unsigned long long q = (unsigned long long)now.QuadPart, f = (unsigned long long)freq.QuadPart;
+    return (unsigned int)(q / f * 1000000000ull + q % f * 1000000000ull / f);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned int)((unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec);
+#endif
+}
+
 SIM_EXPORT void sim_set_callbacks(
     SimBytesCb lower_cb,
     SimTextCb console_cb,
@@ -126,6 +163,13 @@ SIM_EXPORT int sim_load_program(uchar* bin, int len, int memory_size)
     return vm_set_program(sim_vm_memory, sim_vm_memory_size);
 }
 
+// Runtime table sizes for the next sim_load_program (0: default, see struct vm_config).
+SIM_EXPORT void sim_set_config(int heap_objs, int stack_depth, int io_buf_size, int io_slots)
+{
+    struct vm_config config = { heap_objs, stack_depth, io_buf_size, io_slots, 0 };
+    vm_set_config(&config);
+}
+
 SIM_EXPORT int sim_put_upper(uchar* buf, int len)
 {
     if (buf == 0 || len < 0)
@@ -159,12 +203,96 @@ SIM_EXPORT int sim_step(unsigned int timestamp_ms)
     return 0;
 }
 
-SIM_EXPORT void sim_destroy()
+// Runs `steps` scan cycles back to back (no scan-interval pacing) so hosts can
+// compare dispatch engines on the same program. Returns the number of IL
+// instructions executed; the caller times the call.
+SIM_EXPORT int sim_bench(unsigned int steps)
 {
-    if (sim_vm_memory != 0)
+    int il_start = vm_get_il_count();
+    for (unsigned int i = 0; i < steps; ++i)
     {
-        free(sim_vm_memory);
-        sim_vm_memory = 0;
-        sim_vm_memory_size = 0;
+        sim_tick_ms += 1;
+        vm_put_snapshot_buffer(sim_snapshot_input, sim_snapshot_input_size);
+        vm_run((int)sim_tick_ms);
+    }
+    return vm_get_il_count() - il_start;
+}
+
+SIM_EXPORT int sim_get_dispatch_mode()
+{
+    return vm_get_dispatch_mode();
+}
+
+// GC mark-phase benchmark on the loaded program's heap: shape 0 deep chain,
+// 1 wide fan-out, 2 binary tree. Returns total nanoseconds over `rounds`, or
+// -1 when the graph does not fit into the VM memory / object table.
+SIM_EXPORT long long sim_bench_mark(int shape, int objects, int rounds)
+{
+    return vm_bench_mark(shape, objects, rounds);
+}
+
+SIM_EXPORT void sim_set_gc_config(int full_every, int promote_age)
+{
+    vm_set_gc_config(full_every, promote_age);
+}
+
+// GC telemetry of the last step: nanoseconds spent collecting, and 1 if it was a full collection.
+SIM_EXPORT unsigned int sim_get_gc_nanos()
+{
+    return vm_get_gc_cycles();
+}
+
+SIM_EXPORT int sim_get_gc_last_full()
+{
+    return vm_get_gc_last_full();
+}
+
+// Steps since load that allocated nothing and skipped collection.
+SIM_EXPORT int sim_get_gc_free_cycles()
+{
+    return vm_get_gc_skip_count();
+}
+
+// Creates an extra node with its own VM context; select it with sim_select
+// before calling the other exports for it. Returns 0 when out of memory.
+SIM_EXPORT struct sim_node* sim_create()
+{
+    struct sim_node* node = (struct sim_node*)calloc(1, sizeof(struct sim_node));
+    if (node == 0)
+        return 0;
+    node->vm = vm_context_create();
+    if (node->vm == 0)
+    {
+        free(node);
+        return 0;
+    }
+    node->snapshot_input_size = 4;
+    return node;
+}
+
+// Makes `node` current for the calling thread (0: the default node). Nodes can
+// step on different threads at the same time, but one node on one thread at a time.
+SIM_EXPORT void sim_select(struct sim_node* node)
+{
+    sim_cur = node != 0 ? node : &sim_default_node;
+    vm_select_context(sim_cur->vm);
+}
+
+// Frees a node's VM memory; created nodes are released entirely (0: the default
+// node, which only drops its memory and stays usable).
+SIM_EXPORT void sim_destroy(struct sim_node* node)
+{
+    struct sim_node* target = node != 0 ? node : &sim_default_node;
+    if (target->vm_memory != 0)
+    {
+        free(target->vm_memory);
+        target->vm_memory = 0;
+        target->vm_memory_size = 0;
     }
+    if (target == &sim_default_node)
+        return;
+    if (sim_cur == target)
+        sim_select(0);
+    vm_context_destroy(target->vm);
+    free(target);
 }
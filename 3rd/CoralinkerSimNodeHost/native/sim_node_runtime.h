@@ -0,0 +1,24 @@
+#pragma once
+
+#define inline
+#include "mcu_runtime.h"
+#undef inline
+
+#ifdef _WIN32
+#define SIM_EXPORT __declspec(dllexport)
+#else
+#define SIM_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef void(*SimBytesCb)(unsigned char* data, int length, unsigned int timestamp_ms);
+typedef void(*SimTextCb)(unsigned char* message, unsigned int timestamp_ms);
+typedef void(*SimPortBytesCb)(unsigned char port_index, unsigned char direction, unsigned char* data, int length, unsigned int timestamp_ms);
+typedef void(*SimFatalCb)(int il_offset, unsigned char* message, int line_no, unsigned int timestamp_ms);
+
+// Node exports used by sim_fleet.c (see sim_node_runtime.c).
+struct sim_node;
+SIM_EXPORT struct sim_node* sim_create();
+SIM_EXPORT void sim_select(struct sim_node* node);
+SIM_EXPORT void sim_destroy(struct sim_node* node);
+SIM_EXPORT int sim_put_upper(uchar* buf, int len);
+SIM_EXPORT int sim_step(unsigned int timestamp_ms);
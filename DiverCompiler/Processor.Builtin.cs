@@ -205,6 +205,14 @@ internal partial class Processor
         ("System.Runtime.CompilerServices.DefaultInterpolatedStringHandler.AppendFormatted(T)", 0),      //170
         ("System.Runtime.CompilerServices.DefaultInterpolatedStringHandler.AppendFormatted(T, String)", 0),      //171
         ("System.Runtime.CompilerServices.DefaultInterpolatedStringHandler.ToStringAndClear()", 0),      //172
+
+        // RunOnMCU, later additions
+        ("CartActivator.RunOnMCU.ReadEvents(Int32, Int32)", 0),      //173
+        ("CartActivator.RunOnMCU.ReadDigital(Int32)", 0),      //174
+        ("CartActivator.RunOnMCU.ReadAnalog(Int32)", 0),      //175
+        ("CartActivator.RunOnMCU.ReadAnalogFloat(Int32)", 0),      //176
+        ("CartActivator.RunOnMCU.WriteSnapshot(Byte[], Int32)", 0),      //177
+        ("CartActivator.RunOnMCU.WriteDigital(Int32, Boolean)", 0),      //178
     ];
 
 }
@@ -0,0 +1,64 @@
+using System;
+using System.Linq;
+using Mono.Cecil;
+using Mono.Cecil.Cil;
+
+namespace MCURoutineCompiler;
+
+// Compiler checks that need no weaving run: `DiverCompiler.exe -t`.
+internal partial class Processor
+{
+    internal static bool RunSelfTests(Action<string> log)
+    {
+        var ok = true;
+        foreach (var (name, test) in new (string, Func<string>)[]
+                 {
+                     ("ldarg.ldfld carries the linked field operand", TestFusedLdfldLinking),
+                 })
+        {
+            var error = test();
+            log(error == null ? $"PASS {name}" : $"FAIL {name}: {error}");
+            ok &= error == null;
+        }
+        return ok;
+    }
+
+    // Fusion runs per method, field offsets and class ids are patched into the
+    // ldfld bytes at linking; the fused 0xCD must end up with the linked values.
+    static string TestFusedLdfldLinking()
+    {
+        var module = ModuleDefinition.CreateModule("SelfTest", ModuleKind.Dll);
+        var owner = new TypeDefinition("SelfTest", "Node", TypeAttributes.Public, module.TypeSystem.Object);
+        var field = new FieldDefinition("value", FieldAttributes.Public, module.TypeSystem.Int32);
+        owner.Fields.Add(field);
+        module.Types.Add(owner);
+        var method = new MethodDefinition("Get", MethodAttributes.Public, module.TypeSystem.Int32);
+        owner.Methods.Add(method);
+        var il = method.Body.GetILProcessor();
+        il.Emit(OpCodes.Ldarg_1);
+        il.Emit(OpCodes.Ldfld, field);
+        il.Emit(OpCodes.Ret);
+
+        var p = new Processor();
+        byte[] ldarg = [0x02, 0x05, 0x00];
+        byte[] ldfld = [0x7B, 0x00, 0, 0, 0, 0]; // instanced field, operand filled at linking
+        p.SI.linking_actions.Add(() =>
+        {
+            ldfld[2] = 0x24; ldfld[3] = 0x01; // offset 0x124
+            ldfld[4] = 0x03; ldfld[5] = 0x00; // classid 3
+        });
+        p.myBuffer = [(ldarg, 0), (ldfld, 3), ([0x2A], 9)];
+
+        if (p.FuseSuperinstructions(method) == null) return "ldarg; ldfld was not fused";
+        foreach (var la in p.SI.linking_actions)
+            la();
+
+        byte[] expect = [0xCD, 0x05, 0x00, 0x00, 0x24, 0x01, 0x03, 0x00];
+        var got = p.myBuffer[0].bytes;
+        if (!got.SequenceEqual(expect))
+            return $"got {BitConverter.ToString(got)}, expected {BitConverter.ToString(expect)}";
+        if (p.myBuffer[1].bytes.Length != 0 || p.myBuffer[2].offset != expect.Length)
+            return "absorbed ldfld not emptied or offsets not recomputed";
+        return null;
+    }
+}
@@ -65,6 +65,7 @@ internal partial class Processor
         public ResultDLL dll;
         public MethodDefinition md;
         public string ret_name;
+        public string fusionReport; // superinstructions fused in this method, null if none.
         public byte[] retBytes;
 
         public CCoder ccoder;
@@ -122,9 +123,10 @@ internal partial class Processor
     public static uint MakeAbiVersion(int x, int y, int z) =>
         ((uint)(x & 0xFF) << 16) | ((uint)(y & 0xFF) << 8) | (uint)(z & 0xFF);
 
-    // Current ABI version emitted by this compiler. 2.0.0 (layout change:
-    // magic/version prefix + cctor table + static constructor execution).
-    public static readonly uint DiverAbiVersion = MakeAbiVersion(2, 0, 0);
+    // Current ABI version emitted by this compiler. 2.3.0 (additive: typed
+    // i4/r4 opcodes, see InferStackKinds; superinstructions, see FuseSuperinstructions;
+    // event/snapshot builtins 173-178, see Processor.Builtin.cs).
+    public static readonly uint DiverAbiVersion = MakeAbiVersion(2, 3, 0);
 
     private bool isRoot = false;
     public Processor()
@@ -1068,6 +1070,7 @@ internal partial class Processor
         //     bmw.WriteWarning(fname+">"+ instruction.ToString()); 
 
         AnalyzeMethod(method);
+        InferStackKinds(method);
 
         // foreach (var instruction in method.Body.Instructions)
         //     bmw.WriteWarning($"{fname}> s_{stackStates[instruction]} for {instruction}");
@@ -1108,6 +1111,8 @@ internal partial class Processor
             ++i;
         }
 
+        if (EnableSuperinstructions && (ret.fusionReport = FuseSuperinstructions(method)) != null)
+            bmw.WriteWarning($"** Fused {fname}: {ret.fusionReport}");
            
         foreach (var pp in postProcessor) 
             pp(); 
@@ -1773,6 +1778,8 @@ internal partial class Processor
                 {
                     var m = all_methods[j];
                     diver.AppendLine($"=== Method `{m.name}` ===");
+                    if (m.fusionReport != null)
+                        diver.AppendLine($"// fused: {m.fusionReport}");
 
                     var ilList = m.md.Body.Instructions;
                     for (int k = 0; k < ilList.Count; k++)
@@ -2121,52 +2128,52 @@ internal partial class Processor
             case Code.Beq: 
             case Code.Beq_S:
                 cc.Append(me => $"if (({me[0]})==({me[1]})) {genGoto()}",2); 
-                return gen_bcodes(0x2A);
+                return gen_bcodes(TypedOr(instruction, 0x2A, 0xB0, 0xBA));
 
             case Code.Bge:
             case Code.Bge_S:
                 cc.Append(me => $"if (({me[0]})>=({me[1]})) {genGoto()}", 2); 
-                return gen_bcodes(0x2B);
+                return gen_bcodes(TypedOr(instruction, 0x2B, 0xB1, 0xBB));
 
             case Code.Bgt:
             case Code.Bgt_S:
                 cc.Append(me => $"if (({me[0]})>({me[1]})) {genGoto()}", 2); 
-                return gen_bcodes(0x2C);
+                return gen_bcodes(TypedOr(instruction, 0x2C, 0xB2, 0xBC));
 
             case Code.Ble:
             case Code.Ble_S:
                 cc.Append(me => $"if (({me[0]})<=({me[1]})) {genGoto()}", 2);
-                return gen_bcodes(0x2D);
+                return gen_bcodes(TypedOr(instruction, 0x2D, 0xB3, 0xBD));
 
             case Code.Blt:
             case Code.Blt_S:
                 cc.Append(me => $"if (({me[0]})<({me[1]})) {genGoto()}", 2);
-                return gen_bcodes(0x2E);
+                return gen_bcodes(TypedOr(instruction, 0x2E, 0xB4, 0xBE));
 
             case Code.Bne_Un:
             case Code.Bne_Un_S:
                 cc.Append(me => $"if ((unsigned char)({me[0]})!=(unsigned char)({me[1]})) {genGoto()}", 2);
-                return gen_bcodes(0x2F);
+                return gen_bcodes(TypedOr(instruction, 0x2F, 0xB5, 0xBF));
 
             case Code.Bge_Un:
             case Code.Bge_Un_S:
                 cc.Append(me => $"if ((unsigned char)({me[0]})>=(unsigned char)({me[1]})) {genGoto()}", 2);
-                return gen_bcodes(0x30);
+                return gen_bcodes(TypedOr(instruction, 0x30, 0xB6, 0x00));
 
             case Code.Bgt_Un:
             case Code.Bgt_Un_S:
                 cc.Append(me => $"if ((unsigned char)({me[0]})>(unsigned char)({me[1]})) {genGoto()}", 2); 
-                return gen_bcodes(0x31);
+                return gen_bcodes(TypedOr(instruction, 0x31, 0xB7, 0x00));
 
             case Code.Ble_Un:
             case Code.Ble_Un_S:
                 cc.Append(me => $"if ((unsigned char)({me[0]})<=(unsigned char)({me[1]})) {genGoto()}", 2); 
-                return gen_bcodes(0x32);
+                return gen_bcodes(TypedOr(instruction, 0x32, 0xB8, 0x00));
 
             case Code.Blt_Un:
             case Code.Blt_Un_S:
                 cc.Append(me => $"if ((unsigned char)({me[0]})<(unsigned char)({me[1]})) {genGoto()}", 2); 
-                return gen_bcodes(0x33);
+                return gen_bcodes(TypedOr(instruction, 0x33, 0xB9, 0x00));
 
             case Code.Ldind_I1:
                 cc.Append(me => $"*(char*)({me[0]})", 1, "i1");
@@ -2215,43 +2222,43 @@ internal partial class Processor
                  
             case Code.Add:
                 cc.Append(me => $"({me[0]})+({me[1]})", 2, "_stack0");
-                return [0x4D, 0x60];
+                return TypedArith(instruction, 0x60);
             case Code.Sub:
                 cc.Append(me => $"({me[0]})-({me[1]})", 2, "_stack0");
-                return [0x4D, 0x61];
+                return TypedArith(instruction, 0x61);
             case Code.Mul:
                 cc.Append(me => $"({me[0]})*({me[1]})", 2, "_stack0");
-                return [0x4D, 0x62];
+                return TypedArith(instruction, 0x62);
             case Code.Div:
                 cc.Append(me => $"({me[0]})/({me[1]})", 2, "_stack0");
-                return [0x4D, 0x63];
+                return TypedArith(instruction, 0x63);
             case Code.Div_Un:
                 cc.Append(me => $"({me[0]})/({me[1]})", 2, "_stack0");
-                return [0x4D, 0x64];
+                return TypedArith(instruction, 0x64);
             case Code.Rem:
                 cc.Append(me => $"({me[0]})%({me[1]})", 2, "_stack0");
-                return [0x4D, 0x65]; 
+                return TypedArith(instruction, 0x65); 
             case Code.Rem_Un:
                 cc.Append(me => $"({me[0]})%({me[1]})", 2, "_stack0");
-                return [0x4D, 0x66];
+                return TypedArith(instruction, 0x66);
             case Code.And:
                 cc.Append(me => $"({me[0]})&({me[1]})", 2, "_stack0");
-                return [0x4D, 0x67];
+                return TypedArith(instruction, 0x67);
             case Code.Or:
                 cc.Append(me => $"({me[0]})|({me[1]})", 2, "_stack0");
-                return [0x4D, 0x68];
+                return TypedArith(instruction, 0x68);
             case Code.Xor:
                 cc.Append(me => $"({me[0]})^({me[1]})", 2, "_stack0");
-                return [0x4D, 0x69];
+                return TypedArith(instruction, 0x69);
             case Code.Shl:
                 cc.Append(me => $"({me[0]})<<({me[1]})", 2, "_stack0");
-                return [0x4D, 0x6A];
+                return TypedArith(instruction, 0x6A);
             case Code.Shr:
                 cc.Append(me => $"({me[0]})>>({me[1]})", 2, "_stack0");
-                return [0x4D, 0x6B];
+                return TypedArith(instruction, 0x6B);
             case Code.Shr_Un:
                 cc.Append(me => $"({me[0]})>>({me[1]})", 2, "_stack0");
-                return [0x4D, 0x6C];
+                return TypedArith(instruction, 0x6C);
             
             
             case Code.Neg:
@@ -2639,19 +2646,19 @@ internal partial class Processor
 
             case Code.Ceq:
                 cc.Append(me => $"({me[0]})==({me[1]})", 2, "i4");
-                return [0xE2];
+                return [TypedOr(instruction, 0xE2, 0xC2, 0xD2)];
             case Code.Cgt:
                 cc.Append(me => $"({me[0]})>({me[1]})", 2, "i4");
-                return [0xE3]; 
+                return [TypedOr(instruction, 0xE3, 0xC3, 0xD3)]; 
             case Code.Cgt_Un:
                 cc.Append(me => $"({me[0]})>({me[1]})", 2, "i4");
-                return [0xE4];
+                return [TypedOr(instruction, 0xE4, 0xC4, 0x00)];
             case Code.Clt:
                 cc.Append(me => $"({me[0]})<({me[1]})", 2, "i4");
-                return [0xE5];
+                return [TypedOr(instruction, 0xE5, 0xC5, 0xD5)];
             case Code.Clt_Un:
                 cc.Append(me => $"({me[0]})<({me[1]})", 2, "i4");
-                return [0xE6];
+                return [TypedOr(instruction, 0xE6, 0xC6, 0x00)];
 
             case Code.Ldtoken:
             { 
@@ -3127,6 +3134,339 @@ internal partial class Processor
         }
     }
 
+    // ---- superinstruction fusion (ABI 2.2) ----
+    // Peephole over the per-IL bytecode of one method, run after the typed
+    // opcodes are chosen. The sequences were picked by frequency in compiled
+    // logic (DiverTest/TestLogic2.diver: ldarg.ldfld, stloc.ldloc, ldloc/ldc
+    // feeding a loop branch or an arith with a constant). The fused bytes sit on
+    // the first IL instruction and absorbed ones keep an empty entry, so buffer
+    // stays 1:1 with IL (the .diver listing relies on it). Nothing is fused
+    // across a branch target.
+    public static bool EnableSuperinstructions = true;
+
+    static bool IsTypedI4Arith(byte op) => op >= 0x80 && op <= 0x8C;
+    static bool IsTypedR4Arith(byte op) => op >= 0x92 && op <= 0x95;
+    static bool IsTypedI4Branch(byte op) => op >= 0xB0 && op <= 0xB9;
+
+    // returns the per-method fusion report, e.g. "ldarg.ldfld x3, stloc.ldloc x2 (-7 dispatches)".
+    string FuseSuperinstructions(MethodDefinition method)
+    {
+        var instructions = method.Body.Instructions;
+        var targets = new HashSet<Instruction>();
+        foreach (var instruction in instructions)
+        {
+            if (instruction.Operand is Instruction target) targets.Add(target);
+            else if (instruction.Operand is Instruction[] switchTargets) targets.UnionWith(switchTargets);
+        }
+        foreach (var eh in method.Body.ExceptionHandlers)
+        {
+            targets.Add(eh.TryStart);
+            targets.Add(eh.HandlerStart);
+            if (eh.FilterStart != null) targets.Add(eh.FilterStart);
+        }
+
+        var fired = new Dictionary<string, int>();
+        var saved = 0;
+
+        byte[] B(int k) => myBuffer[k].bytes;
+        // instructions k..k+n-1 exist and only k may be jumped to.
+        bool Fusable(int k, int n)
+        {
+            if (k + n > myBuffer.Count) return false;
+            for (int j = k + 1; j < k + n; ++j)
+                if (targets.Contains(instructions[j])) return false;
+            return true;
+        }
+        bool Ldloc(int k) => B(k).Length == 3 && B(k)[0] == 0x06;
+        bool Stloc(int k) => B(k).Length == 4 && B(k)[0] == 0x0A;
+        bool Ldc(int k, int typeid) => B(k).Length == 6 && B(k)[0] == 0x15 && B(k)[1] == typeid;
+        bool OneByte(int k, Func<byte, bool> pred) => B(k).Length == 1 && pred(B(k)[0]);
+        void Fuse(int k, int n, string name, byte[] bytes)
+        {
+            myBuffer[k] = (bytes, 0);
+            for (int j = k + 1; j < k + n; ++j)
+                myBuffer[j] = ([], 0);
+            fired[name] = fired.GetValueOrDefault(name) + 1;
+            saved += n - 1;
+        }
+
+        for (int k = 0; k < myBuffer.Count; ++k)
+        {
+            // ldloc a; ldc k; typed arith; stloc b  (b holds the same kind)
+            if (Fusable(k, 4) && Ldloc(k) && Stloc(k + 3) &&
+                (Ldc(k + 1, tMap.vInt32.typeid) && OneByte(k + 2, IsTypedI4Arith) &&
+                 (B(k + 3)[1] == tMap.vInt32.typeid || B(k + 3)[1] == tMap.vUInt32.typeid) ||
+                 Ldc(k + 1, tMap.vSingle.typeid) && OneByte(k + 2, IsTypedR4Arith) && B(k + 3)[1] == tMap.vSingle.typeid))
+            {
+                Fuse(k, 4, "ldloc.ldc.arith.stloc",
+                    [0xCB, B(k + 2)[0], B(k)[1], B(k)[2], .. B(k + 1)[2..6], B(k + 3)[2], B(k + 3)[3]]);
+                k += 3;
+            }
+            // ldloc a; ldloc b; i4 branch
+            else if (Fusable(k, 3) && Ldloc(k) && Ldloc(k + 1) && B(k + 2).Length == 3 && IsTypedI4Branch(B(k + 2)[0]))
+            {
+                var br = B(k + 2);
+                byte[] fused = [0xC8, br[0], B(k)[1], B(k)[2], B(k + 1)[1], B(k + 1)[2], 0, 0];
+                postProcessor.Add(() => { fused[6] = br[1]; fused[7] = br[2]; }); // after br is patched.
+                Fuse(k, 3, "ldloc.ldloc.br", fused);
+                k += 2;
+            }
+            // ldloc a; ldc.i4 k; i4 branch
+            else if (Fusable(k, 3) && Ldloc(k) && Ldc(k + 1, tMap.vInt32.typeid) && B(k + 2).Length == 3 && IsTypedI4Branch(B(k + 2)[0]))
+            {
+                var br = B(k + 2);
+                byte[] fused = [0xC9, br[0], B(k)[1], B(k)[2], .. B(k + 1)[2..6], 0, 0];
+                postProcessor.Add(() => { fused[8] = br[1]; fused[9] = br[2]; });
+                Fuse(k, 3, "ldloc.ldc.br", fused);
+                k += 2;
+            }
+            // ldc k; typed arith
+            else if (Fusable(k, 2) &&
+                     (Ldc(k, tMap.vInt32.typeid) && OneByte(k + 1, IsTypedI4Arith) ||
+                      Ldc(k, tMap.vSingle.typeid) && OneByte(k + 1, IsTypedR4Arith)))
+            {
+                Fuse(k, 2, "ldc.arith", [0xCA, B(k + 1)[0], .. B(k)[2..6]]);
+                k += 1;
+            }
+            // stloc x; ldloc x
+            else if (Fusable(k, 2) && Stloc(k) && Ldloc(k + 1) && B(k)[2] == B(k + 1)[1] && B(k)[3] == B(k + 1)[2])
+            {
+                Fuse(k, 2, "stloc.ldloc", [0xCC, .. B(k)[1..4]]);
+                k += 1;
+            }
+            // ldarg; ldfld/ldsfld
+            else if (Fusable(k, 2) && B(k).Length == 3 && B(k)[0] == 0x02 && B(k + 1).Length == 6 && B(k + 1)[0] == 0x7B)
+            {
+                var fld = B(k + 1);
+                byte[] fused = [0xCD, B(k)[1], B(k)[2], fld[1], 0, 0, 0, 0];
+                // offset and classid/io id are only known at linking; this runs after the ldfld's own patches.
+                SI.linking_actions.Add(() => Array.Copy(fld, 2, fused, 4, 4));
+                Fuse(k, 2, "ldarg.ldfld", fused);
+                k += 1;
+            }
+        }
+
+        var boffset = 0;
+        for (int k = 0; k < myBuffer.Count; ++k)
+        {
+            myBuffer[k] = (myBuffer[k].bytes, boffset);
+            boffset += myBuffer[k].bytes.Length;
+        }
+
+        if (fired.Count == 0) return null;
+        return $"{string.Join(", ", fired.Select(kv => $"{kv.Key} x{kv.Value}"))} (-{saved} dispatches)";
+    }
+
+    // ---- operand kind inference for type-specialized opcodes (ABI 2.1) ----
+    // Kinds of the evaluation stack (bottom..top) on entry to each instruction.
+    // I4: the runtime slot is Int32/UInt32, R4: Single. Kinds are merged at join
+    // points and any disagreement degrades to Unknown, so a typed opcode is only
+    // emitted when every path into the instruction agrees on both operands.
+    enum StackKind : byte { Unknown, I4, R4 }
+
+    Dictionary<Instruction, StackKind[]> stackKinds = new();
+
+    static StackKind KindOf(int typeid)
+    {
+        if (typeid == tMap.vInt32.typeid || typeid == tMap.vUInt32.typeid) return StackKind.I4;
+        if (typeid == tMap.vSingle.typeid) return StackKind.R4;
+        return StackKind.Unknown;
+    }
+
+    public void InferStackKinds(MethodDefinition method)
+    {
+        var instructions = method.Body.Instructions;
+        if (instructions.Count == 0) return;
+
+        var workQueue = new Queue<Instruction>();
+        stackKinds[instructions[0]] = [];
+        workQueue.Enqueue(instructions[0]);
+
+        try
+        {
+            while (workQueue.Count > 0)
+            {
+                var instruction = workQueue.Dequeue();
+                var stack = new List<StackKind>(stackKinds[instruction]);
+                StepStackKinds(instruction, stack);
+
+                var next = instruction.Next;
+                switch (instruction.OpCode.FlowControl)
+                {
+                    case FlowControl.Return:
+                    case FlowControl.Throw:
+                        break;
+                    case FlowControl.Branch:
+                        MergeStackKinds((Instruction)instruction.Operand, stack, workQueue);
+                        break;
+                    case FlowControl.Cond_Branch:
+                        if (instruction.Operand is Instruction[] targets) // switch
+                            foreach (var target in targets)
+                                MergeStackKinds(target, stack, workQueue);
+                        else
+                            MergeStackKinds((Instruction)instruction.Operand, stack, workQueue);
+                        if (next != null) MergeStackKinds(next, stack, workQueue);
+                        break;
+                    default:
+                        if (next != null) MergeStackKinds(next, stack, workQueue);
+                        break;
+                }
+            }
+        }
+        catch (Exception ex) when (ex is NotImplementedException or InvalidOperationException or ArgumentOutOfRangeException)
+        {
+            // stack shape we don't model (AnalyzeMethod stops early on C errors): stay generic.
+            stackKinds.Clear();
+        }
+    }
+
+    void MergeStackKinds(Instruction target, List<StackKind> stack, Queue<Instruction> workQueue)
+    {
+        if (!stackKinds.TryGetValue(target, out var known))
+        {
+            stackKinds[target] = stack.ToArray();
+            workQueue.Enqueue(target);
+            return;
+        }
+        if (known.Length != stack.Count)
+            throw new InvalidOperationException($"Inconsistent stack depth at instruction {target}");
+
+        var changed = false;
+        for (int i = 0; i < known.Length; ++i)
+        {
+            if (known[i] == StackKind.Unknown || known[i] == stack[i]) continue;
+            known[i] = StackKind.Unknown;
+            changed = true;
+        }
+        if (changed) workQueue.Enqueue(target);
+    }
+
+    void StepStackKinds(Instruction instruction, List<StackKind> stack)
+    {
+        StackKind Pop()
+        {
+            var k = stack[^1];
+            stack.RemoveAt(stack.Count - 1);
+            return k;
+        }
+        StackKind FieldKind() =>
+            tMapDict.TryGetValue(((FieldReference)instruction.Operand).FieldType.Name, out var typing)
+                ? KindOf(typing.typeid)
+                : StackKind.Unknown;
+
+        switch (instruction.OpCode.Code)
+        {
+            case Code.Ldc_I4_M1: case Code.Ldc_I4_0: case Code.Ldc_I4_1: case Code.Ldc_I4_2:
+            case Code.Ldc_I4_3: case Code.Ldc_I4_4: case Code.Ldc_I4_5: case Code.Ldc_I4_6:
+            case Code.Ldc_I4_7: case Code.Ldc_I4_8: case Code.Ldc_I4_S: case Code.Ldc_I4:
+                stack.Add(StackKind.I4);
+                return;
+            case Code.Ldc_R4:
+            case Code.Ldc_R8:
+                stack.Add(StackKind.R4);
+                return;
+
+            // arg/var slots always hold their declared typeid (copy_val converts on store).
+            case Code.Ldarg_0: stack.Add(KindOf(args[0].typeID)); return;
+            case Code.Ldarg_1: stack.Add(KindOf(args[1].typeID)); return;
+            case Code.Ldarg_2: stack.Add(KindOf(args[2].typeID)); return;
+            case Code.Ldarg_3: stack.Add(KindOf(args[3].typeID)); return;
+            case Code.Ldarg:
+            case Code.Ldarg_S:
+                stack.Add(KindOf(args[((ParameterDefinition)instruction.Operand).Sequence].typeID));
+                return;
+            case Code.Ldloc_0: stack.Add(KindOf(vars[0].typeID)); return;
+            case Code.Ldloc_1: stack.Add(KindOf(vars[1].typeID)); return;
+            case Code.Ldloc_2: stack.Add(KindOf(vars[2].typeID)); return;
+            case Code.Ldloc_3: stack.Add(KindOf(vars[3].typeID)); return;
+            case Code.Ldloc:
+            case Code.Ldloc_S:
+                stack.Add(KindOf(vars[((VariableDefinition)instruction.Operand).Index].typeID));
+                return;
+
+            case Code.Ldfld:
+                Pop();
+                stack.Add(FieldKind());
+                return;
+            case Code.Ldsfld:
+                stack.Add(FieldKind());
+                return;
+
+            // 0x4D: int op int => Int32, float op float => Single (add/sub/mul/div only).
+            case Code.Add: case Code.Sub: case Code.Mul: case Code.Div:
+            {
+                var b = Pop();
+                var a = Pop();
+                stack.Add(a == b ? a : StackKind.Unknown);
+                return;
+            }
+            case Code.Div_Un: case Code.Rem: case Code.Rem_Un: case Code.And: case Code.Or:
+            case Code.Xor: case Code.Shl: case Code.Shr: case Code.Shr_Un:
+            {
+                var b = Pop();
+                var a = Pop();
+                stack.Add(a == StackKind.I4 && b == StackKind.I4 ? StackKind.I4 : StackKind.Unknown);
+                return;
+            }
+            case Code.Neg:
+                return;
+            case Code.Not:
+                stack.Add(Pop() == StackKind.I4 ? StackKind.I4 : StackKind.Unknown);
+                return;
+
+            case Code.Ceq: case Code.Cgt: case Code.Cgt_Un: case Code.Clt: case Code.Clt_Un:
+                Pop();
+                Pop();
+                stack.Add(StackKind.I4);
+                return;
+
+            case Code.Conv_I: case Code.Conv_I4: case Code.Conv_U: case Code.Conv_U4:
+            case Code.Ldlen:
+                Pop();
+                stack.Add(StackKind.I4);
+                return;
+            case Code.Conv_R4: case Code.Conv_R8: case Code.Conv_R_Un:
+                Pop();
+                stack.Add(StackKind.R4);
+                return;
+            case Code.Dup:
+                stack.Add(stack[^1]);
+                return;
+        }
+
+        // everything else (calls, ldelem, ...) produces values of unknown kind.
+        var pop = GetPopCount(instruction.OpCode, instruction.Operand);
+        var push = GetPushCount(instruction.OpCode, instruction.Operand);
+        for (int i = 0; i < pop; ++i) Pop();
+        for (int i = 0; i < push; ++i) stack.Add(StackKind.Unknown);
+    }
+
+    // typed opcode when both operands of a binary instruction are I4 (or both R4), else 0.
+    byte TypedBinaryOp(Instruction instruction, byte i4op, byte r4op)
+    {
+        if (!stackKinds.TryGetValue(instruction, out var st) || st.Length < 2) return 0;
+        if (st[^1] != st[^2]) return 0;
+        return st[^1] switch
+        {
+            StackKind.I4 => i4op,
+            StackKind.R4 => r4op,
+            _ => (byte)0
+        };
+    }
+
+    byte TypedOr(Instruction instruction, byte generic, byte i4op, byte r4op)
+    {
+        var op = TypedBinaryOp(instruction, i4op, r4op);
+        return op != 0 ? op : generic;
+    }
+
+    // 0x4D arithmetic => 0x80.. (i4) / 0x92.. (r4, add/sub/mul/div only).
+    byte[] TypedArith(Instruction instruction, byte op)
+    {
+        var typed = TypedBinaryOp(instruction, (byte)(0x80 + op - 0x60), op <= 0x63 ? (byte)(0x92 + op - 0x60) : (byte)0);
+        return typed != 0 ? [typed] : [0x4D, op];
+    }
+
     void EnsureInheritanceLayout(TypeReference type)
     {
         var td = type.Resolve();
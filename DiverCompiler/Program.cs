@@ -15,7 +15,8 @@ namespace DiverCompiler
         {
             Console.WriteLine(@"Dotnet integrated vehicle embedded runtime: 
 -g to generate extramethods handler: It read ExtraMethods.cs(or you can specify one) and generate: txt and h file for weaver, and a dll for reference import(use it in MCU C# project).
--c to put me into weaverfile of the MCU C# project: Run in csproj folder. You also need to manually add FodyWeaver to your MCU C# project.");
+-c to put me into weaverfile of the MCU C# project: Run in csproj folder. You also need to manually add FodyWeaver to your MCU C# project.
+-t to run the compiler self-tests (exit code 1 on failure).");
 
             // Handle command-line arguments
             if (args.Length > 0)
@@ -37,6 +38,10 @@ namespace DiverCompiler
                             Console.WriteLine("No .csproj file found in the current directory.");
                         }
                         break;
+                    case "-t":
+                        if (!Processor.RunSelfTests(Console.WriteLine))
+                            Environment.ExitCode = 1;
+                        return;
                     default:
                         Console.WriteLine("Invalid option.");
                         break;
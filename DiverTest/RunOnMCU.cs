@@ -40,6 +40,10 @@ namespace CartActivator
         // if return null: not data, or return payload data excluding CRC
         public static byte[] ReadEvent(int port, int event_id) => default;
 
+        // all frames of (port, event_id) since the last cycle, oldest first, or null:
+        // each frame is [arrival micros 4B][payload length 2B][payload].
+        public static byte[] ReadEvents(int port, int event_id) => default;
+
         public static void WriteEvent(byte[] payload, int port, int event_id)
         {
         }
@@ -117,6 +121,22 @@ namespace CartActivator
         {
         }
 
+        // typed snapshot reads, without copying the snapshot: digital input `bit`,
+        // analog channel as int / float (raw snapshots: Int32 word `channel`).
+        public static bool ReadDigital(int bit) => default;
+        public static int ReadAnalog(int channel) => default;
+        public static float ReadAnalogFloat(int channel) => default;
+
+        // partial writes patch the output snapshot (kept across cycles), which is
+        // written once at the end of the cycle.
+        public static void WriteSnapshot(byte[] payload, int offset)
+        {
+        }
+
+        public static void WriteDigital(int bit, bool value)
+        {
+        }
+
         public static int GetMicrosFromStart() => default;
         public static int GetMillisFromStart() => default;
         public static int GetSecondsFromStart() => default;
@@ -46,34 +46,13 @@
 #include <stdio.h>    // sprintf
 #include <stdlib.h>   // atoi/iota
 #include <math.h>     // all
+#include <stddef.h>   // offsetof
 #include <stdint.h>
 #include <wchar.h>
 
 //hint: all structs are 1 bytes aligned.
 #pragma pack(push, 1)
 
-MCU_FASTMEM int cur_il_offset;
-
-// Native CCoder integration metadata
-static uchar* native_blob_ptr = NULL;
-static uchar* native_exec_blob = NULL;
-static int native_blob_size = 0;
-static int native_alignment = 1;
-static int native_arch_id = 0;
-static int native_methods = 0;
-static int* native_entry_offsets = NULL;
-static uchar* native_extra_meta = NULL;
-static uchar* native_aux_counts = NULL;
-static unsigned short* native_aux_offsets = NULL;
-static uchar* native_flags = NULL;
-static unsigned short* native_ccids = NULL;
-static void** native_method_ptrs = NULL;
-static int native_exec_blob_owned = 0;
-#ifdef _WIN32
-static HMODULE native_module = NULL;
-static wchar_t native_module_path[MAX_PATH] = { 0 };
-#endif
-
 static void release_native_metadata(void);
 static void parse_native_chunk(uchar* chunk_ptr, int chunk_size);
 
@@ -112,7 +91,7 @@ static void parse_native_chunk(uchar* chunk_ptr, int chunk_size);
 
 
 // Runtime assertions for safety checks (always active)
-#define ASSERT_RT(expr, ...) if (!(expr)) { char err_tmp[256]={0}; int sz = snprintf(err_tmp,sizeof(err_tmp),__VA_ARGS__); report_error(cur_il_offset, err_tmp, __LINE__); }
+#define ASSERT_RT(expr, ...) if (!(expr)) { char err_tmp[256]={0}; snprintf(err_tmp,sizeof(err_tmp),__VA_ARGS__); report_error(cur_il_offset, (uchar*)err_tmp, __LINE__); }
 
 /*
  * memory layout:
@@ -157,6 +136,284 @@ static int bn = 0;  // Builtin number counter
 // Array of built-in method function pointers
 builtin_method_t builtin_methods[NUM_BUILTIN_METHODS];
 
+// The table is shared by all VM contexts; on a host several threads may load
+// programs at once, so it is filled exactly once and read-only afterwards.
+void setup_builtin_methods();
+#if defined(IS_MCU)
+#define ENSURE_BUILTIN_METHODS() if (bn == 0) setup_builtin_methods()
+#elif defined(_WIN32)
+static INIT_ONCE builtin_methods_once = INIT_ONCE_STATIC_INIT;
+static BOOL CALLBACK builtin_methods_init(PINIT_ONCE once, PVOID param, PVOID* ctx)
+{
+	setup_builtin_methods();
+	return TRUE;
+}
+#define ENSURE_BUILTIN_METHODS() InitOnceExecuteOnce(&builtin_methods_once, builtin_methods_init, NULL, NULL)
+#else
+#include <pthread.h>
+static pthread_once_t builtin_methods_once = PTHREAD_ONCE_INIT;
+#define ENSURE_BUILTIN_METHODS() pthread_once(&builtin_methods_once, setup_builtin_methods)
+#endif
+
+// ---- VM context ----
+// Everything a loaded program mutates lives in one struct vm_context, so a host
+// can run several VMs side by side. The interpreter keeps using the plain names:
+// each of them is a macro for a field of the current context VM. On MCU there is
+// only vm_default_ctx and VM is its address, so nothing changes there (no extra
+// indirection, still in CCM). On hosts VM is a per-thread pointer switched by
+// vm_select_context(). Only the builtin tables above are shared (constant once
+// set up).
+struct method_index;
+struct stack_frame_header;
+struct class_layout;
+struct cartIO_entry;
+struct heap_obj_slot;
+struct io_buf;
+
+// One (|io_type|components|) entry of the snapshot layout, resolved once per cycle.
+#define SNAP_GROUPS_MAX 16
+#define SNAP_OUT_CAP 64
+struct snap_group
+{
+	unsigned char typeid;
+	unsigned short count;  // components
+	unsigned short first;  // digital bit (Boolean) or analog channel of the first component
+	unsigned short offset; // payload offset of the first component
+};
+
+#pragma pack(push, 8)
+struct vm_context
+{
+	int cur_il_offset;
+	int il_cnt, iterations;
+	int builtin_arg0; // this pointer for builtin class ctor.
+
+	// program image, see "memory layout" above. img0 is where the image is read
+	// from; mem0 is the base of the writable VM memory that 32-bit addresses on
+	// the VM stack are relative to. They are the same buffer unless the program
+	// was loaded with vm_set_program_image (image executed in place, e.g. flash).
+	uchar* mem0;
+	uchar* img0;
+	uchar* program_desc_ptr, * code_ptr, * virt_ptr, * statics_desc_ptr, * statics_val_ptr;
+	struct method_index* methods_table;
+	uchar* method_detail_pointer;
+	uchar* virt_table;
+	struct class_layout* instanceable_class_layout_ptr;
+	uchar* instanceable_class_per_layout_ptr;
+	struct cartIO_entry* cartIO_layout_ptr;
+	int entry_method_id, init_method_id;
+	int ladderlogic_this_refid, ladderlogic_this_clsid;
+	int statics_amount, cartIO_N, instanceable_class_N;
+	int methods_N, vmethods_N;
+
+	// Native CCoder integration metadata
+	uchar* native_blob_ptr;
+	uchar* native_exec_blob;
+	int native_blob_size;
+	int native_alignment;
+	int native_arch_id;
+	int native_methods;
+	int* native_entry_offsets;
+	uchar* native_extra_meta;
+	uchar* native_aux_counts;
+	unsigned short* native_aux_offsets;
+	uchar* native_flags;
+	unsigned short* native_ccids;
+	void** native_method_ptrs;
+	int native_exec_blob_owned;
+#ifdef _WIN32
+	HMODULE native_module;
+	wchar_t native_module_path[MAX_PATH];
+#endif
+
+	// call stack
+	struct stack_frame_header** stack_ptr; // stack_depth_cap frames, carved in vm_set_program.
+	int stack_depth_cap;
+	struct stack_frame_header* stack0;
+	int new_stack_depth;
+
+	// heap
+	uchar* heap_tail;
+	int heap_newobj_id;
+	uchar* mem_stack_hi; // highest stack address reached this cycle
+	uchar* mem_heap_lo;  // lowest heap address reached this cycle
+	struct heap_obj_slot* heap_obj; // heap_obj_cap + io_view_cap slots, carved from the top of VM memory in vm_set_program.
+	int heap_obj_cap;
+	int io_view_cap;            // IO view ids heap_obj_cap.., see "IO views" below
+	int io_view_n;              // IO views handed out this cycle
+
+	// generational GC, see "Generational heap collection" below.
+	int gc_old_n;               // ids 1..gc_old_n are old (promoted)
+	int gc_full_every;          // full collection cadence in cycles; <=1: every cycle (default)
+	int gc_promote_age;         // collections survived before promotion
+	int gc_cycles_since_full;
+	int gc_force_full;          // set when the young region could not relieve heap pressure
+	unsigned int gc_last_cycles; // telemetry: get_cyclic_cycles() spent in the last collection
+	int gc_last_full;           // telemetry: 1 if the last collection was a full one
+	int gc_full_count, gc_minor_count;
+	int gc_heap_top_id;         // heap_newobj_id right after the last collection
+	int gc_skip_count;          // telemetry: cycles whose collection was skipped
+	short* gc_mark_stack;
+	int gc_mark_cap, gc_mark_sp, gc_mark_overflow;
+	uchar* gc_old_lo;           // lowest address of the old region while cards are kept, else heap_tail
+	unsigned int* gc_cards;     // card table, see "Card table" (carved in vm_set_program)
+	int gc_card_words;
+	uchar* gc_visit_lo, * gc_visit_hi; // slot range for gc_visit_cards
+	void (*gc_visit_fn)(int* ref_id_ptr);
+
+	// cart IO and device IO buffers
+	unsigned int* cart_IO_stored; // one bit per cart_IO field (cartIO_N bits), carved in vm_set_program.
+	int cart_IO_words;
+	unsigned int* lower_hash;     // per cart_IO field: FNV-1a of the last uploaded reference payload (delta LowerIO).
+	int snapshot_state;
+	int io_buf_bytes, io_slot_cap, io_payload_cap;
+	struct io_buf* writing_buf, * processing_buf; // null until a program is loaded.
+	short* writing_idx, * processing_idx; // slot index of each buffer, see "device IO slot index"
+	int io_idx_cap;
+	int io_snapshot_reserve; // IO buffer bytes kept free for the snapshot (size of the last one)
+	uchar* snap_data; int snap_len; // this cycle's snapshot payload (after the layout), see "typed snapshot"
+	int snap_layout;            // vm_config.snapshot_layout of the loaded program
+	int snap_groups_n, snap_bits, snap_channels; // groups 0: no layout, a raw bitmap / Int32 words
+	struct snap_group snap_groups[SNAP_GROUPS_MAX];
+	uchar snap_out[SNAP_OUT_CAP]; // output image patched by WriteDigital / partial WriteSnapshot
+	int snap_out_len, snap_out_dirty;
+	int lowerUploadSz;
+
+	struct vm_config vm_cfg; // all zero: defaults.
+};
+#pragma pack(pop)
+
+// CCM is not initialized by startup, so the default context gets its initial
+// values on first use (vm_default_ready lives in ordinary RAM).
+MCU_FASTMEM struct vm_context vm_default_ctx;
+static int vm_default_ready = 0;
+
+static void vm_context_defaults(struct vm_context* ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->native_alignment = 1;
+	ctx->heap_newobj_id = 1;
+	ctx->gc_full_every = 1; // generational mode is opt-in, see vm_set_gc_config
+	ctx->gc_promote_age = 2;
+}
+
+#ifdef IS_MCU
+#define VM (&vm_default_ctx)
+#else
+#if defined(_MSC_VER)
+#define VM_TLS __declspec(thread)
+#elif defined(__GNUC__)
+#define VM_TLS __thread __attribute__((tls_model("initial-exec")))
+#else
+#define VM_TLS _Thread_local
+#endif
+static VM_TLS struct vm_context* vm_cur = &vm_default_ctx;
+#define VM vm_cur
+#endif
+
+#define ENSURE_DEFAULT_CONTEXT() if (VM == &vm_default_ctx && !vm_default_ready) { vm_context_defaults(&vm_default_ctx); vm_default_ready = 1; }
+
+#define cur_il_offset (VM->cur_il_offset)
+#define il_cnt (VM->il_cnt)
+#define iterations (VM->iterations)
+#define builtin_arg0 (VM->builtin_arg0)
+#define mem0 (VM->mem0)
+#define img0 (VM->img0)
+#define program_desc_ptr (VM->program_desc_ptr)
+#define code_ptr (VM->code_ptr)
+#define virt_ptr (VM->virt_ptr)
+#define statics_desc_ptr (VM->statics_desc_ptr)
+#define statics_val_ptr (VM->statics_val_ptr)
+#define methods_table (VM->methods_table)
+#define method_detail_pointer (VM->method_detail_pointer)
+#define virt_table (VM->virt_table)
+#define instanceable_class_layout_ptr (VM->instanceable_class_layout_ptr)
+#define instanceable_class_per_layout_ptr (VM->instanceable_class_per_layout_ptr)
+#define cartIO_layout_ptr (VM->cartIO_layout_ptr)
+#define entry_method_id (VM->entry_method_id)
+#define init_method_id (VM->init_method_id)
+#define ladderlogic_this_refid (VM->ladderlogic_this_refid)
+#define ladderlogic_this_clsid (VM->ladderlogic_this_clsid)
+#define statics_amount (VM->statics_amount)
+#define cartIO_N (VM->cartIO_N)
+#define instanceable_class_N (VM->instanceable_class_N)
+#define methods_N (VM->methods_N)
+#define vmethods_N (VM->vmethods_N)
+#define native_blob_ptr (VM->native_blob_ptr)
+#define native_exec_blob (VM->native_exec_blob)
+#define native_blob_size (VM->native_blob_size)
+#define native_alignment (VM->native_alignment)
+#define native_arch_id (VM->native_arch_id)
+#define native_methods (VM->native_methods)
+#define native_entry_offsets (VM->native_entry_offsets)
+#define native_extra_meta (VM->native_extra_meta)
+#define native_aux_counts (VM->native_aux_counts)
+#define native_aux_offsets (VM->native_aux_offsets)
+#define native_flags (VM->native_flags)
+#define native_ccids (VM->native_ccids)
+#define native_method_ptrs (VM->native_method_ptrs)
+#define native_exec_blob_owned (VM->native_exec_blob_owned)
+#define native_module (VM->native_module)
+#define native_module_path (VM->native_module_path)
+#define stack_ptr (VM->stack_ptr)
+#define stack_depth_cap (VM->stack_depth_cap)
+#define stack0 (VM->stack0)
+#define new_stack_depth (VM->new_stack_depth)
+#define heap_tail (VM->heap_tail)
+#define heap_newobj_id (VM->heap_newobj_id)
+#define mem_stack_hi (VM->mem_stack_hi)
+#define mem_heap_lo (VM->mem_heap_lo)
+#define heap_obj (VM->heap_obj)
+#define heap_obj_cap (VM->heap_obj_cap)
+#define io_view_cap (VM->io_view_cap)
+#define io_view_n (VM->io_view_n)
+#define gc_old_n (VM->gc_old_n)
+#define gc_full_every (VM->gc_full_every)
+#define gc_promote_age (VM->gc_promote_age)
+#define gc_cycles_since_full (VM->gc_cycles_since_full)
+#define gc_force_full (VM->gc_force_full)
+#define gc_last_cycles (VM->gc_last_cycles)
+#define gc_last_full (VM->gc_last_full)
+#define gc_full_count (VM->gc_full_count)
+#define gc_minor_count (VM->gc_minor_count)
+#define gc_heap_top_id (VM->gc_heap_top_id)
+#define gc_skip_count (VM->gc_skip_count)
+#define gc_mark_stack (VM->gc_mark_stack)
+#define gc_mark_cap (VM->gc_mark_cap)
+#define gc_mark_sp (VM->gc_mark_sp)
+#define gc_mark_overflow (VM->gc_mark_overflow)
+#define gc_old_lo (VM->gc_old_lo)
+#define gc_cards (VM->gc_cards)
+#define gc_card_words (VM->gc_card_words)
+#define gc_visit_lo (VM->gc_visit_lo)
+#define gc_visit_hi (VM->gc_visit_hi)
+#define gc_visit_fn (VM->gc_visit_fn)
+#define cart_IO_stored (VM->cart_IO_stored)
+#define cart_IO_words (VM->cart_IO_words)
+#define lower_hash (VM->lower_hash)
+#define snapshot_state (VM->snapshot_state)
+#define io_buf_bytes (VM->io_buf_bytes)
+#define io_slot_cap (VM->io_slot_cap)
+#define io_payload_cap (VM->io_payload_cap)
+#define writing_idx (VM->writing_idx)
+#define processing_idx (VM->processing_idx)
+#define io_idx_cap (VM->io_idx_cap)
+#define io_snapshot_reserve (VM->io_snapshot_reserve)
+#define snap_data (VM->snap_data)
+#define snap_len (VM->snap_len)
+#define snap_layout (VM->snap_layout)
+#define snap_groups_n (VM->snap_groups_n)
+#define snap_bits (VM->snap_bits)
+#define snap_channels (VM->snap_channels)
+#define snap_groups (VM->snap_groups)
+#define snap_out (VM->snap_out)
+#define snap_out_len (VM->snap_out_len)
+#define snap_out_dirty (VM->snap_out_dirty)
+#define writing_buf (VM->writing_buf)
+#define processing_buf (VM->processing_buf)
+#define lowerUploadSz (VM->lowerUploadSz)
+#define vm_cfg (VM->vm_cfg)
+
 
 #define ReadInt *((int*)ptr); ptr += 4
 #define ReadShort *((short*)ptr); ptr += 2
@@ -171,8 +428,6 @@ struct method_index
 	int meta_offset;
 	int code_offset;
 };
-MCU_FASTMEM struct method_index* methods_table;
-MCU_FASTMEM uchar* method_detail_pointer;
 
 #define STACK_STRIDE 8
 struct stack_frame_header
@@ -181,25 +436,15 @@ struct stack_frame_header
 	uchar* PC, * entry_il, * evaluation_pointer, * args, * vars, * evaluation_st_ptr;
 	int max_stack;
 };
-MCU_FASTMEM struct stack_frame_header* stack_ptr[32]; // maximum 32 depth.
-MCU_FASTMEM struct stack_frame_header* stack0;
-MCU_FASTMEM int new_stack_depth = 0;
-
-int il_cnt = 0;
-
-#define maximum_IO_N 1024
-MCU_FASTMEM unsigned int cart_IO_stored[maximum_IO_N / 32]; // 32*32bit, 1024 slot for cart_IO.
 
 #define SET_CART_IO_TOUCHED(io_id) (cart_IO_stored[(io_id) / 32] |= (1U << ((io_id) % 32)))
 
-MCU_FASTMEM uchar* program_desc_ptr, * code_ptr, * virt_ptr, * statics_desc_ptr, * statics_val_ptr;
-MCU_FASTMEM struct
+struct class_layout
 {
 	unsigned short tot_size;
 	uchar n_of_fields;
 	int layout_offset;
-} *instanceable_class_layout_ptr;
-MCU_FASTMEM uchar* instanceable_class_per_layout_ptr;
+};
 
 // cartIO layout entry: offset (4B) + flags (1B) = 5 bytes per field, packed
 // flags: 0x01=UpperIO (Host->MCU), 0x02=LowerIO (MCU->Host), 0x00=Mutual (bidirectional)
@@ -209,7 +454,6 @@ struct cartIO_entry {
 	uchar flags;
 };
 #pragma pack(pop)
-MCU_FASTMEM struct cartIO_entry* cartIO_layout_ptr;
 
 struct per_field
 {
@@ -218,23 +462,18 @@ struct per_field
 	short aux;
 };
 
-MCU_FASTMEM uchar* mem0;
-MCU_FASTMEM uchar* heap_tail;
-MCU_FASTMEM int heap_newobj_id = 1;
-
 // ---- Memory high-water telemetry (per vm_run cycle) ----
 // The whole VM lives in one buffer [mem0 .. heap_tail). The stack grows up from
 // stack0; the heap grows down from heap_tail. These track the worst extent each
 // reached during a cycle so we can report a (conservative) peak usage without
 // touching the hot opcode loop: mem_stack_hi is updated once per method call,
 // mem_heap_lo once per allocation. Reset at the top of vm_run().
-MCU_FASTMEM uchar* mem_stack_hi; // highest stack address reached this cycle
-MCU_FASTMEM uchar* mem_heap_lo;  // lowest heap address reached this cycle
-MCU_FASTMEM struct heap_obj_slot
+struct heap_obj_slot
 {
 	uchar* pointer;
 	short new_id; // only used on cleanup.
-} heap_obj[1024];
+	uchar age;    // number of collections survived (saturating), drives promotion.
+};
 // reference id 0 is for nullpointer.
 // `this` for entry method, aka, operation(int i), is always reference id 1.
 
@@ -245,23 +484,48 @@ MCU_FASTMEM struct heap_obj_slot
 //   2> re-assign id for alive objects;
 //   3> from tail to head(heap id low->hi), move object chunk to end. (to move a object, we use a "reversed" memcpy, in order the moving distance
 //      is less than the chunk size). note the object can only be moved tail-wise, so it works.
+//   usually only the young objects go through 1>-3>, see below.
+
+// ---- Generational heap collection ----
+// Reference ids follow allocation order and compaction never reorders them, so
+// the id prefix 1..gc_old_n is exactly the set of objects that have survived at
+// least gc_promote_age collections (the "old region", sitting next to heap_tail).
+// A minor collection treats every old object as live and only marks, renumbers
+// and compacts the young ids above gc_old_n; the old slots that may hold a young
+// id are found through the card table below, so its cost follows the young region
+// and the stores into old objects, not the size of the old region. Garbage in the
+// old region is reclaimed by a full mark-compact, which runs every gc_full_every
+// cycles, or early when the heap gets crowded.
+// Collections only run between cycles (the VM stack is not a root set), so an
+// allocation that fails mid-cycle cannot fall back to a full pass, and garbage
+// left in the old region can make newobj/newarr fail where a full collection
+// every cycle would not. gc_full_every therefore defaults to 1; generational mode
+// is opt-in through vm_set_gc_config, for programs whose per-cycle allocation
+// stays well below the free heap.
+// Card table: the old region does not move between full collections, so it is
+// split into 1<<DIVER_GC_CARD_SHIFT byte cards counted down from heap_tail, one
+// bit each in gc_cards. Every store of a reference id into the heap goes through
+// ref_store_id, whose write barrier sets the card of an old slot that receives a
+// young id. A minor collection marks from and remaps only the slots on set cards,
+// then keeps a card set only while one of its slots still holds a young id (and
+// sets the cards of the objects it just promoted). A full collection moves
+// everything, so it rebuilds the table from the promoted objects. Cards are only
+// kept in generational mode; otherwise gc_old_lo is heap_tail and the barrier is
+// a compare. Every live id has new_id == id between collections, which is what a
+// minor collection relies on for the old ids instead of resetting them.
+// gc_heap_top_id is heap_newobj_id right after the last collection. Objects are
+// only created through newobj/newstr/newarr, so if it has not moved, no object
+// was born since then and nothing new can have escaped into statics or old
+// objects: the heap is exactly what the last collection left (minus references
+// dropped since, which can wait).
+#ifndef DIVER_GC_CARD_SHIFT
+#define DIVER_GC_CARD_SHIFT 6 // 64-byte cards
+#endif
+#define GC_CARD_BYTES (1 << DIVER_GC_CARD_SHIFT)
 
-int entry_method_id;
-int init_method_id;
-int ladderlogic_this_refid;
-int ladderlogic_this_clsid;
-int statics_amount, cartIO_N, instanceable_class_N;
-
-int methods_N, vmethods_N;
-
-int snapshot_state = 0;
-
-// MCU-device input/output buffer, not demanding high speed memory:
-#define BUF_SZ 8192
-#define SLOT_NUMBER 256
-
-uchar IO_bufferA[BUF_SZ], IO_bufferB[BUF_SZ];
-short sorted_slots[SLOT_NUMBER];
+// MCU-device input/output buffer, not demanding high speed memory. Double
+// buffered; each buffer is io_buf_bytes bytes = header + io_slot_cap slots +
+// payload, sized in vm_set_program (see vm_set_config).
 
 // layout:  indexier_len|[indexier_type 1B|dummy 1B|len 2B|aux1 4B|aux2 4B]...16Bper slot, 2048B slot size.
 struct io_slot
@@ -275,15 +539,23 @@ struct io_slot
 		unsigned int sortable;
 	};
 	unsigned short len;
+	short prev; // previous slot with the same (type, aux0, aux1) in this buffer, -1: none.
 	int offset;
 };
 struct io_buf
 {
 	int N_slots; int offset;
-	struct io_slot slots[SLOT_NUMBER];
-	uchar payload;
+	struct io_slot slots[]; // io_slot_cap entries, then the payload.
 };
-struct io_buf* writing_buf = IO_bufferA, * processing_buf = IO_bufferB;
+#define IO_PAYLOAD(buf) ((uchar*)((buf)->slots + io_slot_cap))
+
+#define SNAPSHOT_TYPE 0x55
+#define STREAM_TYPE 0x99
+#define EVENT_TYPE 0xbb
+
+// Every input frame is stored as [arrival micros 4B][byte[] header][payload]: the
+// header lets just_read hand out a view of the payload, the time is for ReadEvents.
+#define IO_FRAME_HEADER (4 + ArrayHeaderSize)
 
 #define As(What, TType) (*(TType*)(What))
 
@@ -383,7 +655,6 @@ uchar get_val_sz(uchar typeid)
 }
 
 uchar* builtin_cls[];
-int builtin_arg0; //this pointer for builtin class ctor.
 
 // use heap_newobj_id-1 to get obj_id.
 int newobj(int clsid)
@@ -391,9 +662,9 @@ int newobj(int clsid)
 	ASSERT_LANG(clsid != -1, "bad clsid:-1");
 	int reference_id = heap_newobj_id;
 	
-	// Bounds check: heap_obj array has 1024 slots, and id must be >= 1
-	if (reference_id < 1 || reference_id >= 1024) {
-		ASSERT_RT(0, "heap_obj invalid in newobj: heap_newobj_id=%d (must be 1-1023)", reference_id);
+	// Bounds check: heap_obj table has heap_obj_cap slots, and id must be >= 1
+	if (reference_id < 1 || reference_id >= heap_obj_cap) {
+		ASSERT_RT(0, "heap_obj invalid in newobj: heap_newobj_id=%d (must be 1-%d)", reference_id, heap_obj_cap - 1);
 	}
 	
 	heap_newobj_id++;
@@ -449,9 +720,9 @@ int newstr(short len, uchar* src)
 {
 	int reference_id = heap_newobj_id;
 	
-	// Bounds check: heap_obj array has 1024 slots, and id must be >= 1
-	if (reference_id < 1 || reference_id >= 1024) {
-		ASSERT_RT(0, "heap_obj invalid: heap_newobj_id=%d (must be 1-1023)", reference_id);
+	// Bounds check: heap_obj table has heap_obj_cap slots, and id must be >= 1
+	if (reference_id < 1 || reference_id >= heap_obj_cap) {
+		ASSERT_RT(0, "heap_obj invalid: heap_newobj_id=%d (must be 1-%d)", reference_id, heap_obj_cap - 1);
 	}
 	
 	uchar* tail = heap_newobj_id == 1 ? heap_tail : heap_obj[heap_newobj_id - 1].pointer;
@@ -476,9 +747,9 @@ int newarr(short len, uchar type_id)
 {
 	int reference_id = heap_newobj_id;
 	
-	// Bounds check: heap_obj array has 1024 slots, and id must be >= 1
-	if (reference_id < 1 || reference_id >= 1024) {
-		ASSERT_RT(0, "heap_obj invalid in newarr: heap_newobj_id=%d (must be 1-1023)", reference_id);
+	// Bounds check: heap_obj table has heap_obj_cap slots, and id must be >= 1
+	if (reference_id < 1 || reference_id >= heap_obj_cap) {
+		ASSERT_RT(0, "heap_obj invalid in newarr: heap_newobj_id=%d (must be 1-%d)", reference_id, heap_obj_cap - 1);
 	}
 	
 	uchar* tail = heap_newobj_id == 1 ? heap_tail : heap_obj[heap_newobj_id - 1].pointer;
@@ -505,6 +776,89 @@ int newarr(short len, uchar type_id)
 	return reference_id;
 }
 
+// ---- IO views ----
+// ReadStream/ReadEvent/ReadSnapshot return a view instead of a fresh byte[]: ids
+// heap_obj_cap..heap_obj_cap+io_view_n-1 point straight at a payload in
+// processing_buf, which vm_put_buffer prefixes with an array header, so the array
+// opcodes and builtins read it like any byte[]. Views are valid for the current
+// cycle only and never reach the collector:
+//  - storing one anywhere but the VM stack (field, static, array element,
+//    collection) stores a heap copy instead;
+//  - writing through one (Stelem/Ldelema) first moves it onto a private copy.
+// The copy is made once per view and the view then reads and writes it. The
+// copy has its own id, so comparisons (ceq, beq/bne, the collection lookups)
+// go through ref_identity, which maps a copied view to its copy.
+#define IS_IO_VIEW(id) ((unsigned)((id) - heap_obj_cap) < (unsigned)io_view_n)
+
+// Returns 0 when this cycle's view ids are used up.
+static int io_view_new(uchar* payload)
+{
+	if (io_view_n >= io_view_cap) return 0;
+	int vid = heap_obj_cap + io_view_n++;
+	heap_obj[vid].pointer = payload - ArrayHeaderSize;
+	heap_obj[vid].new_id = 0; // id of the heap copy, once made.
+	return vid;
+}
+
+static int io_view_materialize(int vid)
+{
+	struct heap_obj_slot* v = &heap_obj[vid];
+	if (v->new_id == 0)
+	{
+		struct array_val* src = (struct array_val*)v->pointer;
+		int refid = newarr(src->len, Byte);
+		struct array_val* arr = heap_obj[refid].pointer;
+		memcpy(&arr->payload, &src->payload, src->len);
+		v->new_id = refid;
+		v->pointer = (uchar*)arr; // the heap does not move before the cycle ends.
+		DBG("io view %d escaped, copied to obj_%d\n", vid, refid);
+	}
+	return v->new_id;
+}
+
+// The object a reference id stands for: a view already copied is its copy.
+INLINE int ref_identity(int refid)
+{
+	return IS_IO_VIEW(refid) && heap_obj[refid].new_id ? heap_obj[refid].new_id : refid;
+}
+
+INLINE void gc_card_mark(uchar* slot)
+{
+	int card = (int)(heap_tail - 1 - slot) >> DIVER_GC_CARD_SHIFT;
+	gc_cards[card >> 5] |= 1u << (card & 31);
+}
+
+// Reference id to store at dst (the id slot itself): a view leaving the VM stack
+// becomes its heap copy, and an old slot receiving a young id gets its card set.
+INLINE int ref_store_id(int refid, uchar* dst)
+{
+	if (IS_IO_VIEW(refid))
+	{
+		uchar* heap_lo = heap_newobj_id > 1 ? heap_obj[heap_newobj_id - 1].pointer : heap_tail;
+		if (dst >= (uchar*)stack0 && dst < heap_lo) return refid;
+		refid = io_view_materialize(refid);
+	}
+	if (refid > gc_old_n && dst >= gc_old_lo && dst < heap_tail)
+		gc_card_mark(dst);
+	return refid;
+}
+
+// Same for the reference fields of a struct value just copied to obj.
+static void ref_store_fields(struct object_val* obj)
+{
+	if (io_view_n == 0 && (uchar*)obj < gc_old_lo) return;
+	struct per_field* layout = instanceable_class_per_layout_ptr + instanceable_class_layout_ptr[obj->clsid].layout_offset;
+	int field_count = instanceable_class_layout_ptr[obj->clsid].n_of_fields;
+	for (int j = 0; j < field_count; j++)
+	{
+		if (layout[j].typeid == ReferenceID)
+		{
+			uchar* f = (uchar*)obj + offsetof(struct object_val, payload) + layout[j].offset;
+			As(f + 1, int) = ref_store_id(As(f + 1, int), f + 1);
+		}
+	}
+}
+
 void parse_statics()
 {
 	uchar* ptr = statics_desc_ptr;
@@ -543,7 +897,6 @@ void parse_methods()
 	method_detail_pointer = &methods_table[methods_N];
 }
 
-uchar* virt_table;
 void parse_virt_methods()
 {
 	uchar* ptr = virt_ptr;
@@ -551,6 +904,124 @@ void parse_virt_methods()
 	virt_table = ptr + vmethods_N * 2;
 }
 
+// ---- load-time pre-decoding ----
+// vm_predecode_methods() rewrites hot generic instructions in the downloaded
+// program buffer into internal opcodes (0xF0..) that skip operand-type
+// switching at run time. Rewrites are in place and keep the instruction
+// length, so IL offsets (fault reports, .diver maps, branch/switch targets)
+// are unchanged. Set DIVER_PREDECODE=0 to run the compiler's bytecode as-is.
+#ifndef DIVER_PREDECODE
+#define DIVER_PREDECODE 1
+#endif
+
+// byte length of the instruction at p (not beyond end), or -1 if unknown.
+static int il_instruction_length(uchar* p, uchar* end)
+{
+	switch (*p)
+	{
+	case 0x00: case 0x01: case 0x23: case 0x24: case 0x26: case 0x6D: case 0x6E:
+	case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
+	case 0x78: case 0x79: case 0x8E: case 0x8F: case 0xA8:
+	case 0xE2: case 0xE3: case 0xE4: case 0xE5: case 0xE6:
+	case 0x92: case 0x93: case 0x94: case 0x95:
+	case 0xC2: case 0xC3: case 0xC4: case 0xC5: case 0xC6: case 0xD2: case 0xD3: case 0xD5:
+		return 1;
+	case 0x41: case 0x4C: case 0x4D: case 0x90: case 0x91:
+		return 2;
+	case 0x02: case 0x03: case 0x04: case 0x06: case 0x0B: case 0x25:
+	case 0xA0: case 0xA6: case 0xA7:
+		return 3;
+	case 0x0A: case 0xA2: case 0xCC:
+		return 4;
+	case 0xCA:
+		return 6;
+	case 0xC8: case 0xCD:
+		return 8;
+	case 0xC9: case 0xCB:
+		return 10;
+	case 0x7A: case 0x7B: case 0x7C: case 0x7D:
+		return 6;
+	case 0x15:
+		if (p + 1 >= end) return -1;
+		return p[1] == ReferenceID ? 2 : 6;
+	case 0x16:
+		if (p + 2 >= end) return -1;
+		if (p[1] == StringHeader)
+			return p + 4 > end ? -1 : 4 + *(unsigned short*)(p + 2);
+		return p[2] == ReferenceID ? 5 : 3;
+	case 0xA1:
+		if (p + 2 >= end) return -1;
+		if (p[2] == 0x11)
+			return p + 5 > end ? -1 : 5 + *(unsigned short*)(p + 3);
+		return 5;
+	case 0x50:
+		if (p + 3 > end) return -1;
+		return 3 + 2 * *(unsigned short*)(p + 1);
+	default:
+		if (*p >= 0x80 && *p <= 0x8C) return 1; // typed i4 arith
+		if (*p >= 0x27 && *p <= 0x40) return 3; // branches
+		if (*p >= 0xB0 && *p <= 0xBF) return 3; // typed branches
+		return -1;
+	}
+}
+
+static int predecode_one(uchar* p)
+{
+	switch (*p)
+	{
+	case 0x15:
+		if (p[1] == Int32) { *p = 0xF0; return 1; }
+		if (p[1] == Single) { *p = 0xF1; return 1; }
+		if (p[1] == ReferenceID) { *p = 0xF2; return 1; }
+		return 0;
+	case 0x7B:
+	case 0x7D:
+		// plain static field (bit0 static, bit1 cart_io must be clear).
+		if ((p[1] & 3) != 1) return 0;
+		*p = *p == 0x7B ? 0xF3 : 0xF4;
+		return 1;
+	}
+	return 0;
+}
+
+// returns the number of rewritten instructions.
+int vm_predecode_methods()
+{
+#if DIVER_PREDECODE
+	int rewritten = 0;
+	for (int m = 0; m < methods_N; ++m)
+	{
+		uchar* p = method_detail_pointer + methods_table[m].code_offset;
+		uchar* end = m + 1 < methods_N ? method_detail_pointer + methods_table[m + 1].meta_offset : virt_ptr;
+
+		// validate the whole method first; anything unparsable is left untouched.
+		uchar* q = p;
+		while (q < end)
+		{
+			int len = il_instruction_length(q, end);
+			if (len <= 0 || q + len > end) break;
+			q += len;
+		}
+		if (q != end)
+		{
+			DBG("predecode: method %d not decodable at +%d, kept generic\n", m, (int)(q - p));
+			continue;
+		}
+
+		while (p < end)
+		{
+			int len = il_instruction_length(p, end); // before the opcode byte is replaced.
+			rewritten += predecode_one(p);
+			p += len;
+		}
+	}
+	DBG("predecode: %d instructions rewritten\n", rewritten);
+	return rewritten;
+#else
+	return 0;
+#endif
+}
+
 static void release_native_metadata(void)
 {
     if (native_aux_counts)
@@ -1086,22 +1557,97 @@ int get_virt_method_actual_methodID(int vmethod_id, int cls_id)
 		if (vm_s->clsid == cls_id) return vm_s->methodid;
 	ASSERT_LANG(0, "Cannot find vmethod %d for type %d", vmethod_id, cls_id);
 }
-void setup_builtin_methods();
 
-int iterations = 0;
 void vm_push_stack(int method_id, int new_obj_id, uchar** reptr);
 void clean_up();
 
 void mark_object(int obj_id);
 
-int vm_set_program(uchar* vm_memory, int vm_memory_size)
+void vm_set_config(const struct vm_config* config)
 {
-	setup_builtin_methods();
+	ENSURE_DEFAULT_CONTEXT();
+	if (config) vm_cfg = *config;
+	else memset(&vm_cfg, 0, sizeof(vm_cfg));
+	if (vm_cfg.full_gc_every > 0 || vm_cfg.gc_promote_after > 0)
+		vm_set_gc_config(vm_cfg.full_gc_every > 0 ? vm_cfg.full_gc_every : gc_full_every,
+			vm_cfg.gc_promote_after > 0 ? vm_cfg.gc_promote_after : gc_promote_age);
+}
+
+// Sizes the runtime tables from vm_cfg / the memory size / program metadata and
+// carves them off the top of VM memory, so the heap now ends below them:
+//   [program|statics|stack -> ... <- heap|IO buffers|IO indexes|cart_IO|stack_ptr|heap_obj]
+// Returns the new heap_tail, or NULL if the tables do not fit.
+static uchar* vm_carve_tables(uchar* vm_memory, int vm_memory_size)
+{
+	heap_obj_cap = vm_cfg.heap_objs > 0 ? vm_cfg.heap_objs : vm_memory_size / 128;
+	if (vm_cfg.heap_objs <= 0 && heap_obj_cap < 1024) heap_obj_cap = 1024;
+	if (heap_obj_cap > 32767) heap_obj_cap = 32767; // ids are kept in shorts while collecting.
+	if (heap_obj_cap < 2) heap_obj_cap = 2;
+	io_view_cap = vm_cfg.io_views > 0 ? vm_cfg.io_views : (vm_cfg.io_views < 0 ? 0 : 32);
+	if (io_view_cap > 32767 - heap_obj_cap) io_view_cap = 32767 - heap_obj_cap;
+	stack_depth_cap = vm_cfg.stack_depth > 0 ? vm_cfg.stack_depth : vm_memory_size / 8192;
+	if (vm_cfg.stack_depth <= 0 && stack_depth_cap < 32) stack_depth_cap = 32;
+	if (stack_depth_cap > 32767) stack_depth_cap = 32767;
+	io_buf_bytes = vm_cfg.io_buf_size > 0 ? vm_cfg.io_buf_size : 8192;
+	io_slot_cap = vm_cfg.io_slots > 0 ? vm_cfg.io_slots : 256;
+	io_payload_cap = io_buf_bytes - (int)sizeof(struct io_buf) - io_slot_cap * (int)sizeof(struct io_slot);
+	io_idx_cap = io_slot_cap + io_slot_cap / 2 + 1; // load factor <= 2/3, never full.
+	cart_IO_words = cartIO_N / 32 + 1;
+	gc_card_words = (vm_memory_size >> DIVER_GC_CARD_SHIFT) / 32 + 1;
+
+	uchar* top = vm_memory + vm_memory_size;
+#define CARVE(sz) (top = (uchar*)((uintptr_t)(top - (sz)) & ~(uintptr_t)7))
+	heap_obj = (struct heap_obj_slot*)CARVE((heap_obj_cap + io_view_cap) * sizeof(struct heap_obj_slot));
+	stack_ptr = (struct stack_frame_header**)CARVE(stack_depth_cap * sizeof(struct stack_frame_header*));
+	cart_IO_stored = (unsigned int*)CARVE(cart_IO_words * sizeof(unsigned int));
+	lower_hash = (unsigned int*)CARVE((cartIO_N + 1) * sizeof(unsigned int));
+	gc_cards = (unsigned int*)CARVE(gc_card_words * sizeof(unsigned int));
+	processing_idx = (short*)CARVE(io_idx_cap * sizeof(short));
+	writing_idx = (short*)CARVE(io_idx_cap * sizeof(short));
+	if (vm_cfg.io_memory != 0)
+	{
+		writing_buf = (struct io_buf*)vm_cfg.io_memory;
+		processing_buf = (struct io_buf*)(vm_cfg.io_memory + io_buf_bytes);
+	}
+	else
+	{
+		processing_buf = (struct io_buf*)CARVE(io_buf_bytes);
+		writing_buf = (struct io_buf*)CARVE(io_buf_bytes);
+	}
+#undef CARVE
+	if (io_payload_cap <= 0 || top <= statics_val_ptr)
+		return NULL;
+	return top;
+}
+
+// magic + SemVer gate, see mcu_runtime.h.
+static int vm_abi_compatible(unsigned int program_magic, unsigned int program_abi)
+{
+	unsigned int runtime_abi = (unsigned int)DIVER_ABI_VERSION;
+	return program_magic == DIVER_PROGRAM_MAGIC &&
+		DIVER_ABI_MAJOR(program_abi) == DIVER_ABI_MAJOR(runtime_abi) &&
+		DIVER_ABI_MINOR(runtime_abi) >= DIVER_ABI_MINOR(program_abi);
+}
+
+// Loads the program image at `image`; statics, stack, heap and the runtime
+// tables go to vm_memory. image == vm_memory is the single-buffer layout (the
+// statics follow the image and the image is pre-decoded in place); otherwise
+// the image is only ever read.
+static int vm_load_program(uchar* image, int image_size, uchar* vm_memory, int vm_memory_size)
+{
+	ENSURE_DEFAULT_CONTEXT();
+	ENSURE_BUILTIN_METHODS();
 
 	heap_newobj_id = 1;
 	ladderlogic_this_refid = 0;
+	il_cnt = 0;
+	gc_old_n = gc_cycles_since_full = gc_force_full = 0;
+	gc_last_cycles = gc_last_full = gc_full_count = gc_minor_count = 0;
+	gc_heap_top_id = gc_skip_count = 0;
 	release_native_metadata();
-	uchar* ptr = mem0 = vm_memory;
+	int in_place = image == vm_memory;
+	uchar* ptr = img0 = image;
+	mem0 = vm_memory;
 
 	// ===== DIVER program ABI gate =====
 	// Validate magic + ABI version BEFORE parsing anything else. An incompatible
@@ -1145,14 +1691,36 @@ int vm_set_program(uchar* vm_memory, int vm_memory_size)
 	statics_desc_ptr = virt_ptr + virt_chunk_sz;
 	uchar* native_ptr = statics_desc_ptr + static_desc_sz;
 	uchar* cctor_ptr = native_ptr + native_chunk_sz;
-	statics_val_ptr = cctor_ptr + cctor_chunk_sz;
-
-	heap_tail = vm_memory + vm_memory_size;
+	if (cctor_chunk_sz < 0 || cctor_ptr + cctor_chunk_sz > image + image_size)
+	{
+		report_error(0, (uchar*)"DIVER program image is truncated.", __LINE__);
+		return -1;
+	}
+	statics_val_ptr = in_place ? cctor_ptr + cctor_chunk_sz : vm_memory;
 
 	parse_program_desc();
 	parse_methods();
 	parse_virt_methods();
 	parse_native_chunk(native_ptr, native_chunk_sz);
+	if (in_place) vm_predecode_methods(); // a separate image is read-only, see vm_predecode_image.
+
+	heap_tail = vm_carve_tables(vm_memory, vm_memory_size);
+	if (heap_tail == NULL)
+	{
+		char cfg_err[160] = { 0 };
+		snprintf(cfg_err, sizeof(cfg_err),
+			"VM memory %dB too small for runtime tables (%d heap objs, %d frames, %dB IO buffers).",
+			vm_memory_size, heap_obj_cap, stack_depth_cap, io_buf_bytes);
+		writing_buf = processing_buf = 0;
+		report_error(0, (uchar*)cfg_err, __LINE__);
+		return -1;
+	}
+	memset(cart_IO_stored, 0, cart_IO_words * sizeof(unsigned int));
+	memset(lower_hash, 0, (cartIO_N + 1) * sizeof(unsigned int));
+	memset(gc_cards, 0, gc_card_words * sizeof(unsigned int));
+	gc_old_lo = heap_tail;
+	DBG("tables: heap_objs=%d, stack_depth=%d, io_buf=%dx%d slots, heap_tail=+%d\n",
+		heap_obj_cap, stack_depth_cap, io_buf_bytes, io_slot_cap, (int)(heap_tail - vm_memory));
 
 
 	DBG("interval=%d, nstatics=%d, this_clsid=%d\n", interval, statics_amount, ladderlogic_this_clsid);
@@ -1206,10 +1774,70 @@ int vm_set_program(uchar* vm_memory, int vm_memory_size)
 
 	processing_buf->offset = writing_buf->offset = 0;
 	processing_buf->N_slots = writing_buf->N_slots = 0;
+	io_snapshot_reserve = IO_FRAME_HEADER;
+	memset(snap_out, 0, SNAP_OUT_CAP);
+	snap_out_len = 4; // 32 DO bits until a WriteSnapshot says otherwise.
+	snap_out_dirty = 0;
+	snap_layout = vm_cfg.snapshot_layout > 0;
+	memset(processing_idx, 0, io_idx_cap * sizeof(short));
+	memset(writing_idx, 0, io_idx_cap * sizeof(short));
 
 	return interval;
 }
 
+int vm_set_program(uchar* vm_memory, int vm_memory_size)
+{
+	return vm_load_program(vm_memory, vm_memory_size, vm_memory, vm_memory_size);
+}
+
+int vm_set_program_image(const uchar* image, int image_size, uchar* vm_memory, int vm_memory_size)
+{
+	// ldtoken pushes image addresses as 32-bit offsets from mem0 like every
+	// other address, so the image must lie within +-2GB of vm_memory (always
+	// true on the MCU; on 64-bit hosts two allocations may be further apart).
+	intptr_t lo = (intptr_t)image - (intptr_t)vm_memory;
+	intptr_t hi = lo + image_size;
+	if (lo < -0x7FFFFFFF || hi > 0x7FFFFFFF)
+	{
+		report_error(0, (uchar*)"DIVER program image is too far from VM memory.", __LINE__);
+		return -1;
+	}
+	return vm_load_program((uchar*)image, image_size, vm_memory, vm_memory_size);
+}
+
+int vm_predecode_image(uchar* image, int image_size)
+{
+	ENSURE_DEFAULT_CONTEXT();
+	uchar* ptr = image;
+	if (image == NULL || image_size < 12 * 4) return 0;
+	unsigned int program_magic = (unsigned int)ReadInt;
+	unsigned int program_abi = (unsigned int)ReadInt;
+	if (!vm_abi_compatible(program_magic, program_abi)) return 0;
+	ptr += 3 * 4; // interval, entry method, init method
+	int program_desc_sz = ReadInt;
+	int code_chunk_sz = ReadInt;
+	int virt_chunk_sz = ReadInt;
+	uchar* code = image + 12 * 4 + program_desc_sz;
+	if (program_desc_sz < 0 || code_chunk_sz < 2 || virt_chunk_sz < 0 ||
+		code + code_chunk_sz + virt_chunk_sz > image + image_size)
+		return 0;
+
+	// borrow the method table fields of the current context.
+	uchar* saved_code = code_ptr, * saved_virt = virt_ptr, * saved_detail = method_detail_pointer;
+	struct method_index* saved_table = methods_table;
+	int saved_n = methods_N;
+	code_ptr = code;
+	virt_ptr = code + code_chunk_sz;
+	parse_methods();
+	int rewritten = vm_predecode_methods();
+	code_ptr = saved_code;
+	virt_ptr = saved_virt;
+	method_detail_pointer = saved_detail;
+	methods_table = saved_table;
+	methods_N = saved_n;
+	return rewritten;
+}
+
 
 
 #define HEAP_WRITE_INT(val) *heap=Int32; As(heap+1, int)=val; heap+=get_val_sz(Int32);
@@ -1250,6 +1878,110 @@ int vm_set_program(uchar* vm_memory, int vm_memory_size)
         ASSERT_LANG(0, "POP underflow: method=%d depth=%d eval_ptr=%p st_ptr=%p\n", my_stack->method_id, my_stack->stack_depth, (void*)eptr, (void*)my_stack->evaluation_st_ptr);\
     } }
 
+// Interpreter dispatch engine, chosen at build time.
+// DIVER_THREADED_DISPATCH=1: direct threading via labels-as-values (GCC/Clang).
+//   Each handler ends by fetching the next opcode and jumping through
+//   vm_dispatch_table, so every opcode owns its indirect branch (better branch
+//   prediction, no switch range check).
+// DIVER_THREADED_DISPATCH=0: the portable switch loop (MSVC, other compilers).
+// Both run the very same handler bodies; VM_OP(x) is the case label plus, in
+// threaded mode, the jump label op_x.
+#ifndef DIVER_THREADED_DISPATCH
+#if defined(__GNUC__) || defined(__clang__)
+#define DIVER_THREADED_DISPATCH 1
+#else
+#define DIVER_THREADED_DISPATCH 0
+#endif
+#endif
+
+#define VM_FETCH { cur_il_offset = ptr - img0; ic = ReadByte; il_cnt += 1; DBG("ic=%X(%d,off%d): ", ic, il_cnt, cur_il_offset); }
+// write the frame's PC/eval pointer back before calls/allocations inspect the frame.
+#define VM_SPILL { my_stack->PC = ptr; my_stack->evaluation_pointer = eptr; }
+
+#if DIVER_THREADED_DISPATCH
+#define VM_OP(x) case x: op_##x:
+#define VM_OP_DEFAULT default: op_bad:
+#define VM_DISPATCH goto *vm_dispatch_table[ic]
+#define VM_NEXT { ASSERT_LANG(ptr < virt_ptr, "bad program counter"); VM_FETCH; VM_DISPATCH; }
+#else
+#define VM_OP(x) case x:
+#define VM_OP_DEFAULT default:
+#define VM_DISPATCH ((void)0)
+#define VM_NEXT break
+#endif
+
+// Single payloads travel as their int bits; memcpy keeps the typed opcodes free of
+// type-punned pointer casts (strict aliasing) and compiles to a register move.
+static inline float r4_from_bits(int v)
+{
+	float f;
+	memcpy(&f, &v, sizeof(f));
+	return f;
+}
+
+static inline int r4_to_bits(float f)
+{
+	int v;
+	memcpy(&v, &f, sizeof(v));
+	return v;
+}
+
+// sub-operations carried by the fused opcodes (0xC8..0xCB): the typed opcode
+// that the compiler folded into the superinstruction (0x80.., 0x92.., 0xB0..).
+static inline int i4_arith(uchar op, int a, int b)
+{
+	switch (op)
+	{
+	case 0x80: return a + b;
+	case 0x81: return a - b;
+	case 0x82: return a * b;
+	case 0x83: return a / b;
+	case 0x84: return (int)((unsigned int)a / (unsigned int)b);
+	case 0x85: return a % b;
+	case 0x86: return (int)((unsigned int)a % (unsigned int)b);
+	case 0x87: return a & b;
+	case 0x88: return a | b;
+	case 0x89: return a ^ b;
+	case 0x8A: return a << b;
+	case 0x8B: return a >> b;
+	case 0x8C: return (int)((unsigned int)a >> b);
+	}
+	ASSERT_LANG(0, "bad fused i4 op 0x%02X", op);
+	return 0;
+}
+
+static inline float r4_arith(uchar op, float a, float b)
+{
+	switch (op)
+	{
+	case 0x92: return a + b;
+	case 0x93: return a - b;
+	case 0x94: return a * b;
+	case 0x95: return a / b;
+	}
+	ASSERT_LANG(0, "bad fused r4 op 0x%02X", op);
+	return 0;
+}
+
+static inline int i4_branch(uchar cond, int a, int b)
+{
+	switch (cond)
+	{
+	case 0xB0: return a == b;
+	case 0xB1: return a >= b;
+	case 0xB2: return a > b;
+	case 0xB3: return a <= b;
+	case 0xB4: return a < b;
+	case 0xB5: return a != b;
+	case 0xB6: return (unsigned int)a >= (unsigned int)b;
+	case 0xB7: return (unsigned int)a > (unsigned int)b;
+	case 0xB8: return (unsigned int)a <= (unsigned int)b;
+	case 0xB9: return (unsigned int)a < (unsigned int)b;
+	}
+	ASSERT_LANG(0, "bad fused i4 branch 0x%02X", cond);
+	return 0;
+}
+
 
 #define CPYVAL(dst,src,type) {\
 	switch (type){ \
@@ -1332,7 +2064,7 @@ void copy_val(uchar* dst, uchar* src)
 		switch (*src)
 		{
 		case ReferenceID:
-			*(int32_t*)(dst + 1) = *(int32_t*)(src + 1);
+			*(int32_t*)(dst + 1) = ref_store_id(*(int32_t*)(src + 1), dst + 1);
 			return;
 		case JumpAddress:
 			DBG("case of copy from JMP to REFID\n");
@@ -1341,7 +2073,8 @@ void copy_val(uchar* dst, uchar* src)
 			int refid = newobj(obj_src->clsid);
 			struct object_val* obj_dst = heap_obj[refid].pointer;
 			memcpy(obj_dst, obj_src, instanceable_class_layout_ptr[obj_src->clsid].tot_size + ObjectHeaderSize);
-			As(dst + 1, int) = refid;
+			ref_store_fields(obj_dst);
+			As(dst + 1, int) = ref_store_id(refid, dst + 1);
 			return;
 		}
 		ASSERT_LANG(0, "invalid ref value copy from type_%d", *src);
@@ -1363,6 +2096,7 @@ void copy_val(uchar* dst, uchar* src)
 			ASSERT_LANG(0, "invalid struct ja value copy from type_%d", *src);
 		}
 		memcpy(obj_dst, obj_src, instanceable_class_layout_ptr[obj_src->clsid].tot_size + ObjectHeaderSize);
+		ref_store_fields(obj_dst);
 		return;
 	case Address:
 		//just copy.
@@ -1375,11 +2109,21 @@ void copy_val(uchar* dst, uchar* src)
 }
 
 
+#ifndef IS_MCU
+// Inside the interpreter the context is read once into a local: the per-thread
+// pointer would otherwise be reloaded for every field access.
+#undef VM
+#define VM vm_self
+#endif
 void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 {
+#ifndef IS_MCU
+	struct vm_context* const vm_self = vm_cur;
+#endif
 	ASSERT_LANG(method_id < methods_N, "Bad method id_%d>%d", method_id, methods_N);
 
 	int my_stack_depth = new_stack_depth;
+	ASSERT_RT(my_stack_depth < stack_depth_cap, "call stack overflow: depth %d (max %d)", my_stack_depth, stack_depth_cap);
 	new_stack_depth += 1;
 	struct stack_frame_header* my_stack = my_stack_depth == 0 ? stack0 : stack_ptr[my_stack_depth - 1]->evaluation_pointer;
 	stack_ptr[my_stack_depth] = my_stack;
@@ -1550,37 +2294,78 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 		goto exited;
 
 	// start running:
+	// ptr/eptr stay in locals for the whole method; VM_SPILL publishes them to
+	// the frame before anything that looks at it (calls, builtins, allocation).
+	// Branch targets resolve against st_ptr (== my_stack->entry_il) for the same reason.
+	ptr = my_stack->PC; // pointer to program code
+	uchar* eptr = my_stack->evaluation_pointer; // pointer to evaluation stack.
+	uchar ic;
+
+#if DIVER_THREADED_DISPATCH
+	static const void* const vm_dispatch_table[256] = {
+		[0 ... 255] = &&op_bad,
+		[0x00] = &&op_0x00, [0x01] = &&op_0x01, [0x02] = &&op_0x02, [0x03] = &&op_0x03,
+		[0x04] = &&op_0x04, [0x06] = &&op_0x06, [0x0A] = &&op_0x0A, [0x0B] = &&op_0x0B,
+		[0x15] = &&op_0x15, [0x16] = &&op_0x16, [0x23] = &&op_0x23, [0x24] = &&op_0x24,
+		[0x25] = &&op_0x25, [0x26] = &&op_0x26, [0x27] = &&op_0x27, [0x28] = &&op_0x28,
+		[0x29] = &&op_0x29, [0x2A] = &&op_0x2A, [0x2B] = &&op_0x2B, [0x2C] = &&op_0x2C,
+		[0x2D] = &&op_0x2D, [0x2E] = &&op_0x2E, [0x2F] = &&op_0x2F, [0x30] = &&op_0x30,
+		[0x31] = &&op_0x31, [0x32] = &&op_0x32, [0x33] = &&op_0x33, [0x34] = &&op_0x34,
+		[0x35] = &&op_0x35, [0x36] = &&op_0x36, [0x37] = &&op_0x37, [0x38] = &&op_0x38,
+		[0x39] = &&op_0x39, [0x3A] = &&op_0x3A, [0x3B] = &&op_0x3B, [0x3C] = &&op_0x3C,
+		[0x3D] = &&op_0x3D, [0x3E] = &&op_0x3E, [0x3F] = &&op_0x3F, [0x40] = &&op_0x40,
+		[0x41] = &&op_0x41, [0x4C] = &&op_0x4C, [0x4D] = &&op_0x4D, [0x50] = &&op_0x50,
+		[0x6D] = &&op_0x6D, [0x6E] = &&op_0x6E, [0x70] = &&op_0x70, [0x71] = &&op_0x71,
+		[0x72] = &&op_0x72, [0x73] = &&op_0x73, [0x74] = &&op_0x74, [0x75] = &&op_0x75,
+		[0x76] = &&op_0x76, [0x77] = &&op_0x77, [0x78] = &&op_0x78, [0x79] = &&op_0x79,
+		[0x7A] = &&op_0x7A, [0x7B] = &&op_0x7B, [0x7C] = &&op_0x7C, [0x7D] = &&op_0x7D,
+		[0x8E] = &&op_0x8E, [0x8F] = &&op_0x8F, [0x90] = &&op_0x90, [0x91] = &&op_0x91,
+		[0xA0] = &&op_0xA0, [0xA1] = &&op_0xA1, [0xA2] = &&op_0xA2, [0xA6] = &&op_0xA6,
+		[0xA7] = &&op_0xA7, [0xA8] = &&op_0xA8, [0xE2] = &&op_0xE2, [0xE3] = &&op_0xE3,
+		[0xE4] = &&op_0xE4, [0xE5] = &&op_0xE5, [0xE6] = &&op_0xE6,
+		[0x80] = &&op_0x80, [0x81] = &&op_0x81, [0x82] = &&op_0x82, [0x83] = &&op_0x83,
+		[0x84] = &&op_0x84, [0x85] = &&op_0x85, [0x86] = &&op_0x86, [0x87] = &&op_0x87,
+		[0x88] = &&op_0x88, [0x89] = &&op_0x89, [0x8A] = &&op_0x8A, [0x8B] = &&op_0x8B,
+		[0x8C] = &&op_0x8C, [0x92] = &&op_0x92, [0x93] = &&op_0x93, [0x94] = &&op_0x94,
+		[0x95] = &&op_0x95, [0xB0] = &&op_0xB0, [0xB1] = &&op_0xB1, [0xB2] = &&op_0xB2,
+		[0xB3] = &&op_0xB3, [0xB4] = &&op_0xB4, [0xB5] = &&op_0xB5, [0xB6] = &&op_0xB6,
+		[0xB7] = &&op_0xB7, [0xB8] = &&op_0xB8, [0xB9] = &&op_0xB9, [0xBA] = &&op_0xBA,
+		[0xBB] = &&op_0xBB, [0xBC] = &&op_0xBC, [0xBD] = &&op_0xBD, [0xBE] = &&op_0xBE,
+		[0xBF] = &&op_0xBF, [0xC2] = &&op_0xC2, [0xC3] = &&op_0xC3, [0xC4] = &&op_0xC4,
+		[0xC5] = &&op_0xC5, [0xC6] = &&op_0xC6, [0xD2] = &&op_0xD2, [0xD3] = &&op_0xD3,
+		[0xD5] = &&op_0xD5,
+		[0xC8] = &&op_0xC8, [0xC9] = &&op_0xC9, [0xCA] = &&op_0xCA, [0xCB] = &&op_0xCB,
+		[0xCC] = &&op_0xCC, [0xCD] = &&op_0xCD,
+		[0xF0] = &&op_0xF0, [0xF1] = &&op_0xF1, [0xF2] = &&op_0xF2, [0xF3] = &&op_0xF3,
+		[0xF4] = &&op_0xF4,
+	};
+#endif
+
 	while (1)
 	{
-		uchar* ptr = my_stack->PC; // pointer to program code
-		cur_il_offset = ptr - mem0;
-		uchar* eptr = my_stack->evaluation_pointer; // pointer to evaluation stack.
-
-		uchar ic = ReadByte;
-		il_cnt += 1;
-
-		DBG("ic=%X(%d,off%d): ", ic, il_cnt, cur_il_offset);
+		VM_FETCH;
+		VM_DISPATCH;
 
 		switch (ic)
 		{
-		case 0x00:
+		VM_OP(0x00)
 			DBG
 			("IL_Nop\n");
 			break;
-		case 0x01:
+		VM_OP(0x01)
 			DBG
 			("IL_Break\n");
 			break;
 
-		case 0x02:
+		VM_OP(0x02)
 		{
 			// load argument onto stack:
 			unsigned short offset = ReadShort;
 			PUSH_STACK_INDIRECT(&my_stack->args[offset]);
 			DBG("IL_Ldarg @%d, typeid=%d\n", offset, my_stack->args[offset]);
-			break;
+			VM_NEXT;
 		}
-		case 0x03:
+		VM_OP(0x03)
 		{
 			unsigned short offset = ReadShort;
 			uchar* addr = my_stack->args + offset;
@@ -1589,9 +2374,9 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			PUSH_STACK_ADDRESS(addr + 1, *addr);
 
 			DBG("IL_Ldarga referencing offset %d, type %d\n", offset, *addr);
-			break;
+			VM_NEXT;
 		}
-		case 0x04:
+		VM_OP(0x04)
 		{
 			unsigned short offset = ReadShort;
 			uchar* addr = my_stack->args + offset;
@@ -1599,17 +2384,17 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			copy_val(addr, eptr);
 			DBG
 			("IL_Starg type_%d -> arg@%d(type_%d)\n", *addr, offset, *eptr);
-			break;
+			VM_NEXT;
 		}
-		case 0x06:
+		VM_OP(0x06)
 		{
 			unsigned short var_offset = ReadShort;
 			PUSH_STACK_INDIRECT(&my_stack->vars[var_offset]);
 			DBG
 			("IL_Ldloc var@%d(type_%d)\n", var_offset, my_stack->vars[var_offset]);
-			break;
+			VM_NEXT;
 		}
-		case 0x0A:
+		VM_OP(0x0A)
 		{
 			uchar typeid = ReadByte; // actually not necessary;
 			unsigned short offset = ReadShort;
@@ -1619,18 +2404,18 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			copy_val(addr, eptr);
 			DBG
 			("IL_Stloc from stack(type_%d) -> var@%d(type_%d)\n", typeid, offset, typeid);
-			break;
+			VM_NEXT;
 		}
-		case 0x0B:
+		VM_OP(0x0B)
 		{
 			unsigned short var_offset = ReadShort;
 			uchar* addr = my_stack->vars + var_offset;
 			PUSH_STACK_ADDRESS(addr + 1, *addr);
 			DBG
 			("IL_Ldloca var_offset:%d, type%d\n", var_offset, *addr);
-			break;
+			VM_NEXT;
 		}
-		case 0x15:
+		VM_OP(0x15)
 		{
 			uchar ldc_typeid = ReadByte;
 			// only int/float/null type uses 0x15.
@@ -1662,10 +2447,11 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				break;
 			}
 			}
-			break;
+			VM_NEXT;
 		}
-		case 0x16: // heap object loading. Ldstr or Newarr
+		VM_OP(0x16) // heap object loading. Ldstr or Newarr
 		{
+			VM_SPILL;
 			uchar typeid = ReadByte;
 			if (typeid == StringHeader)
 			{
@@ -1705,21 +2491,21 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			}
 			break;
 		}
-		case 0x23:
+		VM_OP(0x23)
 		{
 			uchar* teptr = eptr - 8;
 			PUSH_STACK_INDIRECT(teptr);
 			DBG("IL_Dup\n");
-			break;
+			VM_NEXT;
 		}
-		case 0x24:
+		VM_OP(0x24)
 		{
 			POP
 				DBG
 				("IL_Pop\n");
-			break;
+			VM_NEXT;
 		}
-		case 0x25:
+		VM_OP(0x25)
 		{
 			unsigned short method_id = ReadShort;
 			// Implement method jump logic here
@@ -1727,7 +2513,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			("IL_Jmp to method %d\n", method_id);
 			break;
 		}
-		case 0x26: //IL_Ret
+		VM_OP(0x26) //IL_Ret
 		{
 			// Return from method
 			if (eptr > my_stack->evaluation_st_ptr)
@@ -1750,27 +2536,42 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			goto exited;
 		}
 
-		case 0x27: // Br_S
-		case 0x34: // Br
+		VM_OP(0x27) // Br_S
+		VM_OP(0x34) // Br
 		{
 			short offset = ReadShort;
-			ptr = my_stack->entry_il + offset;
+			ptr = st_ptr + offset;
 			DBG
 			("IL_Branch to offset %d, \n", offset);
-			break;
+			VM_NEXT;
 		}
 
 		// Mono-operand branch
-		case 0x28: // Brfalse_S
-		case 0x35: // Brfalse
-		case 0x29: // Brtrue_S
-		case 0x36: // Brtrue
+		VM_OP(0x28) // Brfalse_S
+		VM_OP(0x35) // Brfalse
+		VM_OP(0x29) // Brtrue_S
+		VM_OP(0x36) // Brtrue
 		{
 			short offset = ReadShort;
 			POP;
 			uchar* val1p = eptr;
 			ASSERT_LANG(*val1p <= 7 || *val1p == ReferenceID, "not supported branch operand type");
-			uchar val1 = eptr[1];
+			// only the payload bytes count: the rest of the 8-byte slot may be stale
+			// (ldloc/ldfld copy whole slots), and ref id / int 256 is not false.
+			int val1;
+			switch (*val1p)
+			{
+			case Boolean:
+			case Byte:
+			case SByte: val1 = eptr[1];
+				break;
+			case Char:
+			case Int16:
+			case UInt16: val1 = As(eptr + 1, unsigned short);
+				break;
+			default: val1 = As(eptr + 1, int); // Int32/UInt32/ReferenceID
+				break;
+			}
 			int condition;
 			switch (ic)
 			{
@@ -1783,7 +2584,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			}
 			if (condition)
 			{
-				ptr = my_stack->entry_il + offset;
+				ptr = st_ptr + offset;
 				DBG
 				("IL_Branch type 0x%02X, offset %d, condition true\n", ic, offset);
 			}
@@ -1792,30 +2593,30 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				DBG
 				("IL_Branch type 0x%02X, offset %d, condition false\n", ic, offset);
 			}
-			break;
+			VM_NEXT;
 		}
 
 		// Bioperand branch
-		case 0x2A: // Beq_S
-		case 0x2B: // Bge_S
-		case 0x2C: // Bgt_S
-		case 0x2D: // Ble_S
-		case 0x2E: // Blt_S
-		case 0x2F: // Bne_Un_S
-		case 0x30: // Bge_Un_S
-		case 0x31: // Bgt_Un_S
-		case 0x32: // Ble_Un_S
-		case 0x33: // Blt_Un_S
-		case 0x37: // Beq
-		case 0x38: // Bge
-		case 0x39: // Bgt
-		case 0x3A: // Ble
-		case 0x3B: // Blt
-		case 0x3C: // Bne_Un
-		case 0x3D: // Bge_Un
-		case 0x3E: // Bgt_Un
-		case 0x3F: // Ble_Un
-		case 0x40: // Blt_Un
+		VM_OP(0x2A) // Beq_S
+		VM_OP(0x2B) // Bge_S
+		VM_OP(0x2C) // Bgt_S
+		VM_OP(0x2D) // Ble_S
+		VM_OP(0x2E) // Blt_S
+		VM_OP(0x2F) // Bne_Un_S
+		VM_OP(0x30) // Bge_Un_S
+		VM_OP(0x31) // Bgt_Un_S
+		VM_OP(0x32) // Ble_Un_S
+		VM_OP(0x33) // Blt_Un_S
+		VM_OP(0x37) // Beq
+		VM_OP(0x38) // Bge
+		VM_OP(0x39) // Bgt
+		VM_OP(0x3A) // Ble
+		VM_OP(0x3B) // Blt
+		VM_OP(0x3C) // Bne_Un
+		VM_OP(0x3D) // Bge_Un
+		VM_OP(0x3E) // Bgt_Un
+		VM_OP(0x3F) // Ble_Un
+		VM_OP(0x40) // Blt_Un
 		{
 			short offset = ReadShort;
 
@@ -1838,6 +2639,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				val2 = As(val2p + 1, int);
 				val1 = As(val1p + 1, int);
 				break;
+			case ReferenceID: // Beq/Bne_Un on object references
+				val2 = ref_identity(As(val2p + 1, int));
+				val1 = ref_identity(As(val1p + 1, int));
+				break;
 			case Int16:
 			case UInt16:
 				val2 = As(val2p + 1, short);
@@ -1896,7 +2701,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 
 			if (condition)
 			{
-				ptr = my_stack->entry_il + offset;
+				ptr = st_ptr + offset;
 				DBG
 				("IL_Branch type 0x%02X, offset %d, condition true\n", ic, offset);
 			}
@@ -1905,10 +2710,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				DBG
 				("IL_Branch type 0x%02X, offset %d, condition false\n", ic, offset);
 			}
-			break;
+			VM_NEXT;
 		}
 
-		case 0x41: // Ldind
+		VM_OP(0x41) // Ldind
 		{
 			uchar typeid = ReadByte;
 			// POP
@@ -1924,10 +2729,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			DBG
 			("IL_Ldind typeid: %d\n", typeid);
 
-			break;
+			VM_NEXT;
 		}
 
-		case 0x4C: // Stind
+		VM_OP(0x4C) // Stind
 		{
 			uchar typeid = ReadByte;
 			// POP value
@@ -1940,14 +2745,16 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			ASSERT_LANG(*eptr == Address, "IL_Stind as typeid: %d, but stack is %d not address", typeid, *eptr);
 
 			uchar* valaddr = TypedAddrAsValPtr(eptr);
+			if (typeid == ReferenceID)
+				As(value + 1, int) = ref_store_id(As(value + 1, int), valaddr);
 			CPYVAL(valaddr, value + 1, typeid);
 
 			DBG("IL_Stind typeid: %d\n", typeid);
 
-			break;
+			VM_NEXT;
 		}
 
-		case 0x4D:
+		VM_OP(0x4D)
 		{
 			int op = ReadByte;
 			// POP second operand
@@ -2084,10 +2891,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				ASSERT_LANG(0, "Unsupported type for arithmetic operation typeid=%d", typeid1);
 				break;
 			}
-			break;
+			VM_NEXT;
 		}
 
-		case 0x6D:
+		VM_OP(0x6D)
 		{ // Neg
 			POP;
 			uchar typeid = *eptr;
@@ -2113,10 +2920,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			}
 			DBG
 			("IL_Neg operation\n");
-			break;
+			VM_NEXT;
 		}
 
-		case 0x6E: // Not
+		VM_OP(0x6E) // Not
 		{
 			POP;
 			uchar typeid = *eptr;
@@ -2127,7 +2934,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0x70: // Conv_I1 (Convert to SByte)
+		VM_OP(0x70) // Conv_I1 (Convert to SByte)
 		{
 			POP
 				char value = 0;
@@ -2154,7 +2961,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0x71: // Conv_U1 (Convert to Byte)
+		VM_OP(0x71) // Conv_U1 (Convert to Byte)
 		{
 			POP
 				unsigned char value = 0;
@@ -2181,7 +2988,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0x72: // Conv_I2 (Convert to Int16)
+		VM_OP(0x72) // Conv_I2 (Convert to Int16)
 		{
 			POP
 				short value = 0;
@@ -2209,7 +3016,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0x73: // Conv_U2 (Convert to UInt16)
+		VM_OP(0x73) // Conv_U2 (Convert to UInt16)
 		{
 			POP
 				unsigned short value = 0;
@@ -2237,7 +3044,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0x74: // Conv_I4 (Convert to Int32)
+		VM_OP(0x74) // Conv_I4 (Convert to Int32)
 		{
 			POP
 				int value = 0;
@@ -2263,10 +3070,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			PUSH_STACK_INT(value);
 			DBG
 			("ConvI4: %02X\n", ic);
-			break;
+			VM_NEXT;
 		}
 
-		case 0x75: // Conv_U4 (Convert to UInt32)
+		VM_OP(0x75) // Conv_U4 (Convert to UInt32)
 		{
 			POP
 				unsigned int value = 0;
@@ -2295,7 +3102,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0x76: // Conv_R4 (Convert to Single)
+		VM_OP(0x76) // Conv_R4 (Convert to Single)
 		{
 			POP
 				float value = 0;
@@ -2321,10 +3128,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			PUSH_STACK_FLOAT_M(value);
 			DBG
 			("ConvR4: %02X\n", ic);
-			break;
+			VM_NEXT;
 		}
 
-		case 0x77: // Conv_R_Un (Convert to Single, unsigned)
+		VM_OP(0x77) // Conv_R_Un (Convert to Single, unsigned)
 		{
 			POP
 				float value = 0;
@@ -2344,14 +3151,14 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			("ConvR_un: %02X\n", ic);
 			break;
 		}
-		case 0x78: // initobj (struct zero-init)
+		VM_OP(0x78) // initobj (struct zero-init)
 		{
 			// Not supported in this runtime path; just consume operand if any in future
 			DBG("Initobj (noop)\n");
 			break;
 		}
 
-		case 0x79: // Castclass (stack shape unchanged)
+		VM_OP(0x79) // Castclass (stack shape unchanged)
 		{
 			// For now, treat castclass as a no-op that leaves the reference on the stack.
 			// The compiler validates statically when possible; runtime operand is not provided.
@@ -2359,8 +3166,9 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			("Castclass (no-op)\n");
 			break;
 		}
-		case 0x7A: // Newobj
+		VM_OP(0x7A) // Newobj
 		{
+			VM_SPILL;
 			int clsid = ReadShort;
 			int op_type = ReadByte; // 0xA6: custom, 0xA7: builtin
 			int method_id = ReadShort;
@@ -2404,9 +3212,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0x7B: // Ldfld or Ldsfld
-		case 0x7C: // Ldflda or Ldsflda
-		case 0x7D: // Stfld or Stsfld
+		VM_OP(0x7B) // Ldfld or Ldsfld
+		VM_OP(0x7C) // Ldflda or Ldsflda
+		VM_OP(0x7D) // Stfld or Stsfld
+		vm_field_op: // entered with ic=0x7B from fused 0xCD
 		{
 			uchar type = ReadByte;
 			short offset = ReadShort;
@@ -2434,6 +3243,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				{
 					// Ldflda (get address of CartIO) 
 					PUSH_STACK_ADDRESS(field_ptr + 1, *field_ptr);
+					SET_CART_IO_TOUCHED(io_id); // may be written through the address.
 					DBG
 					("Get CartIO address: id=%d, offset=%d, type=%p\n", io_id, offset, *field_ptr);
 				}
@@ -2572,10 +3382,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				}
 			}
 
-			break;
+			VM_NEXT;
 		}
 
-		case 0x8E: // Ldlen
+		VM_OP(0x8E) // Ldlen
 		{
 			POP;
 			ASSERT_LANG(*eptr == ReferenceID, "Ldlen: Expected array reference");
@@ -2586,10 +3396,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			PUSH_STACK_INT(arr->len);
 			DBG
 			("IL_Ldlen obj_%d => %d elements of %d\n", arr_id, arr->len, arr->typeid);
-			break;
+			VM_NEXT;
 		}
 
-		case 0x8F: // Ldelema
+		VM_OP(0x8F) // Ldelema
 		{
 			POP; // index
 			int index = As(eptr + 1, int);
@@ -2597,6 +3407,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			ASSERT_LANG(*eptr == ReferenceID, "Ldelema: Expected array reference");
 			int arr_id = As(eptr + 1, int);
 			ASSERT_RT(arr_id != 0, "Null reference");
+			if (IS_IO_VIEW(arr_id)) io_view_materialize(arr_id); // the element may be written through.
 			struct array_val* arr = heap_obj[arr_id].pointer;
 			ASSERT_LANG(arr->header == ArrayHeader, "obj_%d is not an array", arr_id);
 			ASSERT_RT(index >= 0 && index < arr->len, "Array index out of range: %d/%d", index, arr->len);
@@ -2612,10 +3423,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			PUSH_STACK_ADDRESS(elem_addr, typeid);
 			DBG
 			("IL_Ldelema obj_%d %d-th elem\n", arr_id, index);
-			break;
+			VM_NEXT;
 		}
 
-		case 0x90: // Ldelem
+		VM_OP(0x90) // Ldelem
 		{
 			uchar typeid = ReadByte;
 
@@ -2638,10 +3449,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			//PUSH_STACK_INDIRECT(elem_addr);
 
 			DBG("IL_Ldelem type_%d from obj_%d[%d]\n", typeid, arr_id, index);
-			break;
+			VM_NEXT;
 		}
 
-		case 0x91: // Stelem
+		VM_OP(0x91) // Stelem
 		{
 			uchar typeid = ReadByte; //todo: this could be just elem_sz.
 
@@ -2653,6 +3464,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			ASSERT_LANG(*eptr == ReferenceID, "Stelem: Expected array reference");
 			int arr_id = As(eptr + 1, int);
 			ASSERT_RT(arr_id != 0, "Null reference");
+			if (IS_IO_VIEW(arr_id)) io_view_materialize(arr_id); // copy on write.
 			struct array_val* arr = heap_obj[arr_id].pointer;
 			ASSERT_LANG(arr->header == ArrayHeader, "obj_%d is not an array", arr_id);
 			ASSERT_RT(index >= 0 && index < arr->len, "Array index out of range: %d/%d", index, arr->len);
@@ -2668,17 +3480,20 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			{
 				if(arr->typeid != typeid) 
 					DBG("array_%d is type %d but stelem as %d\n", arr_id, arr->typeid, typeid);
+				if (arr->typeid == ReferenceID)
+					As(value + 1, int) = ref_store_id(As(value + 1, int), elem_addr);
 				CPYVAL(elem_addr, value+1, arr->typeid)
 			}
 
 			DBG
 			("IL_Stelem typeid_%d to obj_%d[%d]\n", typeid, arr_id, index);
-			break;
+			VM_NEXT;
 		} 
 
 
-		case 0xA0: // Callvirt (abstract)
+		VM_OP(0xA0) // Callvirt (abstract)
 		{
+			VM_SPILL;
 			DBG
 			("IL_Callvirt polymorphism \n");
 			short vmethod_id = ReadShort;
@@ -2724,7 +3539,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0xA1: // Ldftn or Ldtoken
+		VM_OP(0xA1) // Ldftn or Ldtoken
 		{
 			uchar address_type = ReadByte;
 			if (address_type != Address)
@@ -2766,8 +3581,9 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0xA2: // Callvirt (instanced)
+		VM_OP(0xA2) // Callvirt (instanced)
 		{
+			VM_SPILL;
 			DBG
 			("IL_Callvirt instanced\n");
 			if (eptr <= my_stack->evaluation_st_ptr)
@@ -2809,17 +3625,19 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0xA6: // Call (custom method)  
+		VM_OP(0xA6) // Call (custom method)  
 		{
+			VM_SPILL;
 			short method_id = ReadShort;
 			DBG
 			("to call custom %d\n", method_id);
 			vm_push_stack(method_id, -1, &eptr);
-			break;
+			VM_NEXT;
 		}
 
-		case 0xA7: // Call (built-in method)
+		VM_OP(0xA7) // Call (built-in method)
 		{
+			VM_SPILL;
 			short method_id = ReadShort;
 			if (method_id < NUM_BUILTIN_METHODS)
 			{
@@ -2831,10 +3649,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			{
 				ASSERT_LANG(0, "Invalid built-in method ID: %d", method_id);
 			}
-			break;
+			VM_NEXT;
 		}
 
-		case 0xA8: // Calli
+		VM_OP(0xA8) // Calli
 		{
 			// Implement indirect method call logic here
 			DBG
@@ -2842,11 +3660,11 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			break;
 		}
 
-		case 0xE2: // Ceq
-		case 0xE3: // Cgt
-		case 0xE4: // Cgt_Un
-		case 0xE5: // Clt
-		case 0xE6: // Clt_Un
+		VM_OP(0xE2) // Ceq
+		VM_OP(0xE3) // Cgt
+		VM_OP(0xE4) // Cgt_Un
+		VM_OP(0xE5) // Clt
+		VM_OP(0xE6) // Clt_Un
 		{
 			// if (il_cnt > 622)
 			// 	printf("CHK");
@@ -2872,7 +3690,8 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			case Byte: v1 = As(value1, unsigned char); break;
 			case Int16: v1 = As(value1, short); break;
 			case UInt16: v1 = As(value1, unsigned short); break;
-			case Int32: case ReferenceID: v1 = As(value1, int); break;
+			case Int32: v1 = As(value1, int); break;
+			case ReferenceID: v1 = ref_identity(As(value1, int)); break;
 			case UInt32: v1 = As(value1, unsigned int); break;
 			case Single: fv1 = As(value1, float); useF = 1; break;
 			}
@@ -2882,7 +3701,8 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			case Byte: v2 = As(value2, unsigned char); break;
 			case Int16: v2 = As(value2, short); break;
 			case UInt16: v2 = As(value2, unsigned short); break;
-			case Int32:  case ReferenceID: v2 = As(value2, int); break;
+			case Int32: v2 = As(value2, int); break;
+			case ReferenceID: v2 = ref_identity(As(value2, int)); break;
 			case UInt32: v2 = As(value2, unsigned int); break;
 			case Single: fv2 = As(value2, float); useF = 1; break;
 			}
@@ -2920,10 +3740,10 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 
 			// Push the result onto the stack
 			PUSH_STACK_INT(result);
-			break;
+			VM_NEXT;
 		}
 
-		case 0x50:
+		VM_OP(0x50)
 		{
 			unsigned short n = ReadShort;
 
@@ -2937,7 +3757,7 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 			if (jmp < n)
 			{
 				unsigned short* sw_ptr = ptr;
-				ptr = my_stack->entry_il + sw_ptr[jmp];
+				ptr = st_ptr + sw_ptr[jmp];
 				DBG
 				("IL_Switch, %d cases, hit case_%d -> offset_%d\n", n, jmp, sw_ptr[jmp]);
 			}
@@ -2947,50 +3767,226 @@ void vm_push_stack(int method_id, int new_obj_id, uchar** reptr)
 				DBG
 				("IL_Switch of %d cases, fall through.", n);
 			}
-			break;
+			VM_NEXT;
 		}
-		default:
+		// ---- type-specialized opcodes (ABI 2.1), emitted by DiverCompiler only when
+		// both operands are statically proven Int32/UInt32 (i4) or Single (r4). No
+		// typeid dispatch: the payload is read directly. Results match 0x4D/0xE2-E6/
+		// 0x2A-0x33 exactly (int results are pushed as Int32, float as Single).
+#define I4_OPERANDS POP; int b = As(eptr + 1, int); POP; int a = As(eptr + 1, int);
+#define R4_OPERANDS POP; float b = r4_from_bits(As(eptr + 1, int)); POP; float a = r4_from_bits(As(eptr + 1, int));
+#define I4_ARITH(x, expr) VM_OP(x) { I4_OPERANDS; PUSH_STACK_INT(expr); VM_NEXT; }
+#define R4_ARITH(x, expr) VM_OP(x) { R4_OPERANDS; *eptr = Single; As(eptr + 1, int) = r4_to_bits(expr); eptr += STACK_STRIDE; VM_NEXT; }
+#define TYPED_BRANCH(x, OPERANDS, cond) VM_OP(x) { short offset = ReadShort; OPERANDS; \
+			if (cond) { ptr = st_ptr + offset; } VM_NEXT; }
+
+		I4_ARITH(0x80, a + b)
+		I4_ARITH(0x81, a - b)
+		I4_ARITH(0x82, a * b)
+		I4_ARITH(0x83, a / b)
+		I4_ARITH(0x84, (int)((unsigned int)a / (unsigned int)b))
+		I4_ARITH(0x85, a % b)
+		I4_ARITH(0x86, (int)((unsigned int)a % (unsigned int)b))
+		I4_ARITH(0x87, a & b)
+		I4_ARITH(0x88, a | b)
+		I4_ARITH(0x89, a ^ b)
+		I4_ARITH(0x8A, a << b)
+		I4_ARITH(0x8B, a >> b)
+		I4_ARITH(0x8C, (int)((unsigned int)a >> b))
+
+		R4_ARITH(0x92, a + b)
+		R4_ARITH(0x93, a - b)
+		R4_ARITH(0x94, a * b)
+		R4_ARITH(0x95, a / b)
+
+		TYPED_BRANCH(0xB0, I4_OPERANDS, a == b)                                 // Beq (i4)
+		TYPED_BRANCH(0xB1, I4_OPERANDS, a >= b)                                 // Bge (i4)
+		TYPED_BRANCH(0xB2, I4_OPERANDS, a > b)                                  // Bgt (i4)
+		TYPED_BRANCH(0xB3, I4_OPERANDS, a <= b)                                 // Ble (i4)
+		TYPED_BRANCH(0xB4, I4_OPERANDS, a < b)                                  // Blt (i4)
+		TYPED_BRANCH(0xB5, I4_OPERANDS, a != b)                                 // Bne_Un (i4)
+		TYPED_BRANCH(0xB6, I4_OPERANDS, (unsigned int)a >= (unsigned int)b)     // Bge_Un (i4)
+		TYPED_BRANCH(0xB7, I4_OPERANDS, (unsigned int)a > (unsigned int)b)      // Bgt_Un (i4)
+		TYPED_BRANCH(0xB8, I4_OPERANDS, (unsigned int)a <= (unsigned int)b)     // Ble_Un (i4)
+		TYPED_BRANCH(0xB9, I4_OPERANDS, (unsigned int)a < (unsigned int)b)      // Blt_Un (i4)
+		TYPED_BRANCH(0xBA, R4_OPERANDS, a == b)                                 // Beq (r4)
+		TYPED_BRANCH(0xBB, R4_OPERANDS, a >= b)                                 // Bge (r4)
+		TYPED_BRANCH(0xBC, R4_OPERANDS, a > b)                                  // Bgt (r4)
+		TYPED_BRANCH(0xBD, R4_OPERANDS, a <= b)                                 // Ble (r4)
+		TYPED_BRANCH(0xBE, R4_OPERANDS, a < b)                                  // Blt (r4)
+		TYPED_BRANCH(0xBF, R4_OPERANDS, a != b)                                 // Bne_Un (r4)
+
+		I4_ARITH(0xC2, a == b)                                                  // Ceq (i4)
+		I4_ARITH(0xC3, a > b)                                                   // Cgt (i4)
+		I4_ARITH(0xC4, (unsigned int)a > (unsigned int)b)                       // Cgt_Un (i4)
+		I4_ARITH(0xC5, a < b)                                                   // Clt (i4)
+		I4_ARITH(0xC6, (unsigned int)a < (unsigned int)b)                       // Clt_Un (i4)
+		VM_OP(0xD2) { R4_OPERANDS; PUSH_STACK_INT(a == b); VM_NEXT; }           // Ceq (r4)
+		VM_OP(0xD3) { R4_OPERANDS; PUSH_STACK_INT(a > b); VM_NEXT; }            // Cgt (r4)
+		VM_OP(0xD5) { R4_OPERANDS; PUSH_STACK_INT(a < b); VM_NEXT; }            // Clt (r4)
+
+#undef I4_OPERANDS
+#undef R4_OPERANDS
+#undef I4_ARITH
+#undef R4_ARITH
+#undef TYPED_BRANCH
+
+		// ---- superinstructions (ABI 2.2), fused by DiverCompiler from common IL
+		// sequences. Each one does exactly what the original instructions did,
+		// minus the intermediate dispatches and stack traffic.
+		VM_OP(0xC8) // Ldloc a; Ldloc b; i4 branch
+		{
+			uchar cond = ReadByte;
+			unsigned short a_offset = ReadShort;
+			unsigned short b_offset = ReadShort;
+			short offset = ReadShort;
+			if (i4_branch(cond, As(my_stack->vars + a_offset + 1, int), As(my_stack->vars + b_offset + 1, int)))
+				ptr = st_ptr + offset;
+			DBG("IL_Fused ldloc.ldloc.br 0x%02X var@%d var@%d -> %d\n", cond, a_offset, b_offset, offset);
+			VM_NEXT;
+		}
+		VM_OP(0xC9) // Ldloc a; Ldc.i4 k; i4 branch
+		{
+			uchar cond = ReadByte;
+			unsigned short a_offset = ReadShort;
+			int imm = ReadInt;
+			short offset = ReadShort;
+			if (i4_branch(cond, As(my_stack->vars + a_offset + 1, int), imm))
+				ptr = st_ptr + offset;
+			DBG("IL_Fused ldloc.ldc.br 0x%02X var@%d %d -> %d\n", cond, a_offset, imm, offset);
+			VM_NEXT;
+		}
+		VM_OP(0xCA) // Ldc k; typed arith (top = top op k)
+		{
+			uchar op = ReadByte;
+			int imm = ReadInt;
+			POP;
+			int a = As(eptr + 1, int);
+			if (op >= 0x92)
+			{
+				*eptr = Single;
+				As(eptr + 1, int) = r4_to_bits(r4_arith(op, r4_from_bits(a), r4_from_bits(imm)));
+				eptr += STACK_STRIDE;
+			}
+			else
+			{
+				PUSH_STACK_INT(i4_arith(op, a, imm));
+			}
+			DBG("IL_Fused ldc.arith 0x%02X\n", op);
+			VM_NEXT;
+		}
+		VM_OP(0xCB) // Ldloc a; Ldc k; typed arith; Stloc b (b is a same-kind local)
+		{
+			uchar op = ReadByte;
+			unsigned short a_offset = ReadShort;
+			int imm = ReadInt;
+			unsigned short b_offset = ReadShort;
+			int a = As(my_stack->vars + a_offset + 1, int);
+			if (op >= 0x92)
+				a = r4_to_bits(r4_arith(op, r4_from_bits(a), r4_from_bits(imm)));
+			else
+				a = i4_arith(op, a, imm);
+			As(my_stack->vars + b_offset + 1, int) = a;
+			DBG("IL_Fused ldloc.ldc.arith.stloc 0x%02X var@%d -> var@%d\n", op, a_offset, b_offset);
+			VM_NEXT;
+		}
+		VM_OP(0xCC) // Stloc x; Ldloc x
+		{
+			ptr += 1; // typeid, not necessary
+			unsigned short offset = ReadShort;
+			uchar* addr = my_stack->vars + offset;
+			POP;
+			copy_val(addr, eptr);
+			PUSH_STACK_INDIRECT(addr);
+			DBG("IL_Fused stloc.ldloc var@%d(type_%d)\n", offset, *addr);
+			VM_NEXT;
+		}
+		VM_OP(0xCD) // Ldarg; Ldfld/Ldsfld (operands of 0x7B follow)
+		{
+			unsigned short offset = ReadShort;
+			PUSH_STACK_INDIRECT(&my_stack->args[offset]);
+			DBG("IL_Fused ldarg @%d, ", offset);
+			ic = 0x7B;
+			goto vm_field_op;
+		}
+
+		// ---- internal opcodes, produced only by vm_predecode_methods() ----
+		VM_OP(0xF0) // Ldc_I4 (pre-decoded 0x15 06)
+		{
+			ptr += 1;
+			int val = ReadInt;
+			PUSH_STACK_INT(val);
+			DBG("IL_Ldc_I4 %d\n", val);
+			VM_NEXT;
+		}
+		VM_OP(0xF1) // Ldc_R4 (pre-decoded 0x15 08)
+		{
+			ptr += 1;
+			int val = ReadInt;
+			PUSH_STACK_FLOAT_M(val);
+			DBG("IL_Ldc_R4\n");
+			VM_NEXT;
+		}
+		VM_OP(0xF2) // Ldnull (pre-decoded 0x15 10)
+		{
+			ptr += 1;
+			PUSH_STACK_REFERENCEID(0);
+			DBG("ldnull \n");
+			VM_NEXT;
+		}
+		VM_OP(0xF3) // Ldsfld (pre-decoded plain static 0x7B)
+		{
+			ptr += 1;
+			short offset = ReadShort;
+			ptr += 2;
+			uchar* field_ptr = statics_val_ptr + offset;
+			PUSH_STACK_INDIRECT(field_ptr);
+			DBG("ldsfld type_%d from offset_%d\n", *field_ptr, offset);
+			VM_NEXT;
+		}
+		VM_OP(0xF4) // Stsfld (pre-decoded plain static 0x7D)
+		{
+			ptr += 1;
+			short offset = ReadShort;
+			ptr += 2;
+			uchar* field_ptr = statics_val_ptr + offset;
+			POP;
+			copy_val(field_ptr, eptr);
+			DBG("stflds type_%d to offset_%d\n", *field_ptr, offset);
+			VM_NEXT;
+		}
+
+		VM_OP_DEFAULT
 			ASSERT_LANG(0, "Unknown instruction: 0x%02X", ic);
 		}
 
 		ASSERT_LANG(ptr < virt_ptr, "bad program counter");
-		my_stack->PC = ptr; // Update program counter
-		my_stack->evaluation_pointer = eptr;
-
 	}
 
 exited:
 	new_stack_depth--;
 	DBG("<<< custom method %d finish\n", method_id);
 }
+#ifndef IS_MCU
+#undef VM
+#define VM vm_cur
+#endif
 
 void reset_cart_IO_stored() {
-	memset(cart_IO_stored, 0, sizeof(cart_IO_stored));
+	memset(cart_IO_stored, 0, cart_IO_words * sizeof(unsigned int));
 }
 
-// Helper function to mark and traverse objects
-void mark_object(int obj_id)
+// Calls visit() on every ReferenceID slot inside heap object obj_id.
+static void foreach_ref_field(int obj_id, void (*visit)(int* ref_id_ptr))
 {
-	ASSERT_LANG(obj_id >= 0 && obj_id < heap_newobj_id, "invalid reference id %d", obj_id);
-	if (obj_id == 0 || heap_obj[obj_id].new_id != -1)
-		return;
-
-	heap_obj[obj_id].new_id = -2; // Mark as visited
-
 	uchar* header = heap_obj[obj_id].pointer;
-	DBG("Marked obj_%d, header_%d\n", obj_id, *header);
-
 	if (*header == ArrayHeader)
 	{
 		struct array_val* arr = header;
 		if (arr->typeid == ReferenceID)
 		{
 			for (int i = 0; i < arr->len; ++i)
-			{
-				int* ref_id_ptr = &arr->payload + get_type_sz(ReferenceID) * i;
-				if (*ref_id_ptr != 0)
-					mark_object(*ref_id_ptr);
-			}
+				visit((int*)(&arr->payload + get_type_sz(ReferenceID) * i));
 		}
 	}
 	else if (*header == ObjectHeader)
@@ -3008,11 +4004,7 @@ void mark_object(int obj_id)
 				int typeid = ftype[j + 1];
 				ASSERT_LANG(typeid == *ptr, "bad builtin_cls %d on obj_%d", b_clsid, obj_id);
 				if (typeid == ReferenceID)
-				{
-					int* ref_id_ptr = ptr + 1;
-					if (*ref_id_ptr != 0)
-						mark_object(*ref_id_ptr);
-				}
+					visit((int*)(ptr + 1));
 				ptr += get_val_sz(typeid);
 			}
 		}
@@ -3023,11 +4015,7 @@ void mark_object(int obj_id)
 			for (int j = 0; j < field_count; j++)
 			{
 				if (layout[j].typeid == ReferenceID)
-				{
-					int* ref_id_ptr = &obj->payload + layout[j].offset + 1;
-					if (*ref_id_ptr != 0)
-						mark_object(*ref_id_ptr);
-				}
+					visit((int*)(&obj->payload + layout[j].offset + 1));
 			}
 		}
 	}
@@ -3037,15 +4025,184 @@ void mark_object(int obj_id)
 	}
 }
 
-void clean_up()
+// ---- Mark worklist ----
+// Marking is iterative: a gray object (new_id -2, fields not scanned yet) sits on
+// an explicit stack of reference ids instead of the C stack, which is small on
+// MCU and was overrun by long lists / linked structures. Collections only run
+// with the VM stack empty, so the worklist borrows the idle evaluation stack
+// area above stack0, bounded by the free gap below the heap, the object table
+// and DIVER_GC_MARK_STACK entries (0: no extra bound). When it is full, the object is left as -3 ("marked,
+// fields not scanned") and picked up again by a rescan of the id table once the
+// stack drains, so marking stays correct with any stack size.
+#ifndef DIVER_GC_MARK_STACK
+#define DIVER_GC_MARK_STACK 0
+#endif
+
+static void mark_begin()
+{
+	uchar* heap_lo = heap_newobj_id > 1 ? heap_obj[heap_newobj_id - 1].pointer : heap_tail;
+	int room = (int)(heap_lo - (uchar*)stack0) / (int)sizeof(short);
+	gc_mark_stack = (short*)stack0;
+	gc_mark_cap = room < heap_obj_cap ? room : heap_obj_cap;
+	if (DIVER_GC_MARK_STACK > 0 && gc_mark_cap > DIVER_GC_MARK_STACK) gc_mark_cap = DIVER_GC_MARK_STACK;
+	if (gc_mark_cap < 0) gc_mark_cap = 0;
+	gc_mark_sp = 0;
+	gc_mark_overflow = 0;
+}
+
+static void mark_push(int obj_id)
+{
+	ASSERT_LANG(obj_id >= 0 && obj_id < heap_newobj_id, "invalid reference id %d", obj_id);
+	if (obj_id == 0 || heap_obj[obj_id].new_id != -1)
+		return;
+	if (gc_mark_sp < gc_mark_cap)
+	{
+		heap_obj[obj_id].new_id = -2; // Mark as visited
+		gc_mark_stack[gc_mark_sp++] = (short)obj_id;
+	}
+	else
+	{
+		heap_obj[obj_id].new_id = -3; // marked, fields still to scan
+		gc_mark_overflow = 1;
+	}
+	DBG("Marked obj_%d, header_%d\n", obj_id, *heap_obj[obj_id].pointer);
+}
+
+static void mark_ref(int* ref_id_ptr)
+{
+	if (*ref_id_ptr != 0)
+		mark_push(*ref_id_ptr);
+}
+
+static void mark_drain()
+{
+	for (;;)
+	{
+		while (gc_mark_sp > 0)
+			foreach_ref_field(gc_mark_stack[--gc_mark_sp], mark_ref);
+		if (!gc_mark_overflow)
+			return;
+		// rescan: re-push everything left unscanned by an overflow.
+		gc_mark_overflow = 0;
+		for (int i = gc_old_n + 1; i < heap_newobj_id; i++)
+		{
+			if (heap_obj[i].new_id == -3)
+			{
+				heap_obj[i].new_id = -1;
+				mark_push(i);
+			}
+		}
+	}
+}
+
+static void remap_ref(int* ref_id_ptr)
+{
+	int old_id = *ref_id_ptr;
+	if (old_id > 0 && old_id < heap_newobj_id)
+	{
+		*ref_id_ptr = heap_obj[old_id].new_id;
+		DBG("Updated rid %d to %d\n", old_id, *ref_id_ptr);
+	}
+}
+
+// Helper function to mark and traverse objects. Objects whose new_id is not -1
+// (already marked, or old during a minor collection) are not traversed.
+// Requires mark_begin() earlier in the same collection.
+void mark_object(int obj_id)
+{
+	mark_push(obj_id);
+	mark_drain();
+}
+
+static void visit_in_range(int* ref_id_ptr)
+{
+	if ((uchar*)ref_id_ptr >= gc_visit_lo && (uchar*)ref_id_ptr < gc_visit_hi)
+		gc_visit_fn(ref_id_ptr);
+}
+
+// Calls visit() on the ReferenceID slots of obj_id that lie in [lo, hi).
+static void foreach_ref_field_in(int obj_id, uchar* lo, uchar* hi, void (*visit)(int* ref_id_ptr))
+{
+	struct array_val* arr = (struct array_val*)heap_obj[obj_id].pointer;
+	if (arr->header == ArrayHeader)
+	{
+		if (arr->typeid != ReferenceID) return;
+		int sz = get_type_sz(ReferenceID);
+		uchar* elems = &arr->payload;
+		int from = lo > elems ? (int)(lo - elems + sz - 1) / sz : 0;
+		int to = hi > elems ? (int)(hi - elems + sz - 1) / sz : 0;
+		if (to > arr->len) to = arr->len;
+		for (int i = from; i < to; ++i)
+			visit((int*)(elems + sz * i));
+		return;
+	}
+	gc_visit_lo = lo;
+	gc_visit_hi = hi;
+	gc_visit_fn = visit;
+	foreach_ref_field(obj_id, visit_in_range);
+}
+
+// Calls visit() on every old slot on a set card. refresh: clear the cards first,
+// for a visit that sets them again (remember_ref).
+static void gc_visit_cards(void (*visit)(int* ref_id_ptr), int refresh)
+{
+	if (gc_old_n == 0) return;
+	int n_cards = (int)(heap_tail - gc_old_lo + GC_CARD_BYTES - 1) >> DIVER_GC_CARD_SHIFT;
+	for (int w = 0; w * 32 < n_cards; w++)
+	{
+		unsigned int bits = gc_cards[w];
+		if (bits == 0) continue;
+		if (refresh) gc_cards[w] = 0;
+		for (int b = 0; b < 32; b++)
+		{
+			if (!(bits & (1u << b))) continue;
+			int card = w * 32 + b;
+			uchar* hi = heap_tail - ((uintptr_t)card << DIVER_GC_CARD_SHIFT);
+			uchar* lo = hi - GC_CARD_BYTES;
+			if (lo < gc_old_lo) lo = gc_old_lo;
+			// first old object that starts below hi (pointers fall as ids grow)
+			int a = 1, z = gc_old_n;
+			while (a < z)
+			{
+				int m = (a + z) / 2;
+				if (heap_obj[m].pointer < hi) z = m; else a = m + 1;
+			}
+			for (int i = a; i <= gc_old_n; i++)
+			{
+				uchar* end = i > 1 ? heap_obj[i - 1].pointer : heap_tail;
+				if (end <= lo) break;
+				foreach_ref_field_in(i, lo, hi, visit);
+			}
+		}
+	}
+}
+
+static void remember_ref(int* ref_id_ptr)
+{
+	if (*ref_id_ptr > gc_old_n)
+		gc_card_mark((uchar*)ref_id_ptr);
+}
+
+static void validate_heap_headers(int first)
+{
+	for (int i = first; i < heap_newobj_id; ++i)
+	{
+		uchar* header = heap_obj[i].pointer;
+		ASSERT_LANG(*header == ArrayHeader || *header == ObjectHeader || *header == StringHeader, "bad heap header! header=%d", *header);
+	}
+}
+
+// Collects ids first..heap_newobj_id-1; ids below `first` are kept as they are
+// (first=1: full collection, first=gc_old_n+1: minor collection).
+static void collect_from(int first)
 {
-	DBG("Starting heap cleanup\n");
+	DBG("Starting heap cleanup from obj_%d\n", first);
 
 	int prev_obj_n = heap_newobj_id;
-	// Reset all new_id to -1
-	for (int i = 1; i < heap_newobj_id; i++)
+	// Reset young new_id to -1; older objects keep new_id == id and count as marked.
+	for (int i = first; i < heap_newobj_id; i++)
 		heap_obj[i].new_id = -1;
-
+	mark_begin();
 
 	// Start traversal from LadderLogic root object
 	DBG("mark root: ");
@@ -3065,9 +4222,14 @@ void clean_up()
 		}
 	}
 
+	// old slots on set cards are roots for the young region.
+	if (first > 1)
+		gc_visit_cards(mark_ref, 0);
+	mark_drain();
+
 	// Assign new IDs to marked objects
-	int new_id = 1;
-	for (int i = 1; i < heap_newobj_id; i++)
+	int new_id = first;
+	for (int i = first; i < heap_newobj_id; i++)
 	{
 		if (heap_obj[i].new_id == -2)
 		{
@@ -3092,115 +4254,43 @@ void clean_up()
 		}
 	}
 
-	// Update reference IDs in heap objects
-	for (int i = 1; i < heap_newobj_id; i++)
+	// Update reference IDs in heap objects (old slots on set cards may point into the young region)
+	for (int i = first; i < heap_newobj_id; i++)
 	{
 		if (heap_obj[i].new_id != -1)
-		{
-			uchar* header = heap_obj[i].pointer;
-			if (*header == ArrayHeader)
-			{
-				struct array_val* arr = header;
-				if (arr->typeid == ReferenceID)
-				{
-					for (int j = 0; j < arr->len; ++j)
-					{
-						int* ref_id_ptr = &arr->payload + get_type_sz(ReferenceID) * j;
-						int old_id = *ref_id_ptr;
-						if (old_id > 0 && old_id < heap_newobj_id)
-						{
-							*ref_id_ptr = heap_obj[old_id].new_id;
-							DBG("Updated rid in old custom obj_%d[%d]: refid %d to %d\n", i, j, old_id, *ref_id_ptr);
-						}
-					}
-				}
-			}
-			else if (*header == ObjectHeader)
-			{
-				struct object_val* obj = header;
-				short clsid = obj->clsid;
-				if (clsid & 0xf000)
-				{
-					// buitin classes.
-					short b_clsid = (short)(clsid - 0xf000);
-					uchar* ftype = builtin_cls[b_clsid];
-					uchar* ptr = &obj->payload;
-					for (int j = 0; j < *ftype; ++j)
-					{
-						int typeid = ftype[j + 1];
-						if (typeid == ReferenceID)
-						{
-							int* ref_id_ptr = ptr + 1;
-							int old_id = *ref_id_ptr;
-							if (old_id > 0 && old_id < heap_newobj_id)
-							{
-								*ref_id_ptr = heap_obj[old_id].new_id;
-								DBG("Updated rid in old builtin obj_%d(bcls_%d), field %d: refid %d to %d\n", i, b_clsid, j, old_id, *ref_id_ptr);
-							}
-						}
-						ptr += get_val_sz(typeid);
-					}
-				}
-				else {
-					struct per_field* layout = instanceable_class_per_layout_ptr + instanceable_class_layout_ptr[clsid].layout_offset;
-					int field_count = instanceable_class_layout_ptr[clsid].n_of_fields;
-
-					for (int j = 0; j < field_count; j++)
-					{
-						if (layout[j].typeid == ReferenceID)
-						{
-							int* ref_id_ptr = (int*)(&obj->payload + layout[j].offset + 1);
-							int old_id = *ref_id_ptr;
-							if (old_id > 0 && old_id < heap_newobj_id)
-							{
-								*ref_id_ptr = heap_obj[old_id].new_id;
-								DBG("Updated rid in old custom obj_%d(cls_%d), field %d: refid %d to %d\n", i, clsid, j, old_id, *ref_id_ptr);
-							}
-						}
-					}
-				}
-			}
-			else if (*header == StringHeader)
-			{
-				// do nothing.
-			}
-
-
-		}
+			foreach_ref_field(i, remap_ref);
 	}
+	if (first > 1)
+		gc_visit_cards(remap_ref, 0);
 
-	for (int i = 1; i < heap_newobj_id; ++i)
-	{
-		uchar* header = heap_obj[i].pointer;
-		ASSERT_LANG(*header == ArrayHeader || *header == ObjectHeader || *header == StringHeader, "bad heap header! header=%d", *header);
-	}
+	validate_heap_headers(first);
 
-	// Compact heap
-	uchar* tail = heap_obj[1].pointer;
-	int lastobj = 1;
-	for (int i = 2; i < heap_newobj_id; i++)
+	// Compact heap, sliding young survivors up against the kept region.
+	uchar* tail = first > 1 ? heap_obj[first - 1].pointer : heap_tail;
+	int lastobj = first - 1;
+	for (int i = first; i < heap_newobj_id; i++)
 	{
 		int nid = heap_obj[i].new_id;
-		if (nid != -1) {
-			if (i != nid)
-			{
-				uchar* originalPtr = heap_obj[i].pointer;
-				uchar* lastPtr = heap_obj[i - 1].pointer;
-				// copy from lastPtr to originalPtr.
-				int len = lastPtr - originalPtr;
-				uchar* newPtr = tail - len;
-				for (int p = len - 1; p >= 0; --p)
-					newPtr[p] = originalPtr[p];
-				tail = heap_obj[nid].pointer = newPtr;
-				lastobj = nid;
-				DBG("Moved object from index %d to %d, len=%d\n", i, nid, len);
-			}
-			else {
-				// keep position.
-				tail = heap_obj[nid].pointer;
-				lastobj = nid;
-			}
+		if (nid == -1) continue;
+		uchar age = heap_obj[i].age;
+		if (age < 255) age++;
+		if (i != nid)
+		{
+			uchar* originalPtr = heap_obj[i].pointer;
+			uchar* lastPtr = i > 1 ? heap_obj[i - 1].pointer : heap_tail;
+			// copy from lastPtr to originalPtr.
+			int len = lastPtr - originalPtr;
+			uchar* newPtr = tail - len;
+			for (int p = len - 1; p >= 0; --p)
+				newPtr[p] = originalPtr[p];
+			heap_obj[nid].pointer = newPtr;
+			DBG("Moved object from index %d to %d, len=%d\n", i, nid, len);
 		}
+		// else: keep position.
+		heap_obj[nid].age = age;
+		heap_obj[nid].new_id = nid;
+		tail = heap_obj[nid].pointer;
+		lastobj = nid;
 	}
 	heap_newobj_id = lastobj + 1;
 	
@@ -3212,16 +4302,172 @@ void clean_up()
 	
 	DBG("Heap cleanup complete. objcnt: %d->%d, size=%dB\n", prev_obj_n, lastobj, heap_tail - tail);
 
+	validate_heap_headers(first);
+
+	gc_heap_top_id = heap_newobj_id;
+
+	// promote: ages never increase with id, so the old region stays a prefix.
+	if (gc_old_n >= heap_newobj_id) gc_old_n = heap_newobj_id - 1;
+	int promoted = gc_old_n + 1;
+	while (gc_old_n + 1 < heap_newobj_id && heap_obj[gc_old_n + 1].age >= gc_promote_age)
+		gc_old_n++;
+
+	if (gc_full_every <= 1)
+	{
+		gc_old_lo = heap_tail; // no minor collections, no cards.
+		return;
+	}
+	gc_old_lo = gc_old_n > 0 ? heap_obj[gc_old_n].pointer : heap_tail;
+	if (first == 1)
+		memset(gc_cards, 0, gc_card_words * sizeof(unsigned int));
+	else
+		gc_visit_cards(remember_ref, 1);
+	for (int i = promoted; i <= gc_old_n; i++)
+		foreach_ref_field(i, remember_ref);
+}
+
+// Full mark-compact of the whole heap.
+void clean_up()
+{
+	gc_old_n = 0;
+	collect_from(1);
+}
+
+// End-of-cycle collection: minor unless a full one is due, nothing at all when
+// the cycle allocated no object.
+static void vm_collect()
+{
+	unsigned int gc_start = get_cyclic_cycles();
+	if (heap_newobj_id == gc_heap_top_id)
+	{
+		gc_skip_count++;
+		gc_last_full = 0;
+		gc_last_cycles = get_cyclic_cycles() - gc_start;
+		return;
+	}
+	int full = gc_full_every <= 1 || gc_force_full || ++gc_cycles_since_full >= gc_full_every;
+	if (full)
+	{
+		clean_up();
+		gc_cycles_since_full = 0;
+		gc_force_full = 0;
+		gc_full_count++;
+	}
+	else
+	{
+		collect_from(gc_old_n + 1);
+		gc_minor_count++;
+		// old garbage is only reclaimed by a full pass: schedule one early when the
+		// heap takes more than half the free region, or the id table is half used.
+		uchar* heap_lo = heap_newobj_id > 1 ? heap_obj[heap_newobj_id - 1].pointer : heap_tail;
+		if ((heap_tail - heap_lo) * 2 > (heap_tail - (uchar*)stack0) || heap_newobj_id * 2 > heap_obj_cap)
+			gc_force_full = 1;
+	}
+	gc_last_full = full;
+	gc_last_cycles = get_cyclic_cycles() - gc_start;
+}
+
+void vm_set_gc_config(int full_every, int promote_age)
+{
+	ENSURE_DEFAULT_CONTEXT();
+	if (full_every > 1 && gc_full_every <= 1)
+		gc_force_full = 1; // the card table is only built by a full collection.
+	gc_full_every = full_every;
+	gc_promote_age = promote_age < 1 ? 1 : (promote_age > 255 ? 255 : promote_age);
+}
+
+void vm_select_context(struct vm_context* ctx)
+{
+#ifdef IS_MCU
+	(void)ctx; // only the default context on MCU.
+#else
+	vm_cur = ctx ? ctx : &vm_default_ctx;
+#endif
+}
+
+struct vm_context* vm_current_context()
+{
+	return VM;
+}
+
+int vm_get_cur_il_offset()
+{
+	return cur_il_offset;
+}
+
+#ifndef IS_MCU
+struct vm_context* vm_context_create()
+{
+	struct vm_context* ctx = (struct vm_context*)malloc(sizeof(struct vm_context));
+	if (ctx) vm_context_defaults(ctx);
+	return ctx;
+}
+
+void vm_context_destroy(struct vm_context* ctx)
+{
+	if (ctx == 0 || ctx == &vm_default_ctx) return;
+	struct vm_context* prev = vm_cur;
+	vm_cur = ctx;
+	release_native_metadata();
+	vm_cur = prev == ctx ? &vm_default_ctx : prev;
+	free(ctx);
+}
+#endif
+
+#ifndef IS_MCU
+// Mark-phase benchmark (host builds only). Builds a throw-away graph of n
+// reference arrays above the current heap and marks it `rounds` times:
+//   shape 0 deep: a chain, every node points to the next one;
+//   shape 1 wide: one root array holding n-1 leaves;
+//   shape 2 tree: a binary tree in heap order.
+// Existing objects are treated as old (not traversed). The graph is dropped
+// afterwards, leaving the program heap untouched. Returns the total
+// get_cyclic_cycles() ticks spent marking, or -1 if the graph does not fit.
+long long vm_bench_mark(int shape, int n, int rounds)
+{
+	int base = heap_newobj_id;
+	uchar* heap_lo = base > 1 ? heap_obj[base - 1].pointer : heap_tail;
+	int need = n * (ArrayHeaderSize + 2 * get_type_sz(ReferenceID));
+	if (n < 1 || base + n > heap_obj_cap || heap_lo - need - heap_obj_cap * (int)sizeof(short) < (uchar*)stack0)
+		return -1;
+
+	for (int k = 0; k < n; ++k)
+	{
+		int len = shape == 1 ? (k == 0 ? n - 1 : 1) : (shape == 2 ? 2 : 1);
+		newarr(len, ReferenceID);
+	}
+	for (int k = 0; k < n; ++k)
+	{
+		int* slot = (int*)&((struct array_val*)heap_obj[base + k].pointer)->payload;
+		if (shape == 0 && k + 1 < n) slot[0] = base + k + 1;
+		if (shape == 1 && k > 0) ((int*)&((struct array_val*)heap_obj[base].pointer)->payload)[k - 1] = base + k;
+		if (shape == 2)
+		{
+			if (2 * k + 1 < n) slot[0] = base + 2 * k + 1;
+			if (2 * k + 2 < n) slot[1] = base + 2 * k + 2;
+		}
+	}
 
-	for (int i = 1; i < heap_newobj_id; ++i)
+	long long ticks = 0;
+	for (int r = 0; r < rounds; ++r)
 	{
-		uchar* header = heap_obj[i].pointer;
-		ASSERT_LANG(*header == ArrayHeader || *header == ObjectHeader || *header == StringHeader, "bad heap header! header=%d", *header);
+		for (int i = 1; i < heap_newobj_id; i++)
+			heap_obj[i].new_id = i < base ? i : -1;
+		unsigned int t0 = get_cyclic_cycles();
+		mark_begin();
+		mark_object(base);
+		ticks += (unsigned int)(get_cyclic_cycles() - t0);
+		for (int i = base; i < heap_newobj_id; i++)
+			ASSERT_RT(heap_obj[i].new_id == -2, "bench_mark: obj_%d not marked", i);
 	}
-}
 
+	heap_newobj_id = base;
+	return ticks;
+}
+#endif
 
-void vm_sort_slots();
+static void snapshot_parse();
+static void snapshot_flush();
 
 void vm_run(int iteration)
 {
@@ -3234,11 +4480,13 @@ void vm_run(int iteration)
 	writing_buf = tmp;
 	writing_buf->offset = 0;
 	writing_buf->N_slots = 0;
+	short* tmp_idx = processing_idx;
+	processing_idx = writing_idx;
+	writing_idx = tmp_idx; // cleared at the end of the cycle that used it.
 	leave_critical();
-	vm_sort_slots();
 
-	// clear all cart_IO touched.
-	reset_cart_IO_stored();
+	// cart_IO touched bits accumulate until the next LowerIO upload consumes them
+	// (vm_get_lower_memory / vm_get_lower_memory_delta clear them).
 
 	// put refreshed cart_IO static vals.
 
@@ -3247,13 +4495,19 @@ void vm_run(int iteration)
 	// static-rooted object (or heap_tail if the heap is empty).
 	mem_stack_hi = stack0;
 	mem_heap_lo = (heap_newobj_id > 1) ? heap_obj[heap_newobj_id - 1].pointer : heap_tail;
+	io_view_n = 0; // views of the previous processing_buf are gone.
+	snapshot_parse();
 
 	// start running.
 	iterations = iteration;
 	vm_push_stack(entry_method_id, -1, 0);
+	if (snap_out_dirty)
+		snapshot_flush();
 
 	// clean up.
-	clean_up();
+	if (processing_buf->N_slots > 0)
+		memset(processing_idx, 0, io_idx_cap * sizeof(short));
+	vm_collect();
 	snapshot_state = 0;
 }
 
@@ -3264,80 +4518,172 @@ void vm_run(int iteration)
 //   - [StringHeader=12][len:2][bytes]
 //   - [ArrayHeader=11][elemTid:1][len:4][raw bytes]
 //   - [ReferenceID=16][rid:4] (null if rid==0)
+// A buffer starting with UPPER_FRAME_SPARSE carries only some fields (see mcu_runtime.h).
+
+// Applies one upper token at ptr to cart_IO field cid; returns the pointer past the token.
+static uchar* put_upper_field(int cid, uchar* ptr, uchar* end)
+{
+	uchar flags = cartIO_layout_ptr[cid].flags;
+	DBG("UPPERIODBG: iterating for cart_io %d (flags=0x%02x), in total cart_io_number %d\n", cid, flags, cartIO_N);
+
+	ASSERT_RT(ptr < end, "upper buffer truncated at field %d", cid);
+	if (flags == 0x00) // Mutual: host write must reach the host's LowerIO view too (delta upload).
+		SET_CART_IO_TOUCHED(cid);
+	uchar* field_ptr = statics_val_ptr + cartIO_layout_ptr[cid].offset;
+	uchar expected_tid = *field_ptr;
+	uchar token = *ptr; ptr += 1;
+
+	DBG("UPPERIODBG: expected_tid: %d, token: %d\n", expected_tid, token);
+
+	if (expected_tid == ReferenceID)
+	{
+		if (token == ReferenceID)
+		{
+			int rid = As(ptr, int); ptr += 4;
+			*field_ptr = ReferenceID;
+			As(field_ptr + 1, int) = rid;
+		}
+		else if (token == StringHeader)
+		{
+			unsigned short slen = As(ptr, unsigned short); ptr += 2;
+			int rid = newstr((short)slen, ptr);
+			ptr += slen;
+			*field_ptr = ReferenceID;
+			As(field_ptr + 1, int) = rid;
+		}
+		else if (token == ArrayHeader)
+		{
+			uchar elem_tid = *ptr; ptr += 1;
+			int arr_len = As(ptr, int); ptr += 4;
+			if (!(elem_tid == Boolean || elem_tid == Byte || elem_tid == SByte || elem_tid == 3 ||
+				elem_tid == Int16 || elem_tid == UInt16 || elem_tid == Int32 || elem_tid == UInt32 || elem_tid == Single))
+				ASSERT_LANG(0, "upper put: array element type %d not allowed", elem_tid);
+			int elem_sz = get_type_sz(elem_tid);
+			ASSERT_RT(ptr + elem_sz * arr_len <= end, "upper buffer array payload overflow");
+			// same element type and length: overwrite the current array instead of allocating.
+			int rid = As(field_ptr + 1, int);
+			struct array_val* arr = rid > 0 && rid < heap_newobj_id ? (struct array_val*)heap_obj[rid].pointer : 0;
+			if (arr == 0 || arr->header != ArrayHeader || arr->typeid != elem_tid || arr->len != arr_len)
+			{
+				rid = newarr((short)arr_len, elem_tid);
+				arr = (struct array_val*)heap_obj[rid].pointer;
+			}
+			memcpy(&arr->payload, ptr, elem_sz * arr_len);
+			ptr += elem_sz * arr_len;
+			*field_ptr = ReferenceID;
+			As(field_ptr + 1, int) = rid;
+		}
+		else
+		{
+			ASSERT_LANG(0, "upper put: expected ReferenceID payload (string/array/ref), got token %d", token);
+		}
+	}
+	else
+	{
+		ASSERT_LANG(token == expected_tid, "put cart_io:%d expected type %d, recv:%d", cid, expected_tid, token);
+		int sz = get_type_sz(expected_tid);
+		ASSERT_RT(ptr + sz <= end, "upper buffer primitive overflow");
+		memcpy(field_ptr + 1, ptr, sz);
+		ptr += sz;
+	}
+	return ptr;
+}
 
 void vm_put_upper_memory(uchar* buffer, int size)
 {
 	uchar* ptr = buffer;
 	uchar* end = buffer + size;
 
-	for (int cid = 0; cid < cartIO_N; ++cid)
+	if (size > 0 && *ptr == UPPER_FRAME_SPARSE)
 	{
-		// Skip non-UpperIO fields (0x02=LowerIO should not be in upper buffer)
-		// Only process UpperIO (0x01) and Mutual (0x00) fields
-		uchar flags = cartIO_layout_ptr[cid].flags;
-		if (flags == 0x02) // LowerIO - skip
-			continue;
-
-		DBG("UPPERIODBG: iterating for cart_io %d (flags=0x%02x), in total cart_io_number %d\n", cid, flags, cartIO_N);
+		// sparse: ['S'][count:2]{[cid:2][token]}, later entries for the same field win.
+		ASSERT_RT(size >= 3, "sparse upper buffer truncated");
+		int count = As(ptr + 1, unsigned short);
+		ptr += 3;
+		for (int i = 0; i < count; ++i)
+		{
+			ASSERT_RT(ptr + 2 <= end, "sparse upper buffer truncated at entry %d", i);
+			int cid = As(ptr, unsigned short); ptr += 2;
+			ASSERT_RT(cid < cartIO_N && cartIO_layout_ptr[cid].flags != 0x02,
+				"sparse upper entry %d: field %d is not an UpperIO/Mutual field", i, cid);
+			ptr = put_upper_field(cid, ptr, end);
+		}
+	}
+	else
+	{
+		for (int cid = 0; cid < cartIO_N; ++cid)
+		{
+			// Skip non-UpperIO fields (0x02=LowerIO should not be in upper buffer)
+			// Only process UpperIO (0x01) and Mutual (0x00) fields
+			if (cartIO_layout_ptr[cid].flags == 0x02) // LowerIO - skip
+				continue;
+			ptr = put_upper_field(cid, ptr, end);
+		}
+	}
 
-		ASSERT_RT(ptr < end, "upper buffer truncated at field %d", cid);
-		uchar* field_ptr = statics_val_ptr + cartIO_layout_ptr[cid].offset;
-		uchar expected_tid = *field_ptr;
-		uchar token = *ptr; ptr += 1;
+	ASSERT_RT(ptr == end, "upper buffer size mismatch: leftover %d bytes", (int)(end - ptr));
+}
 
-		DBG("UPPERIODBG: expected_tid: %d, token: %d\n", expected_tid, token);
+// Serializes one cart_IO field as a LowerIO token (see vm_put_upper_memory for the token forms).
+static uchar* put_lower_field(uchar* lptr, uchar* field_ptr)
+{
+	uchar type_id = *field_ptr;
 
-		if (expected_tid == ReferenceID)
+	if (type_id == ReferenceID)
+	{
+		int rid = As(field_ptr + 1, int);
+		if (rid == 0)
 		{
-			if (token == ReferenceID)
-			{
-				int rid = As(ptr, int); ptr += 4;
-				*field_ptr = ReferenceID;
-				As(field_ptr + 1, int) = rid;
-			}
-			else if (token == StringHeader)
-			{
-				unsigned short slen = As(ptr, unsigned short); ptr += 2;
-				int rid = newstr((short)slen, ptr);
-				ptr += slen;
-				*field_ptr = ReferenceID;
-				As(field_ptr + 1, int) = rid;
-			}
-			else if (token == ArrayHeader)
-			{
-				uchar elem_tid = *ptr; ptr += 1;
-				int arr_len = As(ptr, int); ptr += 4;
-				if (!(elem_tid == Boolean || elem_tid == Byte || elem_tid == SByte || elem_tid == 3 ||
-					elem_tid == Int16 || elem_tid == UInt16 || elem_tid == Int32 || elem_tid == UInt32 || elem_tid == Single))
-					ASSERT_LANG(0, "upper put: array element type %d not allowed", elem_tid);
-				int elem_sz = get_type_sz(elem_tid);
-				ASSERT_RT(ptr + elem_sz * arr_len <= end, "upper buffer array payload overflow");
-				int rid = newarr((short)arr_len, elem_tid);
-				struct array_val* arr = heap_obj[rid].pointer;
-				memcpy(&arr->payload, ptr, elem_sz * arr_len);
-				ptr += elem_sz * arr_len;
-				*field_ptr = ReferenceID;
-				As(field_ptr + 1, int) = rid;
-			}
-			else
-			{
-				ASSERT_LANG(0, "upper put: expected ReferenceID payload (string/array/ref), got token %d", token);
-			}
+			*lptr = ReferenceID; lptr += 1;
+			As(lptr, int) = 0; lptr += 4;
+			return lptr;
+		}
+		uchar* header = heap_obj[rid].pointer;
+		if (*header == StringHeader)
+		{
+			struct string_val* str = (struct string_val*)header;
+			*lptr = StringHeader; lptr += 1;
+			As(lptr, unsigned short) = str->str_len; lptr += 2;
+			memcpy(lptr, &str->payload, str->str_len);
+			lptr += str->str_len;
+		}
+		else if (*header == ArrayHeader)
+		{
+			struct array_val* arr = (struct array_val*)header;
+			uchar elem_tid = arr->typeid;
+			if (!(elem_tid == Boolean || elem_tid == Byte || elem_tid == SByte || elem_tid == 3 ||
+				elem_tid == Int16 || elem_tid == UInt16 || elem_tid == Int32 || elem_tid == UInt32 || elem_tid == Single))
+				ASSERT_LANG(0, "lower get: array element type %d not allowed", elem_tid);
+			*lptr = ArrayHeader; lptr += 1;
+			*lptr = elem_tid; lptr += 1;
+			As(lptr, int) = arr->len; lptr += 4;
+			int elem_sz = get_type_sz(elem_tid);
+			memcpy(lptr, &arr->payload, elem_sz * arr->len);
+			lptr += elem_sz * arr->len;
 		}
 		else
 		{
-			ASSERT_LANG(token == expected_tid, "put cart_io:%d expected type %d, recv:%d", cid, expected_tid, token);
-			int sz = get_type_sz(expected_tid);
-			ASSERT_RT(ptr + sz <= end, "upper buffer primitive overflow");
-			memcpy(field_ptr + 1, ptr, sz);
-			ptr += sz;
+			ASSERT_LANG(0, "lower get: ReferenceID points to unsupported header %d", *header);
 		}
 	}
+	else
+	{
+		*lptr = type_id; lptr += 1;
+		int sz = get_type_sz(type_id);
+		memcpy(lptr, field_ptr + 1, sz);
+		lptr += sz;
+	}
+	return lptr;
+}
 
-	ASSERT_RT(ptr == end, "upper buffer size mismatch: leftover %d bytes", (int)(end - ptr));
+static unsigned int lower_fnv1a(const uchar* p, int n)
+{
+	unsigned int h = 2166136261u;
+	for (int i = 0; i < n; ++i)
+		h = (h ^ p[i]) * 16777619u;
+	return h ? h : 1; // 0 is reserved for "never uploaded".
 }
 
-int lowerUploadSz;
 uchar* vm_get_lower_memory()
 {
 	ASSERT_LANG(new_stack_depth == 0, "Must perform get_lower_memory after VM execution");
@@ -3351,59 +4697,61 @@ uchar* vm_get_lower_memory()
 	{
 		// Skip non-LowerIO fields (0x01=UpperIO should not be in lower buffer)
 		// Only export LowerIO (0x02) and Mutual (0x00) fields
-		uchar flags = cartIO_layout_ptr[i].flags;
-		if (flags == 0x01) // UpperIO - skip
+		if (cartIO_layout_ptr[i].flags == 0x01) // UpperIO - skip
 			continue;
+		lptr = put_lower_field(lptr, statics_val_ptr + cartIO_layout_ptr[i].offset);
+	}
 
-		uchar* field_ptr = statics_val_ptr + cartIO_layout_ptr[i].offset;
-		uchar type_id = *field_ptr;
+	reset_cart_IO_stored();
+	lowerUploadSz = (int)(lptr - lowerUpload);
+	return lowerUpload;
+}
 
-		if (type_id == ReferenceID)
-		{
-			int rid = As(field_ptr + 1, int);
-			if (rid == 0)
-			{
-				*lptr = ReferenceID; lptr += 1;
-				As(lptr, int) = 0; lptr += 4;
-				continue;
-			}
-			uchar* header = heap_obj[rid].pointer;
-			if (*header == StringHeader)
-			{
-				struct string_val* str = (struct string_val*)header;
-				*lptr = StringHeader; lptr += 1;
-				As(lptr, unsigned short) = str->str_len; lptr += 2;
-				memcpy(lptr, &str->payload, str->str_len);
-				lptr += str->str_len;
-			}
-			else if (*header == ArrayHeader)
-			{
-				struct array_val* arr = (struct array_val*)header;
-				uchar elem_tid = arr->typeid;
-				if (!(elem_tid == Boolean || elem_tid == Byte || elem_tid == SByte || elem_tid == 3 ||
-					elem_tid == Int16 || elem_tid == UInt16 || elem_tid == Int32 || elem_tid == UInt32 || elem_tid == Single))
-					ASSERT_LANG(0, "lower get: array element type %d not allowed", elem_tid);
-				*lptr = ArrayHeader; lptr += 1;
-				*lptr = elem_tid; lptr += 1;
-				As(lptr, int) = arr->len; lptr += 4;
-				int elem_sz = get_type_sz(elem_tid);
-				memcpy(lptr, &arr->payload, elem_sz * arr->len);
-				lptr += elem_sz * arr->len;
-			}
-			else
-			{
-				ASSERT_LANG(0, "lower get: ReferenceID points to unsupported header %d", *header);
-			}
-		}
-		else
+uchar* vm_get_lower_memory_delta(int keyframe)
+{
+	ASSERT_LANG(new_stack_depth == 0, "Must perform get_lower_memory after VM execution");
+	uchar* lowerUpload = stack0;
+	uchar* lptr = lowerUpload;
+
+	*lptr = keyframe ? LOWER_FRAME_KEY : LOWER_FRAME_DELTA; lptr += 1;
+	As(lptr, int) = iterations; lptr += 4;
+
+	// delta: bitmap over the exported (non-UpperIO) fields, filled while encoding.
+	uchar* bitmap = lptr;
+	if (!keyframe)
+	{
+		int n_lower = 0;
+		for (int i = 0; i < cartIO_N; ++i)
+			if (cartIO_layout_ptr[i].flags != 0x01) n_lower++;
+		memset(bitmap, 0, (n_lower + 7) / 8);
+		lptr += (n_lower + 7) / 8;
+	}
+
+	int li = 0;
+	for (int i = 0; i < cartIO_N; ++i)
+	{
+		if (cartIO_layout_ptr[i].flags == 0x01) // UpperIO - skip
+			continue;
+		uchar* field_ptr = statics_val_ptr + cartIO_layout_ptr[i].offset;
+		uchar* fstart = lptr;
+		if (*field_ptr == ReferenceID)
 		{
-			*lptr = type_id; lptr += 1;
-			int sz = get_type_sz(type_id);
-			memcpy(lptr, field_ptr + 1, sz);
-			lptr += sz;
+			// strings/arrays can change in place without a Stfld: compare payload hashes.
+			lptr = put_lower_field(lptr, field_ptr);
+			unsigned int h = lower_fnv1a(fstart, (int)(lptr - fstart));
+			if (!keyframe && h == lower_hash[i])
+				lptr = fstart;
+			lower_hash[i] = h;
 		}
+		else if (keyframe || (cart_IO_stored[i / 32] & (1U << (i % 32))))
+			lptr = put_lower_field(lptr, field_ptr);
+
+		if (!keyframe && lptr != fstart)
+			bitmap[li / 8] |= (uchar)(1 << (li % 8));
+		li++;
 	}
 
+	reset_cart_IO_stored();
 	lowerUploadSz = (int)(lptr - lowerUpload);
 	return lowerUpload;
 }
@@ -3455,83 +4803,168 @@ int vm_get_mem_peak_used()
 	return used;
 }
 
-void vm_put_buffer(uchar* buffer, int size, uchar type, int aux0, int aux1)
+// Telemetry: IL instructions executed since the program was loaded.
+int vm_get_il_count()
 {
-	enter_critical();
-	int myslot = writing_buf->N_slots;
-	ASSERT_RT(myslot < SLOT_NUMBER, "device IO buffer slots overflown");
-	writing_buf->N_slots += 1;
-	int myoffset = writing_buf->offset;
-	ASSERT_RT(writing_buf->offset + size <= BUF_SZ, "device IO buffer size overflown");
-	writing_buf->offset += size;
-	leave_critical();
+	return il_cnt;
+}
 
-	writing_buf->slots[myslot].type = type;
-	writing_buf->slots[myslot].offset = myoffset;
-	writing_buf->slots[myslot].aux0 = aux0;
-	writing_buf->slots[myslot].aux1 = aux1;
-	writing_buf->slots[myslot].len = size;
-	memcpy(&writing_buf->payload + myoffset, buffer, size);
+// Telemetry: which interpreter dispatch engine this runtime was built with
+// (1 = direct-threaded computed goto, 0 = portable switch).
+int vm_get_dispatch_mode()
+{
+	return DIVER_THREADED_DISPATCH;
 }
 
-#define SNAPSHOT_TYPE 0x55
-#define STREAM_TYPE 0x99
-#define EVENT_TYPE 0xbb
+// Telemetry: cost of the last end-of-cycle collection, in get_cyclic_cycles()
+// ticks (CPU cycles on MCU), and which kind of collection it was.
+unsigned int vm_get_gc_cycles()
+{
+	return gc_last_cycles;
+}
 
-void vm_put_snapshot_buffer(uchar* buffer, int size)
+int vm_get_gc_last_full()
 {
-	vm_put_buffer(buffer, size, SNAPSHOT_TYPE, 0, 0);
-	snapshot_state = 1;
+	return gc_last_full;
+}
+
+// Telemetry: collections since vm_set_program (full: whole heap, minor: young region only).
+int vm_get_gc_full_count()
+{
+	return gc_full_count;
+}
+
+int vm_get_gc_minor_count()
+{
+	return gc_minor_count;
+}
+
+// Telemetry: cycles that allocated nothing and therefore skipped collection.
+int vm_get_gc_skip_count()
+{
+	return gc_skip_count;
 }
 
-void vm_put_stream_buffer(int streamID, uchar* buffer, int size)
+// Telemetry: number of promoted (old-region) objects.
+int vm_get_gc_old_objs()
 {
-	vm_put_buffer(buffer, size, STREAM_TYPE, streamID, 0);
+	return gc_old_n;
 }
 
-void vm_put_event_buffer(int portID, int eventID, uchar* buffer, int size)
+// ---- device IO slot index ----
+// Each IO buffer has an open-addressed hash index (io_idx_cap entries, 0: empty,
+// else slot+1) keyed on io_slot.sortable = (type, aux0, aux1), filled as frames
+// arrive. An entry holds the latest slot of its key, earlier slots with the same
+// key are chained through io_slot.prev, so a lookup is "latest wins" and the
+// whole chain gives every frame of the key. The index of processing_buf is
+// cleared at the end of the cycle, before it becomes the writing buffer again.
+INLINE unsigned int io_key(uchar type, int aux0, int aux1)
 {
-	vm_put_buffer(buffer, size, EVENT_TYPE, portID, eventID);
+	return ((unsigned int)type << 24) | ((unsigned int)(uchar)aux0 << 16) | (unsigned short)aux1; // == io_slot.sortable
 }
 
-void vm_quick_sort_slots(int left, int right) {
-	int i = left, j = right;
-	unsigned int pivot = processing_buf->slots[sorted_slots[(left + right) / 2]].sortable;
+INLINE int io_hash(unsigned int key)
+{
+	return (int)(((unsigned long long)(key * 2654435761u) * (unsigned int)io_idx_cap) >> 32);
+}
 
-	// Partition
-	while (i <= j) {
-		while (processing_buf->slots[sorted_slots[i]].sortable < pivot)
-			i++;
-		while (processing_buf->slots[sorted_slots[j]].sortable > pivot)
-			j--;
-		if (i <= j) {
-			// Swap
-			short temp = sorted_slots[i];
-			sorted_slots[i] = sorted_slots[j];
-			sorted_slots[j] = temp;
-			i++;
-			j--;
+// Called in the critical section that allocates the slot.
+static void io_index_slot(struct io_buf* buf, short* idx, int slot)
+{
+	unsigned int key = buf->slots[slot].sortable;
+	int h = io_hash(key);
+	short prev = -1;
+	while (idx[h] != 0)
+	{
+		if (buf->slots[idx[h] - 1].sortable == key)
+		{
+			prev = idx[h] - 1;
+			break;
 		}
+		if (++h == io_idx_cap) h = 0;
 	}
+	buf->slots[slot].prev = prev;
+	idx[h] = (short)(slot + 1);
+}
+
+// Latest slot of key in processing_buf, -1 if none arrived.
+static int io_find_slot(unsigned int key)
+{
+	int h = io_hash(key);
+	while (processing_idx[h] != 0)
+	{
+		int slot = processing_idx[h] - 1;
+		if (processing_buf->slots[slot].sortable == key)
+			return slot;
+		if (++h == io_idx_cap) h = 0;
+	}
+	return -1;
+}
+
+// Returns 0, or -1 if the frame was dropped: no program yet, or this cycle's
+// buffer is full. Streams and events leave a slot and the size of the last
+// snapshot free, the snapshot is required every cycle so it is fatal to drop.
+int vm_put_buffer(uchar* buffer, int size, uchar type, int aux0, int aux1)
+{
+	ENSURE_DEFAULT_CONTEXT();
+	if (writing_buf == 0) return -1; // no program loaded yet.
+	int reserve_slots = 0, reserve_bytes = 0;
+	if (type != SNAPSHOT_TYPE)
+	{
+		reserve_slots = 1;
+		reserve_bytes = io_snapshot_reserve;
+	}
+	else
+		io_snapshot_reserve = size + IO_FRAME_HEADER;
+	enter_critical();
+	int myslot = writing_buf->N_slots;
+	int myoffset = writing_buf->offset + IO_FRAME_HEADER;
+	if (myslot + reserve_slots >= io_slot_cap || myoffset + size + reserve_bytes > io_payload_cap)
+	{
+		leave_critical();
+		ASSERT_RT(type != SNAPSHOT_TYPE, "device IO buffer overflown by the snapshot");
+		return -1;
+	}
+	writing_buf->N_slots += 1;
+	writing_buf->offset = myoffset + size;
+	struct io_slot* sp = &writing_buf->slots[myslot];
+	sp->type = type;
+	sp->aux0 = aux0;
+	sp->aux1 = aux1;
+	io_index_slot(writing_buf, writing_idx, myslot);
+	leave_critical();
+
+	uchar* frame = IO_PAYLOAD(writing_buf) + myoffset - IO_FRAME_HEADER;
+	As(frame, unsigned int) = (unsigned int)get_cyclic_micros();
+	struct array_val* hdr = (struct array_val*)(frame + 4);
+	hdr->header = ArrayHeader;
+	hdr->typeid = Byte;
+	hdr->len = size;
+	sp->offset = myoffset;
+	sp->len = size;
+	memcpy(IO_PAYLOAD(writing_buf) + myoffset, buffer, size);
+	return 0;
+}
 
-	// Recursion
-	if (left < j)
-		vm_quick_sort_slots(left, j);
-	if (i < right)
-		vm_quick_sort_slots(i, right);
+void vm_put_snapshot_buffer(uchar* buffer, int size)
+{
+	vm_put_buffer(buffer, size, SNAPSHOT_TYPE, 0, 0);
+	snapshot_state = 1;
 }
 
-void vm_sort_slots() {
-	// Initialize sorted_slots with indices
-	for (int i = 0; i < SLOT_NUMBER; i++)
-		sorted_slots[i] = i;
+int vm_put_stream_buffer(int streamID, uchar* buffer, int size)
+{
+	return vm_put_buffer(buffer, size, STREAM_TYPE, streamID, 0);
+}
 
-	// Perform quick sort
-	vm_quick_sort_slots(0, processing_buf->N_slots - 1);
+int vm_put_event_buffer(int portID, int eventID, uchar* buffer, int size)
+{
+	return vm_put_buffer(buffer, size, EVENT_TYPE, portID, eventID);
 }
 
 
 
+
 /// ##########################################################################################
 ///
 ///    ┳┓  •┓ •    ┏      •      •     ┓             •     
@@ -3578,8 +5011,13 @@ typedef struct { uchar bytes[STACK_VALUE_SIZE]; } stack_value_t;
 
 INLINE void stack_value_copy(stack_value_t* dst, const uchar* src) { 
 	memcpy(dst->bytes, src, STACK_VALUE_SIZE); 
+	if (dst->bytes[0] == ReferenceID) As(dst->bytes + 1, int) = ref_identity(As(dst->bytes + 1, int)); // collections find a copied view's copy.
+}
+INLINE void stack_value_store(uchar* dst, const stack_value_t* value)
+{
+	memcpy(dst, value->bytes, STACK_VALUE_SIZE);
+	if (dst[0] == ReferenceID) As(dst + 1, int) = ref_store_id(As(dst + 1, int), dst + 1); // storage is on the heap.
 }
-INLINE void stack_value_store(uchar* dst, const stack_value_t* value) { memcpy(dst, value->bytes, STACK_VALUE_SIZE); }
 INLINE uchar stack_value_type(const stack_value_t* value) { return value->bytes[0]; }
 INLINE void push_stack_value(uchar** reptr, const stack_value_t* value) { memcpy(*reptr, value->bytes, STACK_VALUE_SIZE); *reptr += STACK_STRIDE; }
 INLINE int stack_value_as_int(const stack_value_t* value) { return *(int*)(value->bytes + 1); }
@@ -3618,7 +5056,7 @@ INLINE void builtin_field_set_reference(struct object_val* obj, int clsidx, int
 {
 	uchar* field = builtin_field_ptr_by_index(obj, clsidx, field_idx);
 	ASSERT_LANG(field[0] == ReferenceID, "Field %d of clsidx %d is not ReferenceID (type=%d)", field_idx, clsidx, field[0]);
-	*(int*)(field + 1) = ref_id;
+	*(int*)(field + 1) = ref_store_id(ref_id, field + 1);
 }
 
 INLINE int builtin_field_get_int(struct object_val* obj, int clsidx, int field_idx)
@@ -3655,7 +5093,7 @@ INLINE struct array_val* cast_array(int ref_id)
 
 INLINE struct array_val* expect_array(int ref_id, uchar expected_type, const char* where)
 {
-	ASSERT_LANG(ref_id > 0 && ref_id < heap_newobj_id, "%s: invalid array reference id %d", where, ref_id);
+	ASSERT_LANG(ref_id > 0 && (ref_id < heap_newobj_id || IS_IO_VIEW(ref_id)), "%s: invalid array reference id %d", where, ref_id);
 	uchar* header = heap_obj[ref_id].pointer;
 	if (header == NULL || *header != ArrayHeader)
 		ASSERT_LANG(0, "%s: reference %d does not point to an array (header=%d)", where, ref_id, header ? *header : -1);
@@ -4669,35 +6107,81 @@ void builtin_String_get_Length(uchar** reptr) {
 }
 
 
-void just_read(uchar** reptr, uchar type, uchar port, short ext)
+// byte[] for an input slot: a view of the payload, or a heap copy once the views run out.
+static int io_read_slot(struct io_slot* sp)
 {
-	// Binary search for slot 
-	int left = 0, right = processing_buf->N_slots - 1;
-	unsigned int mysort = ((type << 24) | (port << 16) | ext); // little endian!
-	while (left <= right) {
-		int mid = left + (right - left) / 2;
-		struct io_slot* sp = &processing_buf->slots[sorted_slots[mid]];
-		if (sp->type == type && sp->aux0 == port && sp->aux1 == ext) {//just fuck.
-			int refid = newarr(sp->len, Byte);
-			struct array_val* arr = heap_obj[refid].pointer;
-			memcpy(&arr->payload, &processing_buf->payload + sp->offset, sp->len);
-			PUSH_STACK_REFERENCEID(refid);
-			return;
-		}
-		else if (sp->sortable < mysort) {
-			left = mid + 1;
+	uchar* payload = IO_PAYLOAD(processing_buf) + sp->offset;
+	int refid = io_view_new(payload);
+	if (refid == 0)
+	{
+		refid = newarr(sp->len, Byte);
+		memcpy(&((struct array_val*)heap_obj[refid].pointer)->payload, payload, sp->len);
+	}
+	return refid;
+}
+
+uchar* vm_next_port_event(int portID, int* cursor, int* eventID, int* len)
+{
+	// slots are in arrival order.
+	for (int i = *cursor; i < processing_buf->N_slots; ++i)
+	{
+		struct io_slot* sp = &processing_buf->slots[i];
+		if (sp->type == EVENT_TYPE && sp->aux0 == (uchar)portID)
+		{
+			*cursor = i + 1;
+			*eventID = sp->aux1;
+			*len = sp->len;
+			return IO_PAYLOAD(processing_buf) + sp->offset;
 		}
-		else {
-			right = mid - 1;
+	}
+	*cursor = processing_buf->N_slots;
+	return NULL;
+}
+
+// Latest frame of (type, port, ext) received before this cycle, or null.
+void just_read(uchar** reptr, uchar type, uchar port, short ext)
+{
+	int slot = io_find_slot(io_key(type, port, ext));
+	PUSH_STACK_REFERENCEID(slot < 0 ? 0 : io_read_slot(&processing_buf->slots[slot])); // ldnull if none.
+}
+
+// Copies the frames chained from slot (latest first through io_slot.prev) into one
+// byte[], oldest first; with_header prefixes each with [arrival micros 4B][len 2B].
+static int io_gather_frames(int slot, int with_header)
+{
+	int hsz = with_header ? 6 : 0;
+	int total = 0;
+	for (int s = slot; s >= 0; s = processing_buf->slots[s].prev)
+		total += hsz + processing_buf->slots[s].len;
+	ASSERT_RT(total <= 32767, "too many bytes in IO frames (%d)", total);
+	int refid = newarr(total, Byte);
+	uchar* dst = &((struct array_val*)heap_obj[refid].pointer)->payload + total;
+	for (int s = slot; s >= 0; s = processing_buf->slots[s].prev)
+	{
+		struct io_slot* sp = &processing_buf->slots[s];
+		uchar* payload = IO_PAYLOAD(processing_buf) + sp->offset;
+		dst -= hsz + sp->len;
+		if (with_header)
+		{
+			memcpy(dst, payload - IO_FRAME_HEADER, 4);
+			As(dst + 4, unsigned short) = sp->len;
 		}
+		memcpy(dst + hsz, payload, sp->len);
 	}
-	PUSH_STACK_REFERENCEID(0); // ldnull
+	return refid;
 }
 
 // RunOnMCU methods
 void builtin_RunOnMCU_ReadStream(uchar** reptr) {
 	int port = pop_int(reptr);
-	just_read(reptr, STREAM_TYPE, port, 0);
+	int slot = io_find_slot(io_key(STREAM_TYPE, port, 0));
+	if (slot >= 0 && processing_buf->slots[slot].prev >= 0)
+	{
+		// several chunks arrived since the last cycle: the stream is their concatenation.
+		PUSH_STACK_REFERENCEID(io_gather_frames(slot, 0));
+		return;
+	}
+	PUSH_STACK_REFERENCEID(slot < 0 ? 0 : io_read_slot(&processing_buf->slots[slot]));
 }
 
 
@@ -4713,7 +6197,7 @@ void builtin_RunOnMCU_WriteStream(uchar** reptr) {
 	enter_critical();
 	int n_offset = writing_buf->offset;
 	// Bounds check: prevent buffer overflow
-	if (writing_buf->offset + arr->len > BUF_SZ - sizeof(struct io_buf)) {
+	if (writing_buf->offset + arr->len > io_payload_cap) {
 		leave_critical();
 		ASSERT_RT(0, "WriteStream buffer overflow: offset=%d + len=%d > max", n_offset, arr->len);
 		return;
@@ -4721,9 +6205,9 @@ void builtin_RunOnMCU_WriteStream(uchar** reptr) {
 	writing_buf->offset += arr->len;
 	leave_critical();
 
-	memcpy(&writing_buf->payload + n_offset, &arr->payload, arr->len);
+	memcpy(IO_PAYLOAD(writing_buf) + n_offset, &arr->payload, arr->len);
 
-	write_stream(port, (&writing_buf->payload) + n_offset, arr->len);
+	write_stream(port, IO_PAYLOAD(writing_buf) + n_offset, arr->len);
 }
 
 void builtin_RunOnMCU_ReadEvent(uchar** reptr) {
@@ -4734,6 +6218,15 @@ void builtin_RunOnMCU_ReadEvent(uchar** reptr) {
 	just_read(reptr, EVENT_TYPE, port, event_id);
 }
 
+// Every frame of (port, event_id) received since the last cycle, oldest first, in
+// one byte[]: {[arrival micros 4B][len 2B][payload]}; null if none arrived.
+void builtin_RunOnMCU_ReadEvents(uchar** reptr) {
+	int event_id = pop_int(reptr);
+	int port = pop_int(reptr);
+	int slot = io_find_slot(io_key(EVENT_TYPE, port, event_id));
+	PUSH_STACK_REFERENCEID(slot < 0 ? 0 : io_gather_frames(slot, 1));
+}
+
 void builtin_RunOnMCU_WriteEvent(uchar** reptr) {
 	int event_id = pop_int(reptr);
 	int port = pop_int(reptr);
@@ -4747,7 +6240,7 @@ void builtin_RunOnMCU_WriteEvent(uchar** reptr) {
 	enter_critical();
 	int n_offset = writing_buf->offset;
 	// Bounds check: prevent buffer overflow
-	if (writing_buf->offset + arr->len > BUF_SZ - sizeof(struct io_buf)) {
+	if (writing_buf->offset + arr->len > io_payload_cap) {
 		leave_critical();
 		ASSERT_RT(0, "WriteEvent buffer overflow: offset=%d + len=%d > max", n_offset, arr->len);
 		return;
@@ -4755,18 +6248,37 @@ void builtin_RunOnMCU_WriteEvent(uchar** reptr) {
 	writing_buf->offset += arr->len;
 	leave_critical();
 
-	memcpy(&writing_buf->payload + n_offset, &arr->payload, arr->len);
+	memcpy(IO_PAYLOAD(writing_buf) + n_offset, &arr->payload, arr->len);
 
-	write_event(port, event_id, (&writing_buf->payload) + n_offset, arr->len);
+	write_event(port, event_id, IO_PAYLOAD(writing_buf) + n_offset, arr->len);
 }
 
 void builtin_RunOnMCU_ReadSnapshot(uchar** reptr) {
-	// always have snapshot.
-	struct io_slot* sp = &processing_buf->slots[sorted_slots[0]];
-	int refid = newarr(sp->len, Byte);
-	struct array_val* arr = heap_obj[refid].pointer;
-	memcpy(&arr->payload, &processing_buf->payload + sp->offset, sp->len);
-	PUSH_STACK_REFERENCEID(refid);
+	// always have snapshot (vm_run requires one).
+	int slot = io_find_slot(io_key(SNAPSHOT_TYPE, 0, 0));
+	ASSERT_RT(slot >= 0, "no snapshot in this cycle");
+	PUSH_STACK_REFERENCEID(io_read_slot(&processing_buf->slots[slot]));
+}
+
+// Hands a whole output snapshot to write_snapshot, via the writing buffer like the
+// other outputs so the pointer stays valid for the rest of the cycle.
+static void snapshot_write(uchar* data, int len)
+{
+	// don't have to have same snapshot layout.
+	enter_critical();
+	int n_offset = writing_buf->offset;
+	// Bounds check: prevent buffer overflow
+	if (writing_buf->offset + len > io_payload_cap) {
+		leave_critical();
+		ASSERT_RT(0, "WriteSnapshot buffer overflow: offset=%d + len=%d > max", n_offset, len);
+		return;
+	}
+	writing_buf->offset += len;
+	leave_critical();
+
+	memcpy(IO_PAYLOAD(writing_buf) + n_offset, data, len);
+
+	write_snapshot(IO_PAYLOAD(writing_buf) + n_offset, len);
 }
 
 void builtin_RunOnMCU_WriteSnapshot(uchar** reptr) {
@@ -4776,21 +6288,176 @@ void builtin_RunOnMCU_WriteSnapshot(uchar** reptr) {
 	struct array_val* arr = header;
 	ASSERT_LANG(arr->typeid == Byte, "WriteSnapshot requires byte[] (typeid=%d)", arr->typeid);
 
-	// don't have to have same snapshot layout.
-	enter_critical();
-	int n_offset = writing_buf->offset;
-	// Bounds check: prevent buffer overflow
-	if (writing_buf->offset + arr->len > BUF_SZ - sizeof(struct io_buf)) {
-		leave_critical();
-		ASSERT_RT(0, "WriteSnapshot buffer overflow: offset=%d + len=%d > max", n_offset, arr->len);
+	snapshot_write(&arr->payload, arr->len);
+	// later partial writes patch what was just written.
+	snap_out_len = arr->len < SNAP_OUT_CAP ? arr->len : SNAP_OUT_CAP;
+	memcpy(snap_out, &arr->payload, snap_out_len);
+	snap_out_dirty = 0;
+}
+
+// Typed snapshot access. The layout {(|io_type|components|)*N|0xFF|}{payload} (see
+// mcu_runtime.h) is resolved once per cycle into snap_groups, so ReadDigital /
+// ReadAnalog read the processing buffer directly instead of ReadSnapshot plus
+// BitConverter. Boolean groups are bit-packed, LSB first, padded to whole bytes.
+// Whether there is a layout at all is configured (vm_config.snapshot_layout), not
+// guessed from the bytes: without it the snapshot is raw (e.g. the firmware's plain
+// 32-bit DI word), bit n is digital input n and Int32 word n is analog channel n.
+static void snapshot_parse()
+{
+	int slot = io_find_slot(io_key(SNAPSHOT_TYPE, 0, 0));
+	ASSERT_RT(slot >= 0, "no snapshot in this cycle");
+	struct io_slot* sp = &processing_buf->slots[slot];
+	uchar* p = IO_PAYLOAD(processing_buf) + sp->offset;
+	int len = sp->len;
+
+	if (!snap_layout)
+	{
+		snap_groups_n = 0;
+		snap_data = p;
+		snap_len = len;
+		snap_bits = len * 8;
+		snap_channels = len / 4;
 		return;
 	}
-	writing_buf->offset += arr->len;
-	leave_critical();
 
-	memcpy(&writing_buf->payload + n_offset, &arr->payload, arr->len);
+	int pos = 0, size = 0, groups = 0;
+	for (; pos + 3 <= len && p[pos] <= Single; pos += 3, ++groups)
+	{
+		int count = p[pos + 1] | (p[pos + 2] << 8);
+		size += p[pos] == Boolean ? (count + 7) / 8 : count * get_type_sz(p[pos]);
+	}
+	ASSERT_RT(pos < len && p[pos] == 0xFF, "snapshot layout: group %d has io_type %d, expected 0-8 or the 0xFF end marker", groups, pos < len ? p[pos] : -1);
+	ASSERT_RT(len - pos - 1 == size, "snapshot layout describes %d payload bytes, the snapshot has %d", size, len - pos - 1);
+	ASSERT_RT(groups <= SNAP_GROUPS_MAX, "snapshot layout has %d groups, at most %d", groups, SNAP_GROUPS_MAX);
+
+	snap_groups_n = groups;
+	snap_data = p + pos + 1;
+	snap_len = size;
+	snap_bits = snap_channels = 0;
+	int offset = 0;
+	for (int g = 0; g < groups; ++g)
+	{
+		struct snap_group* gp = &snap_groups[g];
+		gp->typeid = p[g * 3];
+		gp->count = p[g * 3 + 1] | (p[g * 3 + 2] << 8);
+		gp->offset = offset;
+		if (gp->typeid == Boolean)
+		{
+			gp->first = snap_bits;
+			snap_bits += gp->count;
+			offset += (gp->count + 7) / 8;
+		}
+		else
+		{
+			gp->first = snap_channels;
+			snap_channels += gp->count;
+			offset += gp->count * get_type_sz(gp->typeid);
+		}
+	}
+}
+
+// Group holding digital bit / analog channel `index` (already bounds checked).
+static struct snap_group* snapshot_group(int index, int digital)
+{
+	for (int g = 0; g < snap_groups_n; ++g)
+	{
+		struct snap_group* gp = &snap_groups[g];
+		if ((gp->typeid == Boolean) == digital && index >= gp->first && index < gp->first + gp->count)
+			return gp;
+	}
+	return 0;
+}
+
+void builtin_RunOnMCU_ReadDigital(uchar** reptr) {
+	int bit = pop_int(reptr);
+	ASSERT_RT(bit >= 0 && bit < snap_bits, "ReadDigital: bit %d, the snapshot has %d", bit, snap_bits);
+	int byte = bit >> 3;
+	if (snap_groups_n > 0)
+	{
+		struct snap_group* gp = snapshot_group(bit, 1);
+		bit -= gp->first;
+		byte = gp->offset + (bit >> 3);
+	}
+	push_bool(reptr, (snap_data[byte] >> (bit & 7)) & 1);
+}
+
+// Analog channel value, as int (Single truncated) and as float.
+static int snapshot_analog(int channel, float* fval)
+{
+	ASSERT_RT(channel >= 0 && channel < snap_channels, "ReadAnalog: channel %d, the snapshot has %d", channel, snap_channels);
+	uchar typeid = Int32;
+	int offset = channel * 4;
+	if (snap_groups_n > 0)
+	{
+		struct snap_group* gp = snapshot_group(channel, 0);
+		typeid = gp->typeid;
+		offset = gp->offset + (channel - gp->first) * get_type_sz(typeid);
+	}
+	uchar* p = snap_data + offset;
+	int ival; unsigned short u16; short i16; unsigned int u32;
+	switch (typeid)
+	{
+	case Byte: ival = p[0]; break;
+	case SByte: ival = (signed char)p[0]; break;
+	case Char:
+	case UInt16: memcpy(&u16, p, 2); ival = u16; break;
+	case Int16: memcpy(&i16, p, 2); ival = i16; break;
+	case UInt32: memcpy(&u32, p, 4); *fval = (float)u32; return (int)u32;
+	case Single: memcpy(fval, p, 4); return (int)*fval;
+	default: memcpy(&ival, p, 4); break;
+	}
+	*fval = (float)ival;
+	return ival;
+}
+
+void builtin_RunOnMCU_ReadAnalog(uchar** reptr) {
+	int channel = pop_int(reptr);
+	float f;
+	push_int(reptr, snapshot_analog(channel, &f));
+}
+
+void builtin_RunOnMCU_ReadAnalogFloat(uchar** reptr) {
+	int channel = pop_int(reptr);
+	float f;
+	snapshot_analog(channel, &f);
+	push_float(reptr, f);
+}
+
+// Partial writes patch snap_out, an image of the output snapshot that holds its
+// value across cycles; vm_run hands it to write_snapshot once at the end of the
+// cycle however many patches there were.
+static void snapshot_flush()
+{
+	snapshot_write(snap_out, snap_out_len);
+	snap_out_dirty = 0;
+}
+
+void builtin_RunOnMCU_WriteSnapshot_Offset(uchar** reptr) {
+	int offset = pop_int(reptr);
+	int args_array_id = pop_reference(reptr);
+	uchar* header = heap_obj[args_array_id].pointer;
+	ASSERT_LANG(*header == ArrayHeader, "WriteSnapshot data is not an array (header=%d)", *header);
+	struct array_val* arr = header;
+	ASSERT_LANG(arr->typeid == Byte, "WriteSnapshot requires byte[] (typeid=%d)", arr->typeid);
+	ASSERT_RT(offset >= 0 && offset + arr->len <= SNAP_OUT_CAP, "WriteSnapshot: offset=%d + len=%d > %d", offset, arr->len, SNAP_OUT_CAP);
+
+	memcpy(snap_out + offset, &arr->payload, arr->len);
+	if (offset + arr->len > snap_out_len) snap_out_len = offset + arr->len;
+	snap_out_dirty = 1;
+}
+
+void builtin_RunOnMCU_WriteDigital(uchar** reptr) {
+	// bool arguments arrive as Boolean or, from ldc.i4, as Int32.
+	POP;
+	ASSERT_LANG(**reptr == Boolean || **reptr == Int32, "WriteDigital: value must be Boolean, got %d", **reptr);
+	bool value = **reptr == Boolean ? *(*reptr + 1) != 0 : *(int*)(*reptr + 1) != 0;
+	int bit = pop_int(reptr);
+	ASSERT_RT(bit >= 0 && bit < SNAP_OUT_CAP * 8, "WriteDigital: bit %d >= %d", bit, SNAP_OUT_CAP * 8);
 
-	write_snapshot(&writing_buf->payload + n_offset, arr->len);
+	if (value) snap_out[bit >> 3] |= (uchar)(1 << (bit & 7));
+	else snap_out[bit >> 3] &= (uchar)~(1 << (bit & 7));
+	if ((bit >> 3) + 1 > snap_out_len) snap_out_len = (bit >> 3) + 1;
+	snap_out_dirty = 1;
 }
 
 void builtin_RunOnMCU_GetMicrosFromStart(uchar** reptr) {
@@ -6720,6 +8387,14 @@ void setup_builtin_methods() {
 	builtin_methods[bn++] = builtin_DefaultInterpolatedStringHandler_AppendFormatted_Value_Format; //171
 	builtin_methods[bn++] = builtin_DefaultInterpolatedStringHandler_ToStringAndClear; //172
 
+	// RunOnMCU, later additions.
+	builtin_methods[bn++] = builtin_RunOnMCU_ReadEvents; //173
+	builtin_methods[bn++] = builtin_RunOnMCU_ReadDigital; //174
+	builtin_methods[bn++] = builtin_RunOnMCU_ReadAnalog; //175
+	builtin_methods[bn++] = builtin_RunOnMCU_ReadAnalogFloat; //176
+	builtin_methods[bn++] = builtin_RunOnMCU_WriteSnapshot_Offset; //177
+	builtin_methods[bn++] = builtin_RunOnMCU_WriteDigital; //178
+
 	DBG("System builtin methods n=%d", bn);
 	add_additional_builtins();
 
@@ -6812,6 +8487,7 @@ inline void leave_critical() {};
 inline int get_cyclic_millis() { return 0; }
 inline int get_cyclic_micros() { return 0; }
 inline int get_cyclic_seconds() { return 0; }
+inline unsigned int get_cyclic_cycles() { return 0; }
 
 void print_hex(const unsigned char* buffer, size_t size) {
 	for (size_t i = 0; i < size; ++i) {
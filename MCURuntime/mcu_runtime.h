@@ -43,6 +43,16 @@ typedef unsigned short ushort;
 //   2.0.0     : magic+version prefix added; meta header gains the cctor-table
 //               chunk-size field + trailing .cctor method-id table; static
 //               constructors (.cctor) now run. LAYOUT CHANGE => major bump.
+//   2.1.0     : type-specialized opcodes emitted by the compiler when both
+//               operands are statically Int32 or Single: i4 arith 0x80-0x8C,
+//               r4 arith 0x92-0x95, i4/r4 compares 0xC2-0xC6/0xD2,0xD3,0xD5,
+//               i4/r4 conditional branches 0xB0-0xBF. Additive => minor bump.
+//   2.2.0     : superinstructions fused by the compiler from common sequences:
+//               0xC8 ldloc.ldloc.br, 0xC9 ldloc.ldc.br, 0xCA ldc.arith,
+//               0xCB ldloc.ldc.arith.stloc, 0xCC stloc.ldloc, 0xCD ldarg.ldfld.
+//   2.3.0     : builtins 173 RunOnMCU.ReadEvents, 174 ReadDigital, 175 ReadAnalog,
+//               176 ReadAnalogFloat, 177 WriteSnapshot(byte[],int), 178 WriteDigital.
+//               Additional builtins (add_additional_builtins) now start at 179.
 // ============================================================================
 #define DIVER_PROGRAM_MAGIC 0x52564944u /* bytes 'D','I','V','R' (little-endian) */
 
@@ -52,8 +62,8 @@ typedef unsigned short ushort;
 #define DIVER_ABI_MINOR(v) (((v) >> 8) & 0xFF)
 #define DIVER_ABI_PATCH(v) ((v) & 0xFF)
 
-// Current ABI version of this runtime. 2.0.0 (layout change: see history above).
-#define DIVER_ABI_VERSION DIVER_ABI_MAKE(2, 0, 0)
+// Current ABI version of this runtime. 2.3.0 (event/snapshot builtins: see history above).
+#define DIVER_ABI_VERSION DIVER_ABI_MAKE(2, 3, 0)
 
 /*
 
@@ -112,26 +122,127 @@ interaction with host system:
 // Initialize: first allocate a buffer of size, then fill the buffer first sequence of bytes with program data.
 // the size should be larger than program data size.
 int vm_set_program(uchar* vm_memory, int vm_memory_size); //return interval in milliseconds.
+
+// Execute in place: the program image stays where it is (e.g. in flash) and is
+// only read; vm_memory holds just the statics, stack, heap and runtime tables, so
+// the whole buffer is available to them. Fault IL offsets stay relative to the
+// image start. The image is not pre-decoded here (it is read-only): run
+// vm_predecode_image on a writable copy before storing it for faster dispatch.
+int vm_set_program_image(const uchar* image, int image_size, uchar* vm_memory, int vm_memory_size);
+// Rewrites hot instructions of an image in place (what vm_set_program does on
+// load); idempotent. Returns the number of rewritten instructions, 0 if the image
+// is not compatible with this runtime. Call only while no program is running.
+int vm_predecode_image(uchar* image, int image_size);
+
+// Runtime table sizes, applied by the next vm_set_program. All tables are carved
+// from vm_memory (top end), so large buffers get large tables and small MCUs stay
+// small. Zero fields take the default.
+struct vm_config
+{
+	int heap_objs;    // heap object table slots (live objects + 1); 0: vm_memory_size/128, at least 1024
+	int stack_depth;  // max call depth; 0: vm_memory_size/8192, at least 32
+	int io_buf_size;  // bytes per device IO buffer (double buffered); 0: 8192
+	int io_slots;     // IO slots per buffer; 0: 256
+	uchar* io_memory; // optional 8-byte aligned 2*io_buf_size region for the IO buffers; 0: carve from vm_memory
+	int io_views;     // zero-copy ReadStream/ReadEvent/ReadSnapshot results per cycle; 0: 32, <0: always copy
+	int snapshot_layout; // 1: snapshots start with the {layout} below; 0: raw (DI bitmap / Int32 words)
+	int full_gc_every;   // vm_set_gc_config full_every; 0: keep the current setting
+	int gc_promote_after; // vm_set_gc_config promote_age; 0: keep the current setting
+};
+void vm_set_config(const struct vm_config* config); // NULL restores the defaults.
 void vm_run(int iteration); //if operation_id is same between previous/current call, it's a medulla communication timed out event.
 
 // MCU - Medulla interface (use config protocol)
+// Full upper image: {token for every UpperIO/Mutual field} in layout order.
+// Sparse upper image: ['S'][count 2B]{[cart_IO index 2B][token]}, only the listed
+// fields are written (later entries for the same field win, so pending sparse
+// images can be merged by concatenating their entries). An array whose element
+// type and length are unchanged is overwritten in place instead of reallocated.
+#define UPPER_FRAME_SPARSE 'S'
 void vm_put_upper_memory(uchar* buffer, int size);
 uchar* vm_get_lower_memory();
 int vm_get_lower_memory_size();
 
+// Delta LowerIO (negotiated by the host, see CommandSetLowerIoMode). "Lower fields"
+// are the non-UpperIO cart_IO fields in layout order; tokens are the same as in the
+// full frame returned by vm_get_lower_memory ([iteration 4B]{token...}).
+//   keyframe: ['K'][iteration 4B]{token for every lower field}
+//   delta:    ['D'][iteration 4B][bitmap ceil(n_lower/8)B]{token for each set bit}
+// Bit i (LSB first) marks lower field i as changed since the previous frame: a
+// primitive whose cart_IO touched bit is set (Stfld/Ldflda in the program or a
+// Mutual field written by vm_put_upper_memory), or a string/array whose payload
+// hash differs. The first delta-mode frame must be a keyframe; the size is read
+// with vm_get_lower_memory_size().
+#define LOWER_FRAME_KEY   'K'
+#define LOWER_FRAME_DELTA 'D'
+uchar* vm_get_lower_memory_delta(int keyframe);
+
 // Telemetry accessors (used for per-node CPU/memory load reporting).
 int vm_get_heap_used();      // bytes currently occupied by the heap (resting)
 int vm_get_heap_obj_count(); // number of live heap objects
 int vm_get_mem_capacity();   // total VM buffer size (bytes)
 int vm_get_mem_peak_used();  // in-cycle high-water mark (bytes): stack + heap peak
+int vm_get_il_count();       // IL instructions executed since vm_set_program
+int vm_get_dispatch_mode();  // 1: computed-goto threaded dispatch, 0: switch dispatch
+unsigned int vm_get_gc_cycles(); // get_cyclic_cycles() ticks spent in the last end-of-cycle collection
+int vm_get_gc_last_full();   // 1: last collection was a full mark-compact, 0: minor (young region only)
+int vm_get_gc_full_count();  // full collections since vm_set_program
+int vm_get_gc_minor_count(); // minor collections since vm_set_program
+int vm_get_gc_skip_count();  // GC-free cycles (nothing allocated) since vm_set_program
+int vm_get_gc_old_objs();    // objects promoted to the old region
+
+// Generational GC tuning. full_every: run a full mark-compact every N cycles
+// (<=1: full collection after every vm_run); promote_age: collections an
+// object must survive before it moves to the old region.
+// Defaults: full_every=1 (generational mode off), promote_age=2. Minor-only
+// cycles cannot reclaim old garbage when an allocation fails mid-cycle, so only
+// enable it (e.g. full_every=16) for programs with a small per-cycle allocation.
+// Persists across vm_set_program; firmware sets it through vm_config.full_gc_every /
+// gc_promote_after instead.
+void vm_set_gc_config(int full_every, int promote_age);
+
+// Runtime state lives in a struct vm_context. Every vm_* call above acts on the
+// calling thread's current context, which starts out as the built-in default
+// one (the only context on MCU), so single-VM hosts need none of this.
+struct vm_context;
+void vm_select_context(struct vm_context* ctx); // per thread on hosts; NULL: the default context
+struct vm_context* vm_current_context();
+int vm_get_cur_il_offset();  // IL offset of the instruction being executed (fault reports)
+#ifndef IS_MCU
+struct vm_context* vm_context_create();          // fresh context with default config; NULL: out of memory
+void vm_context_destroy(struct vm_context* ctx); // vm_memory stays owned by the caller
+#endif
+
+#ifndef IS_MCU
+// Host-only: marks a throw-away n-object graph (shape 0 deep chain, 1 wide, 2
+// binary tree) `rounds` times; returns total get_cyclic_cycles() ticks, -1 if it does not fit.
+long long vm_bench_mark(int shape, int n, int rounds);
+#endif
 
 // MCU - device interface.
 // snap_shot buffer layout:
 // {layout}|{payload}
 // layout: (|1B io_type|2B components|)*N|0xFF|, io_type is 0-8 same to typeid. payload:boolean is byte-padded
+// (bit-packed, LSB first). Only snapshots of a program loaded with vm_config.snapshot_layout=1
+// carry the layout (resolved once per cycle for ReadDigital/ReadAnalog, a malformed one is a
+// runtime error); otherwise the snapshot is raw, e.g. the firmware's 32-bit DI word, and reads
+// as bits / Int32 channels.
 void vm_put_snapshot_buffer(uchar* buffer, int size); // put IO/analog data here, as a whole snapshot.
-void vm_put_stream_buffer(int streamID, uchar* buffer, int size); // put serial-like buffer here.
-void vm_put_event_buffer(int portID, int eventID, uchar* buffer, int size); // put CAN/modbus similar data here.
+int vm_put_stream_buffer(int streamID, uchar* buffer, int size); // put serial-like buffer here.
+int vm_put_event_buffer(int portID, int eventID, uchar* buffer, int size); // put CAN/modbus similar data here.
+// The stream/event puts return 0, or -1 when the frame was dropped because the IO buffer
+// of this cycle is full (the caller counts it, e.g. as a per-port overflow).
+// Frames are indexed by (kind, port, id) as they arrive. When the same id arrives more
+// than once before a cycle, ReadEvent returns the latest, ReadEvents all of them in
+// order with their arrival time, and ReadStream the concatenation of the chunks.
+// Event frames of the running cycle on one port, oldest first (call while vm_run
+// executes the program, e.g. from a native): start with *cursor = 0; returns the
+// payload and sets *eventID / *len, or NULL after the last frame.
+uchar* vm_next_port_event(int portID, int* cursor, int* eventID, int* len);
+// Each put costs size + 10 bytes of the IO buffer (arrival time and a byte[] header):
+// the program's ReadStream/ReadEvent/ReadSnapshot return a view of it instead of a copy
+// (vm_config.io_views per cycle). A view only lives for the cycle; the runtime copies
+// it to the heap when the program stores it outside the stack or writes to it.
 
 /*
 // MCU Serial Bridge Protocol (MCU ↔ PC Communication Protocol)
@@ -191,6 +302,7 @@ void vm_put_event_buffer(int portID, int eventID, uchar* buffer, int size); // p
 */
 
 void write_snapshot(uchar* buffer, int size); // size is equal to "vm_put_snapshot_buffer", called per iteration
+// (WriteDigital / partial WriteSnapshot: once at the end of the cycle, with the whole output image)
 void write_stream(int streamID, uchar* buffer, int size); // called to write bytes into serial. called anytime needed.
 void write_event(int portID, int eventID, uchar* buffer, int size); // called to write bytes into CAN/modbus similar ports. called anytime needed.
 
@@ -207,4 +319,7 @@ inline void leave_critical();
 inline int get_cyclic_millis();
 inline int get_cyclic_micros();
 inline int get_cyclic_seconds();
+// free-running high-resolution counter (CPU cycles on MCU), wraps. Not inline off the MCU:
+// it is called from the GC, and the host build defines it in another translation unit.
+unsigned int get_cyclic_cycles();
 #endif
\ No newline at end of file
@@ -0,0 +1,462 @@
+// test_runtime.c
+//
+// Host-side interpreter checks. Each case hand-assembles a small DIVER program,
+// runs it through the SimNode shim and checks the static fields it wrote.
+//
+// Build and run from the repo root:
+//   gcc -std=gnu11 -DSIM_NODE_HOST -D__cdecl= -I MCURuntime MCURuntime/test/test_runtime.c \
+//       3rd/CoralinkerSimNodeHost/native/sim_node_runtime.c -lm -lpthread -o test_runtime
+//   ./test_runtime
+//
+// `./test_runtime bench` times an arithmetic loop instead (build with -O2, once
+// per DIVER_THREADED_DISPATCH value, to compare the dispatch engines).
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../mcu_runtime.c"
+
+int sim_load_program(uchar* bin, int len, int memory_size);
+int sim_step(unsigned int timestamp_ms);
+int sim_bench(unsigned int steps);
+
+// ---- tiny assembler ----
+
+struct asm_buf
+{
+	uchar b[4096];
+	int n;
+};
+
+static void emit8(struct asm_buf* a, int v) { a->b[a->n++] = (uchar)v; }
+static void emit16(struct asm_buf* a, int v) { emit8(a, v); emit8(a, v >> 8); }
+static void emit32(struct asm_buf* a, int v) { emit16(a, v); emit16(a, v >> 16); }
+static void emit(struct asm_buf* a, const struct asm_buf* src) { memcpy(a->b + a->n, src->b, src->n); a->n += src->n; }
+
+static void ldc_i4(struct asm_buf* a, int v) { emit8(a, 0x15); emit8(a, Int32); emit32(a, v); }
+static int r4_bits(float f) { int v; memcpy(&v, &f, 4); return v; }
+static void ldc_r4(struct asm_buf* a, float v) { emit8(a, 0x15); emit8(a, Single); emit32(a, r4_bits(v)); }
+static void ldloc(struct asm_buf* a, int off) { emit8(a, 0x06); emit16(a, off); }
+static void stloc(struct asm_buf* a, int typeid, int off) { emit8(a, 0x0A); emit8(a, typeid); emit16(a, off); }
+static void stsfld(struct asm_buf* a, int off) { emit8(a, 0x7D); emit8(a, 1); emit16(a, off); emit16(a, -1); }
+static void ldsfld(struct asm_buf* a, int off) { emit8(a, 0x7B); emit8(a, 1); emit16(a, off); emit16(a, -1); }
+static void emit_newarr(struct asm_buf* a, int typeid) { emit8(a, 0x16); emit8(a, ArrayHeader); emit8(a, typeid); if (typeid == ReferenceID) emit16(a, -1); }
+
+// branch with a 2-byte target relative to the method code start; returns the
+// operand position for patch().
+static int branch(struct asm_buf* a, int opcode) { emit8(a, opcode); emit16(a, 0); return a->n - 2; }
+static void patch(struct asm_buf* a, int at) { a->b[at] = (uchar)a->n; a->b[at + 1] = (uchar)(a->n >> 8); }
+
+// <loaded value> ; branch(opcode) -> statics[idx] = taken ? 1 : 0
+static void store_branch_taken(struct asm_buf* a, int opcode, int idx)
+{
+	int taken = branch(a, opcode);
+	ldc_i4(a, 0);
+	int done = branch(a, 0x27);
+	patch(a, taken);
+	ldc_i4(a, 1);
+	patch(a, done);
+	stsfld(a, idx * 5);
+}
+
+// Program with one class, one method `void Operation(int)` with the given
+// locals, and `n_statics` statics of the given types (all Int32 if NULL).
+static int build_program(uchar* out, const struct asm_buf* code, const uchar* vars, int n_vars, const uchar* statics, int n_statics)
+{
+	struct asm_buf pd = { 0 }, cc = { 0 }, virt = { 0 }, sd = { 0 }, cctor = { 0 }, meta = { 0 }, bin = { 0 };
+
+	emit16(&pd, 0);
+	emit16(&pd, 1);
+	emit16(&pd, 0); emit8(&pd, 0); emit32(&pd, 0);
+
+	emit8(&meta, 0xFF); emit16(&meta, -1);           // returns void
+	emit16(&meta, 2); emit8(&meta, ReferenceID); emit16(&meta, -1); // (this, int iteration)
+	emit8(&meta, Int32); emit16(&meta, -1);
+	emit16(&meta, n_vars);
+	for (int i = 0; i < n_vars; ++i) { emit8(&meta, vars[i]); emit16(&meta, -1); }
+	emit32(&meta, 8);                                 // max stack
+	emit16(&cc, 1);
+	emit32(&cc, 0);
+	emit32(&cc, meta.n);
+	emit(&cc, &meta);
+	emit(&cc, code);
+
+	emit16(&virt, 0);
+	emit16(&sd, n_statics);
+	for (int i = 0; i < n_statics; ++i) { emit8(&sd, statics ? statics[i] : Int32); emit16(&sd, -1); }
+	emit16(&cctor, 0);
+
+	emit32(&bin, DIVER_PROGRAM_MAGIC);
+	emit32(&bin, DIVER_ABI_VERSION);
+	emit32(&bin, 100);  // interval
+	emit32(&bin, 0);    // entry method
+	emit32(&bin, -1);   // no init method
+	emit32(&bin, pd.n); emit32(&bin, cc.n); emit32(&bin, virt.n); emit32(&bin, sd.n);
+	emit32(&bin, 0); emit32(&bin, cctor.n); emit32(&bin, 0);
+	emit(&bin, &pd); emit(&bin, &cc); emit(&bin, &virt); emit(&bin, &sd); emit(&bin, &cctor);
+	memcpy(out, bin.b, bin.n);
+	return bin.n;
+}
+
+static int load_program(const struct asm_buf* code, const uchar* vars, int n_vars, const uchar* statics, int n_statics)
+{
+	static uchar bin[8192];
+	int len = build_program(bin, code, vars, n_vars, statics, n_statics);
+	if (sim_load_program(bin, len, 64 * 1024) < 0) // returns the scan interval
+	{
+		printf("  program rejected\n");
+		return 0;
+	}
+	return 1;
+}
+
+static int run_program(const struct asm_buf* code, const uchar* vars, int n_vars, int n_statics)
+{
+	if (!load_program(code, vars, n_vars, 0, n_statics))
+		return 0;
+	sim_step(0);
+	return 1;
+}
+
+static int static_i4(int idx)
+{
+	return As(statics_val_ptr + idx * 5 + 1, int);
+}
+
+static int expect_statics(const char* name, const int* expect, int n)
+{
+	int ok = 1;
+	for (int i = 0; i < n; ++i)
+	{
+		if (static_i4(i) != expect[i])
+		{
+			printf("  %s: static %d = %d, expected %d\n", name, i, static_i4(i), expect[i]);
+			ok = 0;
+		}
+	}
+	printf("%s %s\n", ok ? "PASS" : "FAIL", name);
+	return ok;
+}
+
+// ---- cases ----
+
+// Brtrue/Brfalse only look at the payload of the popped slot. ldloc copies a
+// whole 8-byte slot, so the bytes above a Boolean / Int16 payload are the next
+// local's typeid and value, which must not make a false value branch as true.
+static int test_branch_payload_width(void)
+{
+	enum { B_FALSE = 0, I4_BIG = 2, I2_ZERO = 7, I4_NEXT = 10, B_TRUE = 15 };
+	static const uchar vars[] = { Boolean, Int32, Int16, Int32, Boolean };
+	struct asm_buf a = { 0 };
+
+	ldc_i4(&a, 0x100); stloc(&a, Int32, I4_BIG);
+	ldc_i4(&a, 0); stloc(&a, Boolean, B_FALSE);
+	ldc_i4(&a, 0x7F7F7F); stloc(&a, Int32, I4_NEXT);
+	ldc_i4(&a, 0); stloc(&a, Int16, I2_ZERO);
+	ldc_i4(&a, 1); stloc(&a, Boolean, B_TRUE);
+
+	ldloc(&a, B_FALSE); store_branch_taken(&a, 0x36, 0); // brtrue false  -> not taken
+	ldloc(&a, B_FALSE); store_branch_taken(&a, 0x35, 1); // brfalse false -> taken
+	ldloc(&a, I2_ZERO); store_branch_taken(&a, 0x29, 2); // brtrue.s 0s   -> not taken
+	ldloc(&a, I4_BIG);  store_branch_taken(&a, 0x36, 3); // brtrue 256    -> taken
+	ldloc(&a, B_TRUE);  store_branch_taken(&a, 0x28, 4); // brfalse.s true -> not taken
+	emit8(&a, 0x26); // ret
+
+	static const int expect[] = { 0, 1, 0, 1, 0 };
+	if (!run_program(&a, vars, sizeof(vars), 5))
+		return 0;
+	return expect_statics("brtrue/brfalse read only the slot payload", expect, 5);
+}
+
+// Type-specialized opcodes (ABI 2.1): r4 arithmetic and typed branches, and the
+// fused ldc.arith superinstruction (ABI 2.2) on r4.
+static int test_typed_opcodes(void)
+{
+	static const uchar statics[] = { Single, Int32, Int32, Single };
+	struct asm_buf a = { 0 };
+
+	ldc_r4(&a, 1.5f); ldc_r4(&a, 2.25f); emit8(&a, 0x92); stsfld(&a, 0); // add (r4)
+	ldc_r4(&a, 2.0f); ldc_r4(&a, 1.0f); store_branch_taken(&a, 0xBB, 1); // bge (r4) -> taken
+	ldc_i4(&a, 1); ldc_i4(&a, 2); store_branch_taken(&a, 0xB2, 2);      // bgt (i4) -> not taken
+	ldc_r4(&a, 1.5f); emit8(&a, 0xCA); emit8(&a, 0x94); emit32(&a, r4_bits(2.0f)); stsfld(&a, 15); // fused ldc.mul (r4)
+	emit8(&a, 0x26); // ret
+
+	const int expect[] = { r4_bits(3.75f), 1, 0, r4_bits(3.0f) };
+	if (!load_program(&a, 0, 0, statics, 4))
+		return 0;
+	sim_step(0);
+	return expect_statics("typed r4 arithmetic and branches", expect, 4);
+}
+
+// Generational collection is opt-in: by default every allocating cycle ends with
+// a full collection, and full_every > 1 (vm_set_gc_config or vm_config) switches
+// to minor ones.
+static int test_gc_full_by_default(void)
+{
+	static const uchar statics[] = { ReferenceID };
+	struct asm_buf a = { 0 };
+
+	ldc_i4(&a, 1000);
+	emit8(&a, 0x16); emit8(&a, ArrayHeader); emit8(&a, Byte); // newarr byte
+	stsfld(&a, 0);
+	emit8(&a, 0x26); // ret
+
+	int ok = 1;
+	if (!load_program(&a, 0, 0, statics, 1))
+		return 0;
+	for (int i = 0; i < 4; ++i)
+		sim_step(i * 100);
+	if (vm_get_gc_minor_count() != 0 || vm_get_gc_full_count() < 4)
+	{
+		printf("  default: %d full, %d minor collections\n", vm_get_gc_full_count(), vm_get_gc_minor_count());
+		ok = 0;
+	}
+
+	struct vm_config config = { 0 };
+	config.full_gc_every = 16; // the firmware's way in, same as vm_set_gc_config(16, 2)
+	vm_set_config(&config);
+	if (!load_program(&a, 0, 0, statics, 1))
+		return 0;
+	for (int i = 0; i < 4; ++i)
+		sim_step(i * 100);
+	if (vm_get_gc_minor_count() == 0)
+	{
+		printf("  full_every=16: no minor collection\n");
+		ok = 0;
+	}
+	vm_set_config(0);
+	vm_set_gc_config(1, 2);
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", "generational GC is opt-in");
+	return ok;
+}
+
+// new int[] { value }, dropped.
+static void garbage_i4(struct asm_buf* a, int value)
+{
+	ldc_i4(a, 1); emit_newarr(a, Int32); emit8(a, 0x23);
+	ldc_i4(a, 0); ldc_i4(a, value); emit8(a, 0x91); emit8(a, Int32);
+	emit8(a, 0x24);
+}
+
+// A minor collection finds the young objects referenced from old ones through
+// the card table. statics[0] is an object[1] that gets promoted. Cycles alternate:
+// one stores a fresh int[1] into it (reachable only through the old slot), the
+// next reads it back into statics[1] and clears the slot, so the card is clean
+// again before every store and only the write barrier can set it. Every cycle
+// starts with two garbage int[] { 9999 }, which take over the ids and memory of a
+// young array the collector lost; a read cycle allocates one more before reading,
+// so it lands exactly where a lost array was.
+static int test_gc_card_table(void)
+{
+	static const uchar statics[] = { ReferenceID, Int32 };
+	struct asm_buf a = { 0 };
+
+	for (int i = 0; i < 2; ++i)
+		garbage_i4(&a, 9999);
+	ldsfld(&a, 0);
+	int have = branch(&a, 0x36);
+	ldc_i4(&a, 1); emit_newarr(&a, ReferenceID); stsfld(&a, 0); // statics[0] = new object[1]
+	emit8(&a, 0x26); // ret
+	patch(&a, have);
+	ldsfld(&a, 0); ldc_i4(&a, 0); emit8(&a, 0x90); emit8(&a, ReferenceID);
+	int empty = branch(&a, 0x35);
+	garbage_i4(&a, 9999);
+	ldsfld(&a, 0); ldc_i4(&a, 0); emit8(&a, 0x90); emit8(&a, ReferenceID); // statics[1] = ((int[])statics[0][0])[0]
+	ldc_i4(&a, 0); emit8(&a, 0x90); emit8(&a, Int32); stsfld(&a, 5);
+	ldsfld(&a, 0); ldc_i4(&a, 0); emit8(&a, 0x15); emit8(&a, ReferenceID); // statics[0][0] = null
+	emit8(&a, 0x91); emit8(&a, ReferenceID);
+	emit8(&a, 0x26); // ret
+	patch(&a, empty);
+	ldsfld(&a, 0); ldc_i4(&a, 0);                           // statics[0][0] = new int[] { 4321 }
+	ldc_i4(&a, 1); emit_newarr(&a, Int32); emit8(&a, 0x23);
+	ldc_i4(&a, 0); ldc_i4(&a, 4321); emit8(&a, 0x91); emit8(&a, Int32);
+	emit8(&a, 0x91); emit8(&a, ReferenceID);
+	emit8(&a, 0x26); // ret
+
+	int ok = 1, reads = 0;
+	vm_set_gc_config(16, 2);
+	if (!load_program(&a, 0, 0, statics, 2))
+		return 0;
+	for (int i = 0; i < 12; ++i)
+	{
+		sim_step(i * 100);
+		if (static_i4(1) == 4321)
+			reads++;
+		else if (static_i4(1) != 0)
+		{
+			printf("  cycle %d: read %d through the old array\n", i, static_i4(1));
+			ok = 0;
+		}
+		As(statics_val_ptr + 6, int) = 0;
+	}
+	if (reads < 5 || gc_old_n == 0 || vm_get_gc_minor_count() < 6)
+	{
+		printf("  %d reads, %d old objects, %d minor collections\n", reads, gc_old_n, vm_get_gc_minor_count());
+		ok = 0;
+	}
+	vm_set_gc_config(1, 2);
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", "minor GC keeps young objects stored in old ones");
+	return ok;
+}
+
+// An IO view stored outside the stack becomes a heap copy, but stays the same
+// object: ceq and beq between the view and the stored copy hold, a write through
+// the view lands in the copy, and the input buffer itself is untouched.
+static int test_io_view_identity(void)
+{
+	enum { VIEW = 0 };
+	static const uchar vars[] = { ReferenceID };
+	static const uchar statics[] = { ReferenceID, Int32, Int32, Int32, Int32 };
+	static const uchar raw[] = { 0x11, 0x22, 0x33, 0x44 };
+	struct asm_buf a = { 0 };
+
+	emit8(&a, 0xA7); emit16(&a, 66); stloc(&a, ReferenceID, VIEW); // view = ReadSnapshot()
+	ldloc(&a, VIEW); stsfld(&a, 0);                                  // statics[0] = view (a copy)
+	ldloc(&a, VIEW); ldsfld(&a, 0); emit8(&a, 0xE2); stsfld(&a, 5);  // statics[1] = view == statics[0]
+	ldloc(&a, VIEW); ldsfld(&a, 0); store_branch_taken(&a, 0x37, 2); // statics[2] = beq taken
+	ldloc(&a, VIEW); ldc_i4(&a, 0); ldc_i4(&a, 0x55);                // view[0] = 0x55
+	emit8(&a, 0x91); emit8(&a, Byte);
+	ldsfld(&a, 0); ldc_i4(&a, 0); emit8(&a, 0x90); emit8(&a, Byte);  // statics[3] = statics[0][0]
+	stsfld(&a, 15);
+	emit8(&a, 0xA7); emit16(&a, 66);                                 // statics[4] = ReadSnapshot()[0]
+	ldc_i4(&a, 0); emit8(&a, 0x90); emit8(&a, Byte);
+	stsfld(&a, 20);
+	emit8(&a, 0x26); // ret
+
+	if (!load_program(&a, vars, 1, statics, 5))
+		return 0;
+	write_snapshot((uchar*)raw, sizeof(raw));
+	sim_step(0);
+	static const int expect[] = { -1, 1, 1, 0x55, 0x11 };
+	int ok = 1;
+	for (int i = 1; i < 5; ++i)
+	{
+		if (static_i4(i) != expect[i])
+		{
+			printf("  static %d = %d, expected %d\n", i, static_i4(i), expect[i]);
+			ok = 0;
+		}
+	}
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", "IO view keeps its identity when stored, copies on write");
+	return ok;
+}
+
+// The snapshot layout is configured, not guessed: a raw DI word that happens to
+// look like a layout (0xFF000001: one empty Byte group, then the end marker) must
+// still read as 32 digital inputs.
+static int test_snapshot_layout_is_explicit(void)
+{
+	static const uchar raw[] = { 0x01, 0x00, 0x00, 0xFF };
+	static const uchar described[] = { Boolean, 3, 0, Int16, 1, 0, 0xFF, 0x05, 0x34, 0x12 };
+	struct asm_buf a = { 0 };
+	emit8(&a, 0x26); // ret
+	int ok = 1;
+	float f;
+
+	if (!load_program(&a, 0, 0, 0, 0))
+		return 0;
+	write_snapshot((uchar*)raw, sizeof(raw)); // the SimNode loops outputs back as the next input
+	sim_step(0);
+	if (snap_groups_n != 0 || snap_bits != 32 || snap_channels != 1 || !(snap_data[3] & 0x80))
+	{
+		printf("  raw: %d groups, %d bits, %d channels\n", snap_groups_n, snap_bits, snap_channels);
+		ok = 0;
+	}
+
+	struct vm_config config = { 0 };
+	config.snapshot_layout = 1;
+	vm_set_config(&config);
+	if (!load_program(&a, 0, 0, 0, 0))
+		return 0;
+	write_snapshot((uchar*)described, sizeof(described));
+	sim_step(0);
+	if (snap_groups_n != 2 || snap_bits != 3 || snap_channels != 1 || snapshot_analog(0, &f) != 0x1234 || snap_data[0] != 0x05)
+	{
+		printf("  layout: %d groups, %d bits, %d channels\n", snap_groups_n, snap_bits, snap_channels);
+		ok = 0;
+	}
+	vm_set_config(0);
+
+	printf("%s %s\n", ok ? "PASS" : "FAIL", "snapshot layout is explicit");
+	return ok;
+}
+
+// ---- dispatch benchmark ----
+
+// acc = (acc + i) ^ 0x5A for i in 0..999, then statics[0] = acc: 13 instructions
+// per iteration, all locals and i4 arithmetic. typed=0 uses the generic opcodes
+// (0x4D / 0x3B), typed=1 the ABI 2.1 i4 ones (0x80.. / 0xB4).
+static void bench_loop(struct asm_buf* a, int typed)
+{
+	enum { I = 0, ACC = 5 };
+	ldc_i4(a, 0); stloc(a, Int32, I);
+	ldc_i4(a, 0); stloc(a, Int32, ACC);
+	int top = a->n;
+	ldloc(a, ACC); ldloc(a, I);
+	if (typed) emit8(a, 0x80); else { emit8(a, 0x4D); emit8(a, 0x60); } // add
+	ldc_i4(a, 0x5A);
+	if (typed) emit8(a, 0x89); else { emit8(a, 0x4D); emit8(a, 0x69); } // xor
+	stloc(a, Int32, ACC);
+	ldloc(a, I); ldc_i4(a, 1);
+	if (typed) emit8(a, 0x80); else { emit8(a, 0x4D); emit8(a, 0x60); }
+	stloc(a, Int32, I);
+	ldloc(a, I); ldc_i4(a, 1000);
+	emit8(a, typed ? 0xB4 : 0x3B); emit16(a, top); // blt
+	ldloc(a, ACC); stsfld(a, 0);
+	emit8(a, 0x26); // ret
+}
+
+static int bench_dispatch(void)
+{
+	static const uchar vars[] = { Int32, Int32 };
+	enum { STEPS = 2000 };
+	printf("%s dispatch\n", vm_get_dispatch_mode() ? "threaded" : "switch");
+	for (int typed = 0; typed < 2; ++typed)
+	{
+		struct asm_buf a = { 0 };
+		bench_loop(&a, typed);
+		if (!load_program(&a, vars, 2, 0, 1))
+			return 1;
+		sim_bench(10); // warm up
+		int acc = 0;
+		for (int i = 0; i < 1000; ++i)
+			acc = (acc + i) ^ 0x5A;
+		if (static_i4(0) != acc)
+		{
+			printf("  loop computed %d, expected %d\n", static_i4(0), acc);
+			return 1;
+		}
+		double best = 0;
+		for (int round = 0; round < 15; ++round)
+		{
+			struct timespec t0, t1;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			int il = sim_bench(STEPS);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / il;
+			if (round == 0 || ns < best)
+				best = ns;
+		}
+		printf("  %-8s %.2f ns/instruction (best of 15 x %d cycles)\n", typed ? "i4" : "generic", best, STEPS);
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return bench_dispatch();
+	int ok = 1;
+	ok &= test_branch_payload_width();
+	ok &= test_typed_opcodes();
+	ok &= test_gc_full_by_default();
+	ok &= test_gc_card_table();
+	ok &= test_io_view_identity();
+	ok &= test_snapshot_layout_is_explicit();
+	printf(ok ? "ALL PASS\n" : "FAILED\n");
+	return ok ? 0 : 1;
+}
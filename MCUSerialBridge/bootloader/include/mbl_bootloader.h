@@ -9,7 +9,8 @@
  * 1. mbl_open() 打开串口（可指定波特率或自动探测）
  * 2. mbl_command_read() 读取下位机信息
  * 3. mbl_command_erase() 擦除固件
- * 4. mbl_command_write() 分块写入固件
+ * 4. mbl_command_write() 分块写入固件（或 mbl_write_firmware() 一次写完，
+ *    Bootloader 支持时自动走快速升级：大帧、多帧在途、最后整镜像校验）
  * 5. mbl_command_exit() 退出 Bootloader
  * 6. mbl_close() 关闭串口
  */
@@ -96,6 +97,19 @@ MBL_EXPORT MCUBootloaderError mbl_close(mbl_handle* handle);
  */
 MBL_EXPORT uint32_t mbl_get_baudrate(mbl_handle* handle);
 
+/**
+ * @brief 获取探测时协商到的扩展能力
+ *
+ * 旧 Bootloader（或以固定波特率打开且未回能力块）时返回全 0。
+ *
+ * @param handle    句柄
+ * @param[out] caps 返回能力
+ *
+ * @return MCUBootloaderError
+ */
+MBL_EXPORT MCUBootloaderError
+mbl_get_capabilities(mbl_handle* handle, MBL_Capabilities* caps);
+
 /**
  * @brief 注册进度与错误回调
  *
@@ -164,6 +178,22 @@ MBL_EXPORT MCUBootloaderError mbl_command_write(
         uint32_t chunk_length,
         uint32_t timeout_ms);
 
+/**
+ * @brief 校验已写入的整个镜像（需 MBL_CAPS_FLAG_VERIFY）
+ *
+ * @param handle       句柄
+ * @param total_length 已写入的总长度
+ * @param crc32        写入数据的 CRC32（与发送的字节流一致）
+ * @param timeout_ms   超时时间（毫秒），建议 2000
+ *
+ * @return MCUBootloaderError，不一致时为 MBL_Error_MCU_WriteFirmwareCrcMismatch
+ */
+MBL_EXPORT MCUBootloaderError mbl_command_verify(
+        mbl_handle* handle,
+        uint32_t total_length,
+        uint32_t crc32,
+        uint32_t timeout_ms);
+
 /**
  * @brief 退出 Bootloader，重启进入应用程序
  *
@@ -182,7 +212,10 @@ mbl_command_exit(mbl_handle* handle, uint32_t timeout_ms);
 /**
  * @brief 写入完整固件（自动分块）
  *
- * 将整个固件数据自动按 64 字节分块写入。
+ * 旧 Bootloader：按 64 字节分块，逐块一问一答写入。
+ * 支持快速升级的 Bootloader：按能力块的 MaxChunk 分块，最多 Window 帧在途，
+ * 出错 / 超时从 Bootloader 报告的已写入位置重发；写完后发 CMD_VERIFY 核对
+ * 整个镜像的 CRC32。
  * 写入过程中会触发进度回调（如果已注册）。
  *
  * @param handle       句柄
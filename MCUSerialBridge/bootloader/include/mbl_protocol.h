@@ -4,6 +4,7 @@
  *
  * 定义 Bootloader 通讯协议的帧结构、命令类型、响应类型等常量。
  * 协议特点：固定 92 字节帧长，一问一答模式（类似 Modbus）。
+ * 快速升级扩展（探测时协商）：变长写帧、多帧在途、整镜像 CRC 校验。
  */
 
 #ifndef MBL_PROTOCOL_H
@@ -50,6 +51,29 @@ extern "C" {
 
 #define MBL_SYNC_LEN            4       // 同步帧长度
 
+/** 扩展能力（快速升级）
+ *
+ * 支持快速升级的 Bootloader 在同步应答 55 AA 5A 5A 之后紧跟 8 字节能力块：
+ *   'M' 'B' 'L' 'X' | MaxChunk(uint16) | Window(uint8) | Flags(uint8)
+ * 旧 Bootloader 只回 4 字节，上位机读不到能力块就按旧协议一问一答；旧上位机
+ * 只读 4 字节，多出的能力块在下一次发帧前随接收缓冲一起清掉，互不影响。
+ */
+#define MBL_CAPS_MAGIC_0        'M'
+#define MBL_CAPS_MAGIC_1        'B'
+#define MBL_CAPS_MAGIC_2        'L'
+#define MBL_CAPS_MAGIC_3        'X'
+#define MBL_CAPS_LEN            8       // 能力块长度
+#define MBL_CAPS_FLAG_VERIFY    0x01    // 支持 CMD_VERIFY
+
+/** 快速写帧：AA BB | CMD_WRITE_FAST(4) | Offset(4) TotalLength(4)
+ *  ChunkLength(4) ChunkData(ChunkLength) | CRC32(4) | EE EE
+ *  CRC32 覆盖 CommandType 到 ChunkData。应答仍是 92 字节定长帧。 */
+#define MBL_FAST_HEADER_LEN     12      // Offset + TotalLength + ChunkLength
+#define MBL_FAST_CHUNK_MAX      1024    // 上位机使用的最大块长
+#define MBL_FAST_FRAME_LEN(n) \
+    (MBL_HEADER_LEN + MBL_CMD_LEN + MBL_FAST_HEADER_LEN + (n) + MBL_CRC_LEN + \
+     MBL_TAIL_LEN)
+
 /*==============================================================================
  * 命令类型枚举（PC → MCU）
  *============================================================================*/
@@ -66,6 +90,12 @@ typedef enum {
 
     /** 退出 Bootloader / 重启进入 App */
     MBL_CMD_EXIT  = 0x00000004,
+
+    /** 快速写入（变长帧，可多帧在途；需能力块声明支持） */
+    MBL_CMD_WRITE_FAST = 0x00000005,
+
+    /** 整镜像 CRC 校验（需 MBL_CAPS_FLAG_VERIFY） */
+    MBL_CMD_VERIFY = 0x00000006,
 } MBL_CommandType;
 
 /*==============================================================================
@@ -85,6 +115,12 @@ typedef enum {
     /** Exit 成功响应 */
     MBL_RSP_EXIT_OK   = 0x14,
 
+    /** WriteFast 成功响应：[0-3] 本块 Offset，[4-7] 已连续写入长度 */
+    MBL_RSP_WRITE_FAST_OK = 0x15,
+
+    /** Verify 成功响应 */
+    MBL_RSP_VERIFY_OK = 0x16,
+
     /** Read 失败响应 */
     MBL_RSP_READ_ERR  = 0x81,
 
@@ -96,6 +132,13 @@ typedef enum {
 
     /** Exit 失败响应 */
     MBL_RSP_EXIT_ERR  = 0x84,
+
+    /** WriteFast 失败响应：[0-3] ErrorCode，[4-7] 已连续写入长度，
+     *  [8-11] 被拒块的 Offset */
+    MBL_RSP_WRITE_FAST_ERR = 0x85,
+
+    /** Verify 失败响应 */
+    MBL_RSP_VERIFY_ERR = 0x86,
 } MBL_ResponseType;
 
 /*==============================================================================
@@ -185,6 +228,20 @@ typedef struct {
     uint8_t chunk_data[64];
 } MBL_WriteParams;
 
+/**
+ * @brief Bootloader 扩展能力（探测时从能力块解析，旧 Bootloader 全 0）
+ */
+typedef struct {
+    /** 快速写单块最大长度（0 = 不支持快速写入） */
+    uint16_t max_chunk;
+
+    /** 最多在途的写帧数 */
+    uint8_t window;
+
+    /** MBL_CAPS_FLAG_* */
+    uint8_t flags;
+} MBL_Capabilities;
+
 /**
  * @brief MCU 返回的错误信息
  */
@@ -12,6 +12,7 @@
 #include "mbl_bootloader.h"
 #include "mbl_error.h"
 #include "mbl_protocol.h"
+#include "msb_crc.h"
 #include "msb_platform.h"
 
 /*==============================================================================
@@ -36,40 +37,26 @@ struct mbl_handle {
 
     /** 回调用户上下文 */
     void* callback_ctx;
-};
-
-/*==============================================================================
- * CRC32 计算（与 Python zlib.crc32 兼容）
- *============================================================================*/
 
-static uint32_t crc32_table[256];
-static bool crc32_table_initialized = false;
-
-static void init_crc32_table(void) {
-    if (crc32_table_initialized) return;
+    /** 探测时协商到的扩展能力（旧 Bootloader 全 0） */
+    MBL_Capabilities caps;
+};
 
-    for (uint32_t i = 0; i < 256; i++) {
-        uint32_t crc = i;
-        for (int j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xEDB88320;
-            } else {
-                crc >>= 1;
-            }
-        }
-        crc32_table[i] = crc;
-    }
-    crc32_table_initialized = true;
+static uint32_t get_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
 }
 
-static uint32_t calc_crc32(const uint8_t* data, size_t len) {
-    init_crc32_table();
+static void put_le32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)((v >> 24) & 0xFF);
+}
 
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < len; i++) {
-        crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
-    }
-    return crc ^ 0xFFFFFFFF;
+/** 错误响应 Payload 前 4 字节是 MCU 错误码 */
+static MCUBootloaderError mcu_error_from_payload(const uint8_t* payload) {
+    return (MCUBootloaderError)(0x0F000000 | (get_le32(payload) & 0xFF));
 }
 
 /*==============================================================================
@@ -283,6 +270,41 @@ static MCUBootloaderError read_serial_timeout(
  * 波特率探测
  *============================================================================*/
 
+/**
+ * @brief 读取同步应答后面的能力块（旧 Bootloader 没有，caps 保持全 0）
+ */
+static void read_capabilities(mbl_handle* h) {
+    uint8_t caps[MBL_CAPS_LEN];
+    memset(&h->caps, 0, sizeof(h->caps));
+    if (read_serial_timeout(h->hComm, caps, MBL_CAPS_LEN, 30) != MBL_Error_OK ||
+        caps[0] != MBL_CAPS_MAGIC_0 || caps[1] != MBL_CAPS_MAGIC_1 ||
+        caps[2] != MBL_CAPS_MAGIC_2 || caps[3] != MBL_CAPS_MAGIC_3) {
+        return;
+    }
+    h->caps.max_chunk = (uint16_t)(caps[4] | (caps[5] << 8));
+    h->caps.window = caps[6];
+    h->caps.flags = caps[7];
+}
+
+/**
+ * @brief 固定波特率打开时补做一次同步，只为拿到能力块
+ */
+static void query_capabilities(mbl_handle* h) {
+    const uint8_t sync_tx[] = {
+            MBL_SYNC_TX_0, MBL_SYNC_TX_1, MBL_SYNC_TX_2, MBL_SYNC_TX_3};
+    const uint8_t sync_rx_expected[] = {
+            MBL_SYNC_RX_0, MBL_SYNC_RX_1, MBL_SYNC_RX_2, MBL_SYNC_RX_3};
+    uint8_t sync_rx[MBL_SYNC_LEN];
+
+    flush_serial(h->hComm);
+    if (write_serial(h->hComm, sync_tx, MBL_SYNC_LEN) == MBL_Error_OK &&
+        read_serial_timeout(h->hComm, sync_rx, MBL_SYNC_LEN, 100) ==
+                MBL_Error_OK &&
+        memcmp(sync_rx, sync_rx_expected, MBL_SYNC_LEN) == 0) {
+        read_capabilities(h);
+    }
+}
+
 static MCUBootloaderError probe_baudrate(mbl_handle* h) {
     const uint8_t sync_tx[] = {
             MBL_SYNC_TX_0, MBL_SYNC_TX_1, MBL_SYNC_TX_2, MBL_SYNC_TX_3};
@@ -322,6 +344,7 @@ static MCUBootloaderError probe_baudrate(mbl_handle* h) {
         }
 
         if (success) {
+            read_capabilities(h);
             return MBL_Error_OK;
         }
 
@@ -372,7 +395,7 @@ static MCUBootloaderError send_frame(
     }
 
     // CRC32（覆盖 CommandType + Payload，即 frame[2] 到 frame[85]）
-    uint32_t crc = calc_crc32(frame + 2, MBL_CMD_LEN + MBL_PAYLOAD_LEN);
+    uint32_t crc = msb_crc32(frame + 2, MBL_CMD_LEN + MBL_PAYLOAD_LEN);
     frame[86] = (uint8_t)(crc & 0xFF);
     frame[87] = (uint8_t)((crc >> 8) & 0xFF);
     frame[88] = (uint8_t)((crc >> 16) & 0xFF);
@@ -426,7 +449,7 @@ static MCUBootloaderError recv_frame(
     uint32_t crc_recv = (uint32_t)frame[86] | ((uint32_t)frame[87] << 8) |
                         ((uint32_t)frame[88] << 16) |
                         ((uint32_t)frame[89] << 24);
-    uint32_t crc_calc = calc_crc32(frame + 2, MBL_CMD_LEN + MBL_PAYLOAD_LEN);
+    uint32_t crc_calc = msb_crc32(frame + 2, MBL_CMD_LEN + MBL_PAYLOAD_LEN);
     if (crc_recv != crc_calc) {
         return MBL_Error_Proto_CRCError;
     }
@@ -443,6 +466,41 @@ static MCUBootloaderError recv_frame(
     return MBL_Error_OK;
 }
 
+/**
+ * @brief 发送快速写帧（变长帧）
+ *
+ * 与 send_frame 不同，发送前不清接收缓冲：前面在途帧的应答还在路上。
+ */
+static MCUBootloaderError send_fast_write(
+        mbl_handle* h,
+        uint32_t offset,
+        uint32_t total_length,
+        const uint8_t* chunk_data,
+        uint32_t chunk_length) {
+    uint8_t frame[MBL_FAST_FRAME_LEN(MBL_FAST_CHUNK_MAX)];
+    if (chunk_length > MBL_FAST_CHUNK_MAX) {
+        return MBL_Error_Win_InvalidParam;
+    }
+
+    uint8_t* p = frame;
+    *p++ = MBL_FRAME_HEADER_0;
+    *p++ = MBL_FRAME_HEADER_1;
+    put_le32(p, MBL_CMD_WRITE_FAST);
+    put_le32(p + 4, offset);
+    put_le32(p + 8, total_length);
+    put_le32(p + 12, chunk_length);
+    memcpy(p + 16, chunk_data, chunk_length);
+
+    // CRC32 覆盖 CommandType 到 ChunkData
+    uint32_t crc_len = MBL_CMD_LEN + MBL_FAST_HEADER_LEN + chunk_length;
+    put_le32(p + crc_len, msb_crc32(p, crc_len));
+    p += crc_len + MBL_CRC_LEN;
+    *p++ = MBL_FRAME_TAIL_0;
+    *p++ = MBL_FRAME_TAIL_1;
+
+    return write_serial(h->hComm, frame, (size_t)(p - frame));
+}
+
 /*==============================================================================
  * 公开 API 实现
  *============================================================================*/
@@ -473,6 +531,9 @@ mbl_open(mbl_handle** handle, const char* port, uint32_t baud) {
     } else {
         // 使用指定波特率
         err = open_serial(h, baud);
+        if (err == MBL_Error_OK) {
+            query_capabilities(h);
+        }
     }
 
     if (err != MBL_Error_OK) {
@@ -502,6 +563,16 @@ MBL_EXPORT uint32_t mbl_get_baudrate(mbl_handle* handle) {
     return handle->baud;
 }
 
+MBL_EXPORT MCUBootloaderError
+mbl_get_capabilities(mbl_handle* handle, MBL_Capabilities* caps) {
+    if (!handle || !caps) {
+        return MBL_Error_Win_InvalidParam;
+    }
+
+    *caps = handle->caps;
+    return MBL_Error_OK;
+}
+
 MBL_EXPORT MCUBootloaderError mbl_register_progress_callback(
         mbl_handle* handle,
         mbl_progress_callback_t callback,
@@ -706,6 +777,43 @@ MBL_EXPORT MCUBootloaderError mbl_command_write(
     }
 }
 
+MBL_EXPORT MCUBootloaderError mbl_command_verify(
+        mbl_handle* handle,
+        uint32_t total_length,
+        uint32_t crc32,
+        uint32_t timeout_ms) {
+    if (!handle) {
+        return MBL_Error_Win_InvalidParam;
+    }
+
+    // [0-3] TotalLength, [4-7] CRC32
+    uint8_t payload[MBL_PAYLOAD_LEN];
+    memset(payload, 0, MBL_PAYLOAD_LEN);
+    put_le32(payload, total_length);
+    put_le32(payload + 4, crc32);
+
+    MCUBootloaderError err =
+            send_frame(handle, MBL_CMD_VERIFY, payload, MBL_PAYLOAD_LEN);
+    if (err != MBL_Error_OK) {
+        return err;
+    }
+
+    uint32_t cmd_type;
+    uint8_t rsp_payload[MBL_PAYLOAD_LEN];
+    err = recv_frame(handle, timeout_ms, &cmd_type, rsp_payload);
+    if (err != MBL_Error_OK) {
+        return err;
+    }
+
+    if (cmd_type == MBL_RSP_VERIFY_OK) {
+        return MBL_Error_OK;
+    } else if (cmd_type == MBL_RSP_VERIFY_ERR) {
+        return mcu_error_from_payload(rsp_payload);
+    } else {
+        return MBL_Error_Proto_UnknownResponse;
+    }
+}
+
 MBL_EXPORT MCUBootloaderError
 mbl_command_exit(mbl_handle* handle, uint32_t timeout_ms) {
     if (!handle) {
@@ -743,6 +851,144 @@ mbl_command_exit(mbl_handle* handle, uint32_t timeout_ms) {
  * 便捷 API
  *============================================================================*/
 
+/** 快速写入时连续多少次没有进展就放弃 */
+#define MBL_FAST_RETRY_MAX 5
+
+static void report_progress(
+        mbl_handle* h,
+        uint32_t done,
+        uint32_t total,
+        MCUBootloaderError err) {
+    if (h->progress_callback) {
+        int progress = (int)(((uint64_t)done * 100) / total);
+        h->progress_callback(progress, err, h->callback_ctx);
+    }
+}
+
+/**
+ * @brief 快速写入：大帧、最多 window 帧在途（回退 N 帧重传）
+ *
+ * Bootloader 只按顺序写：每帧应答带已连续写入的长度 next。某帧丢了，后面
+ * 在途的帧都会被拒（WriteOffsetMisaligned），收到最后发出那一帧的应答后
+ * 从 next 重发；应答超时也从已确认的位置重发（重复的帧 Bootloader 直接应答
+ * OK）。
+ */
+static MCUBootloaderError write_firmware_fast(
+        mbl_handle* h,
+        const uint8_t* firmware,
+        uint32_t firmware_len,
+        uint32_t timeout_ms) {
+    uint32_t chunk_size = h->caps.max_chunk;
+    if (chunk_size > MBL_FAST_CHUNK_MAX) {
+        chunk_size = MBL_FAST_CHUNK_MAX;
+    }
+    chunk_size &= ~3u;  // 除最后一块外按字对齐
+    uint32_t window = h->caps.window ? h->caps.window : 1;
+
+    uint32_t acked = 0;        // Bootloader 确认已连续写入的长度
+    uint32_t sent = 0;         // 已发出的长度
+    uint32_t outstanding = 0;  // 在途帧数
+    uint32_t last_offset = 0;  // 最后发出那一帧的 Offset
+    int retries = 0;
+    int last_progress = -1;
+
+    flush_serial(h->hComm);
+    while (acked < firmware_len) {
+        while (outstanding < window && sent < firmware_len) {
+            uint32_t remaining = firmware_len - sent;
+            uint32_t chunk_len =
+                    (remaining > chunk_size) ? chunk_size : remaining;
+            MCUBootloaderError err = send_fast_write(
+                    h, sent, firmware_len, firmware + sent, chunk_len);
+            if (err != MBL_Error_OK) {
+                report_progress(h, acked, firmware_len, err);
+                return err;
+            }
+            last_offset = sent;
+            sent += chunk_len;
+            outstanding++;
+        }
+
+        uint32_t cmd_type;
+        uint8_t payload[MBL_PAYLOAD_LEN];
+        MCUBootloaderError err = recv_frame(h, timeout_ms, &cmd_type, payload);
+        if (err == MBL_Error_OK && cmd_type == MBL_RSP_WRITE_FAST_OK) {
+            if (outstanding > 0) {
+                outstanding--;
+            }
+            uint32_t next = get_le32(payload + 4);
+            if (next > acked && next <= firmware_len) {
+                acked = next;
+                retries = 0;
+                int progress = (int)(((uint64_t)acked * 100) / firmware_len);
+                if (progress != last_progress) {
+                    last_progress = progress;
+                    report_progress(h, acked, firmware_len, MBL_Error_OK);
+                }
+            }
+            continue;
+        }
+
+        if (err == MBL_Error_OK && cmd_type == MBL_RSP_WRITE_FAST_ERR) {
+            err = mcu_error_from_payload(payload);
+            if (err != MBL_Error_MCU_WriteOffsetMisaligned) {
+                report_progress(h, acked, firmware_len, err);
+                return err;  // 写 Flash 失败等，重发也没用
+            }
+            // 后面在途的帧都会被拒，收到最后一帧的应答为止（丢了的帧
+            // 没有应答，不能按在途帧数去等）
+            uint32_t offset = get_le32(payload + 8);
+            for (;;) {
+                uint32_t next = get_le32(payload + 4);
+                if (next > acked && next <= firmware_len) {
+                    acked = next;
+                    retries = 0;
+                }
+                if (offset == last_offset ||
+                    recv_frame(h, timeout_ms, &cmd_type, payload) !=
+                            MBL_Error_OK) {
+                    break;
+                }
+                if (cmd_type == MBL_RSP_WRITE_FAST_OK) {
+                    offset = get_le32(payload);
+                } else if (cmd_type == MBL_RSP_WRITE_FAST_ERR) {
+                    offset = get_le32(payload + 8);
+                } else {
+                    break;
+                }
+            }
+        } else if (
+                err != MBL_Error_OK && err != MBL_Error_Win_Timeout &&
+                err != MBL_Error_Proto_HeaderError &&
+                err != MBL_Error_Proto_TailError &&
+                err != MBL_Error_Proto_CRCError) {
+            report_progress(h, acked, firmware_len, err);
+            return err;
+        } else if (err == MBL_Error_OK) {
+            err = MBL_Error_Proto_UnknownResponse;
+        }
+
+        // 从已确认的位置重发
+        if (++retries > MBL_FAST_RETRY_MAX) {
+            report_progress(h, acked, firmware_len, err);
+            return err;
+        }
+        flush_serial(h->hComm);
+        outstanding = 0;
+        sent = acked;
+    }
+
+    if (h->caps.flags & MBL_CAPS_FLAG_VERIFY) {
+        MCUBootloaderError err = mbl_command_verify(
+                h, firmware_len, msb_crc32(firmware, firmware_len), timeout_ms);
+        if (err != MBL_Error_OK) {
+            report_progress(h, acked, firmware_len, err);
+            return err;
+        }
+    }
+    return MBL_Error_OK;
+}
+
 MBL_EXPORT MCUBootloaderError mbl_write_firmware(
         mbl_handle* handle,
         const uint8_t* firmware,
@@ -752,6 +998,10 @@ MBL_EXPORT MCUBootloaderError mbl_write_firmware(
         return MBL_Error_Win_InvalidParam;
     }
 
+    if (handle->caps.max_chunk >= 64) {
+        return write_firmware_fast(handle, firmware, firmware_len, timeout_ms);
+    }
+
     const uint32_t chunk_size = 64;
     uint32_t offset = 0;
 
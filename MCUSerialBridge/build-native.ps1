@@ -88,6 +88,8 @@ function Build-LinuxNative {
     $sources = @(
         "c_core/src/msb_handle.c",
         "c_core/src/msb_packet.c",
+        "c_core/src/msb_ring.c",
+        "c_core/src/msb_crc.c",
         "c_core/src/msb_thread.c",
         "c_core/src/msb_bridge.c",
         "c_core/src/msb_platform_posix.c",
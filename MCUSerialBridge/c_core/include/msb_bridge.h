@@ -201,6 +201,26 @@ DLL_EXPORT MCUSerialBridgeError msb_set_wire_tap(
         uint8_t flags,
         uint32_t timeout_ms);
 
+/**
+ * @brief 设置 LowerIO 上报格式
+ *
+ * 在全量与增量（位图 + 变化字段，周期关键帧）LowerIO 上报之间切换，
+ * 只对下一次 Start 有效，每次 Start 之前都要重新设置。
+ * 旧固件返回 MSB_Error_Proto_UnknownCommand，此时应继续按全量格式解析；
+ * 其它错误（如超时）时 MCU 的格式未知。
+ *
+ * @param handle MCU 句柄
+ * @param mode LowerIoMode_Full / LowerIoMode_Delta
+ * @param keyframe_interval 增量模式关键帧间隔（迭代数），0 = 默认 100
+ * @param timeout_ms 超时时间（毫秒）
+ * @return MCUSerialBridgeError 错误码
+ */
+DLL_EXPORT MCUSerialBridgeError msb_set_lower_io_mode(
+        msb_handle* handle,
+        uint8_t mode,
+        uint16_t keyframe_interval,
+        uint32_t timeout_ms);
+
 /**
  * @brief 读取MCU IO输入
  *
@@ -324,7 +344,10 @@ DLL_EXPORT MCUSerialBridgeError msb_write_port(
  *
  * 向 MCU 发送程序数据。如果 program_bytes 为 NULL 或 program_len 为 0，
  * MCU 进入透传模式；否则进入 DIVER 模式并加载程序。
- * 大程序会自动分片传输。
+ * 大程序会自动分片传输：多个分片同时在途（见 @ref msb_set_program_window），
+ * 丢失的分片从 MCU 确认的偏移处重传，最后校验整个程序的 CRC32。
+ * 下载前先用 CRC32 查询 MCU 上是否已经是同一个镜像，是则直接返回
+ * （见 @ref msb_set_program_cache）。
  *
  * @param handle MCU 句柄
  * @param program_bytes 程序字节数据（可为 NULL）
@@ -338,6 +361,31 @@ DLL_EXPORT MCUSerialBridgeError msb_program(
         uint32_t program_len,
         uint32_t timeout_ms);
 
+/**
+ * @brief 设置程序下载的窗口和分片大小
+ *
+ * @param handle MCU 句柄
+ * @param window 同时在途的分片数，1 即逐片等应答；默认 8，最大 PROGRAM_WINDOW_MAX
+ * @param chunk_size 分片字节数，0 表示按单包负载上限（默认）
+ * @return MCUSerialBridgeError 错误码
+ */
+DLL_EXPORT MCUSerialBridgeError msb_set_program_window(
+        msb_handle* handle,
+        uint32_t window,
+        uint32_t chunk_size);
+
+/**
+ * @brief 设置 msb_program 是否先查询 MCU 上已有的镜像
+ *
+ * 开启时（默认）MCU 缓冲区里已经是同样长度和 CRC32 的程序就跳过下载。
+ * 关闭后每次都完整下载。
+ *
+ * @param handle MCU 句柄
+ * @param enable 1 查询，0 不查询
+ * @return MCUSerialBridgeError 错误码
+ */
+DLL_EXPORT MCUSerialBridgeError msb_set_program_cache(msb_handle* handle, uint8_t enable);
+
 /**
  * @brief PC → MCU 内存交换（UpperIO）
  *
@@ -547,6 +595,52 @@ DLL_EXPORT MCUSerialBridgeError msb_get_stats(
         RuntimeStatsC* stats,
         uint32_t timeout_ms);
 
+/**
+ * @brief 主机侧发送统计（send 线程合并写）
+ *
+ * send 线程把队列里连续的多帧合并成一次串口写，这里统计合并效果。
+ * 与 msb_get_stats 不同，本结构只在主机侧维护，不经过 MCU。
+ */
+typedef struct {
+    uint64_t frames;                // 已写出的帧数
+    uint64_t bytes;                 // 已写出的字节数（含帧头帧尾）
+    uint64_t writes;                // 串口写调用次数
+    uint32_t max_frames_per_write;  // 单次写最多合并的帧数
+    uint32_t max_bytes_per_write;   // 单次写最大字节数
+    uint32_t batch_max_bytes;       // 当前合并字节上限
+    uint32_t batch_linger_ms;       // 当前合并等待时间
+} SendStatsC;
+
+/**
+ * @brief 获取主机侧发送统计
+ *
+ * @param handle MCU 句柄
+ * @param stats 返回统计数据
+ * @return MCUSerialBridgeError 错误码
+ */
+DLL_EXPORT MCUSerialBridgeError msb_get_send_stats(
+        msb_handle* handle,
+        SendStatsC* stats);
+
+/**
+ * @brief 设置 send 线程的合并写参数
+ *
+ * 队头帧总是立即发出；其后已入队的帧只要总长度不超过 max_bytes
+ * 就合并进同一次写。linger_ms > 0 时，未达上限会再等最多 linger_ms
+ * 收集后续帧（用延迟换吞吐）。
+ *
+ * @param handle MCU 句柄
+ * @param max_bytes 单次写的字节上限，0 表示不合并（每帧一次写）。
+ *                  MCU 上行接收缓冲为 1536 字节，默认 1024，超过
+ *                  WRITE_BATCH_LIMIT_BYTES 时截断
+ * @param linger_ms 合并等待时间（毫秒），默认 0
+ * @return MCUSerialBridgeError 错误码
+ */
+DLL_EXPORT MCUSerialBridgeError msb_set_write_batch(
+        msb_handle* handle,
+        uint32_t max_bytes,
+        uint32_t linger_ms);
+
 /*
  * @brief 生成函数指针结构体
  * 导出所有 API
@@ -602,6 +696,8 @@ typedef struct MCUSerialBridgeAPI {
     MCUSerialBridgeError (
             *msb_program)(msb_handle*, const uint8_t*, uint32_t, uint32_t);
     MCUSerialBridgeError (*msb_set_wire_tap)(msb_handle*, uint8_t, uint8_t, uint32_t);
+    MCUSerialBridgeError (
+            *msb_set_lower_io_mode)(msb_handle*, uint8_t, uint16_t, uint32_t);
     MCUSerialBridgeError (*msb_memory_upper_io)(
             msb_handle*,
             const uint8_t*,
@@ -631,10 +727,14 @@ typedef struct MCUSerialBridgeAPI {
             msb_handle*,
             RuntimeStatsC*,
             uint32_t);
+    MCUSerialBridgeError (*msb_set_program_window)(msb_handle*, uint32_t, uint32_t);
+    MCUSerialBridgeError (*msb_get_send_stats)(msb_handle*, SendStatsC*);
+    MCUSerialBridgeError (*msb_set_write_batch)(msb_handle*, uint32_t, uint32_t);
     MCUSerialBridgeError (*msb_get_transport_error_state)(
             msb_handle*,
             TransportErrorStateC*);
     MCUSerialBridgeError (*msb_clear_transport_error_state)(msb_handle*);
+    MCUSerialBridgeError (*msb_set_program_cache)(msb_handle*, uint8_t);
 } MCUSerialBridgeAPI;
 
 DLL_EXPORT void mcu_serial_bridge_get_api(MCUSerialBridgeAPI* api);
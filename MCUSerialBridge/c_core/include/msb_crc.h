@@ -0,0 +1,62 @@
+#ifndef MSB_CRC_H
+#define MSB_CRC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// --------------------
+// 串口协议共用的 CRC 计算
+// - CRC16/Modbus：MSB 帧的负载校验（主机 msb_thread.c 与 MCU packet.c）
+// - CRC32 (zlib)：程序镜像与 Bootloader 帧/固件校验
+//
+// 软件实现是 slice-by-8（每次 8 字节、8 张 256 项表）；CRC32 另有加速路径：
+// - x86/x64：PCLMULQDQ 折叠（运行时检测 CPU，≥64 字节才走）
+// - ARMv8：CRC32 指令（编译期 __ARM_FEATURE_CRC32 / MSVC ARM64）
+// - MCU (IS_MCU)：STM32F4 硬件 CRC 单元，不可重入，不要在中断里调用
+// 所有路径结果逐位一致，由 test/bench_crc.c 交叉校验。
+// --------------------
+
+#define MSB_CRC16_INIT 0xFFFFu  // msb_crc16_update 的起始值
+
+/**
+ * @brief CRC16/Modbus（init 0xFFFF，反射多项式 0xA001，无结果异或）
+ */
+uint16_t msb_crc16(const uint8_t* data, uint32_t len);
+
+/**
+ * @brief 分段计算 CRC16/Modbus
+ * @param crc 上一段的结果，第一段传 MSB_CRC16_INIT
+ */
+uint16_t msb_crc16_update(uint16_t crc, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief CRC32，与 zlib.crc32 / Python binascii.crc32 相同
+ */
+uint32_t msb_crc32(const uint8_t* data, uint32_t len);
+
+/**
+ * @brief 分段计算 CRC32（zlib crc32() 的语义）
+ * @param crc 上一段的结果，第一段传 0
+ */
+uint32_t msb_crc32_update(uint32_t crc, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief 纯软件 slice-by-8 的 CRC32，参数同 msb_crc32_update
+ *
+ * 测试和基准用它对照加速路径；MCU 上没有 CRC32 大表，这里退化为逐字节。
+ */
+uint32_t msb_crc32_portable(uint32_t crc, const uint8_t* data, uint32_t len);
+
+/**
+ * @brief 当前 CRC32 走的实现："pclmul" / "armv8-crc" / "stm32-hw" / "slice-by-8"
+ */
+const char* msb_crc32_impl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MSB_CRC_H
@@ -8,12 +8,15 @@
 #include "msb_error_c.h"
 #include "msb_platform.h"
 #include "msb_protocol.h"
+#include "msb_ring.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define MAX_PENDING_SEQ 32
+#define PROGRAM_WINDOW_MAX 16  // msb_program 同时在途的分片上限，要小于 MAX_PENDING_SEQ
+#define PROGRAM_WINDOW_DEFAULT 8
 
 // Port receive queue
 typedef struct {
@@ -22,9 +25,8 @@ typedef struct {
     uint32_t timestamp_ms;
 } PortDataFrame;
 typedef struct {
-    PortDataFrame queue[0x100];
-    uint8_t head;  // 写（parse 线程）
-    uint8_t tail;  // 读（read_port）
+    PortDataFrame queue[RING_QUEUE_SIZE];
+    SpscIndex idx;  // head 写（parse 线程），tail 读（read_port）
     HANDLE data_event;
 } PortQueue;
 
@@ -36,24 +38,9 @@ typedef struct {
     bool in_use;                  // 是否已被占用
     bool done_flag;               // 接收到响应后置为 true
     MCUSerialBridgeError result;  // MCU返回结果
-#define RETURN_DATA_MAX_SIZE 512
-    uint8_t return_data[RETURN_DATA_MAX_SIZE];  // MCU 返回的额外数据
-    uint32_t return_data_len;  // MCU 返回的额外数据的长度
+    PacketBuf* reply;  // 应答包（持有一个引用，调用方取完数据后释放）
 } SeqWaiter;
 
-// RawPacket entry for sending and receiving
-typedef struct {
-    uint16_t len;       // Payload长度
-    uint8_t header[6];  // BB AA len_lo len_hi rev_lo rev_hi
-    uint8_t payload[PACKET_MAX_PAYLOAD_LEN + 4];  // Payload数据 + crc16_lo
-                                                  // crc16_hi + EE EE
-} PayloadEntry;
-typedef struct {
-    PayloadEntry entries[0x100];  // 队列数组，环形队列长度=256, 不要改
-    volatile uint8_t head;        // 写指针
-    volatile uint8_t tail;        // 读指针
-} RingQueue;
-
 
 typedef struct msb_handle {
     char port_name[64];
@@ -63,19 +50,32 @@ typedef struct msb_handle {
     HANDLE hComm;
     CRITICAL_SECTION comm_lock;  // 保护 hComm 读写与重连切换
 
+    // send 线程合并写参数与统计（send_stats 由 comm_lock 保护）
+    uint32_t write_batch_max_bytes;
+    uint32_t write_batch_linger_ms;
+    SendStatsC send_stats;
+
+    // msb_program 的滑动窗口参数，以及下载前是否查询 MCU 上已有的镜像
+    uint32_t program_window;
+    uint32_t program_chunk_size;
+    bool program_cache;
+
     // 线程相关
     void* recv_thread;
     void* parse_thread;
     void* send_thread;
+    HANDLE rx_event;  // recv → parse：接收队列有新包
+    HANDLE tx_event;  // API → send：发送队列有新包
 
     CRITICAL_SECTION seq_lock;  // 保护全局 sequence
     uint32_t sequence;
     SeqWaiter pending[MAX_PENDING_SEQ];
 
-    // 命令接收队列
-    RingQueue receive_queue;
-    // 命令发送队列
-    RingQueue send_queue;
+    // 命令接收队列（recv → parse，SPSC）及其包缓冲池
+    PacketPool receive_pool;
+    PacketQueue receive_queue;
+    // 命令发送队列（API 线程 → send，MPSC）
+    SendQueue send_queue;
 
     // Port 数据接收队列
     PortQueue ports[PACKET_MAX_PORTS_NUM];
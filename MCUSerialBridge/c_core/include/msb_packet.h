@@ -38,6 +38,44 @@ MCUSerialBridgeError mcu_send_packet_and_wait(
         uint32_t return_data_len,
         uint32_t timeout_ms);
 
+/**
+ * @brief 发送需要应答的协议包，不等应答
+ *
+ * 占用一个 SeqWaiter 并把包放进发送队列后立即返回，之后必须调用
+ * @ref mcu_wait_packet 取结果并归还 SeqWaiter。用于同时有多个包在途的
+ * 传输（如分片下载程序）。
+ *
+ * @param timeout_ms 发送队列满时等待空位的上限（毫秒）
+ * @param[out] out_waiter 成功时返回占用的 SeqWaiter
+ */
+MCUSerialBridgeError mcu_send_packet_begin(
+        msb_handle* handle,
+        uint8_t command,
+        const uint8_t* other_data,
+        uint32_t other_data_len,
+        uint32_t timeout_ms,
+        SeqWaiter** out_waiter);
+
+/**
+ * @brief 等待 @ref mcu_send_packet_begin 发出的包的应答
+ *
+ * 到 deadline_ms（GetTickCount64 时间）仍未收到应答时返回
+ * MSB_Error_Proto_Timeout。无论结果如何都会归还 SeqWaiter。
+ */
+MCUSerialBridgeError mcu_wait_packet(
+        msb_handle* handle,
+        SeqWaiter* waiter,
+        uint64_t deadline_ms,
+        uint8_t* return_data,
+        uint32_t return_data_len);
+
+/**
+ * @brief 查询 @ref mcu_send_packet_begin 发出的包是否已收到应答
+ *
+ * 未收到时最多等待 wait_ms。不归还 SeqWaiter，之后仍要调用 @ref mcu_wait_packet。
+ */
+bool mcu_packet_ready(SeqWaiter* waiter, uint32_t wait_ms);
+
 void msb_parse_upload_data(msb_handle* handle, const DataPacket* data_packet, uint32_t timestamp_ms);
 
 
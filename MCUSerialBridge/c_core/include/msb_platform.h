@@ -10,6 +10,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,8 @@ typedef DWORD (*LPTHREAD_START_ROUTINE)(LPVOID);
 #define GENERIC_WRITE 0x40000000u
 #define OPEN_EXISTING 3
 #define FILE_ATTRIBUTE_NORMAL 0x00000080u
+#define FILE_FLAG_OVERLAPPED 0x40000000u  // POSIX 上忽略
+#define EV_RXCHAR 0x0001
 
 #define PURGE_RXABORT 0x0002
 #define PURGE_RXCLEAR 0x0008
@@ -104,6 +107,14 @@ typedef struct {
     DWORD WriteTotalTimeoutConstant;
 } COMMTIMEOUTS;
 
+typedef union {
+    struct {
+        DWORD LowPart;
+        int32_t HighPart;
+    } u;
+    int64_t QuadPart;
+} LARGE_INTEGER;
+
 typedef struct {
     DWORD cbInQue;
     DWORD cbOutQue;
@@ -117,6 +128,7 @@ void LeaveCriticalSection(CRITICAL_SECTION* cs);
 void InitializeConditionVariable(CONDITION_VARIABLE* cv);
 BOOL SleepConditionVariableCS(CONDITION_VARIABLE* cv, CRITICAL_SECTION* cs, DWORD timeout_ms);
 void WakeConditionVariable(CONDITION_VARIABLE* cv);
+void WakeAllConditionVariable(CONDITION_VARIABLE* cv);
 
 HANDLE CreateEvent(void* security_attributes, BOOL manual_reset, BOOL initial_state, const char* name);
 BOOL SetEvent(HANDLE handle);
@@ -146,13 +158,24 @@ BOOL SetCommState(HANDLE handle, DCB* dcb);
 BOOL SetCommTimeouts(HANDLE handle, COMMTIMEOUTS* timeouts);
 BOOL ClearCommError(HANDLE handle, DWORD* errors, COMSTAT* stat);
 BOOL PurgeComm(HANDLE handle, DWORD flags);
+BOOL SetCommMask(HANDLE handle, DWORD mask);
 BOOL CancelIoEx(HANDLE handle, void* overlapped);
 BOOL FlushFileBuffers(HANDLE handle);
 
+// POSIX 专用（Win32 没有对应 API）：调用时持有 cs，等待期间释放 cs，
+// 直到串口有数据、CancelIoEx(comm) 或超时；返回前重新获得 cs。
+// 返回 TRUE 表示可以读（或已取消），FALSE 为超时或句柄无效。
+BOOL WaitCommInputCS(HANDLE comm, CRITICAL_SECTION* cs, DWORD timeout_ms);
+
+// POSIX 专用：一次 writev 写出多段缓冲（语义同 WriteFile，写完后 tcdrain）。
+BOOL WriteFileV(HANDLE handle, const struct iovec* iov, int iovcnt, DWORD* bytes_written);
+
 DWORD GetLastError(void);
 void SetLastError(DWORD error);
 DWORD GetTickCount(void);
 uint64_t GetTickCount64(void);
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
 void Sleep(DWORD milliseconds);
 void GetLocalTime(SYSTEMTIME* system_time);
 
@@ -138,6 +138,23 @@ typedef enum {
      */
     CommandGetAbi = 0x08,
 
+    /**
+     * @brief 设置 LowerIO 上报格式 (PC → MCU)
+     *
+     * 协商 CommandUploadLowerIoAndVmStats 中 LowerIO 数据的编码：全量（默认）
+     * 或增量（位图 + 仅变化字段，周期性关键帧用于重同步，格式见
+     * MCURuntime/mcu_runtime.h vm_get_lower_memory_delta）。
+     * 请求数据：LowerIoModeC 结构。
+     * 响应命令：0x89（同 seq）。
+     *
+     * 协商结果只对下一次 CommandStart 有效：下载程序、复位以及没有先协商的
+     * Start 都会恢复全量，上位机每次启动会话都要在 Start 之前重新发送。
+     *
+     * 兼容性说明：旧固件返回 MSB_Error_Proto_UnknownCommand，上位机应继续按
+     * 全量格式解析；超时等其它错误时 MCU 的格式未知，不能当作全量。
+     */
+    CommandSetLowerIoMode = 0x09,
+
     /**
      * @brief 启动 MCU 运行 (PC → MCU)
      *
@@ -217,7 +234,7 @@ typedef enum {
      * 将「LowerIO 输出变量」与「本轮 vm_run() 的运行遥测」合并到一个包里发送。
      *
      * Payload 布局（紧随 PayloadHeader 之后）：
-     *   [ VmStatsC stats (28B) ][ MemoryExchangePacket lower_io (2B len + N) ]
+     *   [ VmStatsC stats (44B) ][ MemoryExchangePacket lower_io (2B len + N) ]
      *
      * 上位机协议层（c_core）解析后会拆开：把 VmStatsC 投递给 vm_stats 回调，把
      * LowerIO 字节投递给 memory_lower_io 回调，对上层保持与原先一致的两个事件。
@@ -386,6 +403,32 @@ typedef struct {
 
 STATIC_ASSERT(sizeof(AbiInfoC) == 8, "AbiInfoC size must be 8 bytes");
 
+/* ===============================
+ * LowerIO Mode (CommandSetLowerIoMode 0x09)
+ * =============================== */
+
+/**
+ * @brief LowerIO 上报格式
+ */
+typedef enum {
+    LowerIoMode_Full  = 0x00, /**< 全量：[iteration 4B]{全部 LowerIO 字段} */
+    LowerIoMode_Delta = 0x01, /**< 增量：'K' 关键帧 / 'D' 增量帧（位图 + 变化字段） */
+} LowerIoMode;
+
+/**
+ * @brief LowerIO 上报格式配置
+ *
+ * 用于 CommandSetLowerIoMode 命令的请求数据。切换到增量模式后，MCU 的第一帧
+ * 一定是关键帧；此后每 keyframe_interval 次迭代再发送一次关键帧。
+ */
+typedef struct {
+    u8 mode;               /**< LowerIoMode 枚举值 */
+    u8 reserved;           /**< 保留，填 0 */
+    u16 keyframe_interval; /**< 关键帧间隔（迭代数），0 = 默认 100 */
+} LowerIoModeC;
+
+STATIC_ASSERT(sizeof(LowerIoModeC) == 4, "LowerIoModeC size must be 4 bytes");
+
 /* ===============================
  * MCU State
  * =============================== */
@@ -542,6 +585,23 @@ typedef struct {
  * @brief 程序下载数据包结构
  *
  * 用于 CommandProgram，支持分片传输大程序。
+ *
+ * 主机可以同时有多个分片在途（滑动窗口），丢了哪片只重传哪片：
+ * - offset <= 已连续收到的长度：接收（重复部分不再拷贝），应答 OK；
+ * - offset 超前但按 PROGRAM_CHUNK_GRANULE 对齐，且 chunk_len 也是它的
+ *   整数倍（或正好到程序末尾）：乱序接收并记下，应答 OK；
+ * - 其它超前的分片：应答 ProgramInvalidOffset（旧固件对所有超前分片都如此）。
+ * 应答数据都带 ProgramAck（已连续收到的长度），主机据此判断要重传的分片。
+ * offset == 0 的分片总是重新开始一次下载，所以主机要等它应答后再发后续分片。
+ *
+ * 全部分片收完后，主机再发一个 offset == total_len、chunk_len == 4 的
+ * 校验包，data 为整个程序的 CRC32（zlib 兼容），不一致时 MCU 应答
+ * Proto_Checksum 并清除已加载标志。
+ *
+ * 同样的校验包也可以在下载之前发（缓存查询）：MCU 上次校验通过的镜像
+ * （复位后仍在，VM 加载改写过也算）是这个长度和 CRC 时直接采用，应答 OK 且 next_offset == total_len，
+ * 主机不再下载；否则应答错误码（通常是 ProgramInvalidOffset，旧固件是
+ * InvalidPayload），主机照常从 offset 0 开始下载。
  */
 typedef struct {
     u32 total_len; /**< 程序总长度（字节） */
@@ -554,6 +614,20 @@ STATIC_ASSERT(
         sizeof(ProgramPacket) == 10,
         "ProgramPacket size must be 10 (packed)");
 
+#define PROGRAM_CRC_CHUNK_LEN 4   /**< 整镜像校验包的 chunk_len */
+#define PROGRAM_CHUNK_GRANULE 64  /**< 乱序接收的对齐粒度（字节） */
+
+/**
+ * @brief 程序下载应答数据（CommandProgram 应答的 OtherData）
+ *
+ * 旧固件应答不带数据，主机按 0 处理。
+ */
+typedef struct {
+    u32 next_offset; /**< MCU 已连续收到的长度（下一个缺口的偏移） */
+} ProgramAck;
+
+STATIC_ASSERT(sizeof(ProgramAck) == 4, "ProgramAck size must be 4 (packed)");
+
 /**
  * @brief 内存交换数据包结构
  *
@@ -591,6 +665,8 @@ STATIC_ASSERT(sizeof(PortStatsC) == 16, "PortStatsC size must be 16 bytes");
  * - 数字 IO 状态
  * - 每个端口的收发统计
  * - 运行时间
+ * - 每个端口因 DIVER IO 缓冲已满而没有交给程序的接收帧数（追加在末尾，
+ *   旧固件的回包较短，上位机收到的这部分为 0）
  */
 typedef struct {
     u32 uptime_ms;       /**< MCU 运行时间（毫秒） */
@@ -599,9 +675,10 @@ typedef struct {
     u8 port_count;       /**< 有效端口数量 */
     u8 reserved[3];      /**< 保留字节（对齐） */
     PortStatsC ports[PACKET_MAX_PORTS_NUM]; /**< 各端口统计数据 */
+    u32 rx_dropped[PACKET_MAX_PORTS_NUM];   /**< 各端口 DIVER 接收溢出丢帧数 */
 } RuntimeStatsC;
 
-STATIC_ASSERT(sizeof(RuntimeStatsC) == 16 + 16 * PACKET_MAX_PORTS_NUM, 
+STATIC_ASSERT(sizeof(RuntimeStatsC) == 16 + 20 * PACKET_MAX_PORTS_NUM, 
               "RuntimeStatsC size error");
 
 /* ===============================
@@ -621,7 +698,10 @@ STATIC_ASSERT(sizeof(RuntimeStatsC) == 16 + 16 * PACKET_MAX_PORTS_NUM,
  * - mem_capacity:  整个 VM 工作缓冲区总大小（program+statics+stack+heap）。
  * - mem_peak_used: 本轮 cycle 内存占用峰值（high-water mark，含 program+statics+峰值栈+峰值堆）。
  *                  Memory 负载% = mem_peak_used / mem_capacity。
- * - heap_objs:   当前存活的堆对象数量（上限 1023）。
+ * - heap_objs:   当前存活的堆对象数量（上限为 vm_set_program 时确定的对象表大小 - 1，MCU 默认 1023）。
+ * - gc_cycles:   本轮 vm_run() 末尾垃圾回收耗费的 DWT 周期数（包含在 last_cycles 内）。
+ *                分代回收下大部分轮次只回收新生代，周期性做一次全堆 mark-compact。
+ * - gc_free_cycles: 自程序加载以来没有分配任何堆对象、因而整轮跳过 GC 的循环数。
  */
 typedef struct {
     u32 iteration;     /**< 循环计数 */
@@ -634,9 +714,11 @@ typedef struct {
     u32 mem_peak_used; /**< 本轮内存占用峰值（high-water，字节） */
     u16 heap_objs;     /**< 存活堆对象数量 */
     u16 reserved;      /**< 保留对齐 */
+    u32 gc_cycles;     /**< 本轮 GC 耗费的 DWT 周期数 */
+    u32 gc_free_cycles; /**< 跳过 GC 的循环累计数 */
 } VmStatsC;
 
-STATIC_ASSERT(sizeof(VmStatsC) == 36, "VmStatsC size must be 36 bytes");
+STATIC_ASSERT(sizeof(VmStatsC) == 44, "VmStatsC size must be 44 bytes");
 
 /* ===============================
  * Error Payload (CommandError 0xFF)
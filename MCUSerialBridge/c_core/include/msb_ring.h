@@ -0,0 +1,257 @@
+#ifndef MSB_RING_H
+#define MSB_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "msb_platform.h"
+#include "msb_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// --------------------
+// 原子操作
+// GCC / Clang 用 C11 <stdatomic.h>；MSVC 的 C 模式没有它，用 Interlocked 和
+// 编译器屏障代替（x86/x64 是 TSO，普通读写已经带 acquire/release 语义）。
+// --------------------
+#if defined(_MSC_VER) && !defined(__clang__)
+
+#include <intrin.h>
+
+typedef volatile long msb_atomic_u32;
+
+static __inline uint32_t msb_atomic_load_acquire(msb_atomic_u32* p)
+{
+#if defined(_M_ARM64)
+    return __ldar32((volatile unsigned __int32*)p);
+#else
+    uint32_t v = (uint32_t)*p;
+    _ReadWriteBarrier();
+    return v;
+#endif
+}
+
+static __inline void msb_atomic_store_release(msb_atomic_u32* p, uint32_t v)
+{
+#if defined(_M_ARM64)
+    __stlr32((volatile unsigned __int32*)p, v);
+#else
+    _ReadWriteBarrier();
+    *p = (long)v;
+#endif
+}
+
+static __inline bool msb_atomic_cas(
+        msb_atomic_u32* p,
+        uint32_t* expected,
+        uint32_t desired)
+{
+    long old = _InterlockedCompareExchange(p, (long)desired, (long)*expected);
+    if ((uint32_t)old == *expected) {
+        return true;
+    }
+    *expected = (uint32_t)old;
+    return false;
+}
+
+static __inline uint32_t msb_atomic_fetch_add(msb_atomic_u32* p, uint32_t v)
+{
+    return (uint32_t)_InterlockedExchangeAdd(p, (long)v);
+}
+
+static __inline void msb_atomic_fence(void)
+{
+#if defined(_M_ARM64)
+    __dmb(_ARM64_BARRIER_ISH);
+#else
+    _mm_mfence();
+#endif
+}
+
+#else
+
+#include <stdatomic.h>
+
+typedef _Atomic uint32_t msb_atomic_u32;
+
+static inline uint32_t msb_atomic_load_acquire(msb_atomic_u32* p)
+{
+    return atomic_load_explicit(p, memory_order_acquire);
+}
+
+static inline void msb_atomic_store_release(msb_atomic_u32* p, uint32_t v)
+{
+    atomic_store_explicit(p, v, memory_order_release);
+}
+
+static inline bool msb_atomic_cas(
+        msb_atomic_u32* p,
+        uint32_t* expected,
+        uint32_t desired)
+{
+    return atomic_compare_exchange_weak_explicit(
+            p, expected, desired, memory_order_acq_rel, memory_order_acquire);
+}
+
+static inline uint32_t msb_atomic_fetch_add(msb_atomic_u32* p, uint32_t v)
+{
+    return atomic_fetch_add(p, v);
+}
+
+static inline void msb_atomic_fence(void)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+#endif
+
+#define MSB_CACHE_LINE 64
+#define RING_QUEUE_SIZE 0x100  // 必须是 2 的幂
+#define RING_QUEUE_MASK (RING_QUEUE_SIZE - 1)
+
+// --------------------
+// SPSC 下标：生产者只写 head，消费者只写 tail。
+// 下标单调递增（uint32 回绕无妨），用 & mask 定位槽位；
+// head - tail == 容量 即为满。head / tail 分属不同 cache line。
+// --------------------
+typedef struct {
+    msb_atomic_u32 head;  // 写指针（生产者）
+    uint8_t pad_[MSB_CACHE_LINE - sizeof(msb_atomic_u32)];
+    msb_atomic_u32 tail;  // 读指针（消费者）
+} SpscIndex;
+
+// 生产者：有空位时返回 true 和要写的槽位下标
+static inline bool spsc_reserve(SpscIndex* r, uint32_t size, uint32_t* slot)
+{
+    uint32_t head = msb_atomic_load_acquire(&r->head);
+    if (head - msb_atomic_load_acquire(&r->tail) >= size) {
+        return false;
+    }
+    *slot = head & (size - 1);
+    return true;
+}
+
+// 生产者：槽位写完后发布
+static inline void spsc_publish(SpscIndex* r)
+{
+    msb_atomic_store_release(&r->head, msb_atomic_load_acquire(&r->head) + 1);
+}
+
+// 消费者：非空时返回 true 和要读的槽位下标
+static inline bool spsc_front(SpscIndex* r, uint32_t size, uint32_t* slot)
+{
+    uint32_t tail = msb_atomic_load_acquire(&r->tail);
+    if (msb_atomic_load_acquire(&r->head) == tail) {
+        return false;
+    }
+    *slot = tail & (size - 1);
+    return true;
+}
+
+// 消费者：槽位读完后归还
+static inline void spsc_release(SpscIndex* r)
+{
+    msb_atomic_store_release(&r->tail, msb_atomic_load_acquire(&r->tail) + 1);
+}
+
+// --------------------
+// 队列满时的等待：生产者在锁内登记 waiters 后再检查一次，
+// 消费者归还槽位后只在 waiters 非 0 时才进锁唤醒，空闲路径不碰锁。
+// --------------------
+typedef struct {
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE cnd;
+    msb_atomic_u32 waiters;
+} RingSpace;
+
+// --------------------
+// 接收包缓冲池（slab）：按尺寸分级的定长块，小应答不再占满 1200 B。
+// 只有 recv 线程分配；引用计数归零时由任意线程归还到所属尺寸的空闲链表。
+// 空闲链表是下标组成的栈：多个线程 push，只有一个线程 pop，所以没有 ABA。
+// --------------------
+#define PACKET_POOL_CLASSES 3
+#define PACKET_POOL_NIL 0xFFFFFFFFu
+
+typedef struct {
+    uint32_t next;        // 空闲链表中的下一个块（下标）
+    uint32_t self;        // 本块下标：尺寸级别 << 16 | 级内序号
+    msb_atomic_u32 refs;  // 引用计数
+    uint16_t len;         // 有效数据长度
+    uint16_t cap;         // 可用容量
+    uint8_t data[];       // 包 payload（PayloadHeader 开头）
+} PacketBuf;
+
+typedef struct {
+    uint8_t* memory;  // 所有尺寸的块连续放在一次分配里
+    uint32_t offset[PACKET_POOL_CLASSES];
+    msb_atomic_u32 free_head[PACKET_POOL_CLASSES];
+    RingSpace space;
+} PacketPool;
+
+// 接收队列：recv 线程 → parse 线程，单生产者单消费者，只传 PacketBuf 指针。
+// 容量不小于缓冲池的块数，所以入队不会失败，背压落在缓冲池分配上。
+#define PACKET_QUEUE_SIZE 1024
+typedef struct {
+    PacketBuf* items[PACKET_QUEUE_SIZE];
+    SpscIndex idx;
+} PacketQueue;
+
+// RawPacket entry for sending
+typedef struct {
+    uint16_t len;       // Payload长度
+    uint8_t header[6];  // BB AA len_lo len_hi rev_lo rev_hi
+    uint8_t payload[PACKET_MAX_PAYLOAD_LEN + 4];  // Payload数据 + crc16_lo
+                                                  // crc16_hi + EE EE
+} PayloadEntry;
+
+// 发送队列：任意 API 线程 → send 线程，多生产者单消费者。
+// 每个槽位带序号 seq（Vyukov 有界队列）：
+//   seq == pos            槽位空闲，等生产者用 CAS 领取 pos
+//   seq == pos + 1        生产者已写完，send 线程可以发
+//   seq == pos + SIZE     send 线程发完，留给下一圈
+typedef struct {
+    msb_atomic_u32 seq;
+    PayloadEntry entry;
+} SendSlot;
+typedef struct {
+    SendSlot slots[RING_QUEUE_SIZE];
+    msb_atomic_u32 head;  // 下一个领取位置（生产者 CAS）
+    uint8_t pad_[MSB_CACHE_LINE - sizeof(msb_atomic_u32)];
+    msb_atomic_u32 tail;  // 下一个发送位置（只有 send 线程写）
+    RingSpace space;
+} SendQueue;
+
+bool packet_pool_init(PacketPool* pool);
+void packet_pool_deinit(PacketPool* pool);
+// 只由一个线程调用：分配至少 len 字节的块（refs = 1），
+// 池里没有合适的块时最多等 timeout_ms，超时返回 NULL
+PacketBuf* packet_alloc(PacketPool* pool, uint32_t len, uint32_t timeout_ms);
+void packet_retain(PacketBuf* buf);
+// 任意线程调用；最后一个引用释放时块回到池里
+void packet_release(PacketPool* pool, PacketBuf* buf);
+
+void packet_queue_init(PacketQueue* q);
+bool packet_queue_push(PacketQueue* q, PacketBuf* buf);
+PacketBuf* packet_queue_pop(PacketQueue* q);
+
+void send_queue_init(SendQueue* q);
+void send_queue_deinit(SendQueue* q);
+// 可被多个线程同时调用：领取一个空槽位，调用方直接在 entry->payload 里
+// 组包、填 entry->len，再 send_queue_commit。满时最多等 timeout_ms，超时返回 NULL
+PayloadEntry* send_queue_claim(SendQueue* q, uint32_t timeout_ms);
+void send_queue_commit(SendQueue* q, PayloadEntry* entry);
+// 只由 send 线程调用：取队头（空返回 NULL），用完后 send_queue_pop 归还
+PayloadEntry* send_queue_front(SendQueue* q);
+void send_queue_pop(SendQueue* q);
+// 只由 send 线程调用：取队头之后第 index 个已提交的包（没有则 NULL），
+// 用于把连续的几帧合并成一次写；发完后 send_queue_pop_n 一起归还
+PayloadEntry* send_queue_peek(SendQueue* q, uint32_t index);
+void send_queue_pop_n(SendQueue* q, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MSB_RING_H
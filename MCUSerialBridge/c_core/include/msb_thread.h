@@ -14,7 +14,17 @@ DWORD WINAPI parse_thread_func(LPVOID param);
 
 DWORD WINAPI send_thread_func(LPVOID param);
 
-bool send_payload(msb_handle* handle, const uint8_t* data, uint32_t len);
+#define SEND_QUEUE_FULL_WAIT_MS 100  // 不等应答的包在发送队列满时的等待上限
+
+// 合并写：默认字节上限留在 MCU 上行接收缓冲（1536 B）之内
+#define WRITE_BATCH_DEFAULT_BYTES 1024
+#define WRITE_BATCH_LIMIT_BYTES 4096  // 可设置的上限
+#define WRITE_BATCH_MAX_FRAMES 64     // 单次写最多合并的帧数
+
+// 领取一个发送槽位，调用方直接往 entry->payload 写 payload；
+// 队列满时最多等待 timeout_ms，超时返回 NULL。写完后必须 send_payload_commit
+PayloadEntry* send_payload_begin(msb_handle* handle, uint32_t timeout_ms);
+void send_payload_commit(msb_handle* handle, PayloadEntry* entry, uint32_t len);
 
 #ifdef __cplusplus
 }
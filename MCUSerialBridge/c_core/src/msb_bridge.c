@@ -6,6 +6,7 @@
 
 #include "c_core_common.h"
 #include "msb_bridge.h"
+#include "msb_crc.h"
 #include "msb_handle.h"
 #include "msb_packet.h"
 #include "msb_thread.h"
@@ -80,7 +81,7 @@ MCUSerialBridgeError msb_open(
             0,  // 串口必须独占
             NULL,
             OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,  // 收发可以同时挂起
             NULL);
 
     if ((*handle)->hComm == INVALID_HANDLE_VALUE) {
@@ -119,6 +120,7 @@ MCUSerialBridgeError msb_open(
     timeouts.WriteTotalTimeoutConstant = 0;
     timeouts.WriteTotalTimeoutMultiplier = 0;
     SetCommTimeouts((*handle)->hComm, &timeouts);
+    SetCommMask((*handle)->hComm, EV_RXCHAR);  // 接收线程用 WaitCommEvent 等数据
 
     (*handle)->is_open = true;
 
@@ -171,6 +173,9 @@ MCUSerialBridgeError msb_close(msb_handle* handle)
 
     handle->is_open = false;
 
+    // 唤醒等待中的线程，让它们马上看到 is_open = false
+    SetEvent(handle->rx_event);
+    SetEvent(handle->tx_event);
     HANDLE hComm = handle->hComm;
     if (hComm && hComm != INVALID_HANDLE_VALUE) {
         CancelIoEx(hComm, NULL);
@@ -465,6 +470,42 @@ MCUSerialBridgeError msb_set_wire_tap(
     return ret;
 }
 
+// --------------------
+// 设置 LowerIO 上报格式
+// --------------------
+MCUSerialBridgeError msb_set_lower_io_mode(
+        msb_handle* handle,
+        uint8_t mode,
+        uint16_t keyframe_interval,
+        uint32_t timeout_ms)
+{
+    DBG_PRINT(
+            "SetLowerIoMode called: mode=%u, keyframe_interval=%u",
+            mode,
+            keyframe_interval);
+
+    if (!handle)
+        return MSB_Error_Win_HandleNotFound;
+
+    LowerIoModeC config = {
+            .mode = mode,
+            .reserved = 0,
+            .keyframe_interval = keyframe_interval,
+    };
+
+    MCUSerialBridgeError ret = mcu_send_packet_and_wait(
+            handle,
+            CommandSetLowerIoMode,
+            (const uint8_t*)&config,
+            sizeof(config),
+            NULL,
+            0,
+            timeout_ms);
+
+    DBG_PRINT("SetLowerIoMode finished with result[0x%08X]", ret);
+    return ret;
+}
+
 // --------------------
 // 写IO输出
 // --------------------
@@ -570,8 +611,9 @@ MCUSerialBridgeError msb_read_port(
 
 retry:
     /* ---------- 队列非空：直接取一帧 ---------- */
-    if (q->head != q->tail) {
-        PortDataFrame* frame = &q->queue[q->tail];
+    uint32_t slot;
+    if (spsc_front(&q->idx, RING_QUEUE_SIZE, &slot)) {
+        PortDataFrame* frame = &q->queue[slot];
         uint32_t frame_len = frame->len;
 
         /* 用户缓冲区不够 */
@@ -583,7 +625,7 @@ retry:
         memcpy(dst_data, frame->data, frame_len);
         *out_length = frame_len;
 
-        q->tail++;  // uint8_t 自动 wrap
+        spsc_release(&q->idx);
 
         DBG_PRINT("ReadPort result, OK");
         return MSB_Error_OK;
@@ -638,7 +680,254 @@ DLL_EXPORT MCUSerialBridgeError msb_register_port_data_callback(
 // --------------------
 // 下载程序到 MCU
 // --------------------
-#define PROGRAM_CHUNK_SIZE 512  // 每次传输的最大分片大小
+// 单包负载能放下的最大分片，按乱序接收的粒度向下对齐
+#define PROGRAM_CHUNK_MAX_SIZE                                                \
+    ((PACKET_MAX_PAYLOAD_LEN - sizeof(PayloadHeader) - sizeof(ProgramPacket)) / \
+     PROGRAM_CHUNK_GRANULE * PROGRAM_CHUNK_GRANULE)
+#define PROGRAM_MAX_RETRIES 5  // 每个分片重传的上限
+#define PROGRAM_POLL_MS 2      // 等最早分片时检查后面分片应答的间隔
+
+enum {
+    PROGRAM_CHUNK_PENDING = 0,  // 待发（或待重传）
+    PROGRAM_CHUNK_INFLIGHT,     // 已发，等应答
+    PROGRAM_CHUNK_DONE,         // MCU 已收到
+};
+
+// 一次分片下载的状态
+typedef struct {
+    const uint8_t* bytes;
+    uint32_t len;
+    uint32_t chunk_size;
+    uint32_t chunk_count;
+    uint32_t remaining;  // 还没确认的分片数
+    uint8_t* state;      // 每个分片的 PROGRAM_CHUNK_*
+    uint8_t* retries;    // 每个分片的重传次数
+} ProgramTransfer;
+
+typedef struct {
+    SeqWaiter* waiter;
+    uint64_t deadline_ms;
+    uint32_t index;  // 分片序号
+} ProgramInflight;
+
+static void program_mark_done(ProgramTransfer* t, uint32_t index)
+{
+    if (t->state[index] != PROGRAM_CHUNK_DONE) {
+        t->state[index] = PROGRAM_CHUNK_DONE;
+        t->remaining--;
+    }
+}
+
+// 发一个分片，不等应答
+static MCUSerialBridgeError program_send_chunk(
+        msb_handle* handle,
+        ProgramTransfer* t,
+        uint32_t index,
+        uint32_t timeout_ms,
+        ProgramInflight* out)
+{
+    uint32_t offset = index * t->chunk_size;
+    uint32_t chunk_len = t->len - offset;
+    if (chunk_len > t->chunk_size) {
+        chunk_len = t->chunk_size;
+    }
+
+    uint8_t packet_buf[sizeof(ProgramPacket) + PROGRAM_CHUNK_MAX_SIZE];
+    ProgramPacket* pkt = (ProgramPacket*)packet_buf;
+    pkt->total_len = t->len;
+    pkt->offset = offset;
+    pkt->chunk_len = (uint16_t)chunk_len;
+    memcpy(pkt->data, t->bytes + offset, chunk_len);
+
+    DBG_PRINT(
+            "Program chunk: offset=%u, chunk_len=%u, total=%u",
+            offset,
+            chunk_len,
+            t->len);
+
+    out->index = index;
+    out->deadline_ms = GetTickCount64() + timeout_ms;
+    MCUSerialBridgeError ret = mcu_send_packet_begin(
+            handle,
+            CommandProgram,
+            packet_buf,
+            sizeof(ProgramPacket) + chunk_len,
+            timeout_ms,
+            &out->waiter);
+    if (ret == MSB_Error_OK) {
+        t->state[index] = PROGRAM_CHUNK_INFLIGHT;
+    }
+    return ret;
+}
+
+// 取一个在途分片的应答。OK 的分片记为已收到；应答里的 ProgramAck 是
+// MCU 已连续收到的长度（旧固件不带，读到 0），它之前的分片也都记为已收到。
+// 失败的分片回到待发状态。
+static MCUSerialBridgeError program_wait_chunk(
+        msb_handle* handle,
+        ProgramTransfer* t,
+        ProgramInflight* inflight,
+        uint64_t deadline_ms)
+{
+    ProgramAck ack;
+    MCUSerialBridgeError ret = mcu_wait_packet(
+            handle,
+            inflight->waiter,
+            deadline_ms,
+            (uint8_t*)&ack,
+            sizeof(ack));
+    if (ret == MSB_Error_OK) {
+        program_mark_done(t, inflight->index);
+    } else if (t->state[inflight->index] != PROGRAM_CHUNK_DONE) {
+        t->state[inflight->index] = PROGRAM_CHUNK_PENDING;
+        t->retries[inflight->index]++;
+    }
+    if (ret == MSB_Error_OK || ret == MSB_Error_Proto_ProgramInvalidOffset) {
+        uint32_t covered = ack.next_offset >= t->len
+                ? t->chunk_count
+                : ack.next_offset / t->chunk_size;
+        for (uint32_t i = 0; i < covered; i++) {
+            program_mark_done(t, i);
+        }
+    }
+    return ret;
+}
+
+// 等窗口里最早的分片。排在后面的分片要等前面的发完，所以超时从最近
+// 一次收到应答算起；MCU 按顺序应答，后面的分片先有了应答，
+// 说明最早的这个在线上丢了，不必等到超时。
+static MCUSerialBridgeError program_wait_oldest(
+        msb_handle* handle,
+        ProgramTransfer* t,
+        ProgramInflight* inflight,
+        uint32_t head,
+        uint32_t count,
+        uint32_t timeout_ms,
+        uint64_t* last_reply_ms)
+{
+    ProgramInflight* oldest = &inflight[head];
+    uint64_t deadline_ms = *last_reply_ms + timeout_ms;
+    if (oldest->deadline_ms > deadline_ms) {
+        deadline_ms = oldest->deadline_ms;
+    }
+    while (!mcu_packet_ready(oldest->waiter, PROGRAM_POLL_MS)) {
+        bool later_replied = false;
+        for (uint32_t i = 1; i < count && !later_replied; i++) {
+            later_replied = mcu_packet_ready(
+                    inflight[(head + i) % PROGRAM_WINDOW_MAX].waiter, 0);
+        }
+        // 应答按顺序处理：后面的有了而最早的仍没有，最早的才算丢了
+        if ((later_replied && !mcu_packet_ready(oldest->waiter, 0)) ||
+            GetTickCount64() >= deadline_ms) {
+            deadline_ms = 0;
+            break;
+        }
+    }
+    MCUSerialBridgeError ret = program_wait_chunk(handle, t, oldest, deadline_ms);
+    if (ret != MSB_Error_Proto_Timeout) {
+        *last_reply_ms = GetTickCount64();
+    }
+    return ret;
+}
+
+// 分片传输：最多 window 个分片在途，丢了（超时或被拒）的分片单独重传
+static MCUSerialBridgeError program_transfer(
+        msb_handle* handle,
+        ProgramTransfer* t,
+        uint32_t timeout_ms)
+{
+    ProgramInflight inflight[PROGRAM_WINDOW_MAX];
+    uint32_t head = 0, count = 0;
+    uint32_t resent = 0;
+    uint64_t last_reply_ms = GetTickCount64();
+    MCUSerialBridgeError ret = MSB_Error_OK;
+
+    while (t->remaining > 0) {
+        // 填满窗口。offset 0 的分片会让 MCU 重新开始下载，等它应答后再发后续分片
+        uint32_t window = t->state[0] == PROGRAM_CHUNK_DONE ? handle->program_window : 1;
+        for (uint32_t i = 0; i < t->chunk_count && count < window; i++) {
+            if (t->state[i] != PROGRAM_CHUNK_PENDING) {
+                continue;
+            }
+            if (t->retries[i] > 0) {
+                resent++;
+            }
+            ret = program_send_chunk(
+                    handle, t, i, timeout_ms, &inflight[(head + count) % PROGRAM_WINDOW_MAX]);
+            if (ret != MSB_Error_OK) {
+                break;
+            }
+            count++;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        // 等最早的分片
+        ProgramInflight* oldest = &inflight[head];
+        ret = program_wait_oldest(
+                handle, t, inflight, head, count, timeout_ms, &last_reply_ms);
+        head = (head + 1) % PROGRAM_WINDOW_MAX;
+        count--;
+        if (ret == MSB_Error_OK) {
+            continue;
+        }
+
+        // 只有丢包类错误才重传，其它错误（状态不对、程序过大等）直接返回
+        bool retry = ret == MSB_Error_Proto_Timeout ||
+                     ret == MSB_Error_Proto_ProgramInvalidOffset ||
+                     ret == MSB_Error_Win_BufferFull;
+        if (!retry || t->retries[oldest->index] > PROGRAM_MAX_RETRIES) {
+            DBG_PRINT(
+                    "Program chunk failed at offset=%u, error=0x%08X",
+                    oldest->index * t->chunk_size,
+                    ret);
+            break;
+        }
+        DBG_PRINT(
+                "Program chunk at offset=%u lost (error=0x%08X), resend",
+                oldest->index * t->chunk_size,
+                ret);
+        ret = MSB_Error_OK;
+    }
+
+    // 出错返回时放弃其余在途分片
+    while (count > 0) {
+        program_wait_chunk(handle, t, &inflight[head], 0);
+        head = (head + 1) % PROGRAM_WINDOW_MAX;
+        count--;
+    }
+    if (t->remaining == 0) {
+        DBG_PRINT("Program chunks done, %u resent", resent);
+        return MSB_Error_OK;
+    }
+    return ret != MSB_Error_OK ? ret : MSB_Error_Proto_Timeout;
+}
+
+// 发整镜像校验包（offset == total_len），下载前发是缓存查询，下载后发是校验
+static MCUSerialBridgeError program_send_crc(
+        msb_handle* handle,
+        uint32_t program_len,
+        uint32_t crc,
+        ProgramAck* ack,
+        uint32_t timeout_ms)
+{
+    uint8_t crc_buf[sizeof(ProgramPacket) + PROGRAM_CRC_CHUNK_LEN];
+    ProgramPacket* crc_pkt = (ProgramPacket*)crc_buf;
+    crc_pkt->total_len = program_len;
+    crc_pkt->offset = program_len;
+    crc_pkt->chunk_len = PROGRAM_CRC_CHUNK_LEN;
+    memcpy(crc_pkt->data, &crc, sizeof(crc));
+    ack->next_offset = 0;
+    return mcu_send_packet_and_wait(
+            handle,
+            CommandProgram,
+            crc_buf,
+            sizeof(crc_buf),
+            (uint8_t*)ack,
+            sizeof(*ack),
+            timeout_ms);
+}
 
 MCUSerialBridgeError msb_program(
         msb_handle* handle,
@@ -674,45 +963,92 @@ MCUSerialBridgeError msb_program(
         return ret;
     }
 
-    // 分片传输程序
-    uint32_t offset = 0;
-    while (offset < program_len) {
-        uint32_t remaining = program_len - offset;
-        uint16_t chunk_len =
-                (remaining > PROGRAM_CHUNK_SIZE) ? PROGRAM_CHUNK_SIZE : (uint16_t)remaining;
+    // MCU 上已经是同一个镜像时不再下载
+    uint32_t crc = msb_crc32(program_bytes, program_len);
+    ProgramAck ack;
+    MCUSerialBridgeError ret;
+    if (handle->program_cache) {
+        ret = program_send_crc(handle, program_len, crc, &ack, timeout_ms);
+        if (ret == MSB_Error_OK && ack.next_offset == program_len) {
+            DBG_PRINT(
+                    "Program: MCU already holds this image (%u bytes, "
+                    "crc=0x%08X), transfer skipped",
+                    program_len,
+                    crc);
+            return MSB_Error_OK;
+        }
+    }
 
-        // 构建 ProgramPacket
-        uint8_t packet_buf[sizeof(ProgramPacket) + PROGRAM_CHUNK_SIZE];
-        ProgramPacket* pkt = (ProgramPacket*)packet_buf;
-        pkt->total_len = program_len;
-        pkt->offset = offset;
-        pkt->chunk_len = chunk_len;
-        memcpy(pkt->data, program_bytes + offset, chunk_len);
+    // 分片传输
+    ProgramTransfer t;
+    t.bytes = program_bytes;
+    t.len = program_len;
+    t.chunk_size = handle->program_chunk_size;
+    if (t.chunk_size == 0 || t.chunk_size > PROGRAM_CHUNK_MAX_SIZE)
+        t.chunk_size = PROGRAM_CHUNK_MAX_SIZE;
+    t.chunk_count = (program_len + t.chunk_size - 1) / t.chunk_size;
+    t.remaining = t.chunk_count;
+    t.state = (uint8_t*)calloc(t.chunk_count, 2);
+    if (!t.state)
+        return MSB_Error_Win_AllocFail;
+    t.retries = t.state + t.chunk_count;
 
-        DBG_PRINT(
-                "Program chunk: offset=%u, chunk_len=%u, total=%u",
-                offset,
-                chunk_len,
-                program_len);
+    ret = program_transfer(handle, &t, timeout_ms);
+    free(t.state);
+    if (ret != MSB_Error_OK) {
+        return ret;
+    }
 
-        MCUSerialBridgeError ret = mcu_send_packet_and_wait(
-                handle,
-                CommandProgram,
-                packet_buf,
-                sizeof(ProgramPacket) + chunk_len,
-                NULL,
-                0,
-                timeout_ms);
+    // 整镜像 CRC 校验
+    ret = program_send_crc(handle, program_len, crc, &ack, timeout_ms);
+    if (ret == MSB_Error_Proto_InvalidPayload) {
+        // 旧固件不认识校验包
+        DBG_PRINT("Program: MCU does not support image CRC check, skipped");
+        ret = MSB_Error_OK;
+    }
+    if (ret != MSB_Error_OK) {
+        DBG_PRINT("Program CRC check failed (crc=0x%08X), error=0x%08X", crc, ret);
+        return ret;
+    }
 
-        if (ret != MSB_Error_OK) {
-            DBG_PRINT("Program chunk failed at offset=%u, error=0x%08X", offset, ret);
-            return ret;
-        }
+    DBG_PRINT(
+            "Program finished, total %u bytes transferred, crc=0x%08X",
+            program_len,
+            crc);
+    return MSB_Error_OK;
+}
 
-        offset += chunk_len;
-    }
+DLL_EXPORT MCUSerialBridgeError msb_set_program_window(
+        msb_handle* handle,
+        uint32_t window,
+        uint32_t chunk_size)
+{
+    if (!handle)
+        return MSB_Error_Win_HandleNotFound;
+
+    if (window == 0)
+        window = 1;
+    if (window > PROGRAM_WINDOW_MAX)
+        window = PROGRAM_WINDOW_MAX;
+    if (chunk_size > PROGRAM_CHUNK_MAX_SIZE)
+        chunk_size = PROGRAM_CHUNK_MAX_SIZE;
+    // 对齐后 MCU 才能乱序接收，丢包时只重传丢的那片
+    if (chunk_size > PROGRAM_CHUNK_GRANULE)
+        chunk_size -= chunk_size % PROGRAM_CHUNK_GRANULE;
+
+    handle->program_window = window;
+    handle->program_chunk_size = chunk_size;
+    DBG_PRINT("SetProgramWindow: window=%u chunk_size=%u", window, chunk_size);
+    return MSB_Error_OK;
+}
+
+DLL_EXPORT MCUSerialBridgeError msb_set_program_cache(msb_handle* handle, uint8_t enable)
+{
+    if (!handle)
+        return MSB_Error_Win_HandleNotFound;
 
-    DBG_PRINT("Program finished, total %u bytes transferred", program_len);
+    handle->program_cache = enable != 0;
+    DBG_PRINT("SetProgramCache: %s", enable ? "on" : "off");
     return MSB_Error_OK;
 }
 
@@ -939,6 +1275,43 @@ DLL_EXPORT MCUSerialBridgeError msb_get_stats(
     return ret;
 }
 
+// --------------------
+// 主机侧发送统计 / 合并写参数
+// --------------------
+DLL_EXPORT MCUSerialBridgeError msb_get_send_stats(
+        msb_handle* handle,
+        SendStatsC* stats)
+{
+    if (!handle)
+        return MSB_Error_Win_HandleNotFound;
+    if (!stats)
+        return MSB_Error_Win_InvalidParam;
+
+    EnterCriticalSection(&handle->comm_lock);
+    *stats = handle->send_stats;
+    stats->batch_max_bytes = handle->write_batch_max_bytes;
+    stats->batch_linger_ms = handle->write_batch_linger_ms;
+    LeaveCriticalSection(&handle->comm_lock);
+    return MSB_Error_OK;
+}
+
+DLL_EXPORT MCUSerialBridgeError msb_set_write_batch(
+        msb_handle* handle,
+        uint32_t max_bytes,
+        uint32_t linger_ms)
+{
+    if (!handle)
+        return MSB_Error_Win_HandleNotFound;
+    if (max_bytes > WRITE_BATCH_LIMIT_BYTES)
+        max_bytes = WRITE_BATCH_LIMIT_BYTES;
+
+    // send 线程每批开始时读一次，改动从下一批生效
+    handle->write_batch_max_bytes = max_bytes;
+    handle->write_batch_linger_ms = linger_ms;
+    DBG_PRINT("SetWriteBatch: max_bytes=%u linger_ms=%u", max_bytes, linger_ms);
+    return MSB_Error_OK;
+}
+
 // --------------------
 // 获取 API 函数指针
 // --------------------
@@ -962,7 +1335,10 @@ void mcu_serial_bridge_get_api(MCUSerialBridgeAPI* api)
     api->msb_upgrade = msb_upgrade;
     api->msb_start = msb_start;
     api->msb_program = msb_program;
+    api->msb_set_program_window = msb_set_program_window;
+    api->msb_set_program_cache = msb_set_program_cache;
     api->msb_set_wire_tap = msb_set_wire_tap;
+    api->msb_set_lower_io_mode = msb_set_lower_io_mode;
     api->msb_memory_upper_io = msb_memory_upper_io;
     api->msb_register_memory_lower_io_callback = msb_register_memory_lower_io_callback;
     api->msb_register_console_writeline_callback = msb_register_console_writeline_callback;
@@ -970,6 +1346,8 @@ void mcu_serial_bridge_get_api(MCUSerialBridgeAPI* api)
     api->msb_register_fatal_error_callback = msb_register_fatal_error_callback;
     api->msb_register_error_callback = msb_register_error_callback;
     api->msb_get_stats = msb_get_stats;
+    api->msb_get_send_stats = msb_get_send_stats;
+    api->msb_set_write_batch = msb_set_write_batch;
     api->msb_get_transport_error_state = msb_get_transport_error_state;
     api->msb_clear_transport_error_state = msb_clear_transport_error_state;
 }
\ No newline at end of file
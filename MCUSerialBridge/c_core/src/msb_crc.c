@@ -0,0 +1,333 @@
+// msb_crc.c
+#include "msb_crc.h"
+
+#include <string.h>
+
+#include "msb_crc_tables.h"
+
+#if defined(IS_MCU) && IS_MCU
+#define MSB_CRC32_STM32 1
+#elif defined(__ARM_FEATURE_CRC32) || (defined(_MSC_VER) && defined(_M_ARM64))
+#define MSB_CRC32_ARMV8 1
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MSB_CRC32_PCLMUL 1
+#define MSB_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define MSB_CRC32_PCLMUL 1
+#define MSB_PCLMUL_TARGET
+#endif
+
+#if defined(MSB_CRC32_ARMV8)
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <arm_acle.h>
+#endif
+#elif defined(MSB_CRC32_PCLMUL)
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+// 按小端拼出 32 位字；编译器在 x86/ARM 上会合并成一次非对齐加载
+static inline uint32_t load_le32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+// --------------------
+// CRC16/Modbus
+// --------------------
+
+uint16_t msb_crc16_update(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+    uint32_t c = crc;
+    while (len >= 8) {
+        uint32_t lo = load_le32(data) ^ c;
+        uint32_t hi = load_le32(data + 4);
+        c = crc16_table[7][lo & 0xFF] ^ crc16_table[6][(lo >> 8) & 0xFF] ^
+            crc16_table[5][(lo >> 16) & 0xFF] ^ crc16_table[4][lo >> 24] ^
+            crc16_table[3][hi & 0xFF] ^ crc16_table[2][(hi >> 8) & 0xFF] ^
+            crc16_table[1][(hi >> 16) & 0xFF] ^ crc16_table[0][hi >> 24];
+        data += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = (c >> 8) ^ crc16_table[0][(c ^ *data++) & 0xFF];
+    }
+    return (uint16_t)c;
+}
+
+uint16_t msb_crc16(const uint8_t* data, uint32_t len)
+{
+    return msb_crc16_update(MSB_CRC16_INIT, data, len);
+}
+
+// --------------------
+// CRC32 软件实现（crc 是未取反的寄存器值）
+// --------------------
+
+#if defined(MSB_CRC32_STM32)
+
+// MCU 上只有尾部和分段续算走软件，用半字节表，不占 8KB
+static uint32_t crc32_sw(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    static const uint32_t table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+            0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+            0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+    while (len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return crc;
+}
+
+#else
+
+static uint32_t crc32_sw(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    while (len >= 8) {
+        uint32_t lo = load_le32(data) ^ crc;
+        uint32_t hi = load_le32(data + 4);
+        crc = crc32_table[7][lo & 0xFF] ^ crc32_table[6][(lo >> 8) & 0xFF] ^
+              crc32_table[5][(lo >> 16) & 0xFF] ^ crc32_table[4][lo >> 24] ^
+              crc32_table[3][hi & 0xFF] ^ crc32_table[2][(hi >> 8) & 0xFF] ^
+              crc32_table[1][(hi >> 16) & 0xFF] ^ crc32_table[0][hi >> 24];
+        data += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#endif
+
+uint32_t msb_crc32_portable(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    return ~crc32_sw(~crc, data, len);
+}
+
+// --------------------
+// CRC32 加速路径
+// --------------------
+
+#if defined(MSB_CRC32_STM32)
+
+// STM32F4 CRC 单元（RM0090 第 4 章）：固定多项式 0x04C11DB7，按 32 位字
+// 高位先行，复位值 0xFFFFFFFF，没有输入/输出反转，也不能设初值。
+// zlib CRC 是反射的，每个小端字先 RBIT 再送入，寄存器 RBIT 后就是 zlib 的
+// 寄存器值。所以只有从头开始的计算能用硬件，续算走软件。
+#define RCC_AHB1ENR (*(volatile uint32_t*)0x40023830u)
+#define RCC_AHB1ENR_CRCEN (1u << 12)
+#define CRC_DR (*(volatile uint32_t*)0x40023000u)
+#define CRC_CR (*(volatile uint32_t*)0x40023008u)
+#define CRC_CR_RESET (1u << 0)
+
+static inline uint32_t rbit32(uint32_t v)
+{
+    uint32_t r;
+    __asm__("rbit %0, %1" : "=r"(r) : "r"(v));
+    return r;
+}
+
+static uint32_t crc32_hw(const uint8_t* data, uint32_t len)
+{
+    if (!(RCC_AHB1ENR & RCC_AHB1ENR_CRCEN)) {
+        RCC_AHB1ENR |= RCC_AHB1ENR_CRCEN;
+        (void)RCC_AHB1ENR;  // 等时钟生效
+    }
+    CRC_CR = CRC_CR_RESET;
+    uint32_t words = len / 4;
+    for (uint32_t i = 0; i < words; i++) {
+        CRC_DR = rbit32(load_le32(data + i * 4));
+    }
+    uint32_t crc = rbit32(CRC_DR);
+    return crc32_sw(crc, data + words * 4, len - words * 4);
+}
+
+uint32_t msb_crc32_update(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    if (crc == 0 && len >= 16) {
+        return ~crc32_hw(data, len);
+    }
+    return ~crc32_sw(~crc, data, len);
+}
+
+const char* msb_crc32_impl(void)
+{
+    return "stm32-hw";
+}
+
+#elif defined(MSB_CRC32_ARMV8)
+
+uint32_t msb_crc32_update(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    uint32_t c = ~crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        c = __crc32d(c, v);
+        data += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = __crc32b(c, *data++);
+    }
+    return ~c;
+}
+
+const char* msb_crc32_impl(void)
+{
+    return "armv8-crc";
+}
+
+#elif defined(MSB_CRC32_PCLMUL)
+
+// PCLMULQDQ 折叠（Intel "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ"，反射域常数）：4 路并行每次折叠 64 字节，再归并到 128 位，
+// 最后 Barrett 归约到 32 位。len 必须 ≥64 且是 16 的倍数，crc 是寄存器值。
+MSB_PCLMUL_TARGET
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    static const uint64_t k1k2[2] = {0x0154442bd4ull, 0x01c6e41596ull};
+    static const uint64_t k3k4[2] = {0x01751997d0ull, 0x00ccaa009eull};
+    static const uint64_t k5k0[2] = {0x0163cd6124ull, 0x0000000000ull};
+    static const uint64_t poly[2] = {0x01db710641ull, 0x01f7011641ull};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_loadu_si128((const __m128i*)k1k2);
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    // 4 路归并到 128 位
+    x0 = _mm_loadu_si128((const __m128i*)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    // 128 位折叠到 64 位
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett 归约到 32 位
+    x0 = _mm_loadu_si128((const __m128i*)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static int cpu_has_pclmul(void)
+{
+    // 0 未检测，1 支持，2 不支持；多线程同时检测结果相同，无需加锁
+    static volatile int state = 0;
+    if (state == 0) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        int ok = (info[2] & (1 << 1)) && (info[2] & (1 << 19));  // PCLMUL SSE4.1
+#else
+        __builtin_cpu_init();
+        int ok = __builtin_cpu_supports("pclmul") &&
+                 __builtin_cpu_supports("sse4.1");
+#endif
+        state = ok ? 1 : 2;
+    }
+    return state == 1;
+}
+
+uint32_t msb_crc32_update(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    uint32_t c = ~crc;
+    if (len >= 64 && cpu_has_pclmul()) {
+        uint32_t bulk = len & ~15u;
+        c = crc32_pclmul(c, data, bulk);
+        data += bulk;
+        len -= bulk;
+    }
+    return ~crc32_sw(c, data, len);
+}
+
+const char* msb_crc32_impl(void)
+{
+    return cpu_has_pclmul() ? "pclmul" : "slice-by-8";
+}
+
+#else
+
+uint32_t msb_crc32_update(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    return ~crc32_sw(~crc, data, len);
+}
+
+const char* msb_crc32_impl(void)
+{
+    return "slice-by-8";
+}
+
+#endif
+
+uint32_t msb_crc32(const uint8_t* data, uint32_t len)
+{
+    return msb_crc32_update(0, data, len);
+}
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "c_core_common.h"
+#include "msb_thread.h"
 
 
 MCUSerialBridgeError msb_handle_init(msb_handle** handle)
@@ -18,6 +19,11 @@ MCUSerialBridgeError msb_handle_init(msb_handle** handle)
     memset(*handle, 0, sizeof(msb_handle));
     (*handle)->is_open = false;
     (*handle)->sequence = 1;
+    (*handle)->write_batch_max_bytes = WRITE_BATCH_DEFAULT_BYTES;
+    (*handle)->write_batch_linger_ms = 0;
+    (*handle)->program_window = PROGRAM_WINDOW_DEFAULT;
+    (*handle)->program_chunk_size = 0;  // 0：按单包负载上限
+    (*handle)->program_cache = true;
 
     // 初始化序号锁
     InitializeCriticalSection(&(*handle)->seq_lock);
@@ -32,13 +38,47 @@ MCUSerialBridgeError msb_handle_init(msb_handle** handle)
         (*handle)->pending[i].done_flag = false;
         (*handle)->pending[i].seq = 0;
         (*handle)->pending[i].result = MSB_Error_OK;
+        (*handle)->pending[i].reply = NULL;
+    }
+
+    // 命令收发队列
+    packet_queue_init(&(*handle)->receive_queue);
+    send_queue_init(&(*handle)->send_queue);
+    if (!packet_pool_init(&(*handle)->receive_pool)) {
+        send_queue_deinit(&(*handle)->send_queue);
+        DeleteCriticalSection(&(*handle)->transport_error_lock);
+        DeleteCriticalSection(&(*handle)->comm_lock);
+        DeleteCriticalSection(&(*handle)->seq_lock);
+        free(*handle);
+        *handle = NULL;
+        return MSB_Error_Win_AllocFail;
+    }
+
+    // 线程间唤醒事件（auto-reset）
+    (*handle)->rx_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    (*handle)->tx_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if ((*handle)->rx_event == NULL || (*handle)->tx_event == NULL) {
+        if ((*handle)->rx_event) {
+            CloseHandle((*handle)->rx_event);
+        }
+        if ((*handle)->tx_event) {
+            CloseHandle((*handle)->tx_event);
+        }
+        packet_pool_deinit(&(*handle)->receive_pool);
+        send_queue_deinit(&(*handle)->send_queue);
+        DeleteCriticalSection(&(*handle)->transport_error_lock);
+        DeleteCriticalSection(&(*handle)->comm_lock);
+        DeleteCriticalSection(&(*handle)->seq_lock);
+        free(*handle);
+        *handle = NULL;
+        return MSB_Error_Win_AllocFail;
     }
 
     for (int i = 0; i < PACKET_MAX_PORTS_NUM; i++) {
         PortQueue* q = &(*handle)->ports[i];
 
-        q->head = 0;
-        q->tail = 0;
+        msb_atomic_store_release(&q->idx.head, 0);
+        msb_atomic_store_release(&q->idx.tail, 0);
 
         q->data_event = CreateEvent(
                 NULL,
@@ -52,6 +92,10 @@ MCUSerialBridgeError msb_handle_init(msb_handle** handle)
                 CloseHandle((*handle)->ports[j].data_event);
                 (*handle)->ports[j].data_event = NULL;
             }
+            CloseHandle((*handle)->rx_event);
+            CloseHandle((*handle)->tx_event);
+            packet_pool_deinit(&(*handle)->receive_pool);
+            send_queue_deinit(&(*handle)->send_queue);
             DeleteCriticalSection(&(*handle)->transport_error_lock);
             DeleteCriticalSection(&(*handle)->comm_lock);
             DeleteCriticalSection(&(*handle)->seq_lock);
@@ -82,6 +126,18 @@ MCUSerialBridgeError msb_handle_deinit(msb_handle* handle)
         }
     }
 
+    if (handle->rx_event) {
+        CloseHandle(handle->rx_event);
+        handle->rx_event = NULL;
+    }
+    if (handle->tx_event) {
+        CloseHandle(handle->tx_event);
+        handle->tx_event = NULL;
+    }
+
+    packet_pool_deinit(&handle->receive_pool);
+    send_queue_deinit(&handle->send_queue);
+
     DeleteCriticalSection(&handle->seq_lock);
     DeleteCriticalSection(&handle->comm_lock);
     DeleteCriticalSection(&handle->transport_error_lock);
@@ -25,25 +25,52 @@ static BOOL msb_is_comm_ready(msb_handle* handle)
 }
 
 // --------------------
-// 构建并发送协议包
+// 领取发送槽位，PayloadHeader 和数据直接写进槽位，不经过中间缓冲
 // --------------------
-MCUSerialBridgeError mcu_send_packet_and_wait(
+static bool mcu_enqueue_packet(
         msb_handle* handle,
         uint8_t command,
+        uint32_t seq,
         const uint8_t* other_data,
         uint32_t other_data_len,
-        uint8_t* return_data,
-        uint32_t return_data_len,
-        uint32_t timeout_ms)
+        uint32_t wait_ms)
 {
+    PayloadEntry* entry = send_payload_begin(handle, wait_ms);
+    if (!entry) {
+        return false;
+    }
+
+    PayloadHeader* header = (PayloadHeader*)entry->payload;
+    header->command = command;
+    header->sequence = seq;
+    header->timestamp_ms = (uint32_t)(clock() * 1000 / CLOCKS_PER_SEC);
+    header->error_code = 0;
+    if (other_data_len > 0) {
+        memcpy(entry->payload + sizeof(PayloadHeader), other_data, other_data_len);
+    }
+
+    send_payload_commit(
+            handle, entry, (uint32_t)sizeof(PayloadHeader) + other_data_len);
+    return true;
+}
+
+// --------------------
+// 构建并发送协议包（需要应答）：占一个 SeqWaiter 后入队，不等应答
+// --------------------
+MCUSerialBridgeError mcu_send_packet_begin(
+        msb_handle* handle,
+        uint8_t command,
+        const uint8_t* other_data,
+        uint32_t other_data_len,
+        uint32_t timeout_ms,
+        SeqWaiter** out_waiter)
+{
+    *out_waiter = NULL;
     if (!handle || !handle->is_open)
         return MSB_Error_Win_HandleNotFound;
     if (!msb_is_comm_ready(handle))
         return MSB_Error_Win_HandleNotFound;
 
-    // --------------------
-    // 构建 Payload
-    // --------------------
     uint32_t total_len = sizeof(PayloadHeader) + other_data_len;
     if (total_len > PACKET_MAX_PAYLOAD_LEN) {
         DBG_PRINT("Packet, payload too large, length = %u\n", total_len);
@@ -55,141 +82,187 @@ MCUSerialBridgeError mcu_send_packet_and_wait(
     uint32_t seq = handle->sequence++;
     LeaveCriticalSection(&handle->seq_lock);
 
-    // 构建PayloadHeader
-    uint8_t buf[PACKET_MAX_PAYLOAD_LEN];
-    PayloadHeader* header = (PayloadHeader*)buf;
-    header->command = command;
-    header->sequence = seq;
-    header->timestamp_ms = (uint32_t)(clock() * 1000 / CLOCKS_PER_SEC);
-    header->error_code = 0;
+    // 找空位并占领
+    SeqWaiter* waiter = NULL;
+    for (int i = 0; i < MAX_PENDING_SEQ; i++) {
+        EnterCriticalSection(&handle->pending[i].mtx);
+        if (!handle->pending[i].in_use) {
+            waiter = &handle->pending[i];
+            waiter->seq = seq;
+            waiter->in_use = true;
+            waiter->done_flag = false;
+            LeaveCriticalSection(&handle->pending[i].mtx);
+            break;
+        }
+        LeaveCriticalSection(&handle->pending[i].mtx);
+    }
 
-    // 拷贝其他数据
-    if (other_data_len > 0) {
-        memcpy(buf + sizeof(PayloadHeader), other_data, other_data_len);
+    if (!waiter) {
+        // 没空位
+        DBG_PRINT(
+                "Send Packet Failed, command[0x%02X], sequence[%u], "
+                "timeout[%u]",
+                command,
+                seq,
+                timeout_ms);
+        return MSB_Error_Win_BufferFull;
     }
 
-    DBG_PRINT(
-            "Send Packet started, command[0x%02X], sequence[%u], timeout[%u]",
-            command,
-            seq,
-            timeout_ms);
-
-    if (timeout_ms == 0) {
-        if (send_payload(handle, buf, total_len)) {
-            DBG_PRINT(
-                    "Send Packet without wait, command[0x%02X], sequence[%u], "
-                    "timeout[%u]",
-                    command,
-                    seq,
-                    timeout_ms);
-            return MSB_Error_OK;
-        } else {
-            DBG_PRINT(
-                    "Send Packet Failed, command[0x%02X], sequence[%u], "
-                    "timeout[%u]",
-                    command,
-                    seq,
-                    timeout_ms);
-            return MSB_Error_Win_BufferFull;
-        }
-    } else {
-        // 找空位并占领
-        SeqWaiter* waiter = NULL;
-        for (int i = 0; i < MAX_PENDING_SEQ; i++) {
-            EnterCriticalSection(&handle->pending[i].mtx);
-            if (!handle->pending[i].in_use) {
-                waiter = &handle->pending[i];
-                waiter->seq = seq;
-                waiter->in_use = true;
-                waiter->done_flag = false;
-                LeaveCriticalSection(&handle->pending[i].mtx);
-                break;
-            }
-            LeaveCriticalSection(&handle->pending[i].mtx);
-        }
+    // 发送包：队列满时等待空位
+    if (!mcu_enqueue_packet(
+                handle, command, seq, other_data, other_data_len, timeout_ms)) {
+        // 发送失败，释放槽位
+        DBG_PRINT(
+                "Send Packet Failed, command[0x%02X], sequence[%u], "
+                "timeout[%u]",
+                command,
+                seq,
+                timeout_ms);
+        waiter->in_use = false;
+        return MSB_Error_Win_BufferFull;
+    }
+
+    *out_waiter = waiter;
+    return MSB_Error_OK;
+}
 
-        if (!waiter) {
-            // 没空位
-            DBG_PRINT(
-                    "Send Packet Failed, command[0x%02X], sequence[%u], "
-                    "timeout[%u]",
-                    command,
-                    seq,
-                    timeout_ms);
-            return MSB_Error_Win_BufferFull;
+// --------------------
+// 等待 mcu_send_packet_begin 发出的包的应答
+// --------------------
+MCUSerialBridgeError mcu_wait_packet(
+        msb_handle* handle,
+        SeqWaiter* waiter,
+        uint64_t deadline_ms,
+        uint8_t* return_data,
+        uint32_t return_data_len)
+{
+    // Wait until the command completes or the caller's total timeout expires.
+    EnterCriticalSection(&waiter->mtx);
+    uint32_t seq = waiter->seq;
+    while (!waiter->done_flag) {
+        uint64_t now_ms = GetTickCount64();
+        if (now_ms >= deadline_ms) {
+            waiter->in_use = false;
+            LeaveCriticalSection(&waiter->mtx);
+
+            DBG_PRINT("Send Packet Timed-out, sequence[%u]", seq);
+            return MSB_Error_Proto_Timeout;
         }
 
-        // 发送包
-        if (!send_payload(handle, buf, total_len)) {
-            // 发送失败，释放槽位
-            DBG_PRINT(
-                    "Send Packet Failed, command[0x%02X], sequence[%u], "
-                    "timeout[%u]",
-                    command,
-                    seq,
-                    timeout_ms);
+        uint64_t remaining_ms = deadline_ms - now_ms;
+        DWORD wait_ms = remaining_ms > MAXDWORD
+                ? MAXDWORD
+                : (DWORD)remaining_ms;
+        BOOL signaled = SleepConditionVariableCS(
+                &waiter->cnd, &waiter->mtx, wait_ms);
+        if (!signaled && GetLastError() == ERROR_TIMEOUT &&
+            !waiter->done_flag) {
             waiter->in_use = false;
-            return MSB_Error_Win_BufferFull;
+            LeaveCriticalSection(&waiter->mtx);
+
+            DBG_PRINT("Send Packet Timed-out, sequence[%u]", seq);
+            return MSB_Error_Proto_Timeout;
         }
+    }
 
-        // Wait until the command completes or the caller's total timeout expires.
-        EnterCriticalSection(&waiter->mtx);
-        uint64_t deadline_ms = GetTickCount64() + timeout_ms;
-        while (!waiter->done_flag) {
-            uint64_t now_ms = GetTickCount64();
-            if (now_ms >= deadline_ms) {
-                waiter->in_use = false;
-                LeaveCriticalSection(&waiter->mtx);
-
-                DBG_PRINT(
-                        "Send Packet Timed-out, command[0x%02X], sequence[%u], "
-                        "timeout[%u]",
-                        command,
-                        seq,
-                        timeout_ms);
-                return MSB_Error_Proto_Timeout;
-            }
-
-            uint64_t remaining_ms = deadline_ms - now_ms;
-            DWORD wait_ms = remaining_ms > MAXDWORD
-                    ? MAXDWORD
-                    : (DWORD)remaining_ms;
-            BOOL signaled = SleepConditionVariableCS(
-                    &waiter->cnd, &waiter->mtx, wait_ms);
-            if (!signaled && GetLastError() == ERROR_TIMEOUT) {
-                waiter->in_use = false;
-                LeaveCriticalSection(&waiter->mtx);
-
-                DBG_PRINT(
-                        "Send Packet Timed-out, command[0x%02X], sequence[%u], "
-                        "timeout[%u]",
-                        command,
-                        seq,
-                        timeout_ms);
-                return MSB_Error_Proto_Timeout;
-            }
+    MCUSerialBridgeError ret = waiter->result;
+    PacketBuf* reply = waiter->reply;
+    waiter->reply = NULL;
+    if (return_data && return_data_len > 0) {
+        // 直接从缓冲池里的应答包拷给调用方，不足部分补 0
+        uint32_t copy_len = reply ? reply->len - (uint32_t)sizeof(PayloadHeader) : 0;
+        if (copy_len > return_data_len) {
+            copy_len = return_data_len;
         }
+        if (copy_len > 0) {
+            memcpy(return_data, reply->data + sizeof(PayloadHeader), copy_len);
+        }
+        memset(return_data + copy_len, 0, return_data_len - copy_len);
+    }
+    if (reply) {
+        packet_release(&handle->receive_pool, reply);
+    }
+    waiter->in_use = false;
+    LeaveCriticalSection(&waiter->mtx);
+
+    DBG_PRINT("Send Packet is done, sequence[%u], result[0x%08X]", seq, ret);
+    return ret;
+}
+
+// --------------------
+// 查询应答是否已到，最多等 wait_ms；不归还 SeqWaiter
+// --------------------
+bool mcu_packet_ready(SeqWaiter* waiter, uint32_t wait_ms)
+{
+    EnterCriticalSection(&waiter->mtx);
+    if (!waiter->done_flag && wait_ms > 0) {
+        SleepConditionVariableCS(&waiter->cnd, &waiter->mtx, wait_ms);
+    }
+    bool done = waiter->done_flag;
+    LeaveCriticalSection(&waiter->mtx);
+    return done;
+}
 
-        MCUSerialBridgeError ret = waiter->result;
-        if (return_data && return_data_len > 0) {
-            if (return_data_len > RETURN_DATA_MAX_SIZE) {
-                return_data_len = RETURN_DATA_MAX_SIZE;
-            }
-            memcpy(return_data, &waiter->return_data, return_data_len);
+// --------------------
+// 构建并发送协议包
+// --------------------
+MCUSerialBridgeError mcu_send_packet_and_wait(
+        msb_handle* handle,
+        uint8_t command,
+        const uint8_t* other_data,
+        uint32_t other_data_len,
+        uint8_t* return_data,
+        uint32_t return_data_len,
+        uint32_t timeout_ms)
+{
+    if (timeout_ms > 0) {
+        // 入队等空位的时间也计入调用方的总超时
+        uint64_t deadline_ms = GetTickCount64() + timeout_ms;
+        SeqWaiter* waiter = NULL;
+        MCUSerialBridgeError ret = mcu_send_packet_begin(
+                handle, command, other_data, other_data_len, timeout_ms, &waiter);
+        if (ret != MSB_Error_OK) {
+            return ret;
         }
-        waiter->in_use = false;
-        LeaveCriticalSection(&waiter->mtx);
+        return mcu_wait_packet(
+                handle, waiter, deadline_ms, return_data, return_data_len);
+    }
 
-        DBG_PRINT(
-                "Send Packet is done, command[0x%02X], sequence[%u], "
-                "timeout[%u], "
-                "result[0x%08X]",
+    if (!handle || !handle->is_open)
+        return MSB_Error_Win_HandleNotFound;
+    if (!msb_is_comm_ready(handle))
+        return MSB_Error_Win_HandleNotFound;
+
+    uint32_t total_len = sizeof(PayloadHeader) + other_data_len;
+    if (total_len > PACKET_MAX_PAYLOAD_LEN) {
+        DBG_PRINT("Packet, payload too large, length = %u\n", total_len);
+        return MSB_Error_Proto_FrameTooLong;
+    }
+
+    // 线程安全生成序号
+    EnterCriticalSection(&handle->seq_lock);
+    uint32_t seq = handle->sequence++;
+    LeaveCriticalSection(&handle->seq_lock);
+
+    // 不等应答的包：发送队列满时也只短暂等待
+    if (mcu_enqueue_packet(
+                handle,
                 command,
                 seq,
-                timeout_ms,
-                waiter->result);
-        return ret;
+                other_data,
+                other_data_len,
+                SEND_QUEUE_FULL_WAIT_MS)) {
+        DBG_PRINT(
+                "Send Packet without wait, command[0x%02X], sequence[%u]",
+                command,
+                seq);
+        return MSB_Error_OK;
     }
+    DBG_PRINT(
+            "Send Packet Failed, command[0x%02X], sequence[%u]",
+            command,
+            seq);
+    return MSB_Error_Win_BufferFull;
 }
 
 void msb_parse_upload_data(msb_handle* handle, const DataPacket* data_packet, uint32_t timestamp_ms)
@@ -234,9 +307,9 @@ void msb_parse_upload_data(msb_handle* handle, const DataPacket* data_packet, ui
     PortQueue* q = &handle->ports[port_index];
 
     /* ---------- 单生产者无锁入队 ---------- */
-    uint8_t next = q->head + 1;
-    if (next == q->tail) {
-        /* 队列满，丢帧 */
+    uint32_t slot;
+    if (!spsc_reserve(&q->idx, RING_QUEUE_SIZE, &slot)) {
+        /* 队列满，丢帧：没人读的 port 不能卡住 parse 线程 */
         DBG_PRINT(
                 "UploadData: Received Port[%u], receive queue full, "
                 "dropping data len=%u",
@@ -247,10 +320,10 @@ void msb_parse_upload_data(msb_handle* handle, const DataPacket* data_packet, ui
 
     /* 拷贝 payload（一帧一次） */
     DBG_PRINT("UploadData: Received Port[%u], len=%u", port_index, data_len);
-    memcpy(q->queue[q->head].data, data_packet->data, data_len);
-    q->queue[q->head].len = data_len;
-    q->queue[q->head].timestamp_ms = timestamp_ms;
-    q->head = next;
+    memcpy(q->queue[slot].data, data_packet->data, data_len);
+    q->queue[slot].len = data_len;
+    q->queue[slot].timestamp_ms = timestamp_ms;
+    spsc_publish(&q->idx);
 
     /* 唤醒 read_ports */
     SetEvent(q->data_event);
@@ -7,10 +7,12 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <termios.h>
@@ -64,7 +66,10 @@ struct msb_platform_thread {
 struct msb_platform_handle {
     enum msb_platform_handle_kind kind;
     union {
-        int fd;
+        struct {
+            int fd;
+            int wake_fd;  // eventfd, CancelIoEx 唤醒 WaitCommInputCS
+        } serial;
         struct msb_platform_event event;
         struct msb_platform_thread thread;
     } u;
@@ -320,6 +325,11 @@ void WakeConditionVariable(CONDITION_VARIABLE* cv)
     pthread_cond_signal(cv);
 }
 
+void WakeAllConditionVariable(CONDITION_VARIABLE* cv)
+{
+    pthread_cond_broadcast(cv);
+}
+
 HANDLE CreateEvent(void* security_attributes, BOOL manual_reset, BOOL initial_state, const char* name)
 {
     (void)security_attributes;
@@ -436,7 +446,8 @@ BOOL CloseHandle(HANDLE handle)
     }
 
     if (handle->kind == MSB_PLATFORM_HANDLE_SERIAL) {
-        close(handle->u.fd);
+        close(handle->u.serial.fd);
+        close(handle->u.serial.wake_fd);
     } else if (handle->kind == MSB_PLATFORM_HANDLE_EVENT) {
         pthread_cond_destroy(&handle->u.event.cond);
         pthread_mutex_destroy(&handle->u.event.mutex);
@@ -521,15 +532,23 @@ HANDLE CreateFileA(
         SetLastError(msb_error_from_errno(errno));
         return INVALID_HANDLE_VALUE;
     }
+    int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        SetLastError(msb_error_from_errno(errno));
+        close(fd);
+        return INVALID_HANDLE_VALUE;
+    }
     struct msb_platform_handle* handle =
             (struct msb_platform_handle*)calloc(1, sizeof(struct msb_platform_handle));
     if (!handle) {
         close(fd);
+        close(wake_fd);
         SetLastError(ERROR_NOT_ENOUGH_MEMORY);
         return INVALID_HANDLE_VALUE;
     }
     handle->kind = MSB_PLATFORM_HANDLE_SERIAL;
-    handle->u.fd = fd;
+    handle->u.serial.fd = fd;
+    handle->u.serial.wake_fd = wake_fd;
     return handle;
 }
 
@@ -547,11 +566,13 @@ BOOL ReadFile(HANDLE handle, void* buffer, DWORD bytes_to_read, DWORD* bytes_rea
         return TRUE;
     }
 
+    // 与 Windows 上 ReadIntervalTimeout = MAXDWORD 一致：没有数据立即返回，
+    // 等数据用 WaitCommInputCS（不占 comm_lock）。
     struct pollfd pfd;
-    pfd.fd = handle->u.fd;
+    pfd.fd = handle->u.serial.fd;
     pfd.events = POLLIN;
     pfd.revents = 0;
-    int poll_ret = poll(&pfd, 1, 10);
+    int poll_ret = poll(&pfd, 1, 0);
     if (poll_ret == 0) {
         return TRUE;
     }
@@ -570,7 +591,7 @@ BOOL ReadFile(HANDLE handle, void* buffer, DWORD bytes_to_read, DWORD* bytes_rea
         return TRUE;
     }
 
-    ssize_t ret = read(handle->u.fd, buffer, bytes_to_read);
+    ssize_t ret = read(handle->u.serial.fd, buffer, bytes_to_read);
     if (ret >= 0) {
         if (bytes_read) {
             *bytes_read = (DWORD)ret;
@@ -605,7 +626,7 @@ BOOL WriteFile(HANDLE handle, const void* buffer, DWORD bytes_to_write, DWORD* b
         fflush(stderr);
     }
     while (total < bytes_to_write) {
-        ssize_t ret = write(handle->u.fd, ptr + total, bytes_to_write - total);
+        ssize_t ret = write(handle->u.serial.fd, ptr + total, bytes_to_write - total);
         if (ret > 0) {
             total += (DWORD)ret;
             if (msb_trace_io_enabled()) {
@@ -632,19 +653,19 @@ BOOL WriteFile(HANDLE handle, const void* buffer, DWORD bytes_to_write, DWORD* b
         *bytes_written = total;
     }
     msb_trace_io_bytes("write", buffer, total);
-    if (tcdrain(handle->u.fd) != 0) {
+    if (tcdrain(handle->u.serial.fd) != 0) {
         SetLastError(msb_error_from_errno(errno));
         return FALSE;
     }
     if (msb_trace_io_enabled()) {
         fprintf(stderr, "[MSB_TRACE_IO] write-drained len=%lu\n", (unsigned long)total);
         struct pollfd pfd;
-        pfd.fd = handle->u.fd;
+        pfd.fd = handle->u.serial.fd;
         pfd.events = POLLIN;
         pfd.revents = 0;
         int poll_ret = poll(&pfd, 1, 100);
         int queued = 0;
-        ioctl(handle->u.fd, FIONREAD, &queued);
+        ioctl(handle->u.serial.fd, FIONREAD, &queued);
         fprintf(stderr,
                 "[MSB_TRACE_IO] after-write poll=%d revents=0x%x queued=%d\n",
                 poll_ret,
@@ -655,6 +676,62 @@ BOOL WriteFile(HANDLE handle, const void* buffer, DWORD bytes_to_write, DWORD* b
     return TRUE;
 }
 
+BOOL WriteFileV(HANDLE handle, const struct iovec* iov, int iovcnt, DWORD* bytes_written)
+{
+    if (bytes_written) {
+        *bytes_written = 0;
+    }
+    if (!msb_is_valid_handle(handle) || handle->kind != MSB_PLATFORM_HANDLE_SERIAL ||
+        iovcnt <= 0 || iovcnt > IOV_MAX) {
+        SetLastError(iovcnt <= 0 || iovcnt > IOV_MAX ? ERROR_INVALID_PARAMETER : ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    // 部分写时要从中间续写，复制一份可改的 iovec
+    struct iovec local[IOV_MAX];
+    memcpy(local, iov, sizeof(struct iovec) * (size_t)iovcnt);
+    struct iovec* cur = local;
+    int left = iovcnt;
+    DWORD total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        msb_trace_io_bytes("write", iov[i].iov_base, (DWORD)iov[i].iov_len);
+    }
+    while (left > 0) {
+        ssize_t ret = writev(handle->u.serial.fd, cur, left);
+        if (ret > 0) {
+            total += (DWORD)ret;
+            size_t n = (size_t)ret;
+            while (left > 0 && n >= cur->iov_len) {
+                n -= cur->iov_len;
+                cur++;
+                left--;
+            }
+            if (left > 0) {
+                cur->iov_base = (uint8_t*)cur->iov_base + n;
+                cur->iov_len -= n;
+            }
+            continue;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            usleep(1000);
+            continue;
+        }
+        SetLastError(msb_error_from_errno(errno));
+        if (bytes_written) {
+            *bytes_written = total;
+        }
+        return FALSE;
+    }
+    if (bytes_written) {
+        *bytes_written = total;
+    }
+    if (tcdrain(handle->u.serial.fd) != 0) {
+        SetLastError(msb_error_from_errno(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
 BOOL GetCommState(HANDLE handle, DCB* dcb)
 {
     if (!msb_is_valid_handle(handle) || handle->kind != MSB_PLATFORM_HANDLE_SERIAL || !dcb) {
@@ -678,7 +755,7 @@ BOOL SetCommState(HANDLE handle, DCB* dcb)
     }
 
     struct termios tty;
-    if (tcgetattr(handle->u.fd, &tty) != 0) {
+    if (tcgetattr(handle->u.serial.fd, &tty) != 0) {
         SetLastError(msb_error_from_errno(errno));
         return FALSE;
     }
@@ -710,17 +787,17 @@ BOOL SetCommState(HANDLE handle, DCB* dcb)
     tty.c_cc[VMIN] = 0;
     tty.c_cc[VTIME] = 0;
 
-    if (tcsetattr(handle->u.fd, TCSANOW, &tty) != 0) {
+    if (tcsetattr(handle->u.serial.fd, TCSANOW, &tty) != 0) {
         SetLastError(msb_error_from_errno(errno));
         return FALSE;
     }
-    if (!msb_set_custom_baud(handle->u.fd, dcb->BaudRate)) {
+    if (!msb_set_custom_baud(handle->u.serial.fd, dcb->BaudRate)) {
         return FALSE;
     }
-    tcflush(handle->u.fd, TCIOFLUSH);
+    tcflush(handle->u.serial.fd, TCIOFLUSH);
     if (msb_trace_io_enabled()) {
         struct termios verify_tty;
-        if (tcgetattr(handle->u.fd, &verify_tty) == 0) {
+        if (tcgetattr(handle->u.serial.fd, &verify_tty) == 0) {
             fprintf(stderr,
                     "[MSB_TRACE_IO] termios baud=%lu standard=%d ispeed=%lu ospeed=%lu iflag=0x%lx cflag=0x%lx lflag=0x%lx\n",
                     (unsigned long)dcb->BaudRate,
@@ -758,7 +835,7 @@ BOOL ClearCommError(HANDLE handle, DWORD* errors, COMSTAT* stat)
     if (stat) {
         memset(stat, 0, sizeof(*stat));
         int queued = 0;
-        if (ioctl(handle->u.fd, FIONREAD, &queued) == 0) {
+        if (ioctl(handle->u.serial.fd, FIONREAD, &queued) == 0) {
             stat->cbInQue = (DWORD)queued;
         }
     }
@@ -772,7 +849,18 @@ BOOL PurgeComm(HANDLE handle, DWORD flags)
         SetLastError(ERROR_INVALID_HANDLE);
         return FALSE;
     }
-    tcflush(handle->u.fd, TCIOFLUSH);
+    tcflush(handle->u.serial.fd, TCIOFLUSH);
+    return TRUE;
+}
+
+BOOL SetCommMask(HANDLE handle, DWORD mask)
+{
+    // 等数据走 WaitCommInputCS，这里只检查句柄
+    (void)mask;
+    if (!msb_is_valid_handle(handle) || handle->kind != MSB_PLATFORM_HANDLE_SERIAL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
     return TRUE;
 }
 
@@ -783,16 +871,59 @@ BOOL CancelIoEx(HANDLE handle, void* overlapped)
         SetLastError(ERROR_INVALID_HANDLE);
         return FALSE;
     }
+    if (handle->kind == MSB_PLATFORM_HANDLE_SERIAL) {
+        // 唤醒 WaitCommInputCS；计数不清零，之后的等待都立即返回（句柄随后会被关闭）。
+        uint64_t one = 1;
+        if (write(handle->u.serial.wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            SetLastError(msb_error_from_errno(errno));
+            return FALSE;
+        }
+    }
     return TRUE;
 }
 
+BOOL WaitCommInputCS(HANDLE comm, CRITICAL_SECTION* cs, DWORD timeout_ms)
+{
+    if (!msb_is_valid_handle(comm) || comm->kind != MSB_PLATFORM_HANDLE_SERIAL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    // 只拷贝 fd：等待期间别的线程可以持 cs 关闭/重开句柄（先 CancelIoEx 唤醒这里）。
+    struct pollfd pfd[2];
+    pfd[0].fd = comm->u.serial.fd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = comm->u.serial.wake_fd;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+
+    LeaveCriticalSection(cs);
+    int poll_ret = poll(pfd, 2, timeout_ms == INFINITE ? -1 : (int)timeout_ms);
+    int poll_errno = errno;
+    EnterCriticalSection(cs);
+
+    if (poll_ret > 0) {
+        return TRUE;
+    }
+    if (poll_ret == 0) {
+        SetLastError(ERROR_TIMEOUT);
+        return FALSE;
+    }
+    if (poll_errno == EINTR) {
+        return TRUE;
+    }
+    SetLastError(msb_error_from_errno(poll_errno));
+    return FALSE;
+}
+
 BOOL FlushFileBuffers(HANDLE handle)
 {
     if (!msb_is_valid_handle(handle) || handle->kind != MSB_PLATFORM_HANDLE_SERIAL) {
         SetLastError(ERROR_INVALID_HANDLE);
         return FALSE;
     }
-    return tcdrain(handle->u.fd) == 0 ? TRUE : FALSE;
+    return tcdrain(handle->u.serial.fd) == 0 ? TRUE : FALSE;
 }
 
 DWORD GetLastError(void)
@@ -817,6 +948,20 @@ uint64_t GetTickCount64(void)
     return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
 }
 
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    count->QuadPart = (int64_t)ts.tv_sec * 1000000000ll + (int64_t)ts.tv_nsec;
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+    frequency->QuadPart = 1000000000ll;  // 计数单位是 ns
+    return TRUE;
+}
+
 void Sleep(DWORD milliseconds)
 {
     usleep((useconds_t)milliseconds * 1000u);
@@ -0,0 +1,308 @@
+// msb_ring.c
+#include "msb_ring.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef bool (*ring_try_fn)(void* ctx);
+
+static void ring_space_init(RingSpace* s)
+{
+    InitializeCriticalSection(&s->lock);
+    InitializeConditionVariable(&s->cnd);
+    msb_atomic_store_release(&s->waiters, 0);
+}
+
+// 消费者归还槽位后调用。fence 保证“归还”先于读 waiters：
+// 要么这里看到 waiters > 0 去唤醒，要么生产者登记后的复查能看到空位。
+// 一次归还多个槽位时唤醒全部等待者。
+static void ring_space_notify(RingSpace* s, uint32_t freed)
+{
+    msb_atomic_fence();
+    if (msb_atomic_load_acquire(&s->waiters) != 0) {
+        EnterCriticalSection(&s->lock);
+        if (freed > 1) {
+            WakeAllConditionVariable(&s->cnd);
+        } else {
+            WakeConditionVariable(&s->cnd);
+        }
+        LeaveCriticalSection(&s->lock);
+    }
+}
+
+// 先无锁试一次；不成再在锁内登记 waiters 并等待，直到 try_fn 成功或超时
+static bool ring_space_wait(
+        RingSpace* s,
+        ring_try_fn try_fn,
+        void* ctx,
+        uint32_t timeout_ms)
+{
+    if (try_fn(ctx)) {
+        return true;
+    }
+    if (timeout_ms == 0) {
+        return false;
+    }
+
+    uint64_t deadline_ms = GetTickCount64() + timeout_ms;
+    bool ok = false;
+    EnterCriticalSection(&s->lock);
+    msb_atomic_fetch_add(&s->waiters, 1);
+    msb_atomic_fence();  // 与 ring_space_notify 的 fence 配对
+    for (;;) {
+        if (try_fn(ctx)) {
+            ok = true;
+            break;
+        }
+        uint64_t now_ms = GetTickCount64();
+        if (now_ms >= deadline_ms) {
+            break;
+        }
+        SleepConditionVariableCS(&s->cnd, &s->lock, (DWORD)(deadline_ms - now_ms));
+    }
+    msb_atomic_fetch_add(&s->waiters, (uint32_t)-1);
+    LeaveCriticalSection(&s->lock);
+    return ok;
+}
+
+// --------------------
+// 接收包缓冲池
+// --------------------
+static const uint16_t PACKET_CLASS_CAP[PACKET_POOL_CLASSES] = {
+        64, 256, PACKET_MAX_PAYLOAD_LEN + 8};
+static const uint16_t PACKET_CLASS_COUNT[PACKET_POOL_CLASSES] = {512, 256, 128};
+
+static uint32_t packet_stride(uint32_t cls)
+{
+    return (uint32_t)((sizeof(PacketBuf) + PACKET_CLASS_CAP[cls] + 7) & ~7u);
+}
+
+static PacketBuf* packet_at(PacketPool* pool, uint32_t index)
+{
+    uint32_t cls = index >> 16;
+    return (PacketBuf*)(pool->memory + pool->offset[cls] +
+                        (index & 0xFFFF) * packet_stride(cls));
+}
+
+static void packet_push_free(PacketPool* pool, PacketBuf* buf)
+{
+    msb_atomic_u32* head = &pool->free_head[buf->self >> 16];
+    uint32_t old = msb_atomic_load_acquire(head);
+    do {
+        buf->next = old;
+    } while (!msb_atomic_cas(head, &old, buf->self));
+}
+
+bool packet_pool_init(PacketPool* pool)
+{
+    uint32_t total = 0;
+    for (uint32_t cls = 0; cls < PACKET_POOL_CLASSES; cls++) {
+        pool->offset[cls] = total;
+        total += PACKET_CLASS_COUNT[cls] * packet_stride(cls);
+    }
+    pool->memory = (uint8_t*)malloc(total);
+    if (!pool->memory) {
+        return false;
+    }
+
+    for (uint32_t cls = 0; cls < PACKET_POOL_CLASSES; cls++) {
+        msb_atomic_store_release(&pool->free_head[cls], PACKET_POOL_NIL);
+        for (uint32_t i = PACKET_CLASS_COUNT[cls]; i-- > 0;) {
+            PacketBuf* buf = packet_at(pool, (cls << 16) | i);
+            buf->self = (cls << 16) | i;
+            buf->cap = PACKET_CLASS_CAP[cls];
+            buf->len = 0;
+            msb_atomic_store_release(&buf->refs, 0);
+            packet_push_free(pool, buf);
+        }
+    }
+    ring_space_init(&pool->space);
+    return true;
+}
+
+void packet_pool_deinit(PacketPool* pool)
+{
+    DeleteCriticalSection(&pool->space.lock);
+    free(pool->memory);
+    pool->memory = NULL;
+}
+
+typedef struct {
+    PacketPool* pool;
+    uint32_t len;
+    PacketBuf* out;
+} PacketAllocCtx;
+
+// 从能放下 len 的最小尺寸开始找，小尺寸用完时借用大尺寸
+static bool packet_try_alloc(void* ctx)
+{
+    PacketAllocCtx* a = (PacketAllocCtx*)ctx;
+    for (uint32_t cls = 0; cls < PACKET_POOL_CLASSES; cls++) {
+        if (PACKET_CLASS_CAP[cls] < a->len) {
+            continue;
+        }
+        msb_atomic_u32* head = &a->pool->free_head[cls];
+        uint32_t index = msb_atomic_load_acquire(head);
+        while (index != PACKET_POOL_NIL) {
+            PacketBuf* buf = packet_at(a->pool, index);
+            if (msb_atomic_cas(head, &index, buf->next)) {
+                msb_atomic_store_release(&buf->refs, 1);
+                buf->len = 0;
+                a->out = buf;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+PacketBuf* packet_alloc(PacketPool* pool, uint32_t len, uint32_t timeout_ms)
+{
+    PacketAllocCtx ctx = {pool, len, NULL};
+    if (len > PACKET_CLASS_CAP[PACKET_POOL_CLASSES - 1]) {
+        return NULL;
+    }
+    ring_space_wait(&pool->space, packet_try_alloc, &ctx, timeout_ms);
+    return ctx.out;
+}
+
+void packet_retain(PacketBuf* buf)
+{
+    msb_atomic_fetch_add(&buf->refs, 1);
+}
+
+void packet_release(PacketPool* pool, PacketBuf* buf)
+{
+    if (msb_atomic_fetch_add(&buf->refs, (uint32_t)-1) == 1) {
+        packet_push_free(pool, buf);
+        ring_space_notify(&pool->space, 1);
+    }
+}
+
+// --------------------
+// 接收队列（SPSC）
+// --------------------
+void packet_queue_init(PacketQueue* q)
+{
+    msb_atomic_store_release(&q->idx.head, 0);
+    msb_atomic_store_release(&q->idx.tail, 0);
+}
+
+bool packet_queue_push(PacketQueue* q, PacketBuf* buf)
+{
+    uint32_t slot;
+    if (!spsc_reserve(&q->idx, PACKET_QUEUE_SIZE, &slot)) {
+        return false;
+    }
+    q->items[slot] = buf;
+    spsc_publish(&q->idx);
+    return true;
+}
+
+PacketBuf* packet_queue_pop(PacketQueue* q)
+{
+    uint32_t slot;
+    if (!spsc_front(&q->idx, PACKET_QUEUE_SIZE, &slot)) {
+        return NULL;  // 队列空
+    }
+    PacketBuf* buf = q->items[slot];
+    spsc_release(&q->idx);
+    return buf;
+}
+
+// --------------------
+// 发送队列（MPSC）
+// --------------------
+void send_queue_init(SendQueue* q)
+{
+    for (uint32_t i = 0; i < RING_QUEUE_SIZE; i++) {
+        msb_atomic_store_release(&q->slots[i].seq, i);
+    }
+    msb_atomic_store_release(&q->head, 0);
+    msb_atomic_store_release(&q->tail, 0);
+    ring_space_init(&q->space);
+}
+
+void send_queue_deinit(SendQueue* q)
+{
+    DeleteCriticalSection(&q->space.lock);
+}
+
+typedef struct {
+    SendQueue* q;
+    SendSlot* out;
+} SendClaimCtx;
+
+static bool send_queue_try_claim(void* ctx)
+{
+    SendClaimCtx* c = (SendClaimCtx*)ctx;
+    SendQueue* q = c->q;
+    uint32_t pos = msb_atomic_load_acquire(&q->head);
+    for (;;) {
+        SendSlot* slot = &q->slots[pos & RING_QUEUE_MASK];
+        uint32_t seq = msb_atomic_load_acquire(&slot->seq);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            // 槽位空闲，抢占 pos；失败时 pos 被更新为最新值
+            if (msb_atomic_cas(&q->head, &pos, pos + 1)) {
+                c->out = slot;
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // 上一圈还没发完：队列满
+        } else {
+            pos = msb_atomic_load_acquire(&q->head);  // 被别的生产者抢先
+        }
+    }
+}
+
+PayloadEntry* send_queue_claim(SendQueue* q, uint32_t timeout_ms)
+{
+    SendClaimCtx ctx = {q, NULL};
+    if (!ring_space_wait(&q->space, send_queue_try_claim, &ctx, timeout_ms)) {
+        return NULL;
+    }
+    return &ctx.out->entry;
+}
+
+// 领取后到提交前 seq 一直等于 pos，只有领取者会改它
+void send_queue_commit(SendQueue* q, PayloadEntry* entry)
+{
+    (void)q;
+    SendSlot* slot = (SendSlot*)((uint8_t*)entry - offsetof(SendSlot, entry));
+    msb_atomic_store_release(&slot->seq, msb_atomic_load_acquire(&slot->seq) + 1);
+}
+
+PayloadEntry* send_queue_front(SendQueue* q)
+{
+    return send_queue_peek(q, 0);
+}
+
+PayloadEntry* send_queue_peek(SendQueue* q, uint32_t index)
+{
+    if (index >= RING_QUEUE_SIZE) {
+        return NULL;
+    }
+    uint32_t pos = msb_atomic_load_acquire(&q->tail) + index;
+    SendSlot* slot = &q->slots[pos & RING_QUEUE_MASK];
+    if (msb_atomic_load_acquire(&slot->seq) != pos + 1) {
+        return NULL;  // 队列空，或生产者还在写这个槽位
+    }
+    return &slot->entry;
+}
+
+void send_queue_pop(SendQueue* q)
+{
+    send_queue_pop_n(q, 1);
+}
+
+void send_queue_pop_n(SendQueue* q, uint32_t count)
+{
+    uint32_t pos = msb_atomic_load_acquire(&q->tail);
+    for (uint32_t i = 0; i < count; i++, pos++) {
+        SendSlot* slot = &q->slots[pos & RING_QUEUE_MASK];
+        msb_atomic_store_release(&slot->seq, pos + RING_QUEUE_SIZE);
+    }
+    msb_atomic_store_release(&q->tail, pos);
+    ring_space_notify(&q->space, count);
+}
@@ -6,16 +6,18 @@
 #include <string.h>
 
 #include "c_core_common.h"
+#include "msb_crc.h"
 #include "msb_handle.h"
 #include "msb_packet.h"
 
 #define LINEAR_BUFFER_SIZE 65536  // 接收线性缓冲区大小
 
 #define READ_SLEEP_MS 1
-#define WRITE_SLEEP_MS 2
+#define WRITE_SLEEP_MS 2     // 相邻两帧之间的最小间隔
+#define IDLE_WAIT_MS 100     // 线程空闲时等待事件的上限，用来检查 is_open
+#define RECEIVE_QUEUE_FULL_WAIT_MS 20  // 接收队列满时 recv 线程的等待上限
 #define RECONNECT_BACKOFF_COUNT 11
 
-static uint16_t calculate_crc16(const uint8_t* data, uint32_t len);
 static const char* win32_error_name(DWORD err);
 static void msb_emit_transport_error(msb_handle* handle, const char* message);
 static void msb_reset_transport_error_state(msb_handle* handle);
@@ -43,7 +45,7 @@ static BOOL msb_reopen_comm_locked(msb_handle* handle, DWORD* out_err)
             0,
             NULL,
             OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
             NULL);
     if (!is_comm_valid(new_comm)) {
         if (out_err) {
@@ -87,6 +89,13 @@ static BOOL msb_reopen_comm_locked(msb_handle* handle, DWORD* out_err)
         CloseHandle(new_comm);
         return FALSE;
     }
+    if (!SetCommMask(new_comm, EV_RXCHAR)) {
+        if (out_err) {
+            *out_err = GetLastError();
+        }
+        CloseHandle(new_comm);
+        return FALSE;
+    }
 
     handle->hComm = new_comm;
     if (out_err) {
@@ -171,6 +180,7 @@ static void msb_try_auto_reconnect(msb_handle* handle, char from_op, DWORD from_
 
     attempt_no = handle->reconnect_attempt;
     if (is_comm_valid(handle->hComm)) {
+        CancelIoEx(handle->hComm, NULL);  // 接收线程可能正等在旧句柄上
         CloseHandle(handle->hComm);
     }
     handle->hComm = INVALID_HANDLE_VALUE;
@@ -343,302 +353,360 @@ static void msb_transport_record_error(
 }
 
 // --------------------
-// 接收无锁入队
+// 接收入队（recv 线程）：把校验过的 payload 拷进缓冲池的块里交给 parse，
+// 这是接收路径上唯一一次拷贝。缓冲池用完时等 parse / 调用方释放，超时才丢包
 // --------------------
 static bool receive_ring_enqueue(
         msb_handle* handle,
         const uint8_t* data,
         uint32_t len)
 {
-    uint8_t next = (handle->receive_queue.head + 1);
-    if (next == handle->receive_queue.tail) {
-        // 队列满，丢包
-        DBG_PRINT(
-                "Receive: Receive Queue full, drop packet of "
-                "len=%u",
-                len);
-        return 0;
-    }
     if (len > PACKET_MAX_PAYLOAD_LEN) {
         DBG_PRINT("Receive: Packet Payload too large, len=%u", len);
         return 0;
     }
-
-    memcpy(handle->receive_queue.entries[handle->receive_queue.head].payload,
-           data,
-           len);
-    handle->receive_queue.entries[handle->receive_queue.head].len = len;
-    handle->receive_queue.head = next;
-
-    return 1;
-}
-
-// --------------------
-// 发送无锁入队
-// --------------------
-bool send_payload(msb_handle* handle, const uint8_t* data, uint32_t len)
-{
-    if (len > PACKET_MAX_PAYLOAD_LEN) {
-        DBG_PRINT("Send: Packet Payload too large, len=%u", len);
-        return 0;
+    // 多留 1 字节，Console 消息可以原地补 '\0'
+    PacketBuf* pkt = packet_alloc(&handle->receive_pool, len + 1, 0);
+    if (!pkt) {
+        // 用完了：先叫醒 parse（本批次的包还没 SetEvent），再等它释放
+        SetEvent(handle->rx_event);
+        pkt = packet_alloc(
+                &handle->receive_pool, len + 1, RECEIVE_QUEUE_FULL_WAIT_MS);
+        if (!pkt) {
+            DBG_PRINT(
+                    "Receive: Packet pool exhausted for %u ms, drop packet of "
+                    "len=%u",
+                    RECEIVE_QUEUE_FULL_WAIT_MS,
+                    len);
+            return 0;
+        }
     }
-
-    uint8_t next = (handle->send_queue.head + 1);
-    if (next == handle->send_queue.tail) {
-        // 队列满，丢包
-        DBG_PRINT(
-                "Send: Send Queue full, drop packet of len=%u, head=%u "
-                "tail=%u",
-                len,
-                handle->send_queue.head,
-                handle->send_queue.tail);
+    memcpy(pkt->data, data, len);
+    pkt->len = (uint16_t)len;
+    if (!packet_queue_push(&handle->receive_queue, pkt)) {
+        packet_release(&handle->receive_pool, pkt);  // 队列不小于池，不会发生
         return 0;
     }
-
-    memcpy(handle->send_queue.entries[handle->send_queue.head].payload,
-           data,
-           len);
-    handle->send_queue.entries[handle->send_queue.head].len = len;
-    handle->send_queue.head = next;
-
     return 1;
 }
 
 // --------------------
-// 接收无锁出队（只返回长度，payload需拷贝到线程私有缓存）
+// 发送入队（MPSC，任意 API 线程）：领取发送槽位，调用方直接在槽位里组包。
+// 队列满时等待 send 线程腾出槽位
 // --------------------
-static bool receive_ring_dequeue(
-        msb_handle* handle,
-        uint8_t* out_buf,
-        uint32_t* out_len)
+PayloadEntry* send_payload_begin(msb_handle* handle, uint32_t timeout_ms)
 {
-    if (handle->receive_queue.head == handle->receive_queue.tail)
-        return 0;  // 队列空
-
-    uint32_t len =
-            handle->receive_queue.entries[handle->receive_queue.tail].len;
-    memcpy(out_buf,
-           handle->receive_queue.entries[handle->receive_queue.tail].payload,
-           len);
-    *out_len = len;
-    handle->receive_queue.tail++;
+    PayloadEntry* entry = send_queue_claim(&handle->send_queue, timeout_ms);
+    if (!entry) {
+        DBG_PRINT("Send: Send Queue full for %u ms, drop packet", timeout_ms);
+    }
+    return entry;
+}
 
-    return 1;
+void send_payload_commit(msb_handle* handle, PayloadEntry* entry, uint32_t len)
+{
+    entry->len = (uint16_t)len;
+    send_queue_commit(&handle->send_queue, entry);
+    SetEvent(handle->tx_event);
 }
 
 // --------------------
-// 解析线程
+// 解析一个包：payload 就地使用，回调拿到的指针直接指向缓冲池
 // --------------------
-DWORD WINAPI parse_thread_func(LPVOID param)
+static void msb_parse_packet(msb_handle* handle, PacketBuf* pkt)
 {
-    DBG_PRINT("Thread: Parse thread started");
+    uint8_t* payload = pkt->data;
+    uint32_t len = pkt->len;
 
-    msb_handle* handle = (msb_handle*)param;
-    uint8_t local_buf[PACKET_MAX_PAYLOAD_LEN];  // 线程私有缓存
+    if (len < sizeof(PayloadHeader)) {
+        return;  // 数据太短
+    }
 
-    while (handle && handle->is_open) {
-        uint32_t len = 0;
-        if (receive_ring_dequeue(handle, local_buf, &len)) {
-            // Payload 已拷贝到线程私有缓存
-            if (len < sizeof(PayloadHeader)) {
-                continue;  // 数据太短
-            }
+    PayloadHeader* payload_header = (PayloadHeader*)payload;
+    uint32_t seq = payload_header->sequence;
+    u8 command = payload_header->command;
+
+    DBG_PRINT(
+            "Parsing with packet, command[0x%02X], sequence[%u], "
+            "result[0x%08X]",
+            command,
+            seq,
+            payload_header->error_code);
+    if (command == CommandUploadPort) {
+        // Upload Port Data (MCU -> PC)
+        if (len < sizeof(PayloadHeader) + sizeof(DataPacket)) {
+            return;  // 数据太短
+        }
+        DataPacket* data_packet =
+                (DataPacket*)((uint8_t*)payload + sizeof(PayloadHeader));
+        if (data_packet->data_len !=
+            len - sizeof(PayloadHeader) - sizeof(DataPacket)) {
+            return;  // Length mismatch
+        }
 
-            PayloadHeader* payload_header = (PayloadHeader*)local_buf;
-            uint32_t seq = payload_header->sequence;
-            u8 command = payload_header->command;
+        msb_parse_upload_data(handle, data_packet, payload_header->timestamp_ms);
+    } else if (command == CommandMemoryLowerIO) {
+        // Memory LowerIO Data (MCU -> PC, DIVER mode output)
+        if (len <
+            sizeof(PayloadHeader) + sizeof(MemoryExchangePacket)) {
+            return;  // 数据太短
+        }
+        MemoryExchangePacket* mem_packet =
+                (MemoryExchangePacket*)((uint8_t*)payload + sizeof(PayloadHeader));
+        if (mem_packet->data_len !=
+            len - sizeof(PayloadHeader) -
+                    sizeof(MemoryExchangePacket)) {
+            return;  // Length mismatch
+        }
 
-            DBG_PRINT(
-                    "Parsing with packet, command[0x%02X], sequence[%u], "
-                    "result[0x%08X]",
-                    command,
-                    seq,
-                    payload_header->error_code);
-            if (command == CommandUploadPort) {
-                // Upload Port Data (MCU -> PC)
-                if (len < sizeof(PayloadHeader) + sizeof(DataPacket)) {
-                    continue;  // 数据太短
-                }
-                DataPacket* data_packet =
-                        (DataPacket*)((uint8_t*)local_buf + sizeof(PayloadHeader));
-                if (data_packet->data_len !=
-                    len - sizeof(PayloadHeader) - sizeof(DataPacket)) {
-                    continue;  // Length mismatch
-                }
+        // 调用用户回调
+        if (handle->memory_lower_io_callback) {
+            handle->memory_lower_io_callback(
+                    mem_packet->data,
+                    mem_packet->data_len,
+                    handle->memory_lower_io_callback_ctx);
+        }
+    } else if (command == CommandUploadConsoleWriteLine) {
+        // Console WriteLine (MCU -> PC, DIVER mode log output)
+        // Payload 结构: PayloadHeader + string data (不含长度字段)
+        uint32_t msg_len = len - sizeof(PayloadHeader);
+        if (msg_len == 0) {
+            return;  // 空消息
+        }
 
-                msb_parse_upload_data(handle, data_packet, payload_header->timestamp_ms);
-            } else if (command == CommandMemoryLowerIO) {
-                // Memory LowerIO Data (MCU -> PC, DIVER mode output)
-                if (len <
-                    sizeof(PayloadHeader) + sizeof(MemoryExchangePacket)) {
-                    continue;  // 数据太短
-                }
-                MemoryExchangePacket* mem_packet =
-                        (MemoryExchangePacket*)((uint8_t*)local_buf + sizeof(PayloadHeader));
-                if (mem_packet->data_len !=
-                    len - sizeof(PayloadHeader) -
-                            sizeof(MemoryExchangePacket)) {
-                    continue;  // Length mismatch
-                }
+        // 分配时多留了 1 字节，原地补 '\0'
+        char* msg_buf = (char*)(payload + sizeof(PayloadHeader));
+        payload[len] = '\0';
+        DBG_PRINT("MCU: Called Console.WriteLine, msg = >>>\n%s<<<", msg_buf);
+
+        // 调用用户回调
+        if (handle->console_writeline_callback) {
+            handle->console_writeline_callback(
+                    msg_buf,
+                    msg_len,
+                    payload_header->timestamp_ms,
+                    handle->console_writeline_callback_ctx);
+        }
+    } else if (command == CommandUploadLowerIoAndVmStats) {
+        // Combined LowerIO + VM Stats (MCU -> PC, per-iteration).
+        // Payload layout: [VmStatsC][MemoryExchangePacket(len + bytes)].
+        // We split it back into the two original callbacks so upper
+        // layers keep seeing separate LowerIO and VmStats events.
+        if (len < sizeof(PayloadHeader) + sizeof(VmStatsC) +
+                          sizeof(MemoryExchangePacket)) {
+            return;  // 数据太短
+        }
 
-                // 调用用户回调
-                if (handle->memory_lower_io_callback) {
-                    handle->memory_lower_io_callback(
-                            mem_packet->data,
-                            mem_packet->data_len,
-                            handle->memory_lower_io_callback_ctx);
-                }
-            } else if (command == CommandUploadConsoleWriteLine) {
-                // Console WriteLine (MCU -> PC, DIVER mode log output)
-                // Payload 结构: PayloadHeader + string data (不含长度字段)
-                uint32_t msg_len = len - sizeof(PayloadHeader);
-                if (msg_len == 0) {
-                    continue;  // 空消息
-                }
+        VmStatsC* vm_stats =
+                (VmStatsC*)((uint8_t*)payload + sizeof(PayloadHeader));
+
+        MemoryExchangePacket* mem_packet =
+                (MemoryExchangePacket*)((uint8_t*)payload +
+                                        sizeof(PayloadHeader) +
+                                        sizeof(VmStatsC));
+        if (mem_packet->data_len !=
+            len - sizeof(PayloadHeader) - sizeof(VmStatsC) -
+                    sizeof(MemoryExchangePacket)) {
+            return;  // Length mismatch
+        }
 
-                char* msg_ptr = (char*)(local_buf + sizeof(PayloadHeader));
-                // 临时存储，确保末尾有 '\0'
-                char msg_buf[PACKET_MAX_PAYLOAD_LEN + 1];
-                if (msg_len > PACKET_MAX_PAYLOAD_LEN) {
-                    msg_len = PACKET_MAX_PAYLOAD_LEN;
-                }
-                // 确保字符串以 '\0' 结尾
-                memcpy(msg_buf, msg_ptr, msg_len);
-                msg_buf[msg_len] = '\0';
-                DBG_PRINT("MCU: Called Console.WriteLine, msg = >>>\n%s<<<", msg_buf);
-
-                // 调用用户回调
-                if (handle->console_writeline_callback) {
-                    handle->console_writeline_callback(
-                            msg_buf,
-                            msg_len,
-                            payload_header->timestamp_ms,
-                            handle->console_writeline_callback_ctx);
-                }
-            } else if (command == CommandUploadLowerIoAndVmStats) {
-                // Combined LowerIO + VM Stats (MCU -> PC, per-iteration).
-                // Payload layout: [VmStatsC][MemoryExchangePacket(len + bytes)].
-                // We split it back into the two original callbacks so upper
-                // layers keep seeing separate LowerIO and VmStats events.
-                if (len < sizeof(PayloadHeader) + sizeof(VmStatsC) +
-                                  sizeof(MemoryExchangePacket)) {
-                    continue;  // 数据太短
-                }
+        // Fire VmStats first, then LowerIO (so the latest telemetry is
+        // available before output variables are processed).
+        if (handle->vm_stats_callback) {
+            handle->vm_stats_callback(
+                    vm_stats,
+                    payload_header->timestamp_ms,
+                    handle->vm_stats_callback_ctx);
+        }
 
-                VmStatsC* vm_stats =
-                        (VmStatsC*)((uint8_t*)local_buf + sizeof(PayloadHeader));
-
-                MemoryExchangePacket* mem_packet =
-                        (MemoryExchangePacket*)((uint8_t*)local_buf +
-                                                sizeof(PayloadHeader) +
-                                                sizeof(VmStatsC));
-                if (mem_packet->data_len !=
-                    len - sizeof(PayloadHeader) - sizeof(VmStatsC) -
-                            sizeof(MemoryExchangePacket)) {
-                    continue;  // Length mismatch
-                }
+        if (handle->memory_lower_io_callback && mem_packet->data_len > 0) {
+            handle->memory_lower_io_callback(
+                    mem_packet->data,
+                    mem_packet->data_len,
+                    handle->memory_lower_io_callback_ctx);
+        }
+    } else if (command == CommandError) {
+        // Fatal Error (MCU -> PC, MCU 致命错误上报)
+        // MCU 会连续发送多次（防止丢包），需要时间去重（5秒内不重复触发）
+        if (len < sizeof(PayloadHeader) + sizeof(ErrorPayloadC)) {
+            DBG_PRINT("Fatal Error: Payload too short, len=%u", len);
+            return;
+        }
 
-                // Fire VmStats first, then LowerIO (so the latest telemetry is
-                // available before output variables are processed).
-                if (handle->vm_stats_callback) {
-                    handle->vm_stats_callback(
-                            vm_stats,
-                            payload_header->timestamp_ms,
-                            handle->vm_stats_callback_ctx);
-                }
+        ErrorPayloadC* error_payload =
+                (ErrorPayloadC*)((uint8_t*)payload + sizeof(PayloadHeader));
 
-                if (handle->memory_lower_io_callback && mem_packet->data_len > 0) {
-                    handle->memory_lower_io_callback(
-                            mem_packet->data,
-                            mem_packet->data_len,
-                            handle->memory_lower_io_callback_ctx);
-                }
-            } else if (command == CommandError) {
-                // Fatal Error (MCU -> PC, MCU 致命错误上报)
-                // MCU 会连续发送多次（防止丢包），需要时间去重（5秒内不重复触发）
-                if (len < sizeof(PayloadHeader) + sizeof(ErrorPayloadC)) {
-                    DBG_PRINT("Fatal Error: Payload too short, len=%u", len);
-                    continue;
-                }
+        // 时间去重：距离上次触发超过 5 秒才触发
+        uint64_t now_ms = GetTickCount64();
+        uint64_t elapsed_ms = now_ms - handle->last_fatal_error_time_ms;
+        
+        if (elapsed_ms >= 5000) {
+            handle->last_fatal_error_time_ms = now_ms;
+            
+            DBG_PRINT(
+                    "Fatal Error: version=%u, il_offset=%d, line=%d, layout=%u, seq=%u",
+                    error_payload->payload_version,
+                    error_payload->debug_info.il_offset,
+                    error_payload->debug_info.line_no,
+                    error_payload->core_dump_layout,
+                    seq);
+            
+            if (handle->fatal_error_callback) {
+                handle->fatal_error_callback(
+                        error_payload,
+                        handle->fatal_error_callback_ctx);
+            }
+        } else {
+            DBG_PRINT("Fatal Error: Duplicate within 5s (elapsed=%llums), seq=%u skipped",
+                      (unsigned long long)elapsed_ms, seq);
+        }
+    } else {
+        // -------------------------------
+        // 找到对应的 SeqWaiter
+        // -------------------------------
+        SeqWaiter* waiter = NULL;
+        for (int i = 0; i < MAX_PENDING_SEQ; i++) {
+            EnterCriticalSection(&handle->pending[i].mtx);
+            if (handle->pending[i].in_use &&
+                handle->pending[i].seq == seq) {
+                waiter = &handle->pending[i];
+                LeaveCriticalSection(&handle->pending[i].mtx);
+                break;
+            }
+            LeaveCriticalSection(&handle->pending[i].mtx);
+        }
 
-                ErrorPayloadC* error_payload =
-                        (ErrorPayloadC*)((uint8_t*)local_buf + sizeof(PayloadHeader));
+        if (waiter) {
+            // 设置结果并唤醒
+            EnterCriticalSection(&waiter->mtx);
+            waiter->result =
+                    (MCUSerialBridgeError)payload_header->error_code;
+            waiter->done_flag = true;
+            // 应答留在缓冲池里，调用方取完数据再释放
+            if (waiter->reply) {
+                packet_release(&handle->receive_pool, waiter->reply);
+            }
+            packet_retain(pkt);
+            waiter->reply = pkt;
+            LeaveCriticalSection(&waiter->mtx);
 
-                // 时间去重：距离上次触发超过 5 秒才触发
-                uint64_t now_ms = GetTickCount64();
-                uint64_t elapsed_ms = now_ms - handle->last_fatal_error_time_ms;
-                
-                if (elapsed_ms >= 5000) {
-                    handle->last_fatal_error_time_ms = now_ms;
-                    
-                    DBG_PRINT(
-                            "Fatal Error: version=%u, il_offset=%d, line=%d, layout=%u, seq=%u",
-                            error_payload->payload_version,
-                            error_payload->debug_info.il_offset,
-                            error_payload->debug_info.line_no,
-                            error_payload->core_dump_layout,
-                            seq);
-                    
-                    if (handle->fatal_error_callback) {
-                        handle->fatal_error_callback(
-                                error_payload,
-                                handle->fatal_error_callback_ctx);
-                    }
-                } else {
-                    DBG_PRINT("Fatal Error: Duplicate within 5s (elapsed=%llums), seq=%u skipped",
-                              (unsigned long long)elapsed_ms, seq);
-                }
-            } else {
-                // -------------------------------
-                // 找到对应的 SeqWaiter
-                // -------------------------------
-                SeqWaiter* waiter = NULL;
-                for (int i = 0; i < MAX_PENDING_SEQ; i++) {
-                    EnterCriticalSection(&handle->pending[i].mtx);
-                    if (handle->pending[i].in_use &&
-                        handle->pending[i].seq == seq) {
-                        waiter = &handle->pending[i];
-                        LeaveCriticalSection(&handle->pending[i].mtx);
-                        break;
-                    }
-                    LeaveCriticalSection(&handle->pending[i].mtx);
-                }
+            WakeConditionVariable(&waiter->cnd);
+        } else {
+            DBG_PRINT(
+                    "Parse: ERROR, Sequence[%u] not pending, "
+                    "result=%08X",
+                    seq,
+                    payload_header->error_code);
+        }
+    }
+}
 
-                if (waiter) {
-                    // 设置结果并唤醒
-                    EnterCriticalSection(&waiter->mtx);
-                    waiter->result =
-                            (MCUSerialBridgeError)payload_header->error_code;
-                    waiter->done_flag = true;
-                    memset(&waiter->return_data, 0, RETURN_DATA_MAX_SIZE);
-                    if (len > sizeof(PayloadHeader)) {
-                        uint32_t return_data_size = len - sizeof(PayloadHeader);
-                        if (return_data_size > RETURN_DATA_MAX_SIZE) {
-                            return_data_size = RETURN_DATA_MAX_SIZE;
-                        }
-                        memcpy(&waiter->return_data,
-                               local_buf + sizeof(PayloadHeader),
-                               return_data_size);
-                    }
-                    LeaveCriticalSection(&waiter->mtx);
+// --------------------
+// 解析线程
+// --------------------
+DWORD WINAPI parse_thread_func(LPVOID param)
+{
+    DBG_PRINT("Thread: Parse thread started");
 
-                    WakeConditionVariable(&waiter->cnd);
-                } else {
-                    DBG_PRINT(
-                            "Parse: ERROR, Sequence[%u] not pending, "
-                            "result=%08X",
-                            seq,
-                            payload_header->error_code);
-                }
-            }
+    msb_handle* handle = (msb_handle*)param;
+
+    while (handle && handle->is_open) {
+        PacketBuf* pkt = packet_queue_pop(&handle->receive_queue);
+        if (pkt) {
+            msb_parse_packet(handle, pkt);
+            packet_release(&handle->receive_pool, pkt);
         } else {
-            Sleep(READ_SLEEP_MS);  // 队列空，休眠
+            // 队列空，等 recv 线程入队
+            WaitForSingleObject(handle->rx_event, IDLE_WAIT_MS);
         }
     }
     DBG_PRINT("Thread: Parse thread exited");
     return 0;
 }
 
+// --------------------
+// 串口读写 / 等数据
+// --------------------
+// Windows 上串口以 FILE_FLAG_OVERLAPPED 打开：每个线程带自己的 OVERLAPPED
+// （hEvent 为 manual-reset），读写发起后等它完成，对调用方仍是同步语义。
+// POSIX 忽略 overlapped。
+static BOOL msb_comm_read(HANDLE comm, void* buf, DWORD len, DWORD* read, void* overlapped)
+{
+#ifdef _WIN32
+    OVERLAPPED* ov = (OVERLAPPED*)overlapped;
+    *read = 0;
+    if (!ReadFile(comm, buf, len, NULL, ov) && GetLastError() != ERROR_IO_PENDING) {
+        return FALSE;
+    }
+    return GetOverlappedResult(comm, ov, read, TRUE);
+#else
+    (void)overlapped;
+    return ReadFile(comm, buf, len, read, NULL);
+#endif
+}
+
+#ifdef _WIN32
+static BOOL msb_comm_write(
+        HANDLE comm,
+        const void* buf,
+        DWORD len,
+        DWORD* written,
+        OVERLAPPED* ov)
+{
+    *written = 0;
+    if (!WriteFile(comm, buf, len, NULL, ov) && GetLastError() != ERROR_IO_PENDING) {
+        return FALSE;
+    }
+    return GetOverlappedResult(comm, ov, written, TRUE);
+}
+#endif
+
+// 等待期间不占 comm_lock，发送线程可以照常写；msb_close / 重连用 CancelIoEx 唤醒。
+static void msb_wait_comm_input(msb_handle* handle, void* overlapped)
+{
+#ifdef _WIN32
+    // 挂一个 WaitCommEvent(EV_RXCHAR)。驱动记录上次等待以来到达过的字符，
+    // ReadFile 读空之后才到的字节不会漏掉（代价是读完后的第一次等待可能直接返回）。
+    OVERLAPPED* ov = (OVERLAPPED*)overlapped;
+    DWORD mask = 0;
+    BOOL pending = FALSE;
+    EnterCriticalSection(&handle->comm_lock);
+    HANDLE comm = handle->hComm;
+    if (is_comm_valid(comm)) {
+        ResetEvent(ov->hEvent);
+        if (WaitCommEvent(comm, &mask, ov)) {
+            LeaveCriticalSection(&handle->comm_lock);
+            return;
+        }
+        pending = GetLastError() == ERROR_IO_PENDING;
+    }
+    LeaveCriticalSection(&handle->comm_lock);
+    if (!pending) {
+        // 句柄无效或等待失败，交给下一次 ReadFile 报错 / 重连
+        Sleep(READ_SLEEP_MS);
+        return;
+    }
+
+    if (WaitForSingleObject(ov->hEvent, IDLE_WAIT_MS) != WAIT_OBJECT_0) {
+        EnterCriticalSection(&handle->comm_lock);
+        if (handle->hComm == comm) {
+            CancelIoEx(comm, ov);
+        }
+        LeaveCriticalSection(&handle->comm_lock);
+        // 取消或关闭句柄后挂起的等待都会完成，ov 之后才能复用
+        WaitForSingleObject(ov->hEvent, INFINITE);
+    }
+#else
+    // 阻塞在 fd 上，CancelIoEx 通过 eventfd 唤醒
+    (void)overlapped;
+    EnterCriticalSection(&handle->comm_lock);
+    if (is_comm_valid(handle->hComm)) {
+        WaitCommInputCS(handle->hComm, &handle->comm_lock, IDLE_WAIT_MS);
+    }
+    LeaveCriticalSection(&handle->comm_lock);
+#endif
+}
+
 // --------------------
 // 接收线程
 // --------------------
@@ -652,6 +720,18 @@ DWORD WINAPI recv_thread_func(LPVOID param)
     DWORD last_read_err = 0;
     uint64_t last_read_log_ms = 0;
     uint32_t suppressed_read_errors = 0;
+#ifdef _WIN32
+    // 读和等数据共用
+    OVERLAPPED rx_ov = {0};
+    rx_ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!rx_ov.hEvent) {
+        DBG_PRINT("Thread: Receive thread cannot create overlapped event");
+        return 1;
+    }
+    void* overlapped = &rx_ov;
+#else
+    void* overlapped = NULL;
+#endif
 
     while (handle && handle->is_open) {
         DWORD bytesRead = 0;
@@ -661,12 +741,12 @@ DWORD WINAPI recv_thread_func(LPVOID param)
         BOOL read_ok = FALSE;
         EnterCriticalSection(&handle->comm_lock);
         if (is_comm_valid(handle->hComm)) {
-            read_ok = ReadFile(
+            read_ok = msb_comm_read(
                     handle->hComm,
                     linear_buffer + head,
                     (DWORD)max_read,
                     &bytesRead,
-                    NULL);
+                    overlapped);
         } else {
             SetLastError(ERROR_INVALID_HANDLE);
             read_ok = FALSE;
@@ -730,11 +810,12 @@ DWORD WINAPI recv_thread_func(LPVOID param)
         msb_clear_reconnect_state(handle);
 
         if (bytesRead == 0) {
-            Sleep(READ_SLEEP_MS);
+            msb_wait_comm_input(handle, overlapped);
             continue;
         }
 
         head += bytesRead;
+        bool enqueued = false;
 
         // --------------------
         // 粘包解析
@@ -774,9 +855,21 @@ DWORD WINAPI recv_thread_func(LPVOID param)
             if (head - tail < payload_len + PACKET_OFFLOAD_SIZE)
                 break;  // 整包没到
 
+            // 尾检查放在 CRC 前面：重同步时大多数假帧头在这里就被排除，
+            // 不用对整段假负载算一遍 CRC
+            if (linear_buffer[offset + PACKET_OFFLOAD_SIZE + payload_len - 2] !=
+                        PACKET_TAIL_1_2 ||
+                linear_buffer[offset + PACKET_OFFLOAD_SIZE + payload_len - 1] !=
+                        PACKET_TAIL_1_2) {
+                DBG_PRINT("Receive: Packet Tail Mismatched, "
+                          "skipped!");
+                tail++;
+                continue;
+            }
+
             // CRC检查
             uint16_t checked_crc =
-                    calculate_crc16(linear_buffer + offset + 6, payload_len);
+                    msb_crc16(linear_buffer + offset + 6, payload_len);
             uint32_t crc_offset = offset + 6 + payload_len;
             uint16_t reported_crc =
                     (uint16_t)linear_buffer[crc_offset] +
@@ -788,26 +881,20 @@ DWORD WINAPI recv_thread_func(LPVOID param)
                 continue;
             }
 
-            // 尾检查
-            if (linear_buffer[offset + PACKET_OFFLOAD_SIZE + payload_len - 2] !=
-                        PACKET_TAIL_1_2 ||
-                linear_buffer[offset + PACKET_OFFLOAD_SIZE + payload_len - 1] !=
-                        PACKET_TAIL_1_2) {
-                DBG_PRINT("Receive: Packet Tail Mismatched, "
-                          "skipped!");
-                tail++;
-                continue;
-            }
-
             // 整包合法，入队RingQueue
             if (!receive_ring_enqueue(
                         handle, linear_buffer + offset + 6, payload_len)) {
                 DBG_PRINT("Receive: RingQueue is full, can not enqueue!");
+            } else {
+                enqueued = true;
             }
 
             // 移动到下一包
             tail += payload_len + PACKET_OFFLOAD_SIZE;
         }
+        if (enqueued) {
+            SetEvent(handle->rx_event);  // 一次读到的包只唤醒 parse 一次
+        }
 
         // --------------------
         // 回收线性缓冲区
@@ -824,57 +911,170 @@ DWORD WINAPI recv_thread_func(LPVOID param)
         }
     }
 
+#ifdef _WIN32
+    CloseHandle(rx_ov.hEvent);
+#endif
     DBG_PRINT("Thread: Receive thread exited");
     return 0;
 }
 
 
+// --------------------
+// 在发送槽位上原地组帧，返回整帧长度
+// --------------------
+static uint32_t msb_frame_entry(PayloadEntry* entry)
+{
+    entry->header[0] = PACKET_HEADER_1;
+    entry->header[1] = PACKET_HEADER_2;
+    entry->header[2] = (uint8_t)(entry->len & 0xFF);
+    entry->header[3] = (uint8_t)((entry->len >> 8) & 0xFF);
+    entry->header[4] = (uint8_t) ~(entry->header[3]);
+    entry->header[5] = (uint8_t) ~(entry->header[2]);
+
+    // CRC直接写在payload后面
+    uint16_t crc = msb_crc16(entry->payload, entry->len);
+    entry->payload[entry->len] = crc & 0xFF;
+    entry->payload[entry->len + 1] = (crc >> 8) & 0xFF;
+
+    // 尾巴
+    entry->payload[entry->len + 2] = PACKET_TAIL_1_2;
+    entry->payload[entry->len + 3] = PACKET_TAIL_1_2;
+
+    return entry->len + PACKET_OFFLOAD_SIZE;
+}
+
+// --------------------
+// 收集要合并成一次写的帧：队头一定发，后面已提交的帧在字节上限内一起发。
+// 上限按 MCU 上行 DMA 接收缓冲取，整批在 MCU 侧落在同一个空闲块里，
+// MCU 的 packet_parse 会逐帧解析。linger_ms > 0 时不满上限会再等一会。
+// --------------------
+static uint32_t msb_collect_batch(
+        msb_handle* handle,
+        PayloadEntry** batch,
+        uint32_t* out_total_len)
+{
+    uint32_t max_bytes = handle->write_batch_max_bytes;
+    uint32_t linger_ms = handle->write_batch_linger_ms;
+    uint64_t linger_deadline_ms = GetTickCount64() + linger_ms;
+    uint32_t count = 0;
+    uint32_t total_len = 0;
+
+    while (count < WRITE_BATCH_MAX_FRAMES) {
+        PayloadEntry* entry = send_queue_peek(&handle->send_queue, count);
+        if (!entry) {
+            uint64_t now_ms = GetTickCount64();
+            if (count > 0 && total_len < max_bytes && now_ms < linger_deadline_ms &&
+                handle->is_open) {
+                WaitForSingleObject(handle->tx_event, (DWORD)(linger_deadline_ms - now_ms));
+                continue;
+            }
+            break;
+        }
+        uint32_t frame_len = entry->len + PACKET_OFFLOAD_SIZE;
+        if (count > 0 && total_len + frame_len > max_bytes) {
+            break;
+        }
+        batch[count++] = entry;
+        total_len += msb_frame_entry(entry);
+    }
+
+    *out_total_len = total_len;
+    return count;
+}
+
+// 单调时钟（us）。GetTickCount64 在 Windows 上按 10~16ms 跳变，量不出 2ms 的帧间隔。
+static uint64_t msb_now_us(void)
+{
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    uint64_t f = (uint64_t)freq.QuadPart;
+    uint64_t c = (uint64_t)count.QuadPart;
+    return c / f * 1000000u + c % f * 1000000u / f;
+}
+
+// 距上一次写不足 WRITE_SLEEP_MS 时睡到补足；Sleep 可能提前醒，按时钟复查
+static void msb_frame_gap(uint64_t last_write_us)
+{
+    for (;;) {
+        uint64_t since_us = msb_now_us() - last_write_us;
+        if (since_us >= WRITE_SLEEP_MS * 1000u) {
+            return;
+        }
+        Sleep((DWORD)((WRITE_SLEEP_MS * 1000u - since_us + 999u) / 1000u));
+    }
+}
+
 DWORD WINAPI send_thread_func(LPVOID param)
 {
     DBG_PRINT("Thread: Send thread started");
 
     msb_handle* handle = (msb_handle*)param;
+    uint64_t last_write_us = 0;
+    PayloadEntry* batch[WRITE_BATCH_MAX_FRAMES];
+#ifdef _WIN32
+    // 串口句柄上没有聚集写，多帧时先拼到连续缓冲里再一次 WriteFile
+    uint8_t batch_buf[WRITE_BATCH_LIMIT_BYTES];
+    OVERLAPPED tx_ov = {0};
+    tx_ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!tx_ov.hEvent) {
+        DBG_PRINT("Thread: Send thread cannot create overlapped event");
+        return 1;
+    }
+#else
+    struct iovec iov[WRITE_BATCH_MAX_FRAMES];
+#endif
 
     while (handle && handle->is_open) {
-        if (handle->send_queue.head != handle->send_queue.tail) {
-            PayloadEntry* entry =
-                    &handle->send_queue.entries[handle->send_queue.tail];
-
-            // --------- 直接在内存上组帧 ----------
-            entry->header[0] = PACKET_HEADER_1;
-            entry->header[1] = PACKET_HEADER_2;
-            entry->header[2] = (uint8_t)(entry->len & 0xFF);
-            entry->header[3] = (uint8_t)((entry->len >> 8) & 0xFF);
-            entry->header[4] = (uint8_t) ~(entry->header[3]);
-            entry->header[5] = (uint8_t) ~(entry->header[2]);
-
-            // CRC直接写在payload后面
-            uint16_t crc = calculate_crc16(entry->payload, entry->len);
-            entry->payload[entry->len] = crc & 0xFF;
-            entry->payload[entry->len + 1] = (crc >> 8) & 0xFF;
-
-            // 尾巴
-            entry->payload[entry->len + 2] = PACKET_TAIL_1_2;
-            entry->payload[entry->len + 3] = PACKET_TAIL_1_2;
-
-            // 写总长度
-            uint32_t total_len = entry->len + PACKET_OFFLOAD_SIZE;
+        if (send_queue_front(&handle->send_queue)) {
+            // 帧间隔：只在紧跟上一次写时补足，空闲后的第一次写立即发
+            msb_frame_gap(last_write_us);
+
+            // 间隔期间新入队的帧一起合并
+            uint32_t total_len = 0;
+            uint32_t count = msb_collect_batch(handle, batch, &total_len);
 
             // 发送
             DWORD bytesWritten = 0;
             BOOL write_ok = FALSE;
             EnterCriticalSection(&handle->comm_lock);
             if (is_comm_valid(handle->hComm)) {
-                write_ok = WriteFile(
-                        handle->hComm,
-                        entry->header,
-                        total_len,
-                        &bytesWritten,
-                        NULL);
+#ifdef _WIN32
+                const uint8_t* src = batch[0]->header;
+                if (count > 1) {
+                    uint32_t off = 0;
+                    for (uint32_t i = 0; i < count; i++) {
+                        uint32_t len = batch[i]->len + PACKET_OFFLOAD_SIZE;
+                        memcpy(batch_buf + off, batch[i]->header, len);
+                        off += len;
+                    }
+                    src = batch_buf;
+                }
+                write_ok = msb_comm_write(
+                        handle->hComm, src, total_len, &bytesWritten, &tx_ov);
+#else
+                for (uint32_t i = 0; i < count; i++) {
+                    iov[i].iov_base = batch[i]->header;
+                    iov[i].iov_len = batch[i]->len + PACKET_OFFLOAD_SIZE;
+                }
+                write_ok = WriteFileV(handle->hComm, iov, (int)count, &bytesWritten);
+#endif
             } else {
                 SetLastError(ERROR_INVALID_HANDLE);
                 write_ok = FALSE;
             }
+            if (write_ok) {
+                SendStatsC* st = &handle->send_stats;
+                st->frames += count;
+                st->bytes += total_len;
+                st->writes++;
+                if (count > st->max_frames_per_write) {
+                    st->max_frames_per_write = count;
+                }
+                if (total_len > st->max_bytes_per_write) {
+                    st->max_bytes_per_write = total_len;
+                }
+            }
             LeaveCriticalSection(&handle->comm_lock);
 
             if (!write_ok) {
@@ -900,70 +1100,19 @@ DWORD WINAPI send_thread_func(LPVOID param)
             } else {
                 msb_clear_reconnect_state(handle);
             }
-            Sleep(WRITE_SLEEP_MS);
+            last_write_us = msb_now_us();
 
-            // 出队
-            handle->send_queue.tail++;
+            // 出队，槽位还给生产者
+            send_queue_pop_n(&handle->send_queue, count);
         } else {
-            Sleep(1);  // 队列空
+            // 队列空，等 send_payload 入队
+            WaitForSingleObject(handle->tx_event, IDLE_WAIT_MS);
         }
     }
 
+#ifdef _WIN32
+    CloseHandle(tx_ov.hEvent);
+#endif
     DBG_PRINT("Thread: Send thread exited");
     return 0;
 }
-
-
-/**
- * @brief 计算给定数据的 CRC16（Modbus CRC16 算法）
- *
- * @param data 数据指针
- * @param len  数据长度
- * @return CRC16 校验值
- */
-uint16_t calculate_crc16(const uint8_t* data, uint32_t len)
-{
-    static const uint16_t CRC16Table[256] =
-            {0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
-             0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
-             0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
-             0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
-             0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
-             0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
-             0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
-             0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
-             0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
-             0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
-             0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
-             0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
-             0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
-             0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
-             0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
-             0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
-             0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
-             0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
-             0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
-             0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
-             0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
-             0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
-             0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
-             0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
-             0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
-             0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
-             0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
-             0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
-             0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
-             0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
-             0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
-             0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040};
-
-    uint16_t crc = 0xffff;  // 初始化
-    uint8_t temp;
-
-    while (len-- > 0) {
-        temp = crc & 0xFF;
-        crc = (crc >> 8) ^ CRC16Table[(temp ^ *data++) & 0xFF];
-    }
-
-    return crc;
-}
@@ -0,0 +1,265 @@
+// bench_loopback.c
+//
+// 串口桥往返延迟基准（POSIX）：用伪终端对代替真实串口，主端由本程序里的
+// 假 MCU 线程应答，从端交给 msb_open。每次 msb_reset 走完整的
+// API→send 线程→串口→假 MCU→串口→recv 线程→parse 线程→唤醒调用方。
+//
+// 用法: bench_loopback [次数=2000] [请求间隔 us=0] [并发线程=1] [合并上限字节=1024]
+// 桥的发送线程保证相邻两次写至少间隔 WRITE_SLEEP_MS，连续请求时往返时间
+// 以它为下限；给一个大于它的间隔（如 3000）可以只看链路本身的延迟。
+// 并发线程 > 1 时多个线程同时发请求，间隔期间入队的帧会合并成一次写，
+// 结束时打印 msb_get_send_stats 的每次写帧数 / 字节数。合并上限给 0 即逐帧写。
+// MCU Bridge 的 DBG_PRINT 写 stdout，结果写 stderr：
+//   ./build/bench_loopback > /dev/null
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msb_bridge.h"
+#include "msb_protocol.h"
+
+static int g_master = -1;
+static volatile int g_running = 1;
+
+static uint16_t crc16_modbus(const uint8_t* data, uint32_t len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len-- > 0) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0xA001) : (uint16_t)(crc >> 1);
+        }
+    }
+    return crc;
+}
+
+static void write_all(int fd, const uint8_t* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+// 假 MCU：收到完整帧后原样回一个 command / sequence 相同、error_code=0 的应答。
+static void* fake_mcu_thread(void* arg)
+{
+    (void)arg;
+    static uint8_t buf[65536];
+    size_t have = 0;
+    while (g_running) {
+        ssize_t n = read(g_master, buf + have, sizeof(buf) - have);
+        if (n <= 0) {
+            continue;
+        }
+        have += (size_t)n;
+
+        size_t pos = 0;
+        while (have - pos >= PACKET_MIN_VALID_LEN) {
+            uint8_t* p = buf + pos;
+            if (p[0] != PACKET_HEADER_1 || p[1] != PACKET_HEADER_2) {
+                pos++;
+                continue;
+            }
+            uint16_t len = (uint16_t)(p[2] | (p[3] << 8));
+            if (have - pos < len + PACKET_OFFLOAD_SIZE) {
+                break;
+            }
+
+            uint8_t reply[PACKET_OFFLOAD_SIZE + sizeof(PayloadHeader)];
+            PayloadHeader* req = (PayloadHeader*)(p + 6);
+            PayloadHeader* rsp = (PayloadHeader*)(reply + 6);
+            uint16_t rlen = sizeof(PayloadHeader);
+            reply[0] = PACKET_HEADER_1;
+            reply[1] = PACKET_HEADER_2;
+            reply[2] = (uint8_t)(rlen & 0xFF);
+            reply[3] = (uint8_t)(rlen >> 8);
+            reply[4] = (uint8_t)~reply[3];
+            reply[5] = (uint8_t)~reply[2];
+            rsp->command = req->command;
+            rsp->sequence = req->sequence;
+            rsp->timestamp_ms = 0;
+            rsp->error_code = 0;
+            uint16_t crc = crc16_modbus(reply + 6, rlen);
+            reply[6 + rlen] = (uint8_t)(crc & 0xFF);
+            reply[7 + rlen] = (uint8_t)(crc >> 8);
+            reply[8 + rlen] = PACKET_TAIL_1_2;
+            reply[9 + rlen] = PACKET_TAIL_1_2;
+            write_all(g_master, reply, sizeof(reply));
+
+            pos += len + PACKET_OFFLOAD_SIZE;
+        }
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+    }
+    return NULL;
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+#define MAX_THREADS 32
+
+typedef struct {
+    msb_handle* handle;
+    int rounds;
+    int gap_us;
+    uint32_t* rtt;
+    int failed;
+} Worker;
+
+static void* worker_thread(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    for (int i = 0; i < w->rounds; i++) {
+        uint64_t a = now_us();
+        if (msb_reset(w->handle, 1000) != MSB_Error_OK) {
+            w->failed++;
+        }
+        w->rtt[i] = (uint32_t)(now_us() - a);
+        if (w->gap_us > 0) {
+            usleep((useconds_t)w->gap_us);
+        }
+    }
+    return NULL;
+}
+
+static double cpu_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    if (rounds <= 0) {
+        rounds = 2000;
+    }
+    int gap_us = argc > 2 ? atoi(argv[2]) : 0;
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    if (threads <= 0 || threads > MAX_THREADS) {
+        threads = 1;
+    }
+    int batch_bytes = argc > 4 ? atoi(argv[4]) : 1024;
+
+    g_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (g_master < 0 || grantpt(g_master) != 0 || unlockpt(g_master) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(g_master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(g_master, TCSANOW, &tio);
+    const char* slave = ptsname(g_master);
+
+    pthread_t mcu;
+    pthread_create(&mcu, NULL, fake_mcu_thread, NULL);
+
+    msb_handle* handle = NULL;
+    MCUSerialBridgeError ret = msb_open(&handle, slave, 1000000);
+    if (ret != MSB_Error_OK) {
+        fprintf(stderr, "msb_open(%s) failed: 0x%08X\n", slave, ret);
+        return 1;
+    }
+
+    msb_set_write_batch(handle, (uint32_t)batch_bytes, 0);
+
+    // 预热
+    for (int i = 0; i < 20; i++) {
+        msb_reset(handle, 1000);
+    }
+    SendStatsC st0;
+    msb_get_send_stats(handle, &st0);
+
+    // 每个线程跑 rounds 次，rtt 汇总到一个数组里排序
+    int samples = rounds * threads;
+    uint32_t* rtt = (uint32_t*)malloc(sizeof(uint32_t) * (size_t)samples);
+    Worker workers[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    int failed = 0;
+    double cpu0 = cpu_ms();
+    uint64_t t0 = now_us();
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (Worker){handle, rounds, gap_us, rtt + t * rounds, 0};
+        pthread_create(&tids[t], NULL, worker_thread, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        failed += workers[t].failed;
+    }
+    uint64_t total = now_us() - t0;
+    double cpu_busy = cpu_ms() - cpu0;
+
+    SendStatsC st;
+    msb_get_send_stats(handle, &st);
+    uint64_t frames = st.frames - st0.frames;
+    uint64_t writes = st.writes - st0.writes;
+    uint64_t bytes = st.bytes - st0.bytes;
+
+    // 空闲 1 秒的 CPU 占用（轮询线程会在这里空转）
+    double cpu1 = cpu_ms();
+    sleep(1);
+    double cpu_idle = cpu_ms() - cpu1;
+
+    qsort(rtt, (size_t)samples, sizeof(uint32_t), cmp_u32);
+    fprintf(stderr,
+            "round trips=%d threads=%d gap=%d us failed=%d total=%.1f ms (%.0f req/s)\n"
+            "rtt us: min=%u p50=%u p90=%u p99=%u max=%u\n"
+            "writes=%llu frames/write=%.2f (max %u) bytes/write=%.1f (max %u, limit %u)\n"
+            "cpu: %.1f ms while busy, %.1f ms per idle second\n",
+            samples,
+            threads,
+            gap_us,
+            failed,
+            total / 1000.0,
+            samples * 1e6 / (double)total,
+            rtt[0],
+            rtt[samples / 2],
+            rtt[samples * 9 / 10],
+            rtt[samples * 99 / 100],
+            rtt[samples - 1],
+            (unsigned long long)writes,
+            writes ? (double)frames / writes : 0.0,
+            st.max_frames_per_write,
+            writes ? (double)bytes / writes : 0.0,
+            st.max_bytes_per_write,
+            st.batch_max_bytes,
+            cpu_busy,
+            cpu_idle);
+
+    g_running = 0;
+    msb_close(handle);
+    close(g_master);
+    pthread_cancel(mcu);
+    pthread_join(mcu, NULL);
+    free(rtt);
+    return failed != 0;
+}
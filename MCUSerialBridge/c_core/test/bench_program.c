@@ -0,0 +1,456 @@
+// bench_program.c
+//
+// 程序下载基准（POSIX）：伪终端对模拟串口链路，本程序里的假 MCU 按固件
+// control_on_program 的规则接收分片（对齐的分片可乱序接收、应答带已连续
+// 收到的长度、最后校验整镜像 CRC32）。链路参数可调：
+//   - 附加延迟：每帧到达假 MCU 后再过 latency_us 才处理（模拟 USB 转串口、
+//     中继节点等带来的往返延迟）；
+//   - 链路波特率：按 10 bit/字节 计算每帧在线上的传输时间，帧排队串行送达；
+//   - 丢包：数据分片按 1/loss_every 的概率丢失，检验重传。
+// 同一个程序先按窗口 1（逐片等应答）下载一次，再按给定窗口下载一次，
+// 比较耗时并核对 MCU 端收到的镜像；这两次关掉缓存查询。之后假 MCU 像 VM
+// 加载那样原地改写缓冲区并复位，打开查询再下载同一个程序应当直接命中，
+// 改动一个字节后应当完整重新下载。
+//
+// 用法: bench_program [程序 KB=40] [延迟 us=5000] [窗口=8] [丢包间隔=0] [波特率=1000000]
+// MCU Bridge 的 DBG_PRINT 写 stdout，结果写 stderr：
+//   ./build/bench_program > /dev/null
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "msb_bridge.h"
+#include "msb_protocol.h"
+
+#define FAKE_PROGRAM_MAX (56 * 1024)
+#define DELAY_QUEUE_SIZE 256
+
+static int g_master = -1;
+static volatile int g_running = 1;
+static uint32_t g_latency_us = 5000;
+static uint32_t g_link_baud = 1000000;
+static uint32_t g_loss_every = 0;
+
+// 假 MCU 的程序接收状态
+static uint8_t g_program[FAKE_PROGRAM_MAX];
+static uint32_t g_program_len = 0;
+static uint32_t g_receiving_offset = 0;
+static uint8_t g_received[FAKE_PROGRAM_MAX / PROGRAM_CHUNK_GRANULE];
+static uint32_t g_out_of_order = 0;
+static int g_programmed = 0;
+static int g_crc_checked = 0;
+static uint32_t g_cache_hits = 0;
+static uint32_t g_chunks_received = 0;
+static uint32_t g_loss_seed = 1;
+// 上次校验通过的 {长度, CRC}，同固件：缓存查询比对它，不重算缓冲区 CRC
+static int g_cached_valid = 0;
+static uint32_t g_cached_len = 0;
+static uint32_t g_cached_crc = 0;
+static uint32_t g_chunks_dropped = 0;
+
+// 到达的帧先进延迟队列，到期后由处理线程按顺序处理
+typedef struct {
+    uint64_t due_us;
+    uint16_t len;
+    uint8_t frame[PACKET_MAX_PAYLOAD_LEN + PACKET_OFFLOAD_SIZE];
+} DelayedFrame;
+
+static DelayedFrame g_delay[DELAY_QUEUE_SIZE];
+static uint32_t g_delay_head = 0, g_delay_tail = 0;
+static pthread_mutex_t g_delay_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_delay_cnd = PTHREAD_COND_INITIALIZER;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+static uint16_t crc16_modbus(const uint8_t* data, uint32_t len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len-- > 0) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0xA001) : (uint16_t)(crc >> 1);
+        }
+    }
+    return crc;
+}
+
+// 逐位计算，和主机端的查表实现互相印证
+static uint32_t crc32_bitwise(const uint8_t* data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len-- > 0) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void write_all(int fd, const uint8_t* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void send_reply(const PayloadHeader* req, uint32_t error_code, const void* data, uint16_t data_len)
+{
+    uint8_t reply[PACKET_OFFLOAD_SIZE + sizeof(PayloadHeader) + 16];
+    PayloadHeader* rsp = (PayloadHeader*)(reply + 6);
+    uint16_t rlen = (uint16_t)(sizeof(PayloadHeader) + data_len);
+    reply[0] = PACKET_HEADER_1;
+    reply[1] = PACKET_HEADER_2;
+    reply[2] = (uint8_t)(rlen & 0xFF);
+    reply[3] = (uint8_t)(rlen >> 8);
+    reply[4] = (uint8_t)~reply[3];
+    reply[5] = (uint8_t)~reply[2];
+    rsp->command = req->command | 0x80;
+    rsp->sequence = req->sequence;
+    rsp->timestamp_ms = 0;
+    rsp->error_code = error_code;
+    memcpy(reply + 6 + sizeof(PayloadHeader), data, data_len);
+    uint16_t crc = crc16_modbus(reply + 6, rlen);
+    reply[6 + rlen] = (uint8_t)(crc & 0xFF);
+    reply[7 + rlen] = (uint8_t)(crc >> 8);
+    reply[8 + rlen] = PACKET_TAIL_1_2;
+    reply[9 + rlen] = PACKET_TAIL_1_2;
+    write_all(g_master, reply, (size_t)rlen + PACKET_OFFLOAD_SIZE);
+}
+
+// 与固件 control_on_program 相同的接收规则
+static uint32_t fake_program(const ProgramPacket* pkt, ProgramAck* ack)
+{
+    ack->next_offset = g_receiving_offset;
+    if (pkt->total_len == 0 || pkt->total_len > FAKE_PROGRAM_MAX) {
+        return MSB_Error_Proto_ProgramTooLarge;
+    }
+    if (pkt->offset == pkt->total_len && pkt->chunk_len == PROGRAM_CRC_CHUNK_LEN) {
+        uint32_t expect;
+        memcpy(&expect, pkt->data, sizeof(expect));
+        if (g_cached_valid && g_cached_len == pkt->total_len && g_cached_crc == expect) {
+            // 缓存命中：缓冲区里是这个镜像（可能已被加载改写）
+            g_program_len = pkt->total_len;
+            g_receiving_offset = pkt->total_len;
+            g_programmed = 1;
+            g_crc_checked = 1;
+            g_cache_hits++;
+            ack->next_offset = g_receiving_offset;
+            return MSB_Error_OK;
+        }
+        int complete = pkt->total_len == g_program_len && g_receiving_offset == g_program_len;
+        if (!complete) {
+            return MSB_Error_Proto_ProgramInvalidOffset;
+        }
+        if (crc32_bitwise(g_program, pkt->total_len) != expect) {
+            g_programmed = 0;
+            return MSB_Error_Proto_Checksum;
+        }
+        g_cached_valid = 1;
+        g_cached_len = pkt->total_len;
+        g_cached_crc = expect;
+        g_crc_checked = 1;
+        ack->next_offset = g_receiving_offset;
+        return MSB_Error_OK;
+    }
+    if (pkt->offset + pkt->chunk_len > pkt->total_len) {
+        return MSB_Error_Proto_InvalidPayload;
+    }
+    g_chunks_received++;
+    if (pkt->offset == 0) {
+        g_program_len = pkt->total_len;
+        g_receiving_offset = 0;
+        g_programmed = 0;
+        g_crc_checked = 0;
+        g_cached_valid = 0;
+        memset(g_program, 0, sizeof(g_program));
+        memset(g_received, 0, sizeof(g_received));
+    }
+    if (pkt->total_len != g_program_len) {
+        return MSB_Error_Proto_ProgramInvalidOffset;
+    }
+    uint32_t end = pkt->offset + pkt->chunk_len;
+    if (pkt->offset <= g_receiving_offset) {
+        if (end > g_receiving_offset) {
+            uint32_t skip = g_receiving_offset - pkt->offset;
+            memcpy(g_program + g_receiving_offset, pkt->data + skip, end - g_receiving_offset);
+            g_receiving_offset = end;
+        }
+    } else if (pkt->offset % PROGRAM_CHUNK_GRANULE == 0 &&
+               (pkt->chunk_len % PROGRAM_CHUNK_GRANULE == 0 || end == g_program_len)) {
+        memcpy(g_program + pkt->offset, pkt->data, pkt->chunk_len);
+        for (uint32_t g = pkt->offset / PROGRAM_CHUNK_GRANULE; g * PROGRAM_CHUNK_GRANULE < end; g++) {
+            g_received[g] = 1;
+        }
+        g_out_of_order++;
+    } else {
+        return MSB_Error_Proto_ProgramInvalidOffset;
+    }
+    while (g_receiving_offset < g_program_len && g_received[g_receiving_offset / PROGRAM_CHUNK_GRANULE]) {
+        g_receiving_offset = (g_receiving_offset / PROGRAM_CHUNK_GRANULE + 1) * PROGRAM_CHUNK_GRANULE;
+        if (g_receiving_offset > g_program_len) {
+            g_receiving_offset = g_program_len;
+        }
+    }
+    ack->next_offset = g_receiving_offset;
+    if (g_receiving_offset >= g_program_len) {
+        g_programmed = 1;
+    }
+    return MSB_Error_OK;
+}
+
+// 模拟 VM 加载运行程序：像 vm_predecode_methods 一样原地改写 opcode
+static uint32_t fake_run_program(void)
+{
+    uint32_t rewritten = 0;
+    for (uint32_t i = 0; i < g_program_len; i++) {
+        if (g_program[i] == 0x15) {
+            g_program[i] = 0xF0;
+        } else if (g_program[i] == 0x7B) {
+            g_program[i] = 0xF3;
+        } else if (g_program[i] == 0x7D) {
+            g_program[i] = 0xF4;
+        } else {
+            continue;
+        }
+        rewritten++;
+    }
+    return rewritten;
+}
+
+static void* fake_mcu_worker(void* arg)
+{
+    (void)arg;
+    while (g_running) {
+        pthread_mutex_lock(&g_delay_mtx);
+        while (g_running && g_delay_head == g_delay_tail) {
+            pthread_cond_wait(&g_delay_cnd, &g_delay_mtx);
+        }
+        if (!g_running) {
+            pthread_mutex_unlock(&g_delay_mtx);
+            break;
+        }
+        DelayedFrame* f = &g_delay[g_delay_tail % DELAY_QUEUE_SIZE];
+        pthread_mutex_unlock(&g_delay_mtx);
+
+        uint64_t t = now_us();
+        if (f->due_us > t) {
+            usleep((useconds_t)(f->due_us - t));
+        }
+
+        const PayloadHeader* req = (const PayloadHeader*)(f->frame + 6);
+        if (req->command == CommandProgram) {
+            ProgramAck ack;
+            uint32_t err = fake_program((const ProgramPacket*)(req + 1), &ack);
+            send_reply(req, err, &ack, sizeof(ack));
+        } else {
+            send_reply(req, MSB_Error_OK, NULL, 0);
+        }
+
+        pthread_mutex_lock(&g_delay_mtx);
+        g_delay_tail++;
+        pthread_cond_signal(&g_delay_cnd);
+        pthread_mutex_unlock(&g_delay_mtx);
+    }
+    return NULL;
+}
+
+// 收完整帧，按链路波特率和附加延迟算出到期时间后放进延迟队列
+static void* fake_mcu_reader(void* arg)
+{
+    (void)arg;
+    static uint8_t buf[65536];
+    size_t have = 0;
+    uint64_t line_free_us = 0;  // 链路上一帧传完的时间
+    while (g_running) {
+        ssize_t n = read(g_master, buf + have, sizeof(buf) - have);
+        if (n <= 0) {
+            continue;
+        }
+        have += (size_t)n;
+
+        size_t pos = 0;
+        while (have - pos >= PACKET_MIN_VALID_LEN) {
+            uint8_t* p = buf + pos;
+            if (p[0] != PACKET_HEADER_1 || p[1] != PACKET_HEADER_2) {
+                pos++;
+                continue;
+            }
+            uint16_t len = (uint16_t)(p[2] | (p[3] << 8));
+            uint32_t frame_len = len + PACKET_OFFLOAD_SIZE;
+            if (have - pos < frame_len) {
+                break;
+            }
+            pos += frame_len;
+
+            uint64_t t = now_us();
+            uint64_t start = line_free_us > t ? line_free_us : t;
+            line_free_us = start + (g_link_baud ? (uint64_t)frame_len * 10 * 1000000 / g_link_baud : 0);
+
+            const PayloadHeader* req = (const PayloadHeader*)(p + 6);
+            if (req->command == CommandProgram) {
+                const ProgramPacket* pkt = (const ProgramPacket*)(req + 1);
+                // 伪随机丢包，平均每 loss_every 个分片丢一个（固定种子，可复现）
+                g_loss_seed = g_loss_seed * 1103515245u + 12345u;
+                if (pkt->offset < pkt->total_len && g_loss_every &&
+                    (g_loss_seed >> 16) % g_loss_every == 0) {
+                    g_chunks_dropped++;
+                    continue;  // 线上丢了
+                }
+            }
+
+            pthread_mutex_lock(&g_delay_mtx);
+            while (g_delay_head - g_delay_tail >= DELAY_QUEUE_SIZE) {
+                pthread_cond_wait(&g_delay_cnd, &g_delay_mtx);
+            }
+            DelayedFrame* f = &g_delay[g_delay_head % DELAY_QUEUE_SIZE];
+            f->due_us = line_free_us + g_latency_us;
+            f->len = (uint16_t)frame_len;
+            memcpy(f->frame, p, frame_len);
+            g_delay_head++;
+            pthread_cond_signal(&g_delay_cnd);
+            pthread_mutex_unlock(&g_delay_mtx);
+        }
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+    }
+    return NULL;
+}
+
+static int run_download(msb_handle* handle, const uint8_t* image, uint32_t len, uint32_t window, double* ms)
+{
+    msb_set_program_window(handle, window, 0);
+    g_chunks_dropped = 0;
+    g_chunks_received = 0;
+    g_out_of_order = 0;
+    uint64_t t0 = now_us();
+    MCUSerialBridgeError ret = msb_program(handle, image, len, 1000);
+    *ms = (now_us() - t0) / 1000.0;
+    // 命中缓存时缓冲区可能已被改写，比对记录下的 CRC
+    int image_ok = g_programmed && g_crc_checked && g_program_len == len &&
+                   (g_chunks_received ? memcmp(g_program, image, len) == 0
+                                      : g_cached_crc == crc32_bitwise(image, len));
+    fprintf(stderr,
+            "window=%-2u result=0x%08X image_ok=%d dropped=%u out_of_order=%u "
+            "time=%.1f ms (%.1f KB/s)\n",
+            window,
+            ret,
+            image_ok,
+            g_chunks_dropped,
+            g_out_of_order,
+            *ms,
+            len / 1.024 / *ms);
+    return ret == MSB_Error_OK && image_ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t size_kb = argc > 1 ? (uint32_t)atoi(argv[1]) : 40;
+    if (size_kb == 0 || size_kb * 1024 > FAKE_PROGRAM_MAX) {
+        size_kb = 40;
+    }
+    if (argc > 2) {
+        g_latency_us = (uint32_t)atoi(argv[2]);
+    }
+    uint32_t window = argc > 3 ? (uint32_t)atoi(argv[3]) : 8;
+    if (argc > 4) {
+        g_loss_every = (uint32_t)atoi(argv[4]);
+    }
+    if (argc > 5) {
+        g_link_baud = (uint32_t)atoi(argv[5]);
+    }
+
+    g_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (g_master < 0 || grantpt(g_master) != 0 || unlockpt(g_master) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(g_master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(g_master, TCSANOW, &tio);
+    const char* slave = ptsname(g_master);
+
+    pthread_t reader, worker;
+    pthread_create(&reader, NULL, fake_mcu_reader, NULL);
+    pthread_create(&worker, NULL, fake_mcu_worker, NULL);
+
+    msb_handle* handle = NULL;
+    MCUSerialBridgeError ret = msb_open(&handle, slave, g_link_baud ? g_link_baud : 1000000);
+    if (ret != MSB_Error_OK) {
+        fprintf(stderr, "msb_open(%s) failed: 0x%08X\n", slave, ret);
+        return 1;
+    }
+
+    uint32_t len = size_kb * 1024;
+    uint8_t* image = (uint8_t*)malloc(len);
+    for (uint32_t i = 0; i < len; i++) {
+        image[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+
+    fprintf(stderr,
+            "program=%u KB latency=%u us link=%u baud loss_every=%u\n",
+            size_kb,
+            g_latency_us,
+            g_link_baud,
+            g_loss_every);
+    double ms_serial = 0, ms_window = 0, ms_cached = 0, ms_changed = 0;
+    msb_set_program_cache(handle, 0);
+    int ok = run_download(handle, image, len, 1, &ms_serial);
+    ok &= run_download(handle, image, len, window, &ms_window);
+    fprintf(stderr, "speedup=%.1fx\n", ms_serial / ms_window);
+
+    // 程序运行过（缓冲区被改写）后模拟 MCU 复位：接收状态清零，缓冲区和记录还在
+    msb_set_program_cache(handle, 1);
+    uint32_t rewritten = fake_run_program();
+    g_program_len = 0;
+    g_receiving_offset = 0;
+    g_programmed = 0;
+    ok &= run_download(handle, image, len, window, &ms_cached);
+    int cached_hits = (int)g_cache_hits;
+    image[len / 2] ^= 0x5A;
+    ok &= run_download(handle, image, len, window, &ms_changed);
+    fprintf(stderr,
+            "cache: unchanged image (%u bytes rewritten by load) %s (%.1f ms), "
+            "changed image %s (%.1f ms)\n",
+            rewritten,
+            cached_hits == 1 ? "hit" : "MISSED",
+            ms_cached,
+            g_cache_hits == 1 && g_chunks_received > 0 ? "re-downloaded" : "WRONGLY HIT",
+            ms_changed);
+    ok &= rewritten > 0 && cached_hits == 1 && g_cache_hits == 1 && g_chunks_received > 0;
+
+    g_running = 0;
+    msb_close(handle);
+    pthread_mutex_lock(&g_delay_mtx);
+    pthread_cond_broadcast(&g_delay_cnd);
+    pthread_mutex_unlock(&g_delay_mtx);
+    close(g_master);
+    pthread_cancel(reader);
+    pthread_join(reader, NULL);
+    pthread_join(worker, NULL);
+    free(image);
+    fprintf(stderr, ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
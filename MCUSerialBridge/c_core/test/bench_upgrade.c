@@ -0,0 +1,510 @@
+// bench_upgrade.c
+//
+// 固件升级基准（POSIX）：每个节点一对伪终端，本程序里的假 Bootloader 按
+// UPGRADE.md 的协议应答（同步 / Erase / Write / WriteFast / Verify）。
+// 链路参数可调：
+//   - 附加延迟：每帧到达后再过 latency_us 才处理（USB 转串口等的往返延迟）；
+//   - 链路波特率：按 10 bit/字节 计算每帧在线上的传输时间，帧排队串行送达；
+//   - Flash 写入：每个字 16us（STM32F4 按字编程的典型值），写完才应答；
+//   - 丢帧：快速写帧按 1/loss_every 的概率丢失，检验回退重发。
+// 先让节点 0 按旧协议（不回能力块，64 字节一问一答）升级一次，再按快速升级
+// 升级一次；最后所有节点各自一个线程并行快速升级，比较总耗时。每次都核对
+// 假 Bootloader 收到的镜像。
+//
+// 用法: bench_upgrade [固件 KB=256] [节点数=4] [延迟 us=2000] [丢帧间隔=0] [波特率=460800]
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mbl_bootloader.h"
+
+#define FAKE_FIRMWARE_MAX (1024 * 1024)
+#define FAKE_NODES_MAX 16
+#define DELAY_QUEUE_SIZE 64
+#define FAKE_WINDOW 8
+#define FLASH_WORD_US 16
+
+static uint32_t g_latency_us = 2000;
+static uint32_t g_link_baud = 460800;
+static uint32_t g_loss_every = 0;
+
+typedef struct {
+    uint64_t due_us;
+    uint32_t len;
+    uint8_t frame[MBL_FAST_FRAME_LEN(MBL_FAST_CHUNK_MAX)];
+} DelayedFrame;
+
+// 一个假 Bootloader 节点
+typedef struct {
+    int master;
+    char slave[64];
+    volatile int running;
+    int fast;  // 是否在同步应答后回能力块
+    pthread_t reader, worker;
+
+    uint8_t* flash;
+    uint32_t app_length;
+    uint32_t written;
+    int verified;
+    uint32_t frames_dropped;
+    uint32_t rejected;
+    uint32_t loss_seed;
+
+    DelayedFrame queue[DELAY_QUEUE_SIZE];
+    uint32_t head, tail;
+    pthread_mutex_t mtx;
+    pthread_cond_t cnd;
+} FakeNode;
+
+static FakeNode g_nodes[FAKE_NODES_MAX];
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+// 逐位计算，和主机端的查表实现互相印证
+static uint32_t crc32_bitwise(const uint8_t* data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len-- > 0) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static uint32_t le32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t* p, uint32_t v)
+{
+    memcpy(p, &v, 4);  // 测试只跑在小端主机上
+}
+
+static void write_all(int fd, const uint8_t* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void send_response(FakeNode* node, uint32_t rsp, const uint8_t* payload)
+{
+    uint8_t frame[MBL_FRAME_LEN] = {MBL_FRAME_HEADER_0, MBL_FRAME_HEADER_1};
+    put_le32(frame + 2, rsp);
+    memcpy(frame + 6, payload, MBL_PAYLOAD_LEN);
+    put_le32(frame + 86, crc32_bitwise(frame + 2, MBL_CMD_LEN + MBL_PAYLOAD_LEN));
+    frame[90] = MBL_FRAME_TAIL_0;
+    frame[91] = MBL_FRAME_TAIL_1;
+    write_all(node->master, frame, sizeof(frame));
+}
+
+static void send_error(FakeNode* node, uint32_t rsp, uint32_t code, uint32_t next, uint32_t offset)
+{
+    uint8_t payload[MBL_PAYLOAD_LEN] = {0};
+    put_le32(payload, code);
+    put_le32(payload + 4, next);
+    put_le32(payload + 8, offset);
+    send_response(node, rsp, payload);
+}
+
+// 按顺序写入：重复的块直接应答，跳过了前面的块就拒绝（报告已写入的位置）
+static void fake_write(FakeNode* node, uint32_t cmd, const uint8_t* p)
+{
+    int fast = cmd == MBL_CMD_WRITE_FAST;
+    uint32_t ok = fast ? MBL_RSP_WRITE_FAST_OK : MBL_RSP_WRITE_OK;
+    uint32_t err = fast ? MBL_RSP_WRITE_FAST_ERR : MBL_RSP_WRITE_ERR;
+    uint32_t offset = le32(p), total = le32(p + 4), n = le32(p + 8);
+    const uint8_t* data = p + MBL_FAST_HEADER_LEN;
+
+    if (total != node->app_length || offset + n > total) {
+        send_error(node, err, 0x02, node->written, offset);
+        return;
+    }
+    if (n > (fast ? MBL_FAST_CHUNK_MAX : 64u)) {
+        send_error(node, err, 0x08, node->written, offset);
+        return;
+    }
+    if (offset > node->written) {
+        node->rejected++;
+        send_error(node, err, 0x07, node->written, offset);
+        return;
+    }
+    if (offset + n > node->written) {
+        uint32_t skip = node->written - offset;
+        memcpy(node->flash + node->written, data + skip, n - skip);
+        usleep((useconds_t)((n - skip + 3) / 4 * FLASH_WORD_US));
+        node->written = offset + n;
+    }
+    uint8_t payload[MBL_PAYLOAD_LEN] = {0};
+    put_le32(payload, offset);
+    put_le32(payload + 4, node->written);
+    send_response(node, ok, payload);
+}
+
+static void fake_process(FakeNode* node, const uint8_t* f, uint32_t len)
+{
+    if (len == MBL_SYNC_LEN) {
+        uint8_t rsp[MBL_SYNC_LEN + MBL_CAPS_LEN] = {
+                MBL_SYNC_RX_0, MBL_SYNC_RX_1, MBL_SYNC_RX_2, MBL_SYNC_RX_3,
+                MBL_CAPS_MAGIC_0, MBL_CAPS_MAGIC_1, MBL_CAPS_MAGIC_2, MBL_CAPS_MAGIC_3,
+                (uint8_t)(MBL_FAST_CHUNK_MAX & 0xFF), (uint8_t)(MBL_FAST_CHUNK_MAX >> 8),
+                FAKE_WINDOW, MBL_CAPS_FLAG_VERIFY};
+        write_all(node->master, rsp, node->fast ? sizeof(rsp) : MBL_SYNC_LEN);
+        return;
+    }
+
+    // 帧校验失败直接丢弃，上位机超时重发
+    uint32_t body = len - MBL_HEADER_LEN - MBL_CRC_LEN - MBL_TAIL_LEN;
+    if (le32(f + 2 + body) != crc32_bitwise(f + 2, body) || f[len - 2] != MBL_FRAME_TAIL_0 ||
+        f[len - 1] != MBL_FRAME_TAIL_1) {
+        return;
+    }
+
+    uint32_t cmd = le32(f + 2);
+    const uint8_t* p = f + 6;
+    uint8_t payload[MBL_PAYLOAD_LEN] = {0};
+    switch (cmd) {
+        case MBL_CMD_READ:
+            memcpy(payload, "FAKE-BOOTLOADER", 15);
+            put_le32(payload + 56, node->app_length);
+            send_response(node, MBL_RSP_READ_OK, payload);
+            break;
+        case MBL_CMD_ERASE:
+            node->app_length = le32(p + 40);
+            node->written = 0;
+            node->verified = 0;
+            memset(node->flash, 0xFF, FAKE_FIRMWARE_MAX);
+            send_response(node, MBL_RSP_ERASE_OK, payload);
+            break;
+        case MBL_CMD_WRITE:
+        case MBL_CMD_WRITE_FAST:
+            if (cmd == MBL_CMD_WRITE_FAST && !node->fast) {
+                send_error(node, MBL_RSP_WRITE_ERR, 0x01, 0, 0);
+                break;
+            }
+            fake_write(node, cmd, p);
+            break;
+        case MBL_CMD_VERIFY:
+            if (le32(p) == node->written && le32(p + 4) == crc32_bitwise(node->flash, node->written)) {
+                node->verified = 1;
+                send_response(node, MBL_RSP_VERIFY_OK, payload);
+            } else {
+                send_error(node, MBL_RSP_VERIFY_ERR, 0x0A, node->written, 0);
+            }
+            break;
+        case MBL_CMD_EXIT:
+            send_response(node, MBL_RSP_EXIT_OK, payload);
+            break;
+        default:
+            break;
+    }
+}
+
+static void* fake_worker(void* arg)
+{
+    FakeNode* node = (FakeNode*)arg;
+    while (node->running) {
+        pthread_mutex_lock(&node->mtx);
+        while (node->running && node->head == node->tail) {
+            pthread_cond_wait(&node->cnd, &node->mtx);
+        }
+        if (!node->running) {
+            pthread_mutex_unlock(&node->mtx);
+            break;
+        }
+        DelayedFrame* f = &node->queue[node->tail % DELAY_QUEUE_SIZE];
+        pthread_mutex_unlock(&node->mtx);
+
+        uint64_t t = now_us();
+        if (f->due_us > t) {
+            usleep((useconds_t)(f->due_us - t));
+        }
+        fake_process(node, f->frame, f->len);
+
+        pthread_mutex_lock(&node->mtx);
+        node->tail++;
+        pthread_cond_signal(&node->cnd);
+        pthread_mutex_unlock(&node->mtx);
+    }
+    return NULL;
+}
+
+// 切出完整的帧（同步帧 / 定长帧 / 快速写帧），按链路波特率和附加延迟算出
+// 到期时间后放进延迟队列
+static void* fake_reader(void* arg)
+{
+    FakeNode* node = (FakeNode*)arg;
+    static __thread uint8_t buf[65536];
+    size_t have = 0;
+    uint64_t line_free_us = 0;
+    while (node->running) {
+        ssize_t n = read(node->master, buf + have, sizeof(buf) - have);
+        if (n <= 0) {
+            continue;
+        }
+        have += (size_t)n;
+
+        size_t pos = 0;
+        while (have - pos >= MBL_SYNC_LEN) {
+            uint8_t* p = buf + pos;
+            uint32_t frame_len;
+            if (p[0] == MBL_SYNC_TX_0 && p[1] == MBL_SYNC_TX_1 && p[2] == MBL_SYNC_TX_2 &&
+                p[3] == MBL_SYNC_TX_3) {
+                frame_len = MBL_SYNC_LEN;
+            } else if (p[0] == MBL_FRAME_HEADER_0 && p[1] == MBL_FRAME_HEADER_1) {
+                if (have - pos < 18) {
+                    break;
+                }
+                frame_len = MBL_FRAME_LEN;
+                if (le32(p + 2) == MBL_CMD_WRITE_FAST) {
+                    uint32_t chunk = le32(p + 14);
+                    if (chunk > MBL_FAST_CHUNK_MAX) {
+                        pos++;
+                        continue;
+                    }
+                    frame_len = MBL_FAST_FRAME_LEN(chunk);
+                }
+            } else {
+                pos++;
+                continue;
+            }
+            if (have - pos < frame_len) {
+                break;
+            }
+            pos += frame_len;
+
+            uint64_t t = now_us();
+            uint64_t start = line_free_us > t ? line_free_us : t;
+            line_free_us = start + (g_link_baud ? (uint64_t)frame_len * 10 * 1000000 / g_link_baud : 0);
+
+            // 伪随机丢帧，平均每 loss_every 个快速写帧丢一个（固定种子，可复现）
+            if (frame_len > MBL_FRAME_LEN && g_loss_every) {
+                node->loss_seed = node->loss_seed * 1103515245u + 12345u;
+                if ((node->loss_seed >> 16) % g_loss_every == 0) {
+                    node->frames_dropped++;
+                    continue;
+                }
+            }
+
+            pthread_mutex_lock(&node->mtx);
+            while (node->head - node->tail >= DELAY_QUEUE_SIZE) {
+                pthread_cond_wait(&node->cnd, &node->mtx);
+            }
+            DelayedFrame* f = &node->queue[node->head % DELAY_QUEUE_SIZE];
+            f->due_us = line_free_us + g_latency_us;
+            f->len = frame_len;
+            memcpy(f->frame, p, frame_len);
+            node->head++;
+            pthread_cond_signal(&node->cnd);
+            pthread_mutex_unlock(&node->mtx);
+        }
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+    }
+    return NULL;
+}
+
+static int node_start(FakeNode* node, uint32_t index)
+{
+    memset(node, 0, sizeof(*node));
+    node->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (node->master < 0 || grantpt(node->master) != 0 || unlockpt(node->master) != 0) {
+        perror("posix_openpt");
+        return 0;
+    }
+    struct termios tio;
+    tcgetattr(node->master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(node->master, TCSANOW, &tio);
+    snprintf(node->slave, sizeof(node->slave), "%s", ptsname(node->master));
+    node->flash = (uint8_t*)malloc(FAKE_FIRMWARE_MAX);
+    node->fast = 1;
+    node->loss_seed = index + 1;
+    node->running = 1;
+    pthread_mutex_init(&node->mtx, NULL);
+    pthread_cond_init(&node->cnd, NULL);
+    pthread_create(&node->reader, NULL, fake_reader, node);
+    pthread_create(&node->worker, NULL, fake_worker, node);
+    return 1;
+}
+
+static void node_stop(FakeNode* node)
+{
+    node->running = 0;
+    pthread_mutex_lock(&node->mtx);
+    pthread_cond_broadcast(&node->cnd);
+    pthread_mutex_unlock(&node->mtx);
+    close(node->master);
+    pthread_cancel(node->reader);
+    pthread_join(node->reader, NULL);
+    pthread_join(node->worker, NULL);
+    free(node->flash);
+}
+
+typedef struct {
+    FakeNode* node;
+    const uint8_t* firmware;
+    uint32_t len;
+    MCUBootloaderError result;
+    MBL_Capabilities caps;
+    double ms;
+} UpgradeJob;
+
+// 上位机一侧：打开（自动探测波特率）、擦除、写入，计写入耗时
+static void* run_upgrade(void* arg)
+{
+    UpgradeJob* job = (UpgradeJob*)arg;
+    mbl_handle* h = NULL;
+    job->result = mbl_open(&h, job->node->slave, 0);
+    if (job->result != MBL_Error_OK) {
+        return NULL;
+    }
+    mbl_get_capabilities(h, &job->caps);
+
+    MBL_EraseParams params;
+    memset(&params, 0, sizeof(params));
+    params.app_length = job->len;
+    job->result = mbl_command_erase(h, &params, 1000);
+    if (job->result == MBL_Error_OK) {
+        uint64_t t0 = now_us();
+        job->result = mbl_write_firmware(h, job->firmware, job->len, 1000);
+        job->ms = (now_us() - t0) / 1000.0;
+    }
+    if (job->result == MBL_Error_OK) {
+        job->result = mbl_command_exit(h, 1000);
+    }
+    mbl_close(h);
+    return NULL;
+}
+
+static int check_job(const UpgradeJob* job, const char* name)
+{
+    FakeNode* node = job->node;
+    int image_ok = node->written == job->len && memcmp(node->flash, job->firmware, job->len) == 0;
+    int verify_ok = !node->fast || node->verified;
+    fprintf(stderr,
+            "%-8s %s result=0x%08X chunk=%u window=%u image_ok=%d verified=%d dropped=%u "
+            "rejected=%u time=%.1f ms (%.1f KB/s)\n",
+            name,
+            node->slave,
+            job->result,
+            job->caps.max_chunk,
+            job->caps.window,
+            image_ok,
+            node->verified,
+            node->frames_dropped,
+            node->rejected,
+            job->ms,
+            job->len / 1.024 / job->ms);
+    return job->result == MBL_Error_OK && image_ok && verify_ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t size_kb = argc > 1 ? (uint32_t)atoi(argv[1]) : 256;
+    if (size_kb == 0 || size_kb * 1024 > FAKE_FIRMWARE_MAX) {
+        size_kb = 256;
+    }
+    uint32_t nodes = argc > 2 ? (uint32_t)atoi(argv[2]) : 4;
+    if (nodes == 0 || nodes > FAKE_NODES_MAX) {
+        nodes = 4;
+    }
+    if (argc > 3) {
+        g_latency_us = (uint32_t)atoi(argv[3]);
+    }
+    if (argc > 4) {
+        g_loss_every = (uint32_t)atoi(argv[4]);
+    }
+    if (argc > 5) {
+        g_link_baud = (uint32_t)atoi(argv[5]);
+    }
+
+    for (uint32_t i = 0; i < nodes; i++) {
+        if (!node_start(&g_nodes[i], i)) {
+            return 1;
+        }
+    }
+
+    uint32_t len = size_kb * 1024 - 20;  // 最后一块不满
+    uint8_t* firmware = (uint8_t*)malloc(len);
+    for (uint32_t i = 0; i < len; i++) {
+        firmware[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+
+    fprintf(stderr,
+            "firmware=%u bytes nodes=%u latency=%u us link=%u baud loss_every=%u\n",
+            len,
+            nodes,
+            g_latency_us,
+            g_link_baud,
+            g_loss_every);
+
+    // 旧协议：节点 0 不回能力块（不丢帧，旧协议没有重发）
+    uint32_t loss_every = g_loss_every;
+    g_loss_every = 0;
+    g_nodes[0].fast = 0;
+    UpgradeJob legacy = {&g_nodes[0], firmware, len, 0, {0}, 0};
+    run_upgrade(&legacy);
+    int ok = check_job(&legacy, "legacy") && legacy.caps.max_chunk == 0;
+    g_loss_every = loss_every;
+
+    g_nodes[0].fast = 1;
+    UpgradeJob fast = {&g_nodes[0], firmware, len, 0, {0}, 0};
+    run_upgrade(&fast);
+    ok &= check_job(&fast, "fast");
+    fprintf(stderr, "speedup=%.1fx\n", legacy.ms / fast.ms);
+
+    // 每个节点一个线程并行升级
+    UpgradeJob jobs[FAKE_NODES_MAX];
+    pthread_t threads[FAKE_NODES_MAX];
+    uint64_t t0 = now_us();
+    for (uint32_t i = 0; i < nodes; i++) {
+        g_nodes[i].frames_dropped = 0;
+        g_nodes[i].rejected = 0;
+        jobs[i] = (UpgradeJob){&g_nodes[i], firmware, len, 0, {0}, 0};
+        pthread_create(&threads[i], NULL, run_upgrade, &jobs[i]);
+    }
+    double sum_ms = 0;
+    for (uint32_t i = 0; i < nodes; i++) {
+        pthread_join(threads[i], NULL);
+        ok &= check_job(&jobs[i], "parallel");
+        sum_ms += jobs[i].ms;
+    }
+    double wall_ms = (now_us() - t0) / 1000.0;
+    fprintf(stderr,
+            "parallel: %u nodes in %.1f ms wall (one after another: %.1f ms)\n",
+            nodes,
+            wall_ms,
+            sum_ms);
+
+    for (uint32_t i = 0; i < nodes; i++) {
+        node_stop(&g_nodes[i]);
+    }
+    free(firmware);
+    fprintf(stderr, ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
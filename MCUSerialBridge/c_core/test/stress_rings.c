@@ -0,0 +1,334 @@
+// stress_rings.c
+//
+// 收发队列多线程压力测试（POSIX）：
+//   1. 发送队列（MPSC）：多个生产者线程同时入队，send 线程角色的消费者按批
+//      取出校验——每个生产者的序号必须连续、内容必须完整，不丢不重不串。
+//   2. 接收路径：一个线程从缓冲池分配块、填数据后经 SPSC 队列交给消费者，
+//      消费者校验顺序和内容；每隔几个包再加一个引用转交给第三个线程，
+//      由它晚些时候复查内容并释放——块在最后一个引用释放前不能被复用。
+//   3. 背压：队列满且没人消费时，领取槽位等满超时后返回失败，而不是立即丢。
+// 消费者故意时快时慢，让队列反复在满和空之间切换。
+//
+// 用法: stress_rings [每个生产者的包数=200000] [生产者数=4]
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "msb_ring.h"
+
+#define MAX_PRODUCERS 16
+#define PUSH_TIMEOUT_MS 5000
+#define POOL_BLOCKS (512 + 256 + 128)  // 与 msb_ring.c 的分级数量一致
+
+static uint32_t g_count = 200000;
+static uint32_t g_producers = 4;
+static SendQueue g_send_queue;
+static PacketPool g_pool;
+static PacketQueue g_recv_queue;
+static PacketQueue g_handoff;
+static msb_atomic_u32 g_handoff_done;
+static volatile int g_late_errors = 0;
+static volatile int g_push_failed = 0;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+// payload: [producer][seq:4][填充字节由 producer/seq 决定]，长度 5..68 随序号变化
+static uint32_t make_payload(uint8_t* buf, uint8_t producer, uint32_t seq)
+{
+    uint32_t len = 5 + (seq * 7 + producer) % 64;
+    buf[0] = producer;
+    memcpy(buf + 1, &seq, 4);
+    for (uint32_t i = 5; i < len; i++) {
+        buf[i] = (uint8_t)(seq * 31 + i + producer);
+    }
+    return len;
+}
+
+static int check_payload(
+        const uint8_t* buf,
+        uint32_t len,
+        uint8_t* producer,
+        uint32_t* seq)
+{
+    if (len < 5) {
+        return 0;
+    }
+    *producer = buf[0];
+    memcpy(seq, buf + 1, 4);
+    uint8_t expect[PACKET_MAX_PAYLOAD_LEN];
+    uint32_t expect_len = make_payload(expect, *producer, *seq);
+    return expect_len == len && memcmp(expect, buf, len) == 0;
+}
+
+// 消费者偶尔歇一下，制造队列满
+static void maybe_stall(uint32_t n)
+{
+    if ((n & 0x3FFF) == 0) {
+        struct timespec ts = {0, 2 * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void* send_producer(void* arg)
+{
+    uint8_t producer = (uint8_t)(uintptr_t)arg;
+    for (uint32_t seq = 0; seq < g_count; seq++) {
+        PayloadEntry* entry = send_queue_claim(&g_send_queue, PUSH_TIMEOUT_MS);
+        if (!entry) {
+            g_push_failed = 1;
+            return NULL;
+        }
+        entry->len = (uint16_t)make_payload(entry->payload, producer, seq);
+        send_queue_commit(&g_send_queue, entry);
+    }
+    return NULL;
+}
+
+static int test_mpsc(void)
+{
+    send_queue_init(&g_send_queue);
+    pthread_t threads[MAX_PRODUCERS];
+    uint64_t t0 = now_ms();
+    for (uint32_t i = 0; i < g_producers; i++) {
+        pthread_create(&threads[i], NULL, send_producer, (void*)(uintptr_t)i);
+    }
+
+    uint32_t next_seq[MAX_PRODUCERS] = {0};
+    uint64_t total = (uint64_t)g_count * g_producers;
+    uint64_t received = 0;
+    int errors = 0;
+    while (received < total && !g_push_failed) {
+        // 像 send 线程合并写一样一次取一批（1..16 帧），一起归还
+        uint32_t want = 1 + (uint32_t)(received % 16);
+        uint32_t batch = 0;
+        PayloadEntry* entry;
+        while (batch < want && (entry = send_queue_peek(&g_send_queue, batch)) != NULL) {
+            uint8_t producer;
+            uint32_t seq;
+            if (!check_payload(entry->payload, entry->len, &producer, &seq) ||
+                producer >= g_producers || seq != next_seq[producer]) {
+                if (errors++ < 5) {
+                    fprintf(stderr,
+                            "mpsc: bad entry #%llu len=%u\n",
+                            (unsigned long long)(received + batch),
+                            entry->len);
+                }
+            } else {
+                next_seq[producer]++;
+            }
+            batch++;
+        }
+        if (batch == 0) {
+            sched_yield();
+            continue;
+        }
+        if (batch == 1) {
+            send_queue_pop(&g_send_queue);
+        } else {
+            send_queue_pop_n(&g_send_queue, batch);
+        }
+        received += batch;
+        maybe_stall((uint32_t)received);
+    }
+    for (uint32_t i = 0; i < g_producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t ms = now_ms() - t0;
+    send_queue_deinit(&g_send_queue);
+
+    fprintf(stderr,
+            "mpsc: %u producers x %u packets, received=%llu errors=%d "
+            "push_failed=%d, %llu ms\n",
+            g_producers,
+            g_count,
+            (unsigned long long)received,
+            errors,
+            g_push_failed,
+            (unsigned long long)ms);
+    return errors == 0 && !g_push_failed && received == total;
+}
+
+static void* recv_producer(void* arg)
+{
+    (void)arg;
+    uint8_t buf[PACKET_MAX_PAYLOAD_LEN];
+    for (uint32_t seq = 0; seq < g_count; seq++) {
+        uint32_t len = make_payload(buf, 0, seq);
+        PacketBuf* pkt = packet_alloc(&g_pool, len, PUSH_TIMEOUT_MS);
+        if (!pkt) {
+            g_push_failed = 1;
+            return NULL;
+        }
+        memcpy(pkt->data, buf, len);
+        pkt->len = (uint16_t)len;
+        if (!packet_queue_push(&g_recv_queue, pkt)) {
+            g_push_failed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// 持有转交来的引用一段时间后复查内容再释放
+static void* late_releaser(void* arg)
+{
+    (void)arg;
+    uint32_t released = 0;
+    for (;;) {
+        PacketBuf* pkt = packet_queue_pop(&g_handoff);
+        if (!pkt) {
+            // 消费者在最后一次转交之后才置 done，置位后再取一次就能取空
+            if (msb_atomic_load_acquire(&g_handoff_done)) {
+                pkt = packet_queue_pop(&g_handoff);
+                if (!pkt) {
+                    break;
+                }
+            } else {
+                sched_yield();
+                continue;
+            }
+        }
+        if ((++released & 0xFF) == 0) {
+            sched_yield();
+        }
+        uint8_t producer;
+        uint32_t seq;
+        if (!check_payload(pkt->data, pkt->len, &producer, &seq)) {
+            g_late_errors++;
+        }
+        packet_release(&g_pool, pkt);
+    }
+    return NULL;
+}
+
+static int test_packet_pool(void)
+{
+    if (!packet_pool_init(&g_pool)) {
+        fprintf(stderr, "pool: init failed\n");
+        return 0;
+    }
+    packet_queue_init(&g_recv_queue);
+    packet_queue_init(&g_handoff);
+    msb_atomic_store_release(&g_handoff_done, 0);
+    g_push_failed = 0;
+
+    pthread_t producer, releaser;
+    uint64_t t0 = now_ms();
+    pthread_create(&producer, NULL, recv_producer, NULL);
+    pthread_create(&releaser, NULL, late_releaser, NULL);
+
+    uint32_t received = 0;
+    uint32_t handed_off = 0;
+    int errors = 0;
+    while (received < g_count && !g_push_failed) {
+        PacketBuf* pkt = packet_queue_pop(&g_recv_queue);
+        if (!pkt) {
+            sched_yield();
+            continue;
+        }
+        uint8_t producer_id;
+        uint32_t seq;
+        if (!check_payload(pkt->data, pkt->len, &producer_id, &seq) ||
+            seq != received) {
+            if (errors++ < 5) {
+                fprintf(stderr, "pool: bad packet #%u len=%u\n", received, pkt->len);
+            }
+        }
+        if (received % 3 == 0) {
+            packet_retain(pkt);
+            while (!packet_queue_push(&g_handoff, pkt)) {
+                sched_yield();
+            }
+            handed_off++;
+        }
+        packet_release(&g_pool, pkt);
+        received++;
+        maybe_stall(received);
+    }
+    msb_atomic_store_release(&g_handoff_done, 1);
+    pthread_join(producer, NULL);
+    pthread_join(releaser, NULL);
+    uint64_t ms = now_ms() - t0;
+
+    // 所有引用都已释放：每个尺寸都应能重新分配满
+    uint32_t reclaimed = 0;
+    PacketBuf* held[1024];
+    PacketBuf* pkt;
+    while (reclaimed < 1024 && (pkt = packet_alloc(&g_pool, 1, 0)) != NULL) {
+        held[reclaimed++] = pkt;
+    }
+    for (uint32_t i = 0; i < reclaimed; i++) {
+        packet_release(&g_pool, held[i]);
+    }
+    packet_pool_deinit(&g_pool);
+
+    fprintf(stderr,
+            "pool: %u packets, received=%u handed_off=%u errors=%d "
+            "late_errors=%d push_failed=%d reclaimed=%u, %llu ms\n",
+            g_count,
+            received,
+            handed_off,
+            errors,
+            g_late_errors,
+            g_push_failed,
+            reclaimed,
+            (unsigned long long)ms);
+    return errors == 0 && g_late_errors == 0 && !g_push_failed &&
+           received == g_count && reclaimed == POOL_BLOCKS;
+}
+
+static int test_backpressure_timeout(void)
+{
+    send_queue_init(&g_send_queue);
+    int filled = 0;
+    PayloadEntry* entry;
+    while ((entry = send_queue_claim(&g_send_queue, 0)) != NULL) {
+        entry->len = (uint16_t)make_payload(entry->payload, 0, (uint32_t)filled);
+        send_queue_commit(&g_send_queue, entry);
+        filled++;
+    }
+    uint64_t t0 = now_ms();
+    int pushed = send_queue_claim(&g_send_queue, 50) != NULL;
+    uint64_t waited = now_ms() - t0;
+    send_queue_deinit(&g_send_queue);
+
+    fprintf(stderr,
+            "backpressure: filled=%d, full push returned %d after %llu ms\n",
+            filled,
+            pushed,
+            (unsigned long long)waited);
+    return filled == RING_QUEUE_SIZE && !pushed && waited >= 45;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && atoi(argv[1]) > 0) {
+        g_count = (uint32_t)atoi(argv[1]);
+    }
+    if (argc > 2 && atoi(argv[2]) > 0) {
+        g_producers = (uint32_t)atoi(argv[2]);
+        if (g_producers > MAX_PRODUCERS) {
+            g_producers = MAX_PRODUCERS;
+        }
+    }
+
+    int ok = test_mpsc();
+    ok &= test_packet_pool();
+    ok &= test_backpressure_timeout();
+    fprintf(stderr, ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
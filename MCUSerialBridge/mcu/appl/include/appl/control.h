@@ -12,6 +12,9 @@ extern volatile MCUStateC g_mcu_state;
 /** @brief 各端口的统计数据（TX/RX 帧数和字节数） */
 extern volatile PortStatsC g_port_stats[PACKET_MAX_PORTS_NUM];
 
+/** @brief 各端口因 DIVER IO 缓冲已满被丢弃的接收帧数 */
+extern volatile uint32_t g_port_rx_dropped[PACKET_MAX_PORTS_NUM];
+
 /** @brief 每端口 WireTap 标志数组，启用后即使在 DIVER 模式下也会上报端口数据 */
 extern volatile uint8_t g_wire_tap_flags[PACKET_MAX_PORTS_NUM];
 
@@ -21,14 +24,29 @@ extern volatile uint8_t g_wire_tap_flags[PACKET_MAX_PORTS_NUM];
 /** @brief 检查指定端口的 TX WireTap 是否启用 */
 #define WIRETAP_TX_ENABLED(port) (g_wire_tap_flags[port] & WireTapFlag_TX)
 
+/** @brief LowerIO 上报格式（LowerIoMode），由 CommandSetLowerIoMode 设置，默认全量 */
+extern volatile uint8_t g_lower_io_mode;
+
+/** @brief 增量模式下的关键帧间隔（迭代数） */
+extern volatile uint16_t g_lower_io_keyframe_interval;
+
+/** @brief 置位后下一次 LowerIO 上报强制为关键帧（切换模式 / 重新下载程序时） */
+extern volatile uint8_t g_lower_io_keyframe_pending;
+
 /** @brief 程序缓冲区指针（DIVER 模式） */
 extern uint8_t* g_program_buffer;
 extern uint32_t g_program_length;
 
+/** @brief 闪存里保存的程序镜像（见 program_store.h）。非 NULL 时 VM 从这里
+ *  原地执行，g_program_buffer 只作为 VM 工作内存；NULL 时在缓冲区里执行。 */
+extern const uint8_t* g_program_image;
+
 /** @brief 程序缓冲区总大小（用于 VM 内存分配）
  *  CCM 优化：缓冲区放入 CCM RAM（见 control.c），容量从 20KiB 扩到 48KiB。
- *  CCM 总量 64KiB，本缓冲 48KiB + heap_obj 8KiB + 其余热变量 ≈ 57KiB，留有余量。 */
-#define PROGRAM_BUFFER_MAX_SIZE (48 * 1024)
+ *  heap_obj / stack_ptr 等运行时表改为在 vm_set_program 时从本缓冲顶部切出
+ *  （默认 1024 个堆对象 ≈ 8KiB），因此缓冲扩到 56KiB，CCM 总占用与原先相同
+ *  （64KiB 中 56KiB + 其余热变量，留有余量）。 */
+#define PROGRAM_BUFFER_MAX_SIZE (56 * 1024)
 
 /*
 下列所有命令返回的错误码都会直接被交互层（packet）直接同步地返回给PC
@@ -108,11 +126,13 @@ MCUSerialBridgeError control_on_upgrade(
 
 /**
  * @brief 处理程序下载命令
- * 接收程序数据，支持分片传输。如果程序长度为 0，切换到透传模式
+ * 接收程序数据，支持分片传输。如果程序长度为 0，切换到透传模式。
+ * ack 返回下一个期望的分片偏移，主机据此重传丢失的分片
  */
 MCUSerialBridgeError control_on_program(
         const uint8_t* data,
-        uint32_t data_length);
+        uint32_t data_length,
+        ProgramAck* ack);
 
 MCUSerialBridgeError control_on_configure(
         const uint8_t* data,
@@ -137,6 +157,17 @@ MCUSerialBridgeError control_on_set_wire_tap(
         const uint8_t* data,
         uint32_t data_length);
 
+/**
+ * @brief 处理设置 LowerIO 上报格式命令
+ * 切换全量 / 增量 LowerIO 上报，增量模式下一帧强制为关键帧。
+ * 只对下一次 Start 有效：加载程序、复位和未协商的 Start 恢复全量
+ * @param data LowerIoModeC 结构数据
+ * @param data_length 数据长度
+ */
+MCUSerialBridgeError control_on_set_lower_io_mode(
+        const uint8_t* data,
+        uint32_t data_length);
+
 /**
  * @brief 处理 UpperIO 内存交换命令
  * PC 向 MCU 发送输入变量数据（DIVER 模式下使用）
@@ -181,6 +212,12 @@ void control_stats_add_tx(uint32_t port_index, uint32_t bytes);
  */
 void control_stats_add_rx(uint32_t port_index, uint32_t bytes);
 
+/**
+ * @brief 累加端口接收溢出（帧没能放进本周期的 DIVER IO 缓冲）
+ * @param port_index 端口索引
+ */
+void control_stats_add_rx_dropped(uint32_t port_index);
+
 /**
  * @brief 获取运行时统计数据
  * @param[out] stats 输出统计数据结构指针
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+
+/* ===============================
+ * 程序镜像的闪存保存区（可选）
+ * ===============================
+ *
+ * 板子在 bsp_config.py 的 CPP_DEFINES 里定义 PROGRAM_FLASH_SECTOR，并按
+ * bsp/program_flash.h 提供闪存驱动和划出扇区的 program_store.ld 即启用
+ * （目前是 CORAL-NODE-V2.1 的扇区 11）：
+ * - 下载并校验通过的程序在应答之后、由主循环写入该扇区，之后 VM 直接从闪存
+ *   执行（vm_set_program_image），整个 g_program_buffer 都留给静态变量、栈和堆；
+ * - 掉电 / 复位后闪存里的镜像仍在，主机的缓存查询可以直接命中。
+ * 未定义时下列函数都是空实现，程序照旧在 RAM 缓冲区里原地执行。
+ *
+ * 保存区布局：| ProgramStoreHeader 16B | 镜像 |，头部最后写，写到一半掉电
+ * 只会留下无效的头部。
+ */
+
+#define PROGRAM_STORE_MAGIC 0x54534750u /* 'P','G','S','T' */
+
+typedef struct {
+    uint32_t magic;       /**< PROGRAM_STORE_MAGIC，最后写入 */
+    uint32_t length;      /**< 镜像长度 */
+    uint32_t image_crc;   /**< 主机下载的原始镜像 CRC32（缓存查询比对的就是它） */
+    uint32_t stored_crc;  /**< 闪存里实际内容的 CRC32（预解码后与原始镜像不同） */
+} ProgramStoreHeader;
+
+/** @brief 是否编译了闪存保存区 */
+bool program_store_available(void);
+
+/**
+ * @brief 取闪存里保存的镜像（只检查头部，内容由调用方按 stored_crc 校验）
+ * @param header 输出头部（可为 NULL）
+ * @return 镜像指针；没有有效镜像时返回 NULL
+ */
+const uint8_t* program_store_image(ProgramStoreHeader* header);
+
+/**
+ * @brief 擦除保存区并写入镜像（耗时：擦除 128KiB 扇区约 1~2s，只在主循环里调用）
+ * @param image 要写入的内容（已预解码）
+ * @param length 长度
+ * @param image_crc 原始镜像的 CRC32
+ * @param stored_crc image 本身的 CRC32
+ * @return 写入并读回比对一致返回 true
+ */
+bool program_store_save(
+        const uint8_t* image,
+        uint32_t length,
+        uint32_t image_crc,
+        uint32_t stored_crc);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "chip/system.h"
 #include "hal/systick.h"
 
 #if defined(HAS_DIVER_RUNTIME) && HAS_DIVER_RUNTIME == 1
@@ -25,4 +26,8 @@ __attribute__((always_inline)) static inline int get_cyclic_seconds()
 {
     return (int)(g_hal_timestamp_us / 1000000);
 }
+__attribute__((always_inline)) static inline unsigned int get_cyclic_cycles()
+{
+    return DWT->CYCCNT;
+}
 #endif
\ No newline at end of file
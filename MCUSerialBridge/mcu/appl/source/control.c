@@ -1,6 +1,7 @@
 #include "appl/control.h"
 
 #include "appl/packet.h"
+#include "appl/program_store.h"
 #include "appl/upload.h"
 #include "appl/vm.h"
 #include "bsp/digital_io.h"
@@ -8,6 +9,7 @@
 #include "hal/nvic.h"
 #include "hal/rtc.h"
 #include "hal/systick.h"
+#include "msb_crc.h"
 #include "msb_error_c.h"
 #include "msb_protocol.h"
 #include "util/async.h"
@@ -67,9 +69,15 @@ Handles g_handles[PACKET_MAX_PORTS_NUM];
 
 volatile MCUStateC g_mcu_state = {.raw = 0};  // Bridge, Idle, not configured
 volatile uint8_t g_wire_tap_flags[PACKET_MAX_PORTS_NUM] = {0};
+volatile uint8_t g_lower_io_mode = LowerIoMode_Full;
+volatile uint16_t g_lower_io_keyframe_interval = 100;
+volatile uint8_t g_lower_io_keyframe_pending = 1;
+// 上次加载程序/Start 之后 Host 是否协商过 LowerIO 格式
+static volatile uint8_t g_lower_io_mode_negotiated = 0;
 
 // 端口统计数据
 volatile PortStatsC g_port_stats[PACKET_MAX_PORTS_NUM] = {0};
+volatile uint32_t g_port_rx_dropped[PACKET_MAX_PORTS_NUM] = {0};
 
 // DIVER 程序缓冲区 (PROGRAM_BUFFER_MAX_SIZE defined in control.h)
 // CCM 优化：整个 VM 工作内存放入 CCM RAM（零等待、与总线矩阵隔离），
@@ -78,7 +86,23 @@ volatile PortStatsC g_port_stats[PACKET_MAX_PORTS_NUM] = {0};
 CCM_RAM static uint8_t program_buffer_storage[PROGRAM_BUFFER_MAX_SIZE];
 uint8_t* g_program_buffer = program_buffer_storage;
 uint32_t g_program_length = 0;
-static uint32_t g_program_receiving_offset = 0;
+const uint8_t* g_program_image = NULL;
+static uint32_t g_program_receiving_offset = 0;  // 已连续收到的长度
+// 乱序收到的整块（按 PROGRAM_CHUNK_GRANULE）
+#define PROGRAM_GRANULE_COUNT (PROGRAM_BUFFER_MAX_SIZE / PROGRAM_CHUNK_GRANULE)
+static uint32_t g_program_received[(PROGRAM_GRANULE_COUNT + 31) / 32];
+
+// 上次校验通过的下载：缓冲区里就是这个镜像。VM 加载时会原地预解码改写缓冲区，
+// 之后缓冲区的 CRC 不再等于下载的镜像，所以缓存查询比对这条记录而不是重算 CRC。
+// 和缓冲区一样放在不被 startup 初始化的 CCM 里，软复位后仍在；check 让上电后的
+// 随机内容（或被清零的 .bss）不会被当成有效记录。
+typedef struct {
+    uint32_t length;
+    uint32_t image_crc;
+    uint32_t check;
+} ProgramCacheRecord;
+#define PROGRAM_CACHE_MAGIC 0x48434750u /* 'P','G','C','H' */
+CCM_RAM static ProgramCacheRecord g_program_cached;
 
 // UpperIO 双缓存结构（避免临界区）
 typedef struct {
@@ -250,9 +274,18 @@ MCUSerialBridgeError control_on_configure(
     return MSB_Error_OK;
 }
 
+// LowerIO 上报格式只在一次会话内有效，恢复为全量
+static void lower_io_mode_reset(void)
+{
+    g_lower_io_mode = LowerIoMode_Full;
+    g_lower_io_keyframe_pending = 1;
+    g_lower_io_mode_negotiated = 0;
+}
+
 MCUSerialBridgeError control_on_reset(const uint8_t* data, uint32_t data_length)
 {
     console_printf_do("CONTROL: RESETTING MCU!\n");
+    lower_io_mode_reset();
     async_timeout(RESET_WAIT_TIME, hal_nvic_reset, 0);
     return 0;
 }
@@ -904,6 +937,14 @@ MCUSerialBridgeError control_on_start(const uint8_t* data, uint32_t data_length)
                 UPPERIO_BUFFER_SIZE);
     }
 
+    // 本次会话（加载程序之后或上次 Start 之后）没有协商过增量上报时按全量上报，
+    // 协商结果只用于这一次 Start
+    if (!g_lower_io_mode_negotiated) {
+        g_lower_io_mode = LowerIoMode_Full;
+    }
+    g_lower_io_mode_negotiated = 0;
+    g_lower_io_keyframe_pending = 1;
+
     // 切换到运行状态
     g_mcu_state.running_state = MCU_RunState_Running;
     console_printf_do(
@@ -950,10 +991,98 @@ MCUSerialBridgeError control_on_set_wire_tap(
     return MSB_Error_OK;
 }
 
-MCUSerialBridgeError control_on_program(
+MCUSerialBridgeError control_on_set_lower_io_mode(
         const uint8_t* data,
         uint32_t data_length)
 {
+    if (!data || data_length < sizeof(LowerIoModeC)) {
+        return MSB_Error_Proto_InvalidPayload;
+    }
+    const LowerIoModeC* config = (const LowerIoModeC*)data;
+    if (config->mode != LowerIoMode_Full && config->mode != LowerIoMode_Delta) {
+        return MSB_Error_Proto_InvalidPayload;
+    }
+
+    g_lower_io_keyframe_interval =
+            config->keyframe_interval ? config->keyframe_interval : 100;
+    g_lower_io_keyframe_pending = 1;
+    g_lower_io_mode = config->mode;
+    g_lower_io_mode_negotiated = 1;
+    console_printf_do(
+            "CONTROL: SET LOWER IO MODE %s, keyframe every %u\n",
+            config->mode == LowerIoMode_Delta ? "DELTA" : "FULL",
+            (unsigned)g_lower_io_keyframe_interval);
+    return MSB_Error_OK;
+}
+
+static uint32_t program_cache_check(const ProgramCacheRecord* record)
+{
+    return msb_crc32((const uint8_t*)record, 8) ^ PROGRAM_CACHE_MAGIC;
+}
+
+static void program_cache_set(uint32_t length, uint32_t image_crc)
+{
+    g_program_cached.length = length;
+    g_program_cached.image_crc = image_crc;
+    g_program_cached.check = program_cache_check(&g_program_cached);
+}
+
+static void program_cache_clear(void)
+{
+    g_program_cached.check = ~program_cache_check(&g_program_cached);
+}
+
+// 缓冲区里是否是这个校验通过的镜像（不论 VM 是否已经加载改写过）
+static bool program_cache_match(uint32_t length, uint32_t image_crc)
+{
+    return g_program_cached.check == program_cache_check(&g_program_cached) &&
+           g_program_cached.length == length &&
+           g_program_cached.image_crc == image_crc;
+}
+
+// 闪存保存区里是这个镜像（头部匹配且内容完好）时返回它
+static const uint8_t* program_stored_image(uint32_t length, uint32_t image_crc)
+{
+    ProgramStoreHeader header;
+    const uint8_t* image = program_store_image(&header);
+    if (!image || header.length != length || header.image_crc != image_crc ||
+        msb_crc32(image, length) != header.stored_crc) {
+        return NULL;
+    }
+    return image;
+}
+
+// 校验通过的程序写入闪存，之后 VM 从闪存执行。先在 RAM 里做完预解码，
+// 闪存里存的就是 VM 最终要读的内容，加载时不再改写镜像。
+// 擦除扇区要 1~2s，期间从闪存取指的代码（包括中断）都停住，所以不在校验包的
+// 处理里做：应答发出后由主循环执行，那时已经 Start、开始了新的下载或切到透传
+// 就不写了（程序照旧在 RAM 里执行）。
+#define PROGRAM_PERSIST_DELAY_MS 20
+
+static void program_persist(uint32_t image_crc)
+{
+    if (g_mcu_state.running_state != MCU_RunState_Idle ||
+        g_mcu_state.mode != MCU_Mode_DIVER ||
+        !program_cache_match(g_program_length, image_crc)) {
+        return;
+    }
+#if defined(HAS_DIVER_RUNTIME) && HAS_DIVER_RUNTIME == 1
+    vm_predecode_image(g_program_buffer, (int)g_program_length);
+#endif
+    uint32_t stored_crc = msb_crc32(g_program_buffer, g_program_length);
+    if (program_store_save(
+                g_program_buffer, g_program_length, image_crc, stored_crc)) {
+        g_program_image = program_store_image(NULL);
+    }
+}
+
+MCUSerialBridgeError control_on_program(
+        const uint8_t* data,
+        uint32_t data_length,
+        ProgramAck* ack)
+{
+    ack->next_offset = g_program_receiving_offset;
+
     if (!data || data_length < sizeof(ProgramPacket)) {
         return MSB_Error_Proto_InvalidPayload;
     }
@@ -963,6 +1092,9 @@ MCUSerialBridgeError control_on_program(
         return MSB_Error_State_Running;
     }
 
+    // 新程序：LowerIO 格式需要重新协商
+    lower_io_mode_reset();
+
     const ProgramPacket* pkt = (const ProgramPacket*)data;
 
     console_printf_do(
@@ -982,6 +1114,7 @@ MCUSerialBridgeError control_on_program(
         g_mcu_state.mode = MCU_Mode_Bridge;
         g_mcu_state.is_programmed = 0;
         g_program_length = 0;
+        g_program_image = NULL;
         return MSB_Error_OK;
     }
 
@@ -1001,6 +1134,64 @@ MCUSerialBridgeError control_on_program(
         return MSB_Error_Proto_ProgramTooLarge;
     }
 
+    // 整镜像校验包。分片收完后发来是下载校验；下载之前发来是缓存查询：
+    // 闪存保存区里、或上次校验通过的缓冲区里（复位后 RAM 也还在）已经是同样
+    // 长度、同样 CRC 的镜像就直接采用，主机跳过下载。
+    if (pkt->offset == pkt->total_len &&
+        pkt->chunk_len == PROGRAM_CRC_CHUNK_LEN) {
+        uint32_t expect;
+        memcpy(&expect, pkt->data, sizeof(expect));
+        const uint8_t* stored = program_stored_image(pkt->total_len, expect);
+        bool cached = program_cache_match(pkt->total_len, expect);
+        if (stored || cached) {
+            g_mcu_state.mode = MCU_Mode_DIVER;
+            g_program_length = pkt->total_len;
+            g_program_receiving_offset = pkt->total_len;
+            g_mcu_state.is_programmed = 1;
+            g_program_image = stored;
+            if (!stored) {
+                memset(g_program_buffer + g_program_length,
+                       0,
+                       PROGRAM_BUFFER_MAX_SIZE - g_program_length);
+            }
+            console_printf_do(
+                    "CONTROL: Program cache hit%s, %u bytes (0x%08X)\n",
+                    stored ? " in flash" : "",
+                    g_program_length,
+                    expect);
+            ack->next_offset = g_program_receiving_offset;
+            return MSB_Error_OK;
+        }
+        bool complete = pkt->total_len == g_program_length &&
+                        g_program_receiving_offset == g_program_length;
+        if (!complete) {
+            return MSB_Error_Proto_ProgramInvalidOffset;  // 缓存未命中
+        }
+        // 刚收完还没加载过，缓冲区就是下载的原始镜像
+        uint32_t actual = msb_crc32(g_program_buffer, pkt->total_len);
+        if (actual != expect) {
+            g_mcu_state.is_programmed = 0;
+            console_printf_do(
+                    "CONTROL: Program CRC mismatch (0x%08X != 0x%08X)\n",
+                    actual,
+                    expect);
+            return MSB_Error_Proto_Checksum;
+        }
+        console_printf_do("CONTROL: Program CRC OK (0x%08X)\n", actual);
+        program_cache_set(g_program_length, expect);
+        // 闪存里已经是同一个镜像就直接用，不重复擦写
+        g_program_image = program_stored_image(g_program_length, expect);
+        if (!g_program_image && program_store_available()) {
+            async_timeout(
+                    PROGRAM_PERSIST_DELAY_MS,
+                    (AsyncCallback)program_persist,
+                    1,
+                    expect);
+        }
+        ack->next_offset = g_program_receiving_offset;
+        return MSB_Error_OK;
+    }
+
     // 检查偏移量
     if (pkt->offset + pkt->chunk_len > pkt->total_len) {
         return MSB_Error_Proto_InvalidPayload;
@@ -1012,20 +1203,58 @@ MCUSerialBridgeError control_on_program(
         g_program_length = pkt->total_len;
         g_mcu_state.is_programmed = 0;
         g_program_receiving_offset = 0;
+        g_program_image = NULL;
+        program_cache_clear();
         memset(g_program_buffer, 0, PROGRAM_BUFFER_MAX_SIZE);
+        memset(g_program_received, 0, sizeof(g_program_received));
     }
 
-    if (pkt->offset != g_program_receiving_offset ||
-        pkt->total_len != g_program_length) {
+    if (pkt->total_len != g_program_length) {
         return MSB_Error_Proto_ProgramInvalidOffset;
     }
 
-    // 复制程序数据
-    memcpy(g_program_buffer + pkt->offset, pkt->data, pkt->chunk_len);
-    g_program_receiving_offset += pkt->chunk_len;
+    uint32_t end = pkt->offset + pkt->chunk_len;
+    if (pkt->offset <= g_program_receiving_offset) {
+        // 接在已收到的部分后面（或是重传的重复分片）
+        if (end > g_program_receiving_offset) {
+            uint32_t skip = g_program_receiving_offset - pkt->offset;
+            memcpy(g_program_buffer + g_program_receiving_offset,
+                   pkt->data + skip,
+                   end - g_program_receiving_offset);
+            g_program_receiving_offset = end;
+        }
+    } else if (
+            pkt->offset % PROGRAM_CHUNK_GRANULE == 0 &&
+            (pkt->chunk_len % PROGRAM_CHUNK_GRANULE == 0 ||
+             end == g_program_length)) {
+        // 前面有分片丢了：对齐的分片先放到位，记下收到的整块
+        memcpy(g_program_buffer + pkt->offset, pkt->data, pkt->chunk_len);
+        for (uint32_t g = pkt->offset / PROGRAM_CHUNK_GRANULE;
+             g * PROGRAM_CHUNK_GRANULE < end;
+             g++) {
+            g_program_received[g / 32] |= 1u << (g % 32);
+        }
+    } else {
+        ack->next_offset = g_program_receiving_offset;
+        return MSB_Error_Proto_ProgramInvalidOffset;
+    }
+
+    // 缺口补上后，把后面乱序收到的整块接上
+    while (g_program_receiving_offset < g_program_length) {
+        uint32_t g = g_program_receiving_offset / PROGRAM_CHUNK_GRANULE;
+        if (!(g_program_received[g / 32] & (1u << (g % 32)))) {
+            break;
+        }
+        g_program_receiving_offset = (g + 1) * PROGRAM_CHUNK_GRANULE;
+        if (g_program_receiving_offset > g_program_length) {
+            g_program_receiving_offset = g_program_length;
+        }
+    }
+    ack->next_offset = g_program_receiving_offset;
 
     // 检查是否接收完整
-    if (pkt->offset + pkt->chunk_len >= g_program_length) {
+    if (g_program_receiving_offset >= g_program_length &&
+        !g_mcu_state.is_programmed) {
         g_mcu_state.is_programmed = 1;
         console_printf_do(
                 "CONTROL: Program loaded, total %u bytes\n", g_program_length);
@@ -1074,14 +1303,36 @@ MCUSerialBridgeError control_on_memory_upper_io(
 
     // ========== 无临界区写入双缓存 ==========
     // 读取当前 hot_buffer_index，写入到热 buffer（可能被多次覆盖）
-    // 如果两个 Op 之间收到多个 UpperIO，后面的会覆盖前面的（只保留最后一个）
+    // 如果两个 Op 之间收到多个全量 UpperIO，后面的会覆盖前面的（只保留最后一个）
     uint32_t hot_idx = g_upperio_buffer.hot_buffer_index;
+    uint8_t* hot = g_upperio_buffer.buffer[hot_idx];
+    bool sparse = pkt->data_len >= 3 && pkt->data[0] == UPPER_FRAME_SPARSE;
+
+    if (sparse && g_upperio_buffer.has_new_data) {
+        // 稀疏 UpperIO 只带变化字段，不能覆盖尚未被 VM 取走的上一包：
+        // 把条目追加到上一包后面（同一字段后写的生效）。上一包是全量或放不下时
+        // 返回错误，上位机据此重发全量 UpperIO。
+        uint32_t len = g_upperio_buffer.write_length;
+        if (len < 3 || hot[0] != UPPER_FRAME_SPARSE) {
+            return MSB_Error_Proto_InvalidPayload;
+        }
+        if (len + pkt->data_len - 3 > UPPERIO_BUFFER_SIZE) {
+            return MSB_Error_Proto_FrameTooLong;
+        }
+        uint16_t count, add;
+        memcpy(&count, hot + 1, sizeof(count));
+        memcpy(&add, pkt->data + 1, sizeof(add));
+        count += add;
+        memcpy(hot + len, pkt->data + 3, pkt->data_len - 3);
+        memcpy(hot + 1, &count, sizeof(count));
+        g_upperio_buffer.write_length = len + pkt->data_len - 3;
+    } else {
+        memcpy(hot, pkt->data, pkt->data_len);
 
-    memcpy(g_upperio_buffer.buffer[hot_idx], pkt->data, pkt->data_len);
-
-    // 原子更新长度和标志（volatile 写入，VM 线程会看到）
-    g_upperio_buffer.write_length = pkt->data_len;
-    g_upperio_buffer.has_new_data = true;
+        // 原子更新长度和标志（volatile 写入，VM 线程会看到）
+        g_upperio_buffer.write_length = pkt->data_len;
+        g_upperio_buffer.has_new_data = true;
+    }
 
     console_printf_do("CONTROL: UpperIO received, len=%u\n", pkt->data_len);
 
@@ -1139,7 +1390,7 @@ bool control_vm_get_upper_io(const uint8_t** data_ptr, uint32_t* data_len)
     uint32_t hot_idx = g_upperio_buffer.hot_buffer_index;
     uint32_t len = g_upperio_buffer.write_length;
 
-    // 计算冷 buffer 索引（VM 读取的安全 buffer，不会变化）
+    // 计算冷 buffer 索引（交换后成为接收线程的新热 buffer）
     uint32_t cold_idx = 1 - hot_idx;
 
     // 交换 hot_buffer_index（0 <-> 1）
@@ -1154,9 +1405,9 @@ bool control_vm_get_upper_io(const uint8_t** data_ptr, uint32_t* data_len)
     hal_nvic_critical_section_quit();
     // ========== 退出临界区 ==========
 
-    // 返回数据（cold_idx 指向的是刚才热 buffer 的数据，现在变成冷
+    // 返回数据（hot_idx 指向的是刚才热 buffer 的数据，现在变成冷
     // buffer，安全不会变化）
-    *data_ptr = g_upperio_buffer.buffer[cold_idx];
+    *data_ptr = g_upperio_buffer.buffer[hot_idx];
     *data_len = len;
 
     return true;
@@ -1185,6 +1436,14 @@ void control_stats_add_rx(uint32_t port_index, uint32_t bytes)
     g_port_stats[port_index].rx_bytes += bytes;
 }
 
+void control_stats_add_rx_dropped(uint32_t port_index)
+{
+    if (port_index >= PACKET_MAX_PORTS_NUM) {
+        return;
+    }
+    g_port_rx_dropped[port_index]++;
+}
+
 void control_get_runtime_stats(RuntimeStatsC* stats)
 {
     if (!stats) {
@@ -1216,4 +1475,7 @@ void control_get_runtime_stats(RuntimeStatsC* stats)
     memcpy((void*)stats->ports,
            (const void*)g_port_stats,
            sizeof(g_port_stats));
+    memcpy((void*)stats->rx_dropped,
+           (const void*)g_port_rx_dropped,
+           sizeof(g_port_rx_dropped));
 }
@@ -17,7 +17,7 @@
 #include "hal/usart.h"
 #include "hal/nvic.h"
 #include "hal/delay.h"
-#include "util/crc.h"
+#include "msb_crc.h"
 #include <string.h>
 
 /** 错误包重复发送次数 */
@@ -87,7 +87,7 @@ static void fatal_error_send_impl(const ErrorPayloadC* payload, uint32_t timesta
         memcpy(header_ptr, &header, sizeof(PayloadHeader));
         
         // 重新计算 CRC (因为 sequence 变了)
-        uint16_t crc = crc16(pkt + 6, payload_len);
+        uint16_t crc = msb_crc16(pkt + 6, payload_len);
         crc_ptr[0] = (uint8_t)(crc & 0xFF);
         crc_ptr[1] = (uint8_t)((crc >> 8) & 0xFF);
         
@@ -194,7 +194,7 @@ void fatal_error_send_console_writeline(const void* data, uint32_t length)
 
     // CRC
     uint8_t* crc_ptr = payload_ptr + length;
-    uint16_t crc = crc16(pkt + 6, payload_len);
+    uint16_t crc = msb_crc16(pkt + 6, payload_len);
     crc_ptr[0] = (uint8_t)(crc & 0xFF);
     crc_ptr[1] = (uint8_t)((crc >> 8) & 0xFF);
 
@@ -6,9 +6,9 @@
 #include "bsp/digital_io.h"
 #include "bsp/ports.h"
 #include "hal/usart.h"
+#include "msb_crc.h"
 #include "msb_protocol.h"
 #include "util/console.h"
-#include "util/crc.h"
 
 #if defined(HAS_DIVER_RUNTIME) && HAS_DIVER_RUNTIME == 1
 #include "mcu_runtime.h"
@@ -90,10 +90,20 @@ void packet_parse(const void* data_void, uint32_t length, ...)
             break;
         }
 
+        // ------------------
+        // 尾部校验（先于 CRC，假帧头大多在这里就被排除）
+        // ------------------
+        uint32_t tail_offset = PACKET_OFFLOAD_SIZE + payload_len - 2;
+        if (data[tail_offset] != PACKET_TAIL_1_2 ||
+            data[tail_offset + 1] != PACKET_TAIL_1_2) {
+            offset++;
+            continue;
+        }
+
         // ------------------
         // CRC 校验
         // ------------------
-        uint16_t checked_crc = crc16(data + 6, payload_len);
+        uint16_t checked_crc = msb_crc16(data + 6, payload_len);
         uint32_t crc_offset = 6 + payload_len;
         uint16_t reported_crc = (uint16_t)data[crc_offset] |
                                 ((uint16_t)data[crc_offset + 1] << 8);
@@ -104,16 +114,6 @@ void packet_parse(const void* data_void, uint32_t length, ...)
             continue;
         }
 
-        // ------------------
-        // 尾部校验
-        // ------------------
-        uint32_t tail_offset = PACKET_OFFLOAD_SIZE + payload_len - 2;
-        if (data[tail_offset] != PACKET_TAIL_1_2 ||
-            data[tail_offset + 1] != PACKET_TAIL_1_2) {
-            offset++;
-            continue;
-        }
-
         PayloadHeader* payload_header = (PayloadHeader*)(data + 6);
         uint8_t* other_data =
                 (uint8_t*)(payload_header) + sizeof(PayloadHeader);
@@ -148,6 +148,9 @@ void packet_parse(const void* data_void, uint32_t length, ...)
         case CommandSetWireTap:
             ret = control_on_set_wire_tap(other_data, other_data_len);
             break;
+        case CommandSetLowerIoMode:
+            ret = control_on_set_lower_io_mode(other_data, other_data_len);
+            break;
         case CommandGetLayout: {
             static LayoutInfoC layout_info;
             bsp_get_layout(&layout_info);
@@ -202,9 +205,13 @@ void packet_parse(const void* data_void, uint32_t length, ...)
             return_buffer = (void*)&read_result;
             return_buffer_size = sizeof(read_result);
             break;
-        case CommandProgram:
-            ret = control_on_program(other_data, other_data_len);
+        case CommandProgram: {
+            static ProgramAck program_ack;
+            ret = control_on_program(other_data, other_data_len, &program_ack);
+            return_buffer = (void*)&program_ack;
+            return_buffer_size = sizeof(program_ack);
             break;
+        }
         case CommandMemoryUpperIO:
             ret = control_on_memory_upper_io(other_data, other_data_len);
             break;
@@ -309,7 +316,7 @@ void packet_send(
     // ------------------
     // CRC16 校验
     // ------------------
-    uint16_t crc = crc16(item->packet + 6, payload_len);
+    uint16_t crc = msb_crc16(item->packet + 6, payload_len);
     *itr++ = (uint8_t)(crc & 0xFF);
     *itr++ = (uint8_t)((crc >> 8) & 0xFF);
 
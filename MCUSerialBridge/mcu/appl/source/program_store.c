@@ -0,0 +1,86 @@
+#include "appl/program_store.h"
+
+#include <string.h>
+
+#include "util/console.h"
+
+#if defined(PROGRAM_FLASH_SECTOR)
+
+#include "bsp/program_flash.h"
+
+bool program_store_available(void)
+{
+    return true;
+}
+
+const uint8_t* program_store_image(ProgramStoreHeader* header)
+{
+    const ProgramStoreHeader* h =
+            (const ProgramStoreHeader*)bsp_program_flash_base();
+    if (h->magic != PROGRAM_STORE_MAGIC || h->length == 0 ||
+        h->length > bsp_program_flash_size() - sizeof(ProgramStoreHeader)) {
+        return NULL;
+    }
+    if (header) {
+        *header = *h;
+    }
+    return (const uint8_t*)(h + 1);
+}
+
+bool program_store_save(
+        const uint8_t* image,
+        uint32_t length,
+        uint32_t image_crc,
+        uint32_t stored_crc)
+{
+    if (length == 0 ||
+        length > bsp_program_flash_size() - sizeof(ProgramStoreHeader)) {
+        return false;
+    }
+
+    // 先写镜像，最后写头部（magic 在头部第一个字，放到最后单独写）
+    ProgramStoreHeader header = {
+            PROGRAM_STORE_MAGIC, length, image_crc, stored_crc};
+    const uint8_t* base = bsp_program_flash_base();
+    bool ok = bsp_program_flash_erase();
+    ok = ok && bsp_program_flash_write(sizeof(header), image, length);
+    ok = ok && bsp_program_flash_write(
+                       4, (const uint8_t*)&header + 4, sizeof(header) - 4);
+    ok = ok && memcmp(base + sizeof(header), image, length) == 0;
+    ok = ok && bsp_program_flash_write(0, (const uint8_t*)&header, 4);
+
+    console_printf_do(
+            "PROGRAM_STORE: save %u bytes to sector %u %s\n",
+            length,
+            (unsigned)PROGRAM_FLASH_SECTOR,
+            ok ? "OK" : "FAILED");
+    return ok;
+}
+
+#else
+
+bool program_store_available(void)
+{
+    return false;
+}
+
+const uint8_t* program_store_image(ProgramStoreHeader* header)
+{
+    (void)header;
+    return NULL;
+}
+
+bool program_store_save(
+        const uint8_t* image,
+        uint32_t length,
+        uint32_t image_crc,
+        uint32_t stored_crc)
+{
+    (void)image;
+    (void)length;
+    (void)image_crc;
+    (void)stored_crc;
+    return false;
+}
+
+#endif
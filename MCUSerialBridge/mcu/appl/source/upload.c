@@ -168,7 +168,8 @@ void on_hal_receive_serial(
     // DIVER 模式下，将串口数据传递给 DIVER 运行时处理
     if (g_mcu_state.mode == MCU_Mode_DIVER &&
         g_mcu_state.running_state == MCU_RunState_Running) {
-        vm_put_stream_buffer((int)port_index, (uchar*)data, (int)length);
+        if (vm_put_stream_buffer((int)port_index, (uchar*)data, (int)length) < 0)
+            control_stats_add_rx_dropped(port_index);
     }
 #endif
 
@@ -205,11 +206,12 @@ void on_hal_receive_can(
         memcpy(can_msg.data + 4, &data_4_7, 4);
         
         uint8_t dlc_clamped = id_info.dlc > 8 ? 8 : id_info.dlc;
-        vm_put_event_buffer(
-                (int)port_index,
-                (int)id_info.id,  // eventID = CAN Standard ID
-                (uchar*)&can_msg,
-                (int)(sizeof(can_msg.info) + dlc_clamped));  // size = info(2) + payload(dlc)
+        if (vm_put_event_buffer(
+                    (int)port_index,
+                    (int)id_info.id,  // eventID = CAN Standard ID
+                    (uchar*)&can_msg,
+                    (int)(sizeof(can_msg.info) + dlc_clamped)) < 0)  // size = info(2) + payload(dlc)
+            control_stats_add_rx_dropped(port_index);
     }
 #endif
 
@@ -336,11 +338,15 @@ void upload_lower_io_and_vm_stats(
     stats->mem_capacity = (uint32_t)vm_get_mem_capacity();
     stats->mem_peak_used = (uint32_t)vm_get_mem_peak_used();
     stats->heap_objs = (uint16_t)vm_get_heap_obj_count();
+    stats->gc_cycles = (uint32_t)vm_get_gc_cycles();
+    stats->gc_free_cycles = (uint32_t)vm_get_gc_skip_count();
 #else
     stats->heap_used = 0;
     stats->mem_capacity = 0;
     stats->mem_peak_used = 0;
     stats->heap_objs = 0;
+    stats->gc_cycles = 0;
+    stats->gc_free_cycles = 0;
 #endif
     stats->reserved = 0;
 
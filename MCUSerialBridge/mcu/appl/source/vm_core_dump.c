@@ -4,10 +4,9 @@
 #include "appl/upload.h"
 #include "util/console.h"
 
-extern int cur_il_offset;
-
 static void core_dump_handler(CoreDumpVariables* core_dump)
 {
+    int cur_il_offset = vm_get_cur_il_offset();
     console_printf_do(
             "Core Dump: IL Offset = %d, sending to PC...\n", cur_il_offset);
 
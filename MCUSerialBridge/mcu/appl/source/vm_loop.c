@@ -16,6 +16,24 @@ static uint64_t vm_interval_period_us = 100000;
 
 static volatile uint64_t vm_last_iteration_time_us = 0;
 
+// 设备 IO 双缓冲放在普通 SRAM（与原先 runtime 内部的静态 IO_bufferA/B 相同），
+// 不占用 CCM 里的 VM 工作内存；其余运行时表由 vm_set_program 从 VM 缓冲中切出。
+#define VM_IO_BUF_SIZE 8192
+static uint8_t vm_io_memory[2 * VM_IO_BUF_SIZE] __attribute__((aligned(8)));
+
+// 分代 GC：每 VM_GC_FULL_EVERY 轮做一次全堆回收，其余轮次只回收新生对象。
+// 默认 1（每轮全量，分代关闭）；每轮分配量远小于空闲堆的程序可在板子的
+// bsp_config.py CPP_DEFINES 里设成例如 16（见 vm_set_gc_config）。
+#ifndef VM_GC_FULL_EVERY
+#define VM_GC_FULL_EVERY 1
+#endif
+#ifndef VM_GC_PROMOTE_AGE
+#define VM_GC_PROMOTE_AGE 2
+#endif
+
+// 增量 LowerIO：距上一关键帧的迭代数
+static uint32_t vm_lower_frames_since_key = 0;
+
 static void vm_loop()
 {
     if (g_mcu_state.mode != MCU_Mode_DIVER || g_mcu_state.is_programmed == 0 ||
@@ -27,15 +45,28 @@ static void vm_loop()
     if (!vm_is_program_loaded) {
         console_printf(
                 LogLevelInfo, "VM: Program not loaded, try load program\n");
+        struct vm_config vm_cfg = {
+                .io_buf_size = VM_IO_BUF_SIZE,
+                .io_memory = vm_io_memory,
+                .full_gc_every = VM_GC_FULL_EVERY,
+                .gc_promote_after = VM_GC_PROMOTE_AGE,
+        };
+        vm_set_config(&vm_cfg);
         // Pass full buffer size, not just program length - VM needs heap/stack
-        // space!
-        int interval =
-                vm_set_program(g_program_buffer, PROGRAM_BUFFER_MAX_SIZE);
+        // space! 程序存在闪存里时原地执行，整个缓冲区都是工作内存。
+        int interval = g_program_image
+                ? vm_set_program_image(
+                          g_program_image,
+                          (int)g_program_length,
+                          g_program_buffer,
+                          PROGRAM_BUFFER_MAX_SIZE)
+                : vm_set_program(g_program_buffer, PROGRAM_BUFFER_MAX_SIZE);
         console_printf(
                 LogLevelInfo, "VM: Program loaded, interval=%d\n", interval);
         vm_iteration_count = 0;
         vm_interval_period_us = (uint64_t)interval * (uint64_t)1000;
         vm_is_program_loaded = true;
+        g_lower_io_keyframe_pending = 1;
     }
 
     uint64_t current_time_us = g_hal_timestamp_us;
@@ -80,7 +111,21 @@ static void vm_loop()
         // Upload LowerIO + this iteration's VM telemetry to host in a single
         // packet (combined CommandUploadLowerIoAndVmStats) to reduce packet
         // count; the host protocol layer splits them back apart.
-        uint8_t* lowerio = vm_get_lower_memory();
+        uint8_t* lowerio;
+        if (g_lower_io_mode == LowerIoMode_Delta) {
+            // Delta mode: bitmap + changed fields, keyframe after a mode switch
+            // or program load and every g_lower_io_keyframe_interval frames.
+            int keyframe = g_lower_io_keyframe_pending ||
+                           ++vm_lower_frames_since_key >=
+                                   g_lower_io_keyframe_interval;
+            if (keyframe) {
+                g_lower_io_keyframe_pending = 0;
+                vm_lower_frames_since_key = 0;
+            }
+            lowerio = vm_get_lower_memory_delta(keyframe);
+        } else {
+            lowerio = vm_get_lower_memory();
+        }
         int lowerio_size = vm_get_lower_memory_size();
         upload_lower_io_and_vm_stats(
                 lowerio,
@@ -6,4 +6,6 @@ CPP_DEFINES = {
     "USE_CCM_RAM": True,
     "HSE_VALUE": 12000000,
     "FORCE_PLL_M": 12,
+    # 扇区 11 存放预解码后的程序，VM 从闪存原地执行（见 program_store.ld）
+    "PROGRAM_FLASH_SECTOR": 11,
 }
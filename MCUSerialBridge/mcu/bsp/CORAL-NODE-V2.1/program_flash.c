@@ -0,0 +1,88 @@
+#include "bsp/program_flash.h"
+
+#include <string.h>
+
+#include "chip/system.h"
+
+/* CORAL-NODE-V2.1 程序保存区：STM32F405RG 的扇区 11（0x080E0000 起 128KiB）。
+ * 地址由 program_store.ld 给出，扇区号是 bsp_config.py 的 PROGRAM_FLASH_SECTOR，
+ * 两处要一致。
+ */
+
+extern const uint8_t __program_store_start[];
+extern const uint8_t __program_store_end[];
+
+#ifndef FLASH_KEY1
+#define FLASH_KEY1 0x45670123u
+#define FLASH_KEY2 0xCDEF89ABu
+#endif
+
+#define FLASH_SR_ERRORS \
+    (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+
+static bool flash_wait(void)
+{
+    while (FLASH->SR & FLASH_SR_BSY) {
+    }
+    return (FLASH->SR & FLASH_SR_ERRORS) == 0;
+}
+
+static void flash_unlock(void)
+{
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+    FLASH->SR = FLASH_SR_ERRORS;  // 写 1 清除上次的错误标志
+}
+
+// 加锁，并丢掉数据缓存里的旧内容
+static void flash_lock(void)
+{
+    FLASH->CR = FLASH_CR_LOCK;
+    uint32_t acr = FLASH->ACR;
+    FLASH->ACR = acr & ~FLASH_ACR_DCEN;
+    FLASH->ACR = (acr & ~FLASH_ACR_DCEN) | FLASH_ACR_DCRST;
+    FLASH->ACR = acr;
+}
+
+const uint8_t* bsp_program_flash_base(void)
+{
+    return __program_store_start;
+}
+
+uint32_t bsp_program_flash_size(void)
+{
+    return (uint32_t)(__program_store_end - __program_store_start);
+}
+
+bool bsp_program_flash_erase(void)
+{
+    flash_unlock();
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER |
+                FLASH_CR_SNB_0 * (uint32_t)PROGRAM_FLASH_SECTOR;
+    FLASH->CR |= FLASH_CR_STRT;
+    bool ok = flash_wait();
+    flash_lock();
+    return ok;
+}
+
+bool bsp_program_flash_write(uint32_t offset, const uint8_t* data, uint32_t len)
+{
+    if (offset % 4 != 0 || offset > bsp_program_flash_size() ||
+        len > bsp_program_flash_size() - offset) {
+        return false;
+    }
+    volatile uint32_t* dst = (volatile uint32_t*)(__program_store_start + offset);
+    flash_unlock();
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+    bool ok = true;
+    for (uint32_t i = 0; i < len && ok; i += 4) {
+        uint32_t word = 0xFFFFFFFFu;
+        memcpy(&word, data + i, len - i < 4 ? len - i : 4);
+        dst[i / 4] = word;
+        ok = flash_wait();
+    }
+    flash_lock();
+    return ok;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+
+/* ===============================
+ * 程序保存区闪存（可选）
+ * ===============================
+ *
+ * appl/program_store.c 用来保存预解码后的 DIVER 程序镜像。只有在
+ * bsp_config.py 的 CPP_DEFINES 里定义了 PROGRAM_FLASH_SECTOR 的板子实现
+ * 这些函数，并在板子目录下提供 program_store.ld：定义
+ * __program_store_start / __program_store_end，并断言固件没有长进该扇区。
+ *
+ * 擦除 / 写入期间从闪存取指的代码（包括中断）都会停住，只能在主循环里调用。
+ */
+
+/** @brief 保存区起始地址（可直接按内存读取） */
+const uint8_t* bsp_program_flash_base(void);
+
+/** @brief 保存区字节数 */
+uint32_t bsp_program_flash_size(void);
+
+/**
+ * @brief 擦除整个保存区（128KiB 扇区约 1~2s）
+ * @return 成功返回 true
+ */
+bool bsp_program_flash_erase(void);
+
+/**
+ * @brief 按 32 位字写入已擦除的保存区，末尾不足一字的部分补 0xFF
+ * @param offset 相对保存区起始的偏移（4 字节对齐）
+ * @param data 数据
+ * @param len 长度
+ * @return 成功返回 true
+ */
+bool bsp_program_flash_write(uint32_t offset, const uint8_t* data, uint32_t len);
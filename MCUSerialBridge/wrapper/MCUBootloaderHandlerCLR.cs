@@ -127,6 +127,32 @@ namespace MCUBootloaderCLR
         }
     }
 
+    /// <summary>
+    /// Bootloader 扩展能力（探测时协商，旧 Bootloader 全 0）
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    public struct BootloaderCapabilities
+    {
+        /// <summary>快速写单块最大长度（0 = 不支持快速升级）</summary>
+        public ushort MaxChunk;
+
+        /// <summary>最多在途的写帧数</summary>
+        public byte Window;
+
+        /// <summary>能力标志（bit0: 支持整镜像校验）</summary>
+        public byte Flags;
+
+        /// <summary>是否支持快速升级</summary>
+        public readonly bool FastWrite => MaxChunk >= 64;
+
+        public override readonly string ToString()
+        {
+            return FastWrite
+                ? $"快速升级: 块 {MaxChunk} 字节, 窗口 {Window}, 校验 {((Flags & 1) != 0 ? "支持" : "不支持")}"
+                : "旧协议（64 字节一问一答）";
+        }
+    }
+
     /// <summary>
     /// Erase 命令参数（内部结构，与 C 层对应）
     /// </summary>
@@ -391,6 +417,11 @@ namespace MCUBootloaderCLR
         [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
         internal static extern uint mbl_get_baudrate(IntPtr handle);
 
+        [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
+        internal static extern MCUBootloaderError mbl_get_capabilities(
+            IntPtr handle,
+            out BootloaderCapabilities caps);
+
         [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
         internal delegate void mbl_progress_callback_t(
             int progress,
@@ -424,6 +455,13 @@ namespace MCUBootloaderCLR
             uint chunk_length,
             uint timeout_ms);
 
+        [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
+        internal static extern MCUBootloaderError mbl_command_verify(
+            IntPtr handle,
+            uint total_length,
+            uint crc32,
+            uint timeout_ms);
+
         [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
         internal static extern MCUBootloaderError mbl_command_exit(
             IntPtr handle,
@@ -518,6 +556,20 @@ namespace MCUBootloaderCLR
             return err;
         }
 
+        /// <summary>
+        /// 获取探测时协商到的扩展能力（WriteFirmware 据此自动选择快速升级）
+        /// </summary>
+        /// <param name="caps">返回能力</param>
+        /// <returns>错误码</returns>
+        public MCUBootloaderError GetCapabilities(out BootloaderCapabilities caps)
+        {
+            caps = default;
+            if (!IsOpen)
+                return MCUBootloaderError.Win_NotOpen;
+
+            return MCUBootloaderCoreAPI.mbl_get_capabilities(nativeHandle, out caps);
+        }
+
         /// <summary>
         /// 注册进度回调
         /// </summary>
@@ -608,6 +660,21 @@ namespace MCUBootloaderCLR
                 nativeHandle, offset, totalLength, chunkData, (uint)chunkData.Length, timeout);
         }
 
+        /// <summary>
+        /// 校验已写入的整个镜像（需 Bootloader 支持，见 GetCapabilities）
+        /// </summary>
+        /// <param name="totalLength">已写入的总长度</param>
+        /// <param name="crc32">写入数据的 CRC32</param>
+        /// <param name="timeout">超时时间（毫秒）</param>
+        /// <returns>错误码</returns>
+        public MCUBootloaderError CommandVerify(uint totalLength, uint crc32, uint timeout = 2000)
+        {
+            if (!IsOpen)
+                return MCUBootloaderError.Win_NotOpen;
+
+            return MCUBootloaderCoreAPI.mbl_command_verify(nativeHandle, totalLength, crc32, timeout);
+        }
+
         /// <summary>
         /// 退出 Bootloader，重启进入应用程序
         /// </summary>
@@ -622,7 +689,8 @@ namespace MCUBootloaderCLR
         }
 
         /// <summary>
-        /// 写入完整固件（使用 UPG 文件）
+        /// 写入完整固件（使用 UPG 文件）。Bootloader 支持时自动走快速升级
+        /// （大帧、多帧在途、最后整镜像校验），否则 64 字节一问一答。
         /// </summary>
         /// <param name="upgFile">已解析的 UPG 文件</param>
         /// <param name="timeout">单次写入超时（毫秒）</param>
@@ -130,8 +130,8 @@ namespace MCUSerialBridgeCLR
         /// <summary>DIVER 程序魔数常量 'DIVR'</summary>
         public const uint DiverMagic = 0x52564944u;
 
-        /// <summary>本 Host/编译器构建所对应的 DIVER 程序 ABI（2.0.0），须与 mcu_runtime.h 同步</summary>
-        public const uint CurrentAbiVersion = (2u << 16) | (0u << 8) | 0u;
+        /// <summary>本 Host/编译器构建所对应的 DIVER 程序 ABI（2.3.0），须与 mcu_runtime.h 同步</summary>
+        public const uint CurrentAbiVersion = (2u << 16) | (3u << 8) | 0u;
 
         /// <summary>固件是否内置了 DIVER 运行时（magic 命中）</summary>
         public bool HasDiverRuntime => Magic == DiverMagic;
@@ -278,6 +278,17 @@ namespace MCUSerialBridgeCLR
         Both = 0x03,
     }
 
+    /// <summary>
+    /// LowerIO 上报格式（CommandSetLowerIoMode）
+    /// </summary>
+    public enum LowerIoMode : byte
+    {
+        /// <summary>全量：[iteration 4B]{全部 LowerIO 字段}</summary>
+        Full = 0x00,
+        /// <summary>增量：'K' 关键帧 / 'D' 增量帧（位图 + 变化字段）</summary>
+        Delta = 0x01,
+    }
+
     /// <summary>
     /// 端口描述符结构体 (16 bytes)
     /// </summary>
@@ -348,6 +359,10 @@ namespace MCUSerialBridgeCLR
         [MarshalAs(UnmanagedType.ByValArray, SizeConst = 16)]
         public PortStats[] Ports;
 
+        /// <summary>各端口因 DIVER IO 缓冲已满被丢弃的接收帧数（旧固件为 0）</summary>
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = 16)]
+        public uint[] RxDropped;
+
         /// <summary>
         /// 获取有效的端口统计列表
         /// </summary>
@@ -372,6 +387,47 @@ namespace MCUSerialBridgeCLR
         }
     }
 
+    /// <summary>
+    /// 主机侧发送统计（send 线程合并写效果，不经过 MCU）
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SendStats
+    {
+        /// <summary>已写出的帧数</summary>
+        public ulong Frames;
+
+        /// <summary>已写出的字节数（含帧头帧尾）</summary>
+        public ulong Bytes;
+
+        /// <summary>串口写调用次数</summary>
+        public ulong Writes;
+
+        /// <summary>单次写最多合并的帧数</summary>
+        public uint MaxFramesPerWrite;
+
+        /// <summary>单次写最大字节数</summary>
+        public uint MaxBytesPerWrite;
+
+        /// <summary>当前合并字节上限（0 = 不合并）</summary>
+        public uint BatchMaxBytes;
+
+        /// <summary>当前合并等待时间（毫秒）</summary>
+        public uint BatchLingerMs;
+
+        /// <summary>平均每次写的帧数</summary>
+        public readonly double FramesPerWrite => Writes == 0 ? 0 : (double)Frames / Writes;
+
+        /// <summary>平均每次写的字节数</summary>
+        public readonly double BytesPerWrite => Writes == 0 ? 0 : (double)Bytes / Writes;
+
+        /// <summary>
+        /// 转换为可读字符串
+        /// </summary>
+        public override readonly string ToString() =>
+            $"Writes={Writes}, Frames/Write={FramesPerWrite:F2} (max {MaxFramesPerWrite}), " +
+            $"Bytes/Write={BytesPerWrite:F1} (max {MaxBytesPerWrite}, limit {BatchMaxBytes})";
+    }
+
     /// <summary>
     /// 单轮 VM 运行遥测数据（CommandUploadVmStats）。
     /// MCU 在每个 vm_loop 迭代后上报，用于统计每节点 CPU 负载。
@@ -409,6 +465,16 @@ namespace MCUSerialBridgeCLR
         /// <summary>保留对齐</summary>
         public ushort Reserved;
 
+        /// <summary>本轮 vm_run() 末尾 GC 耗费的 DWT 周期数（包含在 LastCycles 内）</summary>
+        public uint GcCycles;
+
+        /// <summary>自程序加载以来没有分配堆对象、整轮跳过 GC 的循环数</summary>
+        public uint GcFreeCycles;
+
+        /// <summary>本轮 GC 耗时（微秒），由 GcCycles / CpuHz 换算；无主频信息时为 0。</summary>
+        public readonly double GcMicros =>
+            CpuHz > 0 ? GcCycles * 1_000_000.0 / CpuHz : 0.0;
+
         /// <summary>
         /// 本轮有效执行耗时（微秒）。优先用 DWT 周期数换算（亚微秒精度），
         /// 但 micros 墙钟只有 1ms 精度——若 DWT 换算结果与墙钟显著不一致
@@ -440,7 +506,7 @@ namespace MCUSerialBridgeCLR
             MemCapacity > 0 ? Math.Min(100.0 * MemPeakUsed / MemCapacity, 100.0) : 0.0;
 
         public override readonly string ToString() =>
-            $"iter={Iteration}, cycles={LastCycles}, us={LastMicros}, interval_us={IntervalUs}, cpu={LoadPercent:F1}%, mem={MemLoadPercent:F1}% ({MemPeakUsed}/{MemCapacity}B), heap={HeapUsed}B/{HeapObjs}objs";
+            $"iter={Iteration}, cycles={LastCycles}, us={LastMicros}, interval_us={IntervalUs}, cpu={LoadPercent:F1}%, mem={MemLoadPercent:F1}% ({MemPeakUsed}/{MemCapacity}B), heap={HeapUsed}B/{HeapObjs}objs, gc={GcMicros:F1}us, gc_free={GcFreeCycles}";
     }
 
     /// <summary>
@@ -1034,6 +1100,19 @@ namespace MCUSerialBridgeCLR
             uint timeout_ms
         );
 
+        [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
+        internal static extern MCUSerialBridgeError msb_set_program_window(
+            IntPtr handle,
+            uint window,
+            uint chunk_size
+        );
+
+        [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
+        internal static extern MCUSerialBridgeError msb_set_program_cache(
+            IntPtr handle,
+            byte enable
+        );
+
         [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
         internal static extern MCUSerialBridgeError msb_set_wire_tap(
             IntPtr handle,
@@ -1042,6 +1121,14 @@ namespace MCUSerialBridgeCLR
             uint timeout_ms
         );
 
+        [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
+        internal static extern MCUSerialBridgeError msb_set_lower_io_mode(
+            IntPtr handle,
+            byte mode,
+            ushort keyframe_interval,
+            uint timeout_ms
+        );
+
         [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
         internal static extern MCUSerialBridgeError msb_memory_upper_io(
             IntPtr handle,
@@ -1125,6 +1212,19 @@ namespace MCUSerialBridgeCLR
             out RuntimeStats stats,
             uint timeout_ms
         );
+
+        [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
+        internal static extern MCUSerialBridgeError msb_get_send_stats(
+            IntPtr handle,
+            out SendStats stats
+        );
+
+        [DllImport(DLL, CallingConvention = CallingConvention.Cdecl)]
+        internal static extern MCUSerialBridgeError msb_set_write_batch(
+            IntPtr handle,
+            uint max_bytes,
+            uint linger_ms
+        );
     }
 
     /// <summary>
@@ -1661,6 +1761,34 @@ namespace MCUSerialBridgeCLR
             return MCUSerialBridgeCoreAPI.msb_program(nativeHandle, programBytes, len, timeout);
         }
 
+        /// <summary>
+        /// 设置程序下载的窗口和分片大小
+        /// </summary>
+        /// <param name="window">同时在途的分片数，1 即逐片等应答；默认 8，最大 16</param>
+        /// <param name="chunkSize">分片字节数，0 表示按单包负载上限（默认）</param>
+        /// <returns>错误码</returns>
+        public MCUSerialBridgeError SetProgramWindow(uint window, uint chunkSize = 0)
+        {
+            if (nativeHandle == IntPtr.Zero)
+                return MCUSerialBridgeError.Win_HandleNotFound;
+
+            return MCUSerialBridgeCoreAPI.msb_set_program_window(nativeHandle, window, chunkSize);
+        }
+
+        /// <summary>
+        /// 设置 Program 是否先查询 MCU 上已有的镜像。
+        /// 开启时（默认）MCU 缓冲区里已经是同样长度和 CRC32 的程序就跳过下载。
+        /// </summary>
+        /// <param name="enable">是否查询</param>
+        /// <returns>错误码</returns>
+        public MCUSerialBridgeError SetProgramCache(bool enable)
+        {
+            if (nativeHandle == IntPtr.Zero)
+                return MCUSerialBridgeError.Win_HandleNotFound;
+
+            return MCUSerialBridgeCoreAPI.msb_set_program_cache(nativeHandle, enable ? (byte)1 : (byte)0);
+        }
+
         /// <summary>
         /// 设置 Wire Tap 模式
         /// 配置指定端口的 WireTap 监视功能（RX/TX）。
@@ -1678,6 +1806,24 @@ namespace MCUSerialBridgeCLR
             return MCUSerialBridgeCoreAPI.msb_set_wire_tap(nativeHandle, portIndex, (byte)flags, timeout);
         }
 
+        /// <summary>
+        /// 设置 LowerIO 上报格式（全量 / 增量）。
+        /// 增量帧格式见 MCURuntime/mcu_runtime.h vm_get_lower_memory_delta；
+        /// 只对下一次 Start 有效，每次 Start 之前都要重新设置。
+        /// 旧固件返回 Proto_UnknownCommand，此时继续按全量格式解析；超时等其它错误时 MCU 的格式未知。
+        /// </summary>
+        /// <param name="mode">上报格式</param>
+        /// <param name="keyframeInterval">增量模式关键帧间隔（迭代数），0 = 默认 100</param>
+        /// <param name="timeout">超时时间（毫秒），默认 200ms</param>
+        /// <returns>错误码</returns>
+        public MCUSerialBridgeError SetLowerIoMode(LowerIoMode mode, ushort keyframeInterval = 0, uint timeout = 200)
+        {
+            if (nativeHandle == IntPtr.Zero)
+                return MCUSerialBridgeError.Win_HandleNotFound;
+
+            return MCUSerialBridgeCoreAPI.msb_set_lower_io_mode(nativeHandle, (byte)mode, keyframeInterval, timeout);
+        }
+
         /// <summary>
         /// PC → MCU memory exchange (UpperIO data for DIVER mode).
         /// Sends input variable values to MCU for the next VM iteration.
@@ -1764,6 +1910,50 @@ namespace MCUSerialBridgeCLR
             );
         }
 
+        /// <summary>
+        /// LowerIO 回调（零拷贝）：data 直接指向 C 层接收缓冲池里的包，只在回调返回前有效
+        /// </summary>
+        public delegate void LowerIOSpanHandler(ReadOnlySpan<byte> data);
+
+        /// <summary>
+        /// 注册 MCU → PC 内存交换回调（零拷贝版本）
+        /// </summary>
+        /// <param name="callback">接收数据回调，span 在回调返回后失效，需要保留时自行 ToArray()</param>
+        /// <returns>错误码</returns>
+        /// <remarks>
+        /// 与 <see cref="RegisterMemoryLowerIOCallback(Action{byte[]})"/> 互相替换（后注册的生效），
+        /// 注意事项相同。每轮都上报的 LowerIO 用这个版本可以省掉一次 byte[] 分配和拷贝。
+        /// </remarks>
+        public MCUSerialBridgeError RegisterMemoryLowerIOSpanCallback(LowerIOSpanHandler callback)
+        {
+            if (callback == null)
+                return MCUSerialBridgeError.Win_InvalidParam;
+
+            if (nativeHandle == IntPtr.Zero)
+                return MCUSerialBridgeError.Win_HandleNotFound;
+
+            unsafe void del(IntPtr data, uint data_size, IntPtr user_ctx)
+            {
+                try
+                {
+                    callback(new ReadOnlySpan<byte>((void*)data, (int)data_size));
+                }
+                catch
+                {
+                    // 解析失败直接忽略，保证回调不会抛异常阻塞 C 层线程
+                }
+            }
+
+            // 保存引用，防止 GC 回收
+            _memoryLowerIOCallback = del;
+
+            return MCUSerialBridgeCoreAPI.msb_register_memory_lower_io_callback(
+                nativeHandle,
+                _memoryLowerIOCallback,
+                IntPtr.Zero
+            );
+        }
+
         /// <summary>
         /// 获取 MCU 运行时统计数据
         /// </summary>
@@ -1785,6 +1975,52 @@ namespace MCUSerialBridgeCLR
             return MCUSerialBridgeCoreAPI.msb_get_stats(nativeHandle, out stats, timeout);
         }
 
+        /// <summary>
+        /// 获取 MCU 运行时统计数据，同时取主机侧发送统计
+        /// </summary>
+        /// <param name="stats">输出 MCU 统计数据</param>
+        /// <param name="sendStats">输出主机侧发送统计（每次写的帧数 / 字节数）</param>
+        /// <param name="timeout">超时时间（ms）</param>
+        /// <returns>错误码</returns>
+        public MCUSerialBridgeError GetStats(out RuntimeStats stats, out SendStats sendStats, uint timeout = 200)
+        {
+            var ret = GetSendStats(out sendStats);
+            if (ret != MCUSerialBridgeError.OK)
+            {
+                stats = new RuntimeStats();
+                return ret;
+            }
+            return GetStats(out stats, timeout);
+        }
+
+        /// <summary>
+        /// 获取主机侧发送统计（不经过 MCU）
+        /// </summary>
+        /// <param name="stats">输出发送统计</param>
+        /// <returns>错误码</returns>
+        public MCUSerialBridgeError GetSendStats(out SendStats stats)
+        {
+            stats = new SendStats();
+            if (nativeHandle == IntPtr.Zero)
+                return MCUSerialBridgeError.Win_HandleNotFound;
+
+            return MCUSerialBridgeCoreAPI.msb_get_send_stats(nativeHandle, out stats);
+        }
+
+        /// <summary>
+        /// 设置 send 线程的合并写参数
+        /// </summary>
+        /// <param name="maxBytes">单次写字节上限，0 表示逐帧写；默认 1024（MCU 上行接收缓冲 1536 字节）</param>
+        /// <param name="lingerMs">未达上限时再等后续帧的时间（毫秒），0 表示不等</param>
+        /// <returns>错误码</returns>
+        public MCUSerialBridgeError SetWriteBatch(uint maxBytes, uint lingerMs = 0)
+        {
+            if (nativeHandle == IntPtr.Zero)
+                return MCUSerialBridgeError.Win_HandleNotFound;
+
+            return MCUSerialBridgeCoreAPI.msb_set_write_batch(nativeHandle, maxBytes, lingerMs);
+        }
+
         /// <summary>
         /// 注册 MCU Console.WriteLine 日志回调（DIVER 模式日志输出）
         /// </summary>